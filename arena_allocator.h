@@ -24,28 +24,97 @@
  * 'arena_alloc(11)'. The 'arena_alloc' function call will return NULL because
  * the user is trying to exceed the number of bytes preiviously specified.
  *
+ * 'arena_init_growable' -> Allocates an arena that never runs out of space:
+ * once the current block is full a new one (of at least block_size bytes) is
+ * chained to it. Optionally a helper thread prepares and prefaults the next
+ * block as soon as the current one is more than prefault_percent full, so the
+ * rollover is just a pointer swap instead of a round of page faults.
+ *
  * 'arena_reset' -> This function is extremely straight forward, it sets
- * arena->size (basically the allocation counter) to 0.
+ * arena->size (basically the allocation counter) to 0. Growable arenas also
+ * release all the blocks but the current one.
+ *
+ * 'arena_splice' -> Moves all the blocks of a child arena into a parent arena
+ * without copying anything, the child is consumed. Meant for parallel phases:
+ * every worker fills its own arena, then the arenas are spliced into one that
+ * gets reset or deinit'ed as a unit. The parent keeps allocating from its own
+ * current block.
+ *
+ * 'arena_freeze' -> Seals a growable arena once it's filled: every block is
+ * made read-only with mprotect and the arena refuses new allocations. The
+ * blocks are whole mapped pages and the arena bookkeeping lives outside of
+ * them, so nothing ever writes to those pages again. Built before a fork,
+ * the frozen data stays shared by all the child processes instead of being
+ * copied page by page. Fixed size arenas come from calloc, their memory
+ * shares pages with the heap, so they can't be frozen. Resetting the arena
+ * makes it writable again.
  *
  * 'arena_deinit' -> Frees the arena->data memory and the arena itself since
  * 'arena_init' allocates it on the heap.
+ *
+ * When MEM_USE_PAGE_HEAP is defined the arena memory is taken from the central
+ * page heap (see 'page_heap.h') instead of calloc. When MEM_USE_DEFERRED_FREE
+ * is defined the blocks are released by the background reclaimer of
+ * 'deferred_free.h' instead of inline.
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+#ifdef MEM_USE_PAGE_HEAP
+#include "page_heap.h"
+#endif
+#ifdef MEM_USE_DEFERRED_FREE
+#include "deferred_free.h"
+#endif
+
+/**
+ * @param data memory of the block
+ * @param size bytes used in the block
+ * @param capacity bytes available in the block
+ * @param mapped 1 if the block was mmapped, 0 if it came from calloc
+ * @param prev block filled before this one
+ */
+typedef struct MemArenaBlock {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+  int mapped;
+  struct MemArenaBlock *prev;
+} MemArenaBlock;
+
 /*
- * @param data memory reserved for the arena
+ * @param data memory reserved for the arena (the current block)
  * @param size bytes currently used in the arena (sum of the allocations)
  * @param capacity maximum number of bytes the user can allocate inside the
- * arena
+ * arena (inside the current block for growable arenas)
+ * @param mapped 1 if the current block was mmapped, 0 if it came from calloc
+ * @param block_size minimum size of new blocks, 0 for fixed size arenas
+ * @param blocks blocks filled before the current one, newest first
+ * @param prefault_percent fill percentage triggering the prefault of the next
+ * block, 0 if prefaulting is disabled
+ * @param prefault_at value of size that triggers the prefault request
+ * @param spare next block, prepared by the prefault thread
+ * @param pending 1 while a prefault request is queued or being served
+ * @param next_request next arena in the queue of the prefault thread
+ * @param frozen 1 once the blocks are read-only
  * @note The user isn't supposed access any of the struct members manually,
  * stick to using the provided functions.
  */
-typedef struct {
+typedef struct MemArena {
   uint8_t *data;
   size_t size;
   size_t capacity;
+  int mapped;
+  size_t block_size;
+  MemArenaBlock *blocks;
+  unsigned prefault_percent;
+  size_t prefault_at;
+  MemArenaBlock *_Atomic spare;
+  _Atomic int pending;
+  struct MemArena *next_request;
+  int frozen;
 } MemArena;
 
 /**
@@ -54,6 +123,15 @@ typedef struct {
  */
 MemArena *mem_arena_init(size_t capacity);
 
+/**
+ * Heap allocates a new growable arena and returns the pointer to it
+ * @param block_size minimum number of bytes of every block
+ * @param prefault_percent once the current block is filled past this
+ * percentage the next block is prepared in the background, 0 disables it
+ * @return pointer to the new arena, or NULL on failure
+ */
+MemArena *mem_arena_init_growable(size_t block_size, unsigned prefault_percent);
+
 /**
  * Public interface for allocating bytes in the arena.
  * @param arena pointer to the arena we want to use for the allocation
@@ -68,6 +146,42 @@ void *mem_arena_alloc(MemArena *arena, size_t bytes);
  */
 void mem_arena_reset(MemArena *arena);
 
+/**
+ * Adopts the blocks of child into parent in O(number of child blocks),
+ * the allocations made in child stay valid and now belong to parent
+ * @param parent arena receiving the blocks
+ * @param child arena giving its blocks away, freed on success
+ * @return 1 if the call succeded, 0 otherwise (child is left untouched).
+ * @note Neither arena can be used by other threads during the call.
+ */
+int mem_arena_splice(MemArena *parent, MemArena *child);
+
+/**
+ * Makes every block of a growable arena read-only, allocations fail from now
+ * on until the arena is reset
+ * @param arena pointer to the arena we want to freeze
+ * @return 1 if the call succeded, 0 otherwise (fixed size arena, or a block
+ * that isn't mapped). The arena is left untouched on failure.
+ * @note Writing to the arena memory after this call crashes the program.
+ */
+int mem_arena_freeze(MemArena *arena);
+
+/**
+ * Checks whether a pointer belongs to one of the arena blocks
+ * @param arena pointer to the arena we are interested in
+ * @param ptr pointer to check
+ * @return 1 if ptr points inside the arena memory, 0 otherwise.
+ */
+int mem_arena_owns(const MemArena *arena, const void *ptr);
+
+/**
+ * Gives the physical pages past the allocated bytes back to the OS, they are
+ * still part of the arena and they'll be zero filled on their next touch
+ * @param arena pointer to the arena we want to trim
+ * @return number of bytes given back
+ */
+size_t mem_arena_trim(MemArena *arena);
+
 /**
  * Frees the arena previously allocated with 'arena_init'
  * @param arena pointer to the arena we want to free from the heap.
@@ -76,48 +190,461 @@ void mem_arena_deinit(MemArena *arena);
 
 #endif // ARENA_H
 
-#ifdef ARENA_IMPL
+#if defined(ARENA_IMPL) && !defined(ARENA_IMPL_DONE)
+#define ARENA_IMPL_DONE
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static uint8_t *mem_arena_data_alloc(size_t capacity) {
+#ifdef MEM_USE_PAGE_HEAP
+  return mem_page_heap_calloc(MEM_PAGES_FOR(capacity));
+#else
+  return calloc(capacity, sizeof(uint8_t));
+#endif
+}
+
+// Blocks of growable arenas are mapped, their size is rounded to whole pages
+static uint8_t *mem_arena_block_map(size_t *capacity, int populate) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  if (*capacity > SIZE_MAX - page) {
+    return NULL;
+  }
+  size_t bytes = (*capacity + page - 1) & ~(page - 1);
+#ifdef MEM_USE_PAGE_HEAP
+  uint8_t *data = mem_page_heap_alloc(MEM_PAGES_FOR(bytes));
+  if (data != NULL && populate) {
+    // Spans can't be populated by the kernel, touch them ourselves
+    for (size_t i = 0; i < bytes; i += page) {
+      ((volatile uint8_t *)data)[i] = 0;
+    }
+  }
+#else
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | (populate ? MAP_POPULATE : 0);
+  uint8_t *data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (data == MAP_FAILED) {
+    data = NULL;
+  }
+#endif
+  *capacity = bytes;
+  return data;
+}
+
+static void mem_arena_data_release(void *data, size_t capacity) {
+#ifdef MEM_USE_PAGE_HEAP
+  (void)capacity;
+  mem_page_heap_free(data);
+#else
+  munmap(data, capacity);
+#endif
+}
+
+static void mem_arena_heap_release(void *data, size_t capacity) {
+  (void)capacity;
+#ifdef MEM_USE_PAGE_HEAP
+  mem_page_heap_free(data);
+#else
+  free(data);
+#endif
+}
+
+static void mem_arena_data_free(uint8_t *data, size_t capacity, int mapped) {
+  void (*release)(void *, size_t) =
+      mapped ? mem_arena_data_release : mem_arena_heap_release;
+#ifdef MEM_USE_DEFERRED_FREE
+  // Unmapping big blocks is slow, let the background reclaimer do it
+  mem_deferred_release(release, data, capacity);
+#else
+  release(data, capacity);
+#endif
+}
+
+static void mem_arena_set_prefault_mark(MemArena *arena) {
+  if (arena->prefault_percent == 0) {
+    arena->prefault_at = SIZE_MAX;
+  } else {
+    arena->prefault_at = arena->capacity / 100 * arena->prefault_percent +
+                         arena->capacity % 100 * arena->prefault_percent / 100;
+  }
+}
+
+/**
+ * @param lock protects the queue
+ * @param wakeup signaled when a request is queued
+ * @param done signaled when a request has been served
+ * @param queue arenas waiting for their next block
+ * @param current arena whose block is being prepared right now
+ * @param started 1 once the helper thread is running
+ * @param thread the helper thread, it lives as long as the process
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  pthread_cond_t done;
+  MemArena *queue;
+  MemArena *current;
+  int started;
+  pthread_t thread;
+} MemArenaPrefaulter;
+
+static MemArenaPrefaulter mem_arena_prefaulter = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static void *mem_arena_prefault_thread(void *arg) {
+  (void)arg;
+  MemArenaPrefaulter *pf = &mem_arena_prefaulter;
+  pthread_mutex_lock(&pf->lock);
+  for (;;) {
+    while (pf->queue == NULL) {
+      pthread_cond_wait(&pf->wakeup, &pf->lock);
+    }
+    MemArena *arena = pf->queue;
+    pf->queue = arena->next_request;
+    pf->current = arena;
+    size_t capacity = arena->block_size;
+    pthread_mutex_unlock(&pf->lock);
+
+    MemArenaBlock *block = malloc(sizeof(MemArenaBlock));
+    if (block != NULL) {
+      block->data = mem_arena_block_map(&capacity, 1);
+      if (block->data == NULL) {
+        free(block);
+        block = NULL;
+      } else {
+        block->size = 0;
+        block->capacity = capacity;
+        block->mapped = 1;
+        block->prev = NULL;
+      }
+    }
+    atomic_store_explicit(&arena->spare, block, memory_order_release);
+
+    pthread_mutex_lock(&pf->lock);
+    atomic_store_explicit(&arena->pending, 0, memory_order_release);
+    pf->current = NULL;
+    pthread_cond_broadcast(&pf->done);
+  }
+  return NULL;
+}
+
+static void mem_arena_request_prefault(MemArena *arena) {
+  MemArenaPrefaulter *pf = &mem_arena_prefaulter;
+  // Don't ask again until the next rollover
+  arena->prefault_at = SIZE_MAX;
+  if (atomic_load_explicit(&arena->spare, memory_order_acquire) != NULL) {
+    return;
+  }
+  pthread_mutex_lock(&pf->lock);
+  if (!pf->started) {
+    if (pthread_create(&pf->thread, NULL, mem_arena_prefault_thread, NULL)) {
+      // No helper, the rollover will simply allocate synchronously
+      pthread_mutex_unlock(&pf->lock);
+      return;
+    }
+    pthread_detach(pf->thread);
+    pf->started = 1;
+  }
+  if (atomic_load_explicit(&arena->pending, memory_order_relaxed)) {
+    // Still queued from the previous block, don't link it twice
+    pthread_mutex_unlock(&pf->lock);
+    return;
+  }
+  atomic_store_explicit(&arena->pending, 1, memory_order_relaxed);
+  arena->next_request = pf->queue;
+  pf->queue = arena;
+  pthread_cond_signal(&pf->wakeup);
+  pthread_mutex_unlock(&pf->lock);
+}
+
+static void mem_arena_cancel_prefault(MemArena *arena) {
+  MemArenaPrefaulter *pf = &mem_arena_prefaulter;
+  if (!atomic_load_explicit(&arena->pending, memory_order_acquire)) {
+    return;
+  }
+  pthread_mutex_lock(&pf->lock);
+  for (MemArena **link = &pf->queue; *link != NULL;
+       link = &(*link)->next_request) {
+    if (*link == arena) {
+      *link = arena->next_request;
+      atomic_store_explicit(&arena->pending, 0, memory_order_relaxed);
+      break;
+    }
+  }
+  // The helper is working on it, wait until it's done
+  while (atomic_load_explicit(&arena->pending, memory_order_acquire)) {
+    pthread_cond_wait(&pf->done, &pf->lock);
+  }
+  pthread_mutex_unlock(&pf->lock);
+}
 
 MemArena *mem_arena_init(size_t capacity) {
-  MemArena *new_arena = malloc(sizeof(MemStack));
+  MemArena *new_arena = calloc(1, sizeof(MemArena));
   if (new_arena == NULL) {
     return NULL;
   }
   new_arena->size = 0;
   new_arena->capacity = capacity;
-  new_arena->data = calloc(capacity, sizeof(uint8_t));
+  new_arena->prefault_at = SIZE_MAX;
+  new_arena->data = mem_arena_data_alloc(capacity);
+  if (new_arena->data == NULL) {
+    free(new_arena);
+    return NULL;
+  }
+#ifdef MEM_USE_PAGE_HEAP
+  mem_owner_set(new_arena->data, capacity, MEM_OWNER_ARENA, new_arena);
+#endif
+  return new_arena;
+}
+
+MemArena *mem_arena_init_growable(size_t block_size,
+                                  unsigned prefault_percent) {
+  if (block_size == 0 || prefault_percent > 100) {
+    return NULL;
+  }
+  MemArena *new_arena = calloc(1, sizeof(MemArena));
+  if (new_arena == NULL) {
+    return NULL;
+  }
+  size_t capacity = block_size;
+  new_arena->data = mem_arena_block_map(&capacity, 0);
   if (new_arena->data == NULL) {
     free(new_arena);
     return NULL;
   }
+  new_arena->capacity = capacity;
+  new_arena->mapped = 1;
+  new_arena->block_size = block_size;
+  new_arena->prefault_percent = prefault_percent;
+  mem_arena_set_prefault_mark(new_arena);
+#ifdef MEM_USE_PAGE_HEAP
+  mem_owner_set(new_arena->data, capacity, MEM_OWNER_ARENA, new_arena);
+#endif
   return new_arena;
 }
 
+static int mem_arena_grow(MemArena *arena, size_t bytes) {
+  MemArenaBlock *retired = malloc(sizeof(MemArenaBlock));
+  if (retired == NULL) {
+    return 0;
+  }
+  MemArenaBlock *next =
+      atomic_exchange_explicit(&arena->spare, NULL, memory_order_acquire);
+  if (next != NULL && next->capacity < bytes) {
+    // Too small for this request, keep it for the next rollover
+    atomic_store_explicit(&arena->spare, next, memory_order_release);
+    next = NULL;
+  }
+  uint8_t *data;
+  size_t capacity;
+  int mapped = 1;
+  if (next != NULL) {
+    data = next->data;
+    capacity = next->capacity;
+    free(next);
+  } else {
+    capacity = bytes > arena->block_size ? bytes : arena->block_size;
+    data = mem_arena_block_map(&capacity, 0);
+    if (data == NULL) {
+      free(retired);
+      return 0;
+    }
+  }
+
+  retired->data = arena->data;
+  retired->size = arena->size;
+  retired->capacity = arena->capacity;
+  retired->mapped = arena->mapped;
+  retired->prev = arena->blocks;
+  arena->blocks = retired;
+
+  arena->data = data;
+  arena->size = 0;
+  arena->capacity = capacity;
+  arena->mapped = mapped;
+  mem_arena_set_prefault_mark(arena);
+#ifdef MEM_USE_PAGE_HEAP
+  mem_owner_set(data, capacity, MEM_OWNER_ARENA, arena);
+#endif
+  return 1;
+}
+
 void *mem_arena_alloc(MemArena *arena, size_t bytes) {
   if (arena == NULL) {
     // Something went really wrong here
     return NULL;
   }
-  if (bytes > arena->capacity || arena->size > arena->capacity - bytes) {
+  if (arena->frozen) {
     return NULL;
   }
+  if (bytes > arena->capacity || arena->size > arena->capacity - bytes) {
+    if (arena->block_size == 0 || !mem_arena_grow(arena, bytes)) {
+      return NULL;
+    }
+  }
   void *ptr = (void *)arena->data + arena->size;
   arena->size += bytes;
+  if (arena->size >= arena->prefault_at) {
+    mem_arena_request_prefault(arena);
+  }
   return ptr;
 }
 
+static void mem_arena_release_blocks(MemArenaBlock *block) {
+  while (block != NULL) {
+    MemArenaBlock *prev = block->prev;
+    mem_arena_data_free(block->data, block->capacity, block->mapped);
+    free(block);
+    block = prev;
+  }
+}
+
+// Changes the protection of every block, the ones before stop on failure are
+// given back their old protection
+static int mem_arena_protect(MemArena *arena, int prot, int old_prot) {
+  if (mprotect(arena->data, arena->capacity, prot)) {
+    return 0;
+  }
+  for (MemArenaBlock *block = arena->blocks; block != NULL;
+       block = block->prev) {
+    if (mprotect(block->data, block->capacity, prot)) {
+      for (MemArenaBlock *done = arena->blocks; done != block;
+           done = done->prev) {
+        mprotect(done->data, done->capacity, old_prot);
+      }
+      mprotect(arena->data, arena->capacity, old_prot);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void mem_arena_thaw(MemArena *arena) {
+  if (arena->frozen) {
+    mem_arena_protect(arena, PROT_READ | PROT_WRITE, PROT_READ);
+    arena->frozen = 0;
+  }
+}
+
+int mem_arena_freeze(MemArena *arena) {
+  if (arena == NULL || !arena->mapped) {
+    return 0;
+  }
+  if (arena->frozen) {
+    return 1;
+  }
+  for (MemArenaBlock *block = arena->blocks; block != NULL;
+       block = block->prev) {
+    if (!block->mapped) {
+      return 0; // Spliced from a fixed size arena
+    }
+  }
+  // Nothing is allocated anymore, the next block isn't needed
+  mem_arena_cancel_prefault(arena);
+  mem_arena_release_blocks(
+      atomic_exchange_explicit(&arena->spare, NULL, memory_order_acquire));
+  if (!mem_arena_protect(arena, PROT_READ, PROT_READ | PROT_WRITE)) {
+    return 0;
+  }
+  arena->frozen = 1;
+  return 1;
+}
+
 void mem_arena_reset(MemArena *arena) {
   if (arena != NULL) {
+    mem_arena_thaw(arena);
     arena->size = 0;
+    mem_arena_release_blocks(arena->blocks);
+    arena->blocks = NULL;
+    if (atomic_load_explicit(&arena->spare, memory_order_relaxed) == NULL &&
+        !atomic_load_explicit(&arena->pending, memory_order_relaxed)) {
+      mem_arena_set_prefault_mark(arena);
+    }
+  }
+}
+
+int mem_arena_splice(MemArena *parent, MemArena *child) {
+  if (parent == NULL || child == NULL || parent == child || parent->frozen ||
+      child->frozen) {
+    return 0;
+  }
+  // The current block of the child becomes a retired block of the parent
+  MemArenaBlock *current = malloc(sizeof(MemArenaBlock));
+  if (current == NULL) {
+    return 0;
   }
+  mem_arena_cancel_prefault(child);
+  mem_arena_release_blocks(
+      atomic_exchange_explicit(&child->spare, NULL, memory_order_acquire));
+
+  current->data = child->data;
+  current->size = child->size;
+  current->capacity = child->capacity;
+  current->mapped = child->mapped;
+  current->prev = child->blocks;
+
+  MemArenaBlock *tail = current;
+  for (;;) {
+#ifdef MEM_USE_PAGE_HEAP
+    mem_owner_set(tail->data, tail->capacity, MEM_OWNER_ARENA, parent);
+#endif
+    if (tail->prev == NULL) {
+      break;
+    }
+    tail = tail->prev;
+  }
+  tail->prev = parent->blocks;
+  parent->blocks = current;
+  free(child);
+  return 1;
+}
+
+int mem_arena_owns(const MemArena *arena, const void *ptr) {
+  if (arena == NULL) {
+    return 0;
+  }
+  const uint8_t *p = ptr;
+  if (p >= arena->data && p < arena->data + arena->capacity) {
+    return 1;
+  }
+  for (MemArenaBlock *block = arena->blocks; block != NULL;
+       block = block->prev) {
+    if (p >= block->data && p < block->data + block->capacity) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+size_t mem_arena_trim(MemArena *arena) {
+  if (arena == NULL || arena->data == NULL) {
+    return 0;
+  }
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t first = ((uintptr_t)arena->data + arena->size + page - 1) &
+                    ~(page - 1);
+  uintptr_t last = ((uintptr_t)arena->data + arena->capacity) & ~(page - 1);
+  if (last <= first || madvise((void *)first, last - first, MADV_DONTNEED)) {
+    return 0;
+  }
+  return last - first;
 }
 
 void mem_arena_deinit(MemArena *arena) {
   if (arena != NULL) {
-    free(arena->data);
+    // The page heap and the deferred reclaimer may write to the blocks
+    mem_arena_thaw(arena);
+    mem_arena_cancel_prefault(arena);
+    mem_arena_release_blocks(
+        atomic_exchange_explicit(&arena->spare, NULL, memory_order_acquire));
+    mem_arena_release_blocks(arena->blocks);
+    mem_arena_data_free(arena->data, arena->capacity, arena->mapped);
     free(arena);
     arena = NULL;
   }
 }
 
-#endif
+#endif // ARENA_IMPL
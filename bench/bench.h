@@ -0,0 +1,63 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/**
+ * Timing helpers shared by the benchmarks.
+ *
+ * 'bench_now' -> Monotonic time in seconds.
+ *
+ * 'bench_report' -> Prints the cost per operation of a measurement.
+ *
+ * 'bench_report_latency' -> Prints the median, tail and worst of a set of
+ * latency samples (in seconds), sorting them.
+ *
+ * 'bench_rand' -> Small xorshift generator, so every run sees the same
+ * sequence.
+ *
+ * 'BENCH_KEEP' -> Keeps the compiler from optimizing a value away.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static inline double bench_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+static inline void bench_report(const char *name, double seconds,
+                                size_t ops) {
+  printf("%-40s %10.2f ns/op %12.3f ms\n", name,
+         ops ? seconds * 1e9 / (double)ops : 0.0, seconds * 1e3);
+}
+
+static inline int bench_compare_samples(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static inline void bench_report_latency(const char *name, double *samples,
+                                        size_t n) {
+  if (n == 0) {
+    return;
+  }
+  qsort(samples, n, sizeof(double), bench_compare_samples);
+  printf("%-40s p50 %8.0f  p99 %8.0f  p99.9 %8.0f  max %9.0f ns\n", name,
+         samples[n / 2] * 1e9, samples[n * 99 / 100] * 1e9,
+         samples[n * 999 / 1000] * 1e9, samples[n - 1] * 1e9);
+}
+
+static inline uint64_t bench_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+#define BENCH_KEEP(value) __asm__ volatile("" : : "g"(value) : "memory")
+
+#endif // BENCH_H
@@ -0,0 +1,167 @@
+// A pre-fork server: the parent builds a lookup table of a million 64 bytes
+// entries, parsing each one through a malloc'ed buffer, then forks
+// 32 workers (or the first argument). Every worker keeps its own cache of
+// 100000 malloc'ed 64 bytes objects and reads the table. The table comes
+// from malloc, from a growable arena, and from the same arena frozen. With
+// every worker alive, the Rss and Pss of the processes (smaps_rollup) tell
+// how many table pages the workers still share with the parent. Times are
+// per entry, for building the table.
+#define ARENA_IMPL
+#include "arena_allocator.h"
+
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define ENTRIES 1000000
+#define CACHED 100000
+#define ENTRY_SIZE 64
+
+enum { FROM_MALLOC, FROM_ARENA, FROM_FROZEN_ARENA };
+
+static uint8_t **entries;
+static MemArena *arena;
+
+static void build(int kind) {
+  if (kind != FROM_MALLOC) {
+    arena = mem_arena_init_growable(1 << 22, 0);
+  }
+  entries = kind == FROM_MALLOC
+                ? malloc(ENTRIES * sizeof(uint8_t *))
+                : mem_arena_alloc(arena, ENTRIES * sizeof(uint8_t *));
+  // Half of the buffers are kept until the table is complete, like parsers
+  // freeing their buffers late, which leaves holes among the entries
+  uint8_t **late = malloc(ENTRIES / 2 * sizeof(uint8_t *));
+  for (size_t i = 0; i < ENTRIES; ++i) {
+    uint8_t *buffer = malloc(ENTRY_SIZE);
+    memset(buffer, (int)i, ENTRY_SIZE);
+    entries[i] = kind == FROM_MALLOC ? malloc(ENTRY_SIZE)
+                                     : mem_arena_alloc(arena, ENTRY_SIZE);
+    memcpy(entries[i], buffer, ENTRY_SIZE);
+    if (i % 2 == 0) {
+      late[i / 2] = buffer;
+    } else {
+      free(buffer);
+    }
+  }
+  for (size_t i = 0; i < ENTRIES / 2; ++i) {
+    free(late[i]);
+  }
+  free(late);
+  if (kind == FROM_FROZEN_ARENA) {
+    mem_arena_freeze(arena);
+  }
+}
+
+static void teardown(int kind) {
+  if (kind == FROM_MALLOC) {
+    for (size_t i = 0; i < ENTRIES; ++i) {
+      free(entries[i]);
+    }
+    free(entries);
+  } else {
+    mem_arena_deinit(arena);
+  }
+}
+
+static void worker(int ready, int release) {
+  uint8_t **cache = malloc(CACHED * sizeof(uint8_t *));
+  uint64_t seed = 88172645463325252ull;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < CACHED; ++i) {
+    const uint8_t *entry = entries[bench_rand(&seed) % ENTRIES];
+    cache[i] = malloc(ENTRY_SIZE);
+    memcpy(cache[i], entry, ENTRY_SIZE);
+    sum += cache[i][0];
+  }
+  BENCH_KEEP(sum);
+  char byte = 0;
+  if (write(ready, &byte, 1) != 1 || read(release, &byte, 1) < 0) {
+    _exit(1);
+  }
+  _exit(0);
+}
+
+// Rss and Pss of a process, in kB
+static void memory_of(pid_t pid, long *rss, long *pss) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int)pid);
+  FILE *file = fopen(path, "r");
+  char line[256];
+  *rss = *pss = 0;
+  while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+    sscanf(line, "Rss: %ld", rss);
+    sscanf(line, "Pss: %ld", pss);
+  }
+  if (file != NULL) {
+    fclose(file);
+  }
+}
+
+static void run(int kind, const char *name, size_t n_workers) {
+  double start = bench_now();
+  build(kind);
+  bench_report(name, bench_now() - start, ENTRIES);
+  int ready[2], release[2];
+  if (pipe(ready) || pipe(release)) {
+    return;
+  }
+  pid_t *pids = malloc((n_workers + 1) * sizeof(pid_t));
+  fflush(stdout);
+  for (size_t i = 0; i < n_workers; ++i) {
+    pids[i] = fork();
+    if (pids[i] == 0) {
+      close(release[1]);
+      worker(ready[1], release[0]);
+    }
+  }
+  pids[n_workers] = getpid();
+  char byte;
+  for (size_t i = 0; i < n_workers; ++i) {
+    if (read(ready[0], &byte, 1) != 1) {
+      break;
+    }
+  }
+  long rss = 0, pss = 0, total_rss = 0, total_pss = 0;
+  for (size_t i = 0; i <= n_workers; ++i) {
+    memory_of(pids[i], &rss, &pss);
+    total_rss += rss;
+    total_pss += pss;
+  }
+  close(release[1]);
+  for (size_t i = 0; i < n_workers; ++i) {
+    waitpid(pids[i], NULL, 0);
+  }
+  // The parent was measured last
+  printf("  Pss of the parent and %zu workers %ld MB\n", n_workers,
+         total_pss >> 10);
+  printf("  every worker: Rss %ld MB, Pss %ld MB\n",
+         (total_rss - rss) / (long)n_workers >> 10,
+         (total_pss - pss) / (long)n_workers >> 10);
+  close(ready[0]);
+  close(ready[1]);
+  close(release[0]);
+  free(pids);
+  teardown(kind);
+}
+
+int main(int argc, char **argv) {
+  size_t n_workers = argc > 1 ? strtoul(argv[1], NULL, 10) : 32;
+  const char *names[] = {"table from malloc", "table from an arena",
+                         "table from a frozen arena"};
+  // Every variant gets a fresh process, the heap of the previous one would
+  // show up in the Rss of the workers otherwise
+  for (int kind = FROM_MALLOC; kind <= FROM_FROZEN_ARENA; ++kind) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(kind, names[kind], n_workers);
+      fflush(stdout);
+      _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+  }
+  return 0;
+}
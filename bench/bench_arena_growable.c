@@ -0,0 +1,56 @@
+// Latency of allocating and touching memory from a growable arena, with and
+// without the next block prefaulted in the background. Without it every new
+// page of a block faults on its first touch, inside the timed allocation.
+#define _GNU_SOURCE // RUSAGE_THREAD
+#define ARENA_IMPL
+#include "arena_allocator.h"
+
+#include <string.h>
+#include <sys/resource.h>
+
+#include "bench.h"
+
+#define BLOCK (4 << 20)
+#define REQUESTS 200000
+#define REQUEST_BYTES 512
+
+static double samples[REQUESTS];
+
+// Page faults taken by the calling thread so far
+static long thread_faults(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return usage.ru_minflt;
+}
+
+// Work done by a request between two allocations
+static void request_work(uint64_t *state) {
+  for (int i = 0; i < 200; ++i) {
+    BENCH_KEEP(bench_rand(state));
+  }
+}
+
+static void run(const char *name, unsigned prefault_percent) {
+  MemArena *arena = mem_arena_init_growable(BLOCK, prefault_percent);
+  uint64_t state = 88172645463325252ull;
+  long faults = thread_faults();
+  for (size_t i = 0; i < REQUESTS; ++i) {
+    double start = bench_now();
+    uint8_t *bytes = mem_arena_alloc(arena, REQUEST_BYTES);
+    memset(bytes, (int)i, REQUEST_BYTES);
+    samples[i] = bench_now() - start;
+    request_work(&state);
+  }
+  faults = thread_faults() - faults;
+  bench_report_latency(name, samples, REQUESTS);
+  printf("%-40s %ld page faults in the request thread\n", "", faults);
+  mem_arena_deinit(arena);
+}
+
+int main(void) {
+  run("alloc+touch 512B, no prefault", 0);
+  run("alloc+touch 512B, prefault at 50%", 50);
+  run("alloc+touch 512B, no prefault", 0);
+  run("alloc+touch 512B, prefault at 50%", 50);
+  return 0;
+}
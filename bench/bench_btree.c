@@ -0,0 +1,256 @@
+// Ordered index of 4 million random 64 bits keys: inserts, lookups of keys in
+// random order, and scans of 100 key ranges. The pool backed B+tree against a
+// red-black tree with parent pointers and a malloc per node, the layout of a
+// std::map (color, parent, left, right, key, value), whose range scans walk
+// the in-order successors the way its iterators do. Bulk loading the B+tree
+// from the sorted keys is timed too. Times are per key, or per range.
+#define POOL_IMPL
+#define ARENA_IMPL
+#define BTREE_IMPL
+#include "btree.h"
+
+#include <string.h>
+
+#include "bench.h"
+
+#define KEYS 4000000
+#define RANGES 1000000
+#define RANGE_KEYS 100
+
+typedef struct RbNode {
+  int red;
+  struct RbNode *parent;
+  struct RbNode *left;
+  struct RbNode *right;
+  uint64_t key;
+  uint64_t value;
+} RbNode;
+
+static RbNode *rb_root;
+
+static void rb_rotate_left(RbNode *x) {
+  RbNode *y = x->right;
+  x->right = y->left;
+  if (y->left != NULL) {
+    y->left->parent = x;
+  }
+  y->parent = x->parent;
+  if (x->parent == NULL) {
+    rb_root = y;
+  } else if (x == x->parent->left) {
+    x->parent->left = y;
+  } else {
+    x->parent->right = y;
+  }
+  y->left = x;
+  x->parent = y;
+}
+
+static void rb_rotate_right(RbNode *x) {
+  RbNode *y = x->left;
+  x->left = y->right;
+  if (y->right != NULL) {
+    y->right->parent = x;
+  }
+  y->parent = x->parent;
+  if (x->parent == NULL) {
+    rb_root = y;
+  } else if (x == x->parent->right) {
+    x->parent->right = y;
+  } else {
+    x->parent->left = y;
+  }
+  y->right = x;
+  x->parent = y;
+}
+
+static void rb_insert(uint64_t key, uint64_t value) {
+  RbNode *parent = NULL;
+  RbNode **link = &rb_root;
+  while (*link != NULL) {
+    parent = *link;
+    if (key == parent->key) {
+      parent->value = value;
+      return;
+    }
+    link = key < parent->key ? &parent->left : &parent->right;
+  }
+  RbNode *node = malloc(sizeof(RbNode));
+  *node = (RbNode){1, parent, NULL, NULL, key, value};
+  *link = node;
+  while (node->parent != NULL && node->parent->red) {
+    RbNode *up = node->parent;
+    RbNode *grand = up->parent;
+    RbNode *uncle = up == grand->left ? grand->right : grand->left;
+    if (uncle != NULL && uncle->red) {
+      up->red = uncle->red = 0;
+      grand->red = 1;
+      node = grand;
+    } else if (up == grand->left) {
+      if (node == up->right) {
+        node = up;
+        rb_rotate_left(node);
+      }
+      node->parent->red = 0;
+      grand->red = 1;
+      rb_rotate_right(grand);
+    } else {
+      if (node == up->left) {
+        node = up;
+        rb_rotate_right(node);
+      }
+      node->parent->red = 0;
+      grand->red = 1;
+      rb_rotate_left(grand);
+    }
+  }
+  rb_root->red = 0;
+}
+
+static int rb_get(uint64_t key, uint64_t *value) {
+  RbNode *node = rb_root;
+  while (node != NULL && node->key != key) {
+    node = key < node->key ? node->left : node->right;
+  }
+  if (node == NULL) {
+    return 0;
+  }
+  *value = node->value;
+  return 1;
+}
+
+// Like std::map::lower_bound, then ++iterator up to hi
+static size_t rb_scan(uint64_t lo, uint64_t hi, uint64_t *sum) {
+  RbNode *node = rb_root;
+  RbNode *first = NULL;
+  while (node != NULL) {
+    if (node->key >= lo) {
+      first = node;
+      node = node->left;
+    } else {
+      node = node->right;
+    }
+  }
+  size_t count = 0;
+  for (node = first; node != NULL && node->key <= hi; ++count) {
+    *sum += node->value;
+    if (node->right != NULL) {
+      node = node->right;
+      while (node->left != NULL) {
+        node = node->left;
+      }
+    } else {
+      while (node->parent != NULL && node == node->parent->right) {
+        node = node->parent;
+      }
+      node = node->parent;
+    }
+  }
+  return count;
+}
+
+static void rb_free(RbNode *node) {
+  while (node != NULL) {
+    rb_free(node->left);
+    RbNode *right = node->right;
+    free(node);
+    node = right;
+  }
+}
+
+static int sum_value(uint64_t key, uint64_t value, void *ctx) {
+  (void)key;
+  *(uint64_t *)ctx += value;
+  return 1;
+}
+
+static int compare(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t *keys;
+static uint64_t *sorted;
+
+int main(void) {
+  keys = malloc(KEYS * sizeof(uint64_t));
+  sorted = malloc(KEYS * sizeof(uint64_t));
+  uint64_t seed = 88172645463325252ull;
+  for (size_t i = 0; i < KEYS; ++i) {
+    keys[i] = bench_rand(&seed);
+  }
+  memcpy(sorted, keys, KEYS * sizeof(uint64_t));
+  qsort(sorted, KEYS, sizeof(uint64_t), compare);
+  // Range scans start at random keys and cover RANGE_KEYS of them
+  size_t *starts = malloc(RANGES * sizeof(size_t));
+  for (size_t i = 0; i < RANGES; ++i) {
+    starts[i] = bench_rand(&seed) % (KEYS - RANGE_KEYS);
+  }
+
+  MemBtree *tree = mem_btree_init(4096);
+  double start = bench_now();
+  for (size_t i = 0; i < KEYS; ++i) {
+    mem_btree_insert(tree, keys[i], i);
+  }
+  bench_report("B+tree insert", bench_now() - start, KEYS);
+  start = bench_now();
+  for (size_t i = 0; i < KEYS; ++i) {
+    rb_insert(keys[i], i);
+  }
+  bench_report("red-black + malloc insert", bench_now() - start, KEYS);
+
+  // Looked up in another random order than the one of the inserts
+  uint64_t sum = 0;
+  start = bench_now();
+  for (size_t i = 0; i < KEYS; ++i) {
+    uint64_t value = 0;
+    mem_btree_get(tree, keys[(i * 2654435761u) % KEYS], &value);
+    sum += value;
+  }
+  bench_report("B+tree lookup", bench_now() - start, KEYS);
+  start = bench_now();
+  for (size_t i = 0; i < KEYS; ++i) {
+    uint64_t value = 0;
+    rb_get(keys[(i * 2654435761u) % KEYS], &value);
+    sum += value;
+  }
+  bench_report("red-black + malloc lookup", bench_now() - start, KEYS);
+
+  size_t visited = 0;
+  start = bench_now();
+  for (size_t i = 0; i < RANGES; ++i) {
+    const uint64_t *range = sorted + starts[i];
+    visited += mem_btree_scan(tree, range[0], range[RANGE_KEYS - 1],
+                              sum_value, &sum);
+  }
+  bench_report("B+tree scan of 100 keys", bench_now() - start, RANGES);
+  start = bench_now();
+  for (size_t i = 0; i < RANGES; ++i) {
+    const uint64_t *range = sorted + starts[i];
+    visited += rb_scan(range[0], range[RANGE_KEYS - 1], &sum);
+  }
+  bench_report("red-black + malloc scan of 100 keys", bench_now() - start,
+               RANGES);
+  BENCH_KEEP(sum);
+  BENCH_KEEP(visited);
+  mem_btree_deinit(tree);
+  rb_free(rb_root);
+
+  uint64_t *values = malloc(KEYS * sizeof(uint64_t));
+  for (size_t i = 0; i < KEYS; ++i) {
+    values[i] = i;
+  }
+  tree = mem_btree_init(4096);
+  MemArena *scratch = mem_arena_init_growable(1 << 20, 0);
+  start = bench_now();
+  mem_btree_bulk_load(tree, sorted, values, KEYS, scratch);
+  bench_report("B+tree bulk load", bench_now() - start, KEYS);
+  mem_arena_deinit(scratch);
+  mem_btree_deinit(tree);
+  free(values);
+  free(starts);
+  free(sorted);
+  free(keys);
+  return 0;
+}
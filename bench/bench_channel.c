@@ -0,0 +1,118 @@
+// One producer thread passing messages of 64 B, 1 KB and 64 KB to the
+// consumer: the zero-copy channel, where the producer fills a payload of its
+// pool in place, against malloc, a copy of the message, a push on the same
+// SPSC ring and a free by the consumer. Times are per message.
+#define POOL_IMPL
+#define CHANNEL_IMPL
+#include "channel.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define BYTES_PER_SIZE (1ull << 32)
+#define MAX_MESSAGES 4000000
+#define CAPACITY 256
+
+static size_t message_size;
+static size_t messages;
+static MemChannel *channel;
+static MemSpscRing *ring;
+
+static void *channel_producer(void *arg) {
+  (void)arg;
+  for (size_t i = 0; i < messages;) {
+    uint8_t *payload = mem_channel_acquire(channel, 0);
+    if (payload == NULL) {
+      sched_yield();
+      continue;
+    }
+    memset(payload, (int)i, message_size);
+    while (!mem_channel_send(channel, 0, payload)) {
+      sched_yield();
+    }
+    i++;
+  }
+  return NULL;
+}
+
+static void *copy_producer(void *arg) {
+  (void)arg;
+  uint8_t *message = malloc(message_size);
+  for (size_t i = 0; i < messages; ++i) {
+    memset(message, (int)i, message_size);
+    uint8_t *copy = malloc(message_size);
+    memcpy(copy, message, message_size);
+    while (!mem_spsc_push(ring, copy)) {
+      sched_yield();
+    }
+  }
+  free(message);
+  return NULL;
+}
+
+static double run_channel(void) {
+  channel = mem_channel_init(1, CAPACITY, message_size, 2 * CAPACITY);
+  pthread_t thread;
+  double start = bench_now();
+  pthread_create(&thread, NULL, channel_producer, NULL);
+  uint64_t sum = 0;
+  for (size_t received = 0; received < messages;) {
+    uint8_t *payload = mem_channel_recv(channel);
+    if (payload == NULL) {
+      sched_yield();
+      continue;
+    }
+    sum += payload[0] + payload[message_size - 1];
+    mem_channel_release(channel, payload);
+    received++;
+  }
+  pthread_join(thread, NULL);
+  double seconds = bench_now() - start;
+  BENCH_KEEP(sum);
+  mem_channel_deinit(channel);
+  return seconds;
+}
+
+static double run_copy(void) {
+  ring = mem_spsc_init(CAPACITY);
+  pthread_t thread;
+  double start = bench_now();
+  pthread_create(&thread, NULL, copy_producer, NULL);
+  uint64_t sum = 0;
+  for (size_t received = 0; received < messages;) {
+    uint8_t *payload = mem_spsc_pop(ring);
+    if (payload == NULL) {
+      sched_yield();
+      continue;
+    }
+    sum += payload[0] + payload[message_size - 1];
+    free(payload);
+    received++;
+  }
+  pthread_join(thread, NULL);
+  double seconds = bench_now() - start;
+  BENCH_KEEP(sum);
+  mem_spsc_deinit(ring);
+  return seconds;
+}
+
+int main(void) {
+  const size_t sizes[] = {64, 1024, 65536};
+  const char *names[][2] = {{"64 B channel", "64 B malloc + copy"},
+                            {"1 KB channel", "1 KB malloc + copy"},
+                            {"64 KB channel", "64 KB malloc + copy"}};
+  for (size_t s = 0; s < 3; ++s) {
+    message_size = sizes[s];
+    // 4 GB of messages, but no more than MAX_MESSAGES of them
+    messages = BYTES_PER_SIZE / message_size;
+    if (messages > MAX_MESSAGES) {
+      messages = MAX_MESSAGES;
+    }
+    bench_report(names[s][0], run_channel(), messages);
+    bench_report(names[s][1], run_copy(), messages);
+  }
+  return 0;
+}
@@ -0,0 +1,95 @@
+// Composed allocators against the same logic written by hand: a segregator
+// sending small requests to a pool and the rest to a pool-or-malloc fallback,
+// and a bucketizer over four pools. Both variants should cost the same.
+#define POOL_IMPL
+#define ARENA_IMPL
+#define MEM_STACK_IMPL
+#include "compose_allocator.h"
+
+#include "bench.h"
+
+#define BATCH 4096
+#define ROUNDS 2000
+
+static MemPool *small_pool, *large_pool;
+static MemPool *buckets[4];
+
+MEM_COMPOSE_POOL(small, small_pool)
+MEM_COMPOSE_POOL(large, large_pool)
+MEM_COMPOSE_MALLOC(heap)
+MEM_FALLBACK(large_or_heap, large, heap)
+MEM_SEGREGATOR(composed, 64, small, large_or_heap)
+MEM_BUCKETIZER(sized, buckets, 0, 128, 32)
+
+static void *by_hand_alloc(size_t bytes) {
+  if (bytes <= 64) {
+    return mem_pool_alloc(small_pool);
+  }
+  void *ptr = bytes <= large_pool->chunk_size ? mem_pool_alloc(large_pool)
+                                               : NULL;
+  return ptr != NULL ? ptr : malloc(bytes);
+}
+
+static void by_hand_free(void *ptr, size_t bytes) {
+  if (bytes <= 64) {
+    mem_pool_free(small_pool, ptr);
+  } else if (mem_pool_owns(large_pool, ptr)) {
+    mem_pool_free(large_pool, ptr);
+  } else {
+    free(ptr);
+  }
+}
+
+static void *sized_by_hand_alloc(size_t bytes) {
+  if (bytes == 0 || bytes > 128) {
+    return NULL;
+  }
+  return mem_pool_alloc(buckets[(bytes - 1) / 32]);
+}
+
+static void sized_by_hand_free(void *ptr, size_t bytes) {
+  if (bytes != 0 && bytes <= 128) {
+    mem_pool_free(buckets[(bytes - 1) / 32], ptr);
+  }
+}
+
+static void *ptrs[BATCH];
+static size_t sizes[BATCH];
+
+#define RUN(name, alloc, free_fn)                                              \
+  do {                                                                         \
+    double start_ = bench_now();                                               \
+    for (int r_ = 0; r_ < ROUNDS; ++r_) {                                      \
+      for (size_t i_ = 0; i_ < BATCH; ++i_) {                                  \
+        ptrs[i_] = alloc(sizes[i_]);                                           \
+      }                                                                        \
+      for (size_t i_ = 0; i_ < BATCH; ++i_) {                                  \
+        free_fn(ptrs[i_], sizes[i_]);                                          \
+      }                                                                        \
+    }                                                                          \
+    bench_report(name, bench_now() - start_, (size_t)BATCH * ROUNDS);          \
+  } while (0)
+
+int main(void) {
+  small_pool = mem_pool_init_ex(64, BATCH, MEM_POOL_REUSE_LIFO);
+  large_pool = mem_pool_init_ex(128, BATCH, MEM_POOL_REUSE_LIFO);
+  for (int i = 0; i < 4; ++i) {
+    buckets[i] = mem_pool_init_ex(32 * (i + 1), BATCH, MEM_POOL_REUSE_LIFO);
+  }
+  uint64_t seed = 88172645463325252ull;
+  for (size_t i = 0; i < BATCH; ++i) {
+    sizes[i] = bench_rand(&seed) % 128 + 1;
+  }
+
+  RUN("segregator, composed", composed_alloc, composed_free);
+  RUN("segregator, by hand", by_hand_alloc, by_hand_free);
+  RUN("bucketizer, composed", sized_alloc, sized_free);
+  RUN("bucketizer, by hand", sized_by_hand_alloc, sized_by_hand_free);
+
+  for (int i = 0; i < 4; ++i) {
+    mem_pool_deinit(buckets[i]);
+  }
+  mem_pool_deinit(large_pool);
+  mem_pool_deinit(small_pool);
+  return 0;
+}
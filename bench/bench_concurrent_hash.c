@@ -0,0 +1,156 @@
+// Read-heavy (98% lookups) and write-heavy (50% lookups, the rest inserts and
+// removes) mixes on the concurrent hash table against one mutex around a
+// chained table with a malloc per node, the way unordered_map works. Both
+// start half full. Threads: one per CPU, or the first argument. Times are
+// per operation.
+#define POOL_IMPL
+#define CONCURRENT_HASH_IMPL
+#include "concurrent_hash.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define KEYS 100000
+#define BUCKETS 131072
+#define OPS 2000000
+
+typedef struct LockedNode {
+  uint64_t key;
+  uint64_t value;
+  struct LockedNode *next;
+} LockedNode;
+
+static LockedNode *locked_buckets[BUCKETS];
+static pthread_mutex_t locked_lock = PTHREAD_MUTEX_INITIALIZER;
+static MemHashTable *table;
+static unsigned read_percent;
+
+static size_t locked_bucket(uint64_t key) {
+  return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 47) % BUCKETS;
+}
+
+static int locked_get(uint64_t key, uint64_t *value) {
+  pthread_mutex_lock(&locked_lock);
+  LockedNode *node = locked_buckets[locked_bucket(key)];
+  while (node != NULL && node->key != key) {
+    node = node->next;
+  }
+  if (node != NULL) {
+    *value = node->value;
+  }
+  pthread_mutex_unlock(&locked_lock);
+  return node != NULL;
+}
+
+static void locked_put(uint64_t key, uint64_t value) {
+  pthread_mutex_lock(&locked_lock);
+  LockedNode **head = &locked_buckets[locked_bucket(key)];
+  LockedNode *node = *head;
+  while (node != NULL && node->key != key) {
+    node = node->next;
+  }
+  if (node == NULL) {
+    node = malloc(sizeof(LockedNode));
+    node->key = key;
+    node->next = *head;
+    *head = node;
+  }
+  node->value = value;
+  pthread_mutex_unlock(&locked_lock);
+}
+
+static void locked_remove(uint64_t key) {
+  pthread_mutex_lock(&locked_lock);
+  LockedNode **link = &locked_buckets[locked_bucket(key)];
+  while (*link != NULL && (*link)->key != key) {
+    link = &(*link)->next;
+  }
+  LockedNode *node = *link;
+  if (node != NULL) {
+    *link = node->next;
+  }
+  pthread_mutex_unlock(&locked_lock);
+  free(node);
+}
+
+// Writes alternate between inserts and removes so the tables stay half full
+#define MIX(get, put, remove)                                                 \
+  do {                                                                        \
+    uint64_t seed = (uintptr_t)arg * 2654435761u + 1;                         \
+    uint64_t value = 0;                                                       \
+    for (size_t i = 0; i < OPS; ++i) {                                        \
+      uint64_t r = bench_rand(&seed);                                         \
+      uint64_t key = (r >> 8) % KEYS;                                         \
+      if (r % 100 < read_percent) {                                           \
+        BENCH_KEEP(get(key, &value));                                         \
+      } else if (i & 1) {                                                     \
+        put(key, key);                                                        \
+      } else {                                                                \
+        remove(key);                                                          \
+      }                                                                       \
+    }                                                                         \
+    BENCH_KEEP(value);                                                        \
+  } while (0)
+
+static int hash_get(uint64_t key, uint64_t *value) {
+  return mem_hash_get(table, key, value);
+}
+
+static void hash_put(uint64_t key, uint64_t value) {
+  mem_hash_put(table, key, value);
+}
+
+static void hash_remove(uint64_t key) { mem_hash_remove(table, key); }
+
+static void *hash_mix(void *arg) {
+  MIX(hash_get, hash_put, hash_remove);
+  return NULL;
+}
+
+static void *locked_mix(void *arg) {
+  MIX(locked_get, locked_put, locked_remove);
+  return NULL;
+}
+
+static void run(const char *name, void *(*mix)(void *), size_t n_threads) {
+  pthread_t threads[n_threads];
+  double start = bench_now();
+  for (size_t i = 0; i < n_threads; ++i) {
+    pthread_create(&threads[i], NULL, mix, (void *)(i + 1));
+  }
+  for (size_t i = 0; i < n_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  bench_report(name, bench_now() - start, OPS * n_threads);
+}
+
+int main(int argc, char **argv) {
+  size_t n_threads = argc > 1 ? strtoul(argv[1], NULL, 10)
+                              : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads == 0) {
+    n_threads = 1;
+  }
+  table = mem_hash_init(BUCKETS, 64, 1024);
+  for (uint64_t key = 0; key < KEYS; key += 2) {
+    mem_hash_put(table, key, key);
+    locked_put(key, key);
+  }
+  printf("%zu threads\n", n_threads);
+  read_percent = 98;
+  run("read-heavy concurrent hash", hash_mix, n_threads);
+  run("read-heavy mutex + malloc", locked_mix, n_threads);
+  read_percent = 50;
+  run("write-heavy concurrent hash", hash_mix, n_threads);
+  run("write-heavy mutex + malloc", locked_mix, n_threads);
+  mem_hash_deinit(table);
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    while (locked_buckets[i] != NULL) {
+      LockedNode *next = locked_buckets[i]->next;
+      free(locked_buckets[i]);
+      locked_buckets[i] = next;
+    }
+  }
+  return 0;
+}
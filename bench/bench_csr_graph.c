@@ -0,0 +1,168 @@
+// Building a graph of a million vertices and 64 million random edges (skewed
+// sources) streamed from a generator: the CSR builder on one thread, the CSR
+// builder with one stream per loading thread and a parallel build (one
+// thread per CPU, or the first argument), and an adjacency list of per
+// vertex arrays grown by doubling with realloc, what a vector of vectors
+// does. Every variant runs in its own process so its peak resident memory
+// (ru_maxrss) can be reported, along with what stays resident once the
+// builder is freed. Times are per edge.
+#define POOL_IMPL
+#define ARENA_IMPL
+#define MEM_STACK_IMPL
+#define TASK_SCHED_IMPL
+#define CSR_GRAPH_IMPL
+#include "stack_allocator.h"
+#include "csr_graph.h"
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define VERTICES 1000000
+#define EDGES 64000000ull
+
+// Edge i, the same whatever thread generates it
+static inline MemCsrEdge edge(uint64_t i) {
+  uint64_t x = (i + 1) * 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  x ^= x >> 31;
+  uint32_t src = (uint32_t)(x % 8 == 0 ? x % 1000 : x % VERTICES);
+  return (MemCsrEdge){src, (uint32_t)((x >> 32) % VERTICES)};
+}
+
+static size_t resident_mb(void) {
+  FILE *file = fopen("/proc/self/statm", "r");
+  unsigned long pages = 0, resident = 0;
+  if (file != NULL) {
+    if (fscanf(file, "%lu %lu", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(file);
+  }
+  return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) >> 20;
+}
+
+static uint64_t checksum(const MemCsrGraph *graph) {
+  uint64_t sum = 0;
+  for (uint32_t v = 0; v < VERTICES; v += 997) {
+    uint64_t degree = 0;
+    const uint32_t *neighbors = mem_csr_neighbors(graph, v, &degree);
+    for (uint64_t k = 0; k < degree; ++k) {
+      sum += neighbors[k];
+    }
+  }
+  return sum;
+}
+
+static void csr_serial(void) {
+  double start = bench_now();
+  MemCsrBuilder *builder = mem_csr_builder_init(1 << 24);
+  for (uint64_t i = 0; i < EDGES; ++i) {
+    MemCsrEdge e = edge(i);
+    mem_csr_builder_add(builder, e.src, e.dst);
+  }
+  bench_report("CSR serial, load", bench_now() - start, EDGES);
+  start = bench_now();
+  MemCsrGraph *graph = mem_csr_build(builder, VERTICES, NULL);
+  mem_csr_builder_deinit(builder);
+  bench_report("CSR serial, build", bench_now() - start, EDGES);
+  printf("  resident after build %zu MB\n", resident_mb());
+  BENCH_KEEP(checksum(graph));
+  mem_csr_deinit(graph);
+}
+
+static MemCsrBuilder *shared;
+static size_t n_threads;
+
+static void *load(void *arg) {
+  size_t id = (size_t)arg;
+  MemCsrStream *stream = mem_csr_stream_open(shared);
+  for (uint64_t i = EDGES * id / n_threads; i < EDGES * (id + 1) / n_threads;
+       ++i) {
+    MemCsrEdge e = edge(i);
+    mem_csr_stream_add(stream, e.src, e.dst);
+  }
+  mem_csr_stream_close(shared, stream);
+  return NULL;
+}
+
+static void csr_parallel(void) {
+  MemScheduler *sched = mem_sched_init(n_threads, 256, 0);
+  double start = bench_now();
+  shared = mem_csr_builder_init(1 << 24);
+  pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+  for (size_t i = 0; i < n_threads; ++i) {
+    pthread_create(&threads[i], NULL, load, (void *)i);
+  }
+  for (size_t i = 0; i < n_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  bench_report("CSR parallel, load", bench_now() - start, EDGES);
+  start = bench_now();
+  MemCsrGraph *graph = mem_csr_build(shared, VERTICES, sched);
+  mem_csr_builder_deinit(shared);
+  bench_report("CSR parallel, build", bench_now() - start, EDGES);
+  printf("  resident after build %zu MB\n", resident_mb());
+  BENCH_KEEP(checksum(graph));
+  mem_csr_deinit(graph);
+  free(threads);
+  mem_sched_deinit(sched);
+}
+
+typedef struct {
+  uint32_t *neighbors;
+  uint32_t size;
+  uint32_t capacity;
+} Adjacency;
+
+static void adjacency_lists(void) {
+  double start = bench_now();
+  Adjacency *lists = calloc(VERTICES, sizeof(Adjacency));
+  for (uint64_t i = 0; i < EDGES; ++i) {
+    MemCsrEdge e = edge(i);
+    Adjacency *list = &lists[e.src];
+    if (list->size == list->capacity) {
+      list->capacity = list->capacity ? 2 * list->capacity : 1;
+      list->neighbors = realloc(list->neighbors,
+                                list->capacity * sizeof(uint32_t));
+    }
+    list->neighbors[list->size++] = e.dst;
+  }
+  bench_report("vector of vectors", bench_now() - start, EDGES);
+  printf("  resident after build %zu MB\n", resident_mb());
+  uint64_t sum = 0;
+  for (uint32_t v = 0; v < VERTICES; ++v) {
+    sum += v % 997 == 0 && lists[v].size > 0 ? lists[v].neighbors[0] : 0;
+    free(lists[v].neighbors);
+  }
+  BENCH_KEEP(sum);
+  free(lists);
+}
+
+// Runs a variant in a child process and prints its peak resident memory
+static void measure(void (*variant)(void)) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    variant();
+    fflush(stdout);
+    _exit(0);
+  }
+  int status = 0;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  printf("  peak resident %ld MB\n", usage.ru_maxrss >> 10);
+}
+
+int main(int argc, char **argv) {
+  n_threads = argc > 1 ? strtoul(argv[1], NULL, 10)
+                       : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+  measure(csr_serial);
+  measure(csr_parallel);
+  measure(adjacency_lists);
+  return 0;
+}
@@ -0,0 +1,212 @@
+// Versioned maps of 1000, 10000 and 100000 keys: every update writes a new
+// version of the map and drops the previous one, and lookups read the
+// latest version. The HAMT with a pool store (reference counted nodes)
+// against a copy on write
+// hash table, what a std::unordered_map behind a shared pointer does: an
+// update clones the buckets and every node (one malloc each) before writing,
+// dropping a version frees them all. Versions can also be kept for an epoch
+// of 65536 updates, then dropped together: released one by one with a pool
+// store, or by resetting the arena of an arena store. Times are per update,
+// or per lookup.
+#define POOL_IMPL
+#define ARENA_IMPL
+#define HAMT_IMPL
+#include "hamt.h"
+
+#include "bench.h"
+
+#define EPOCH_VERSIONS 65536
+#define HAMT_UPDATES (32 * EPOCH_VERSIONS)
+#define COPY_WORK 50000000
+#define LOOKUPS 10000000
+
+typedef struct CowNode {
+  uint64_t key;
+  uint64_t value;
+  struct CowNode *next;
+} CowNode;
+
+typedef struct {
+  CowNode **buckets;
+  size_t n_buckets;
+  size_t size;
+} CowMap;
+
+static CowNode **cow_find(CowMap *map, uint64_t key) {
+  CowNode **link = &map->buckets[key % map->n_buckets];
+  while (*link != NULL && (*link)->key != key) {
+    link = &(*link)->next;
+  }
+  return link;
+}
+
+// A version with the node order of every bucket kept
+static CowMap *cow_clone(const CowMap *map) {
+  CowMap *copy = malloc(sizeof(CowMap));
+  copy->n_buckets = map->n_buckets;
+  copy->size = map->size;
+  copy->buckets = malloc(map->n_buckets * sizeof(CowNode *));
+  for (size_t b = 0; b < map->n_buckets; ++b) {
+    CowNode **link = &copy->buckets[b];
+    for (const CowNode *node = map->buckets[b]; node != NULL;
+         node = node->next) {
+      *link = malloc(sizeof(CowNode));
+      **link = *node;
+      link = &(*link)->next;
+    }
+    *link = NULL;
+  }
+  return copy;
+}
+
+static void cow_free(CowMap *map) {
+  for (size_t b = 0; b < map->n_buckets; ++b) {
+    CowNode *node = map->buckets[b];
+    while (node != NULL) {
+      CowNode *next = node->next;
+      free(node);
+      node = next;
+    }
+  }
+  free(map->buckets);
+  free(map);
+}
+
+// In place, only for a version nobody else sees yet
+static void cow_set(CowMap *map, uint64_t key, uint64_t value) {
+  CowNode **link = cow_find(map, key);
+  if (*link == NULL) {
+    *link = malloc(sizeof(CowNode));
+    (*link)->key = key;
+    (*link)->next = NULL;
+    map->size++;
+  }
+  (*link)->value = value;
+}
+
+static CowMap *cow_put(const CowMap *map, uint64_t key, uint64_t value) {
+  CowMap *copy = cow_clone(map);
+  cow_set(copy, key, value);
+  return copy;
+}
+
+static void bench_size(size_t n_keys) {
+  char name[64];
+  uint64_t seed = 88172645463325252ull;
+  uint64_t sum = 0;
+
+  MemHamt *hamt = mem_hamt_init(1024);
+  MemHamtMap map = {0};
+  for (uint64_t key = 0; key < n_keys; ++key) {
+    MemHamtMap next;
+    mem_hamt_put(hamt, &map, key, key, &next);
+    mem_hamt_release(hamt, &map);
+    map = next;
+  }
+  double start = bench_now();
+  for (size_t i = 0; i < HAMT_UPDATES; ++i) {
+    MemHamtMap next;
+    mem_hamt_put(hamt, &map, bench_rand(&seed) % n_keys, i, &next);
+    mem_hamt_release(hamt, &map);
+    map = next;
+  }
+  snprintf(name, sizeof(name), "%zu keys, HAMT pools update", n_keys);
+  bench_report(name, bench_now() - start, HAMT_UPDATES);
+  start = bench_now();
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    uint64_t value = 0;
+    mem_hamt_get(&map, bench_rand(&seed) % n_keys, &value);
+    sum += value;
+  }
+  snprintf(name, sizeof(name), "%zu keys, HAMT lookup", n_keys);
+  bench_report(name, bench_now() - start, LOOKUPS);
+  mem_hamt_release(hamt, &map);
+  mem_hamt_deinit(hamt);
+
+  // Epochs of versions that die together, the map is written again at the
+  // start of every epoch (not timed)
+  static MemHamtMap kept[EPOCH_VERSIONS];
+  hamt = mem_hamt_init(1024);
+  double seconds = 0;
+  for (size_t i = 0; i < HAMT_UPDATES; i += EPOCH_VERSIONS) {
+    map = (MemHamtMap){0};
+    for (uint64_t key = 0; key < n_keys; ++key) {
+      MemHamtMap next;
+      mem_hamt_put(hamt, &map, key, key, &next);
+      mem_hamt_release(hamt, &map);
+      map = next;
+    }
+    MemHamtMap base = map;
+    start = bench_now();
+    for (size_t j = 0; j < EPOCH_VERSIONS; ++j) {
+      mem_hamt_put(hamt, &map, bench_rand(&seed) % n_keys, j, &kept[j]);
+      map = kept[j];
+    }
+    for (size_t j = 0; j < EPOCH_VERSIONS; ++j) {
+      mem_hamt_release(hamt, &kept[j]);
+    }
+    seconds += bench_now() - start;
+    mem_hamt_release(hamt, &base);
+  }
+  snprintf(name, sizeof(name), "%zu keys, HAMT pools epochs", n_keys);
+  bench_report(name, seconds, HAMT_UPDATES);
+  mem_hamt_deinit(hamt);
+
+  MemArena *arena = mem_arena_init_growable(1 << 20, 0);
+  hamt = mem_hamt_init_arena(arena);
+  seconds = 0;
+  for (size_t i = 0; i < HAMT_UPDATES; i += EPOCH_VERSIONS) {
+    map = (MemHamtMap){0};
+    for (uint64_t key = 0; key < n_keys; ++key) {
+      MemHamtMap next;
+      mem_hamt_put(hamt, &map, key, key, &next);
+      map = next;
+    }
+    start = bench_now();
+    for (size_t j = 0; j < EPOCH_VERSIONS; ++j) {
+      MemHamtMap next;
+      mem_hamt_put(hamt, &map, bench_rand(&seed) % n_keys, j, &next);
+      map = next;
+    }
+    mem_arena_reset(arena);
+    seconds += bench_now() - start;
+  }
+  snprintf(name, sizeof(name), "%zu keys, HAMT arena epochs", n_keys);
+  bench_report(name, seconds, HAMT_UPDATES);
+  mem_hamt_deinit(hamt);
+  mem_arena_deinit(arena);
+
+  // libstdc++ keeps about one bucket per key
+  CowMap *cow = malloc(sizeof(CowMap));
+  cow->n_buckets = n_keys | 1;
+  cow->size = 0;
+  cow->buckets = calloc(cow->n_buckets, sizeof(CowNode *));
+  for (uint64_t key = 0; key < n_keys; ++key) {
+    cow_set(cow, key, key);
+  }
+  size_t updates = COPY_WORK / n_keys;
+  start = bench_now();
+  for (size_t i = 0; i < updates; ++i) {
+    CowMap *next = cow_put(cow, bench_rand(&seed) % n_keys, i);
+    cow_free(cow);
+    cow = next;
+  }
+  snprintf(name, sizeof(name), "%zu keys, copy on write update", n_keys);
+  bench_report(name, bench_now() - start, updates);
+  start = bench_now();
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    CowNode *node = *cow_find(cow, bench_rand(&seed) % n_keys);
+    sum += node != NULL ? node->value : 0;
+  }
+  snprintf(name, sizeof(name), "%zu keys, copy on write lookup", n_keys);
+  bench_report(name, bench_now() - start, LOOKUPS);
+  cow_free(cow);
+  BENCH_KEEP(sum);
+}
+
+int main(void) {
+  bench_size(1000);
+  bench_size(10000);
+  bench_size(100000);
+  return 0;
+}
@@ -0,0 +1,98 @@
+// Growth of big buffers whose address doesn't need to stay the same: a
+// buffer doubled from 1 MB to 1 GB, filled before every growth, and a single
+// growth of a filled 512 MB buffer to 1 GB. mem_large_realloc (mremap)
+// against a new malloc'ed buffer plus a memcpy, and against glibc's realloc
+// for reference (which uses mremap too for chunks it mmapped itself). Only
+// the growth calls are timed, times are per growth. Then a MemSoaPool of
+// two columns doubled from 1024 to 64M objects.
+#define LARGE_ALLOC_IMPL
+#define SOA_POOL_IMPL
+#include "large_alloc.h"
+#include "soa_pool.h"
+
+#include <string.h>
+
+#include "bench.h"
+
+#define FIRST (1ull << 20)
+#define LAST (1ull << 30)
+
+enum { WITH_MREMAP, WITH_COPY, WITH_REALLOC };
+
+static uint8_t *grow(int kind, uint8_t *buffer, size_t old_bytes,
+                     size_t new_bytes) {
+  if (kind == WITH_MREMAP) {
+    return mem_large_realloc(buffer, old_bytes, new_bytes, 64);
+  }
+  if (kind == WITH_REALLOC) {
+    return realloc(buffer, new_bytes);
+  }
+  uint8_t *grown = malloc(new_bytes);
+  memcpy(grown, buffer, old_bytes);
+  free(buffer);
+  return grown;
+}
+
+static void release(int kind, uint8_t *buffer, size_t bytes) {
+  if (kind == WITH_MREMAP) {
+    mem_large_free(buffer, bytes);
+  } else {
+    free(buffer);
+  }
+}
+
+static void doubling(int kind, const char *name) {
+  uint8_t *buffer = kind == WITH_MREMAP ? mem_large_alloc(FIRST, 64)
+                                        : malloc(FIRST);
+  double seconds = 0;
+  size_t growths = 0;
+  for (size_t bytes = FIRST; bytes < LAST; bytes *= 2) {
+    memset(buffer, (int)growths, bytes);
+    double start = bench_now();
+    buffer = grow(kind, buffer, bytes, 2 * bytes);
+    seconds += bench_now() - start;
+    growths++;
+  }
+  BENCH_KEEP(buffer[LAST / 2 - 1]);
+  bench_report(name, seconds, growths);
+  release(kind, buffer, LAST);
+}
+
+static void single(int kind, const char *name) {
+  uint8_t *buffer = kind == WITH_MREMAP ? mem_large_alloc(LAST / 2, 64)
+                                        : malloc(LAST / 2);
+  memset(buffer, 1, LAST / 2);
+  double start = bench_now();
+  buffer = grow(kind, buffer, LAST / 2, LAST);
+  bench_report(name, bench_now() - start, 1);
+  BENCH_KEEP(buffer[LAST / 2 - 1]);
+  release(kind, buffer, LAST);
+}
+
+static void soa_doubling(void) {
+  size_t fields[2] = {sizeof(uint64_t), sizeof(float)};
+  MemSoaPool *pool = mem_soa_pool_init(fields, 2, 1024);
+  double seconds = 0;
+  size_t growths = 0;
+  for (size_t capacity = 1024; capacity < (64u << 20); capacity *= 2) {
+    while (mem_soa_pool_alloc(pool) != MEM_SOA_INVALID_HANDLE) {
+    }
+    double start = bench_now();
+    mem_soa_pool_grow(pool, 2 * capacity);
+    seconds += bench_now() - start;
+    growths++;
+  }
+  bench_report("SoA pool doubling to 64M objects", seconds, growths);
+  mem_soa_pool_deinit(pool);
+}
+
+int main(void) {
+  doubling(WITH_MREMAP, "1 MB to 1 GB, mremap");
+  doubling(WITH_COPY, "1 MB to 1 GB, malloc + memcpy");
+  doubling(WITH_REALLOC, "1 MB to 1 GB, glibc realloc");
+  single(WITH_MREMAP, "512 MB to 1 GB, mremap");
+  single(WITH_COPY, "512 MB to 1 GB, malloc + memcpy");
+  single(WITH_REALLOC, "512 MB to 1 GB, glibc realloc");
+  soa_doubling();
+  return 0;
+}
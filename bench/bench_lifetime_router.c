@@ -0,0 +1,90 @@
+// A mixed workload, mostly temporaries freed right away and some objects kept
+// across many allocations: the lifetime router once it has profiled the
+// sites, the same router left in profiling mode (everything in the pools),
+// and malloc.
+#define POOL_IMPL
+#define ARENA_IMPL
+#define SIZE_CLASS_ALLOC_IMPL
+#define LIFETIME_ROUTER_IMPL
+#include "lifetime_router.h"
+
+#include <string.h>
+
+#include "bench.h"
+
+#define OPS 5000000
+#define KEPT 8192
+#define SHORT_SITE 1
+#define LONG_SITE 2
+
+static const size_t classes[] = {32, 64, 128, 256};
+static void *kept[KEPT];
+
+// Temporaries of 16 to 256 bytes, one kept object every 8 of them
+#define WORKLOAD(alloc, free_)                                                \
+  do {                                                                        \
+    uint64_t seed = 88172645463325252ull;                                     \
+    size_t next = 0;                                                          \
+    for (size_t i = 0; i < OPS; ++i) {                                        \
+      uint64_t r = bench_rand(&seed);                                         \
+      size_t bytes = 16 + (r & 0xF0);                                         \
+      void *temporary = alloc(bytes, SHORT_SITE);                             \
+      memset(temporary, 1, bytes);                                            \
+      BENCH_KEEP(temporary);                                                  \
+      free_(temporary, bytes);                                                \
+      if ((r >> 8) % 8 == 0) {                                                \
+        if (kept[next] != NULL) {                                             \
+          free_(kept[next], 64);                                              \
+        }                                                                     \
+        kept[next] = alloc(64, LONG_SITE);                                    \
+        memset(kept[next], 2, 64);                                            \
+        next = (next + 1) % KEPT;                                             \
+      }                                                                       \
+    }                                                                         \
+    for (size_t i = 0; i < KEPT; ++i) {                                       \
+      if (kept[i] != NULL) {                                                  \
+        free_(kept[i], 64);                                                   \
+        kept[i] = NULL;                                                       \
+      }                                                                       \
+    }                                                                         \
+  } while (0)
+
+static MemRouter *router;
+
+static void *router_alloc(size_t bytes, uintptr_t site) {
+  return mem_router_alloc_site(router, bytes, site);
+}
+
+static void router_free(void *ptr, size_t bytes) {
+  mem_router_free(router, ptr, bytes);
+}
+
+static void *heap_alloc(size_t bytes, uintptr_t site) {
+  (void)site;
+  return malloc(bytes);
+}
+
+static void heap_free(void *ptr, size_t bytes) {
+  (void)bytes;
+  free(ptr);
+}
+
+int main(void) {
+  MemRouterConfig config = {classes, 4, 2 * KEPT, 1 << 20, 64};
+  router = mem_router_init(&config);
+
+  double start = bench_now();
+  WORKLOAD(router_alloc, router_free);
+  bench_report("router profiling (pools)", bench_now() - start, OPS);
+
+  mem_router_profile(router, 0);
+  start = bench_now();
+  WORKLOAD(router_alloc, router_free);
+  bench_report("router routing", bench_now() - start, OPS);
+  mem_router_deinit(router);
+
+  start = bench_now();
+  WORKLOAD(heap_alloc, heap_free);
+  bench_report("malloc", bench_now() - start, OPS);
+  return 0;
+}
@@ -0,0 +1,172 @@
+// Zipfian lookups (s = 0.99 over a million keys) in a cache of 100000 values
+// of 64 bytes, a miss puts the key: the exact LRU and the CLOCK policies
+// against a chained hash plus LRU list with a malloc per entry and a free per
+// eviction, the way an unordered_map and a list are usually combined (the
+// identity hash and a prime number of buckets, about one per entry, are the
+// ones of libstdc++).
+// Throughput is per lookup, the latencies are of single lookups that hit
+// (clock_gettime included).
+#define POOL_IMPL
+#define LRU_CACHE_IMPL
+#include "lru_cache.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define KEYS 1000000
+#define CAPACITY 100000
+#define VALUE_SIZE 64
+#define LOOKUPS 10000000
+#define SAMPLES 1000000
+#define HEAP_BUCKETS 100003
+
+typedef struct HeapEntry {
+  uint64_t key;
+  struct HeapEntry *hnext;
+  struct HeapEntry *prev;
+  struct HeapEntry *next;
+  uint8_t value[VALUE_SIZE];
+} HeapEntry;
+
+static HeapEntry *heap_buckets[HEAP_BUCKETS];
+static HeapEntry heap_lru = {0, NULL, &heap_lru, &heap_lru, {0}};
+static size_t heap_size;
+
+static HeapEntry **heap_link(uint64_t key) {
+  HeapEntry **link = &heap_buckets[key % HEAP_BUCKETS];
+  while (*link != NULL && (*link)->key != key) {
+    link = &(*link)->hnext;
+  }
+  return link;
+}
+
+static void heap_unlist(HeapEntry *entry) {
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+}
+
+static void heap_push(HeapEntry *entry) {
+  entry->next = heap_lru.next;
+  entry->prev = &heap_lru;
+  heap_lru.next->prev = entry;
+  heap_lru.next = entry;
+}
+
+static void *heap_get(uint64_t key) {
+  HeapEntry *entry = *heap_link(key);
+  if (entry == NULL) {
+    return NULL;
+  }
+  heap_unlist(entry);
+  heap_push(entry);
+  return entry->value;
+}
+
+static void heap_put(uint64_t key, const void *value) {
+  if (heap_size == CAPACITY) {
+    HeapEntry *victim = heap_lru.prev;
+    heap_unlist(victim);
+    HeapEntry **link = heap_link(victim->key);
+    *link = victim->hnext;
+    free(victim);
+    heap_size--;
+  }
+  HeapEntry *entry = malloc(sizeof(HeapEntry));
+  entry->key = key;
+  memcpy(entry->value, value, VALUE_SIZE);
+  HeapEntry **link = heap_link(key);
+  entry->hnext = NULL;
+  *link = entry;
+  heap_push(entry);
+  heap_size++;
+}
+
+static uint32_t *queries;
+static double samples[SAMPLES];
+
+// Inverse CDF of the Zipf distribution, sampled with a binary search
+static void make_queries(void) {
+  double *cdf = malloc(KEYS * sizeof(double));
+  double sum = 0;
+  for (size_t k = 0; k < KEYS; ++k) {
+    sum += 1.0 / pow((double)(k + 1), 0.99);
+    cdf[k] = sum;
+  }
+  queries = malloc(LOOKUPS * sizeof(uint32_t));
+  uint64_t seed = 88172645463325252ull;
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    double u = (double)(bench_rand(&seed) >> 11) / 9007199254740992.0 * sum;
+    size_t low = 0, high = KEYS - 1;
+    while (low < high) {
+      size_t mid = (low + high) / 2;
+      if (cdf[mid] < u) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    // Popular keys are spread over the key space
+    queries[i] = (uint32_t)((low * 2654435761u) % KEYS);
+  }
+  free(cdf);
+}
+
+static MemLruCache *cache;
+
+static void *cache_get(uint64_t key) { return mem_lru_get(cache, key); }
+
+static void cache_put(uint64_t key, const void *value) {
+  mem_lru_put(cache, key, value);
+}
+
+#define LOOKUP_ALL(name, get, put)                                            \
+  do {                                                                        \
+    uint8_t value[VALUE_SIZE] = {0};                                          \
+    size_t hits = 0;                                                          \
+    double start = bench_now();                                               \
+    for (size_t i = 0; i < LOOKUPS; ++i) {                                    \
+      uint8_t *found = get(queries[i]);                                       \
+      if (found != NULL) {                                                    \
+        hits++;                                                               \
+        BENCH_KEEP(found[0]);                                                 \
+      } else {                                                                \
+        put(queries[i], value);                                               \
+      }                                                                       \
+    }                                                                         \
+    bench_report(name, bench_now() - start, LOOKUPS);                         \
+    printf("  hit ratio %.3f\n", (double)hits / LOOKUPS);                     \
+    size_t n = 0;                                                             \
+    for (size_t i = 0; i < LOOKUPS && n < SAMPLES; ++i) {                     \
+      double begin = bench_now();                                             \
+      uint8_t *found = get(queries[i]);                                       \
+      double seconds = bench_now() - begin;                                   \
+      if (found != NULL) {                                                    \
+        samples[n++] = seconds;                                               \
+      } else {                                                                \
+        put(queries[i], value);                                               \
+      }                                                                       \
+    }                                                                         \
+    bench_report_latency(name, samples, n);                                   \
+  } while (0)
+
+int main(void) {
+  make_queries();
+  cache = mem_lru_init(CAPACITY, VALUE_SIZE, MEM_LRU_EXACT);
+  LOOKUP_ALL("exact LRU", cache_get, cache_put);
+  mem_lru_deinit(cache);
+
+  cache = mem_lru_init(CAPACITY, VALUE_SIZE, MEM_LRU_CLOCK);
+  LOOKUP_ALL("CLOCK", cache_get, cache_put);
+  mem_lru_deinit(cache);
+
+  LOOKUP_ALL("hash + list + malloc", heap_get, heap_put);
+  while (heap_lru.next != &heap_lru) {
+    HeapEntry *entry = heap_lru.next;
+    heap_unlist(entry);
+    free(entry);
+  }
+  free(queries);
+  return 0;
+}
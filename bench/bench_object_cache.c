@@ -0,0 +1,97 @@
+// Objects holding a mutex and a pre-sized buffer: the object cache, which
+// keeps them constructed, against a MemPool and malloc rebuilding them on
+// every allocation.
+#define POOL_IMPL
+#define OBJECT_CACHE_IMPL
+#include "object_cache.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define BATCH 10000
+#define ROUNDS 200
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  size_t length;
+  char buffer[256];
+} Object;
+
+static Object *objects[BATCH];
+
+static int object_ctor(void *object, void *ctx) {
+  (void)ctx;
+  Object *o = object;
+  o->length = 0;
+  memset(o->buffer, 0, sizeof(o->buffer));
+  return pthread_mutex_init(&o->lock, NULL) == 0 &&
+         pthread_cond_init(&o->ready, NULL) == 0;
+}
+
+static void object_dtor(void *object, void *ctx) {
+  (void)ctx;
+  Object *o = object;
+  pthread_cond_destroy(&o->ready);
+  pthread_mutex_destroy(&o->lock);
+}
+
+// What a user of the object does with it, the same for every variant
+static void object_use(Object *o, size_t i) {
+  pthread_mutex_lock(&o->lock);
+  o->buffer[o->length++ % sizeof(o->buffer)] = (char)i;
+  pthread_mutex_unlock(&o->lock);
+}
+
+int main(void) {
+  MemObjectCache *cache = mem_object_cache_init(
+      sizeof(Object), BATCH, object_ctor, object_dtor, NULL);
+  MemPool *pool = mem_pool_init_ex(sizeof(Object), BATCH, MEM_POOL_REUSE_LIFO);
+  size_t ops = (size_t)BATCH * ROUNDS;
+
+  double start = bench_now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < BATCH; ++i) {
+      objects[i] = mem_object_cache_alloc(cache);
+      object_use(objects[i], i);
+    }
+    for (size_t i = 0; i < BATCH; ++i) {
+      mem_object_cache_free(cache, objects[i]);
+    }
+  }
+  bench_report("object cache alloc+free", bench_now() - start, ops);
+
+  start = bench_now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < BATCH; ++i) {
+      objects[i] = mem_pool_alloc(pool);
+      object_ctor(objects[i], NULL);
+      object_use(objects[i], i);
+    }
+    for (size_t i = 0; i < BATCH; ++i) {
+      object_dtor(objects[i], NULL);
+      mem_pool_free(pool, objects[i]);
+    }
+  }
+  bench_report("pool alloc+ctor+dtor+free", bench_now() - start, ops);
+
+  start = bench_now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < BATCH; ++i) {
+      objects[i] = malloc(sizeof(Object));
+      object_ctor(objects[i], NULL);
+      object_use(objects[i], i);
+    }
+    for (size_t i = 0; i < BATCH; ++i) {
+      object_dtor(objects[i], NULL);
+      free(objects[i]);
+    }
+  }
+  bench_report("malloc+ctor+dtor+free", bench_now() - start, ops);
+
+  mem_object_cache_deinit(cache);
+  mem_pool_deinit(pool);
+  return 0;
+}
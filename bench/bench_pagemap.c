@@ -0,0 +1,90 @@
+// Pointer to owner lookups: the radix-tree pagemap against an open addressing
+// hash map keyed by page number, the way owners were tracked before.
+#define PAGEMAP_IMPL
+#include "pagemap.h"
+
+#include <stdlib.h>
+
+#include "bench.h"
+
+#define OWNERS 4096
+#define PAGES_PER_OWNER 16
+#define LOOKUPS 20000000
+
+typedef struct {
+  uintptr_t page;
+  void *owner;
+} HashSlot;
+
+static HashSlot *hash_slots;
+static size_t hash_mask;
+
+static size_t hash_index(uintptr_t page) {
+  return (size_t)((page * 0x9E3779B97F4A7C15ull) >> 20) & hash_mask;
+}
+
+static void hash_put(uintptr_t page, void *owner) {
+  size_t i = hash_index(page);
+  while (hash_slots[i].owner != NULL && hash_slots[i].page != page) {
+    i = (i + 1) & hash_mask;
+  }
+  hash_slots[i].page = page;
+  hash_slots[i].owner = owner;
+}
+
+static void *hash_get(const void *ptr) {
+  uintptr_t page = (uintptr_t)ptr >> MEM_PAGE_SHIFT;
+  for (size_t i = hash_index(page);; i = (i + 1) & hash_mask) {
+    if (hash_slots[i].owner == NULL || hash_slots[i].page == page) {
+      return hash_slots[i].owner;
+    }
+  }
+}
+
+int main(void) {
+  static MemPagemap map;
+  size_t region_bytes = (size_t)PAGES_PER_OWNER << MEM_PAGE_SHIFT;
+  uint8_t *base = (uint8_t *)((uintptr_t)1 << 40);
+
+  size_t n_pages = (size_t)OWNERS * PAGES_PER_OWNER;
+  hash_mask = 2 * n_pages - 1; // Load factor 0.5, n_pages is a power of two
+  hash_slots = calloc(hash_mask + 1, sizeof(HashSlot));
+  // Owners are spread over the address space like real mappings are
+  uint8_t **owners = malloc(OWNERS * sizeof(uint8_t *));
+  for (size_t i = 0; i < OWNERS; ++i) {
+    owners[i] = base + i * 7 * region_bytes;
+    mem_pagemap_set(&map, owners[i], region_bytes, owners[i]);
+    for (size_t p = 0; p < PAGES_PER_OWNER; ++p) {
+      hash_put(((uintptr_t)owners[i] >> MEM_PAGE_SHIFT) + p, owners[i]);
+    }
+  }
+  const void **queries = malloc(LOOKUPS * sizeof(void *));
+  uint64_t seed = 88172645463325252ull;
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    uint64_t r = bench_rand(&seed);
+    queries[i] = owners[r % OWNERS] + (r >> 32) % region_bytes;
+  }
+
+  double start = bench_now();
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    BENCH_KEEP(mem_pagemap_get(&map, queries[i]));
+  }
+  bench_report("pagemap lookup", bench_now() - start, LOOKUPS);
+
+  start = bench_now();
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    BENCH_KEEP(hash_get(queries[i]));
+  }
+  bench_report("hash map lookup", bench_now() - start, LOOKUPS);
+
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    if (mem_pagemap_get(&map, queries[i]) != hash_get(queries[i])) {
+      printf("mismatch\n");
+      return 1;
+    }
+  }
+  free(queries);
+  free(owners);
+  free(hash_slots);
+  return 0;
+}
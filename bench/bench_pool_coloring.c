@@ -0,0 +1,52 @@
+// Walks the first chunks of several page-aligned pools with 4 KB chunks at
+// once, the pattern where every hot line maps to the same cache set. The
+// uncolored walk reads the same pools at their uncolored offsets (the color
+// padding belongs to the pool memory), so both walks touch the same pages.
+#define MEM_USE_PAGE_HEAP
+#define PAGE_HEAP_IMPL
+#define PAGEMAP_IMPL
+#define POOL_IMPL
+#include "pool_allocator.h"
+
+#include "bench.h"
+
+#define POOLS 16
+#define HOT_CHUNKS 2
+#define CHUNK 4096
+#define ACCESSES 10000000
+
+static double walk(uint8_t *const *lines, size_t n_lines) {
+  double start = bench_now();
+  uint64_t sum = 0;
+  for (size_t r = 0; r < ACCESSES / n_lines; ++r) {
+    for (size_t i = 0; i < n_lines; ++i) {
+      sum += ++*(volatile uint64_t *)lines[i];
+    }
+  }
+  BENCH_KEEP(sum);
+  return bench_now() - start;
+}
+
+int main(void) {
+  MemPool *pools[POOLS];
+  uint8_t *colored[POOLS * HOT_CHUNKS];
+  uint8_t *uncolored[POOLS * HOT_CHUNKS];
+  for (size_t p = 0; p < POOLS; ++p) {
+    pools[p] = mem_pool_init(CHUNK, 64);
+    for (size_t c = 0; c < HOT_CHUNKS; ++c) {
+      colored[p * HOT_CHUNKS + c] = pools[p]->data + c * CHUNK;
+      uncolored[p * HOT_CHUNKS + c] =
+          pools[p]->data - pools[p]->color + c * CHUNK;
+    }
+  }
+  size_t n_lines = POOLS * HOT_CHUNKS;
+  size_t ops = ACCESSES / n_lines * n_lines;
+  walk(colored, n_lines); // Warm up
+  bench_report("uncolored hot chunks", walk(uncolored, n_lines), ops);
+  bench_report("colored hot chunks", walk(colored, n_lines), ops);
+
+  for (size_t p = 0; p < POOLS; ++p) {
+    mem_pool_deinit(pools[p]);
+  }
+  return 0;
+}
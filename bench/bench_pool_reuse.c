@@ -0,0 +1,71 @@
+// Cache behavior of the pool reuse policies, on a pool much bigger than the
+// caches (1M chunks of 64 bytes, half of them live):
+//  - churn: a random live object is read, freed and replaced by a new one
+//    that gets written right away. LIFO hands the chunk just read back, FIFO
+//    the one freed the longest time ago;
+//  - batch walk: after the churn, a batch of objects is allocated and then
+//    walked in allocation order. The lowest address policy packs the batch
+//    in as few cache lines and pages as possible.
+#define POOL_IMPL
+#include "pool_allocator.h"
+
+#include <string.h>
+
+#include "bench.h"
+
+#define CHUNK 64
+#define CHUNKS (1 << 20)
+#define CHURN 4000000
+#define BATCH 65536
+#define WALKS 50
+
+static uint8_t *live[CHUNKS / 2];
+static uint8_t *batch[BATCH];
+
+static void run(const char *name, int flags) {
+  MemPool *pool = mem_pool_init_ex(CHUNK, CHUNKS, flags);
+  for (size_t i = 0; i < CHUNKS; ++i) {
+    uint8_t *chunk = mem_pool_alloc(pool);
+    memset(chunk, 0, CHUNK);
+    if (i % 2 == 0) {
+      live[i / 2] = chunk;
+    } else {
+      mem_pool_free(pool, chunk); // Free chunks spread all over the pool
+    }
+  }
+
+  uint64_t seed = 88172645463325252ull, sum = 0;
+  double start = bench_now();
+  for (size_t i = 0; i < CHURN; ++i) {
+    size_t slot = bench_rand(&seed) % (CHUNKS / 2);
+    sum += live[slot][0];
+    mem_pool_free(pool, live[slot]);
+    live[slot] = mem_pool_alloc(pool);
+    memset(live[slot], (int)i, CHUNK);
+  }
+  char label[64];
+  snprintf(label, sizeof(label), "%s, churn", name);
+  bench_report(label, bench_now() - start, CHURN);
+
+  for (size_t i = 0; i < BATCH; ++i) {
+    batch[i] = mem_pool_alloc(pool);
+    memset(batch[i], 1, CHUNK);
+  }
+  start = bench_now();
+  for (int w = 0; w < WALKS; ++w) {
+    for (size_t i = 0; i < BATCH; ++i) {
+      sum += batch[i][w % CHUNK];
+    }
+  }
+  snprintf(label, sizeof(label), "%s, batch walk", name);
+  bench_report(label, bench_now() - start, (size_t)BATCH * WALKS);
+  BENCH_KEEP(sum);
+  mem_pool_deinit(pool);
+}
+
+int main(void) {
+  run("lowest address", MEM_POOL_REUSE_LOWEST);
+  run("LIFO", MEM_POOL_REUSE_LIFO);
+  run("FIFO", MEM_POOL_REUSE_FIFO);
+  return 0;
+}
@@ -0,0 +1,150 @@
+// Lookups in a table of nodes: lock-free readers validating the versions of
+// a type-stable pool, against readers taking one pthread RW-lock per slot.
+// Every read copies a whole node, a writer replaces nodes (a fresh chunk and
+// a free for the optimistic table, an update under the write lock for the
+// other one). Readers: one per CPU, or the first argument. Times are per
+// read, with and without the writer running.
+#define POOL_IMPL
+#include "pool_allocator.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define SLOTS 1024
+#define READS 4000000
+#define FIELDS 7
+
+typedef struct {
+  _Atomic uint64_t fields[FIELDS];
+} Node;
+
+static MemPool *pool;
+static Node *_Atomic stable_slots[SLOTS];
+static Node locked_slots[SLOTS];
+static pthread_rwlock_t locks[SLOTS];
+static _Atomic int writing;
+static _Atomic uint64_t retries;
+
+static void node_fill(Node *node, uint64_t value) {
+  for (size_t f = 0; f < FIELDS; ++f) {
+    atomic_store_explicit(&node->fields[f], value, memory_order_relaxed);
+  }
+}
+
+static uint64_t node_sum(Node *node) {
+  uint64_t sum = 0;
+  for (size_t f = 0; f < FIELDS; ++f) {
+    sum += atomic_load_explicit(&node->fields[f], memory_order_relaxed);
+  }
+  return sum;
+}
+
+static void *stable_reader(void *arg) {
+  uint64_t seed = (uintptr_t)arg * 2654435761u + 1;
+  uint64_t failed = 0;
+  for (size_t i = 0; i < READS; ++i) {
+    size_t slot = bench_rand(&seed) % SLOTS;
+    for (;;) {
+      Node *node = atomic_load_explicit(&stable_slots[slot],
+                                        memory_order_acquire);
+      uint64_t version = mem_pool_read_begin(pool, node);
+      uint64_t sum = node_sum(node);
+      if (mem_pool_read_validate(pool, node, version)) {
+        BENCH_KEEP(sum);
+        break;
+      }
+      failed++;
+    }
+  }
+  atomic_fetch_add(&retries, failed);
+  return NULL;
+}
+
+static void *locked_reader(void *arg) {
+  uint64_t seed = (uintptr_t)arg * 2654435761u + 1;
+  for (size_t i = 0; i < READS; ++i) {
+    size_t slot = bench_rand(&seed) % SLOTS;
+    pthread_rwlock_rdlock(&locks[slot]);
+    uint64_t sum = node_sum(&locked_slots[slot]);
+    pthread_rwlock_unlock(&locks[slot]);
+    BENCH_KEEP(sum);
+  }
+  return NULL;
+}
+
+static void *stable_writer(void *arg) {
+  (void)arg;
+  uint64_t seed = 42;
+  for (uint64_t i = 0; atomic_load(&writing); ++i) {
+    Node *fresh = mem_pool_alloc(pool);
+    node_fill(fresh, i);
+    mem_pool_write_end(pool, fresh);
+    size_t slot = bench_rand(&seed) % SLOTS;
+    mem_pool_free(pool, atomic_exchange_explicit(&stable_slots[slot], fresh,
+                                                 memory_order_acq_rel));
+  }
+  return NULL;
+}
+
+static void *locked_writer(void *arg) {
+  (void)arg;
+  uint64_t seed = 42;
+  for (uint64_t i = 0; atomic_load(&writing); ++i) {
+    size_t slot = bench_rand(&seed) % SLOTS;
+    pthread_rwlock_wrlock(&locks[slot]);
+    node_fill(&locked_slots[slot], i);
+    pthread_rwlock_unlock(&locks[slot]);
+  }
+  return NULL;
+}
+
+static void run(const char *name, void *(*reader)(void *),
+                void *(*writer)(void *), size_t n_readers) {
+  pthread_t threads[n_readers];
+  pthread_t writer_thread;
+  atomic_store(&writing, 1);
+  if (writer != NULL) {
+    pthread_create(&writer_thread, NULL, writer, NULL);
+  }
+  double start = bench_now();
+  for (size_t i = 0; i < n_readers; ++i) {
+    pthread_create(&threads[i], NULL, reader, (void *)(i + 1));
+  }
+  for (size_t i = 0; i < n_readers; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  bench_report(name, bench_now() - start, READS * n_readers);
+  atomic_store(&writing, 0);
+  if (writer != NULL) {
+    pthread_join(writer_thread, NULL);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t n_readers = argc > 1 ? strtoul(argv[1], NULL, 10)
+                              : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_readers == 0) {
+    n_readers = 1;
+  }
+  pool = mem_pool_init_ex(sizeof(Node), 2 * SLOTS,
+                          MEM_POOL_TYPE_STABLE | MEM_POOL_REUSE_FIFO);
+  for (size_t i = 0; i < SLOTS; ++i) {
+    Node *node = mem_pool_alloc(pool);
+    node_fill(node, i);
+    mem_pool_write_end(pool, node);
+    atomic_init(&stable_slots[i], node);
+    node_fill(&locked_slots[i], i);
+    pthread_rwlock_init(&locks[i], NULL);
+  }
+  printf("%zu readers\n", n_readers);
+  run("optimistic reads", stable_reader, NULL, n_readers);
+  run("rwlock reads", locked_reader, NULL, n_readers);
+  run("optimistic reads, writer", stable_reader, stable_writer, n_readers);
+  run("rwlock reads, writer", locked_reader, locked_writer, n_readers);
+  printf("optimistic retries: %llu\n",
+         (unsigned long long)atomic_load(&retries));
+  mem_pool_deinit(pool);
+  return 0;
+}
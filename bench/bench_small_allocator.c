@@ -0,0 +1,103 @@
+// Small object allocation: the sharded small allocator against a plain
+// MemPool (fixed size only) and glibc malloc, for a batch of allocations
+// freed afterwards and for alloc/free pairs.
+#define POOL_IMPL
+#define SMALL_ALLOC_IMPL
+#include "pool_allocator.h"
+#include "small_allocator.h"
+
+#include <stdlib.h>
+
+#include "bench.h"
+
+#define BATCH 100000
+#define ROUNDS 50
+
+static void *ptrs[BATCH];
+
+int main(void) {
+  MemSmallHeap *heap = mem_small_heap_init();
+  MemPool *pool = mem_pool_init_ex(64, BATCH, MEM_POOL_REUSE_LIFO);
+  size_t ops = (size_t)BATCH * ROUNDS;
+
+  double start = bench_now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < BATCH; ++i) {
+      ptrs[i] = mem_small_alloc(heap, 64);
+    }
+    for (size_t i = 0; i < BATCH; ++i) {
+      mem_small_free(ptrs[i]);
+    }
+  }
+  bench_report("small alloc+free 64B batch", bench_now() - start, ops);
+
+  start = bench_now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < BATCH; ++i) {
+      ptrs[i] = mem_pool_alloc(pool);
+    }
+    for (size_t i = 0; i < BATCH; ++i) {
+      mem_pool_free(pool, ptrs[i]);
+    }
+  }
+  bench_report("MemPool alloc+free 64B batch", bench_now() - start, ops);
+
+  start = bench_now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < BATCH; ++i) {
+      ptrs[i] = malloc(64);
+    }
+    for (size_t i = 0; i < BATCH; ++i) {
+      free(ptrs[i]);
+    }
+  }
+  bench_report("malloc+free 64B batch", bench_now() - start, ops);
+
+  // Mixed sizes, the pool can't serve them
+  uint64_t seed = 88172645463325252ull;
+  size_t sizes[1024];
+  for (size_t i = 0; i < 1024; ++i) {
+    sizes[i] = 16 + bench_rand(&seed) % 1000;
+  }
+  start = bench_now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < BATCH; ++i) {
+      ptrs[i] = mem_small_alloc(heap, sizes[i & 1023]);
+    }
+    for (size_t i = 0; i < BATCH; ++i) {
+      mem_small_free(ptrs[i]);
+    }
+  }
+  bench_report("small alloc+free mixed batch", bench_now() - start, ops);
+
+  start = bench_now();
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (size_t i = 0; i < BATCH; ++i) {
+      ptrs[i] = malloc(sizes[i & 1023]);
+    }
+    for (size_t i = 0; i < BATCH; ++i) {
+      free(ptrs[i]);
+    }
+  }
+  bench_report("malloc+free mixed batch", bench_now() - start, ops);
+
+  start = bench_now();
+  for (size_t i = 0; i < ops; ++i) {
+    void *ptr = mem_small_alloc(heap, 64);
+    BENCH_KEEP(ptr);
+    mem_small_free(ptr);
+  }
+  bench_report("small alloc/free pair 64B", bench_now() - start, ops);
+
+  start = bench_now();
+  for (size_t i = 0; i < ops; ++i) {
+    void *ptr = malloc(64);
+    BENCH_KEEP(ptr);
+    free(ptr);
+  }
+  bench_report("malloc/free pair 64B", bench_now() - start, ops);
+
+  mem_pool_deinit(pool);
+  mem_small_heap_deinit(heap);
+  return 0;
+}
@@ -0,0 +1,309 @@
+// Fork-join kernels (fibonacci, n-queens, merge sort) on the work-stealing
+// scheduler against a plain runtime: one mutex protected task stack (LIFO, a
+// FIFO queue makes waiting tasks nest without bound) and malloc'ed task
+// descriptors. Both get the same kernels, stamped out by KERNELS, and the
+// same number of workers: one per CPU, or the first argument. Times are per
+// spawned task.
+#define POOL_IMPL
+#define MEM_STACK_IMPL
+#define TASK_SCHED_IMPL
+#include "task_scheduler.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define FIB_N 27
+#define QUEENS_N 10
+#define SORT_N (1 << 21)
+#define SORT_CUTOFF 4096
+
+typedef struct QueueTask {
+  void (*fn)(void *sched, void *arg);
+  MemTaskGroup *group;
+  struct QueueTask *next;
+  _Alignas(16) uint8_t arg[MEM_TASK_ARG_BYTES];
+} QueueTask;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  QueueTask *head;
+  int running;
+} Queue;
+
+static QueueTask *queue_pop(Queue *queue) {
+  QueueTask *task = queue->head;
+  if (task != NULL) {
+    queue->head = task->next;
+  }
+  return task;
+}
+
+static void queue_execute(Queue *queue, QueueTask *task) {
+  MemTaskGroup *group = task->group;
+  task->fn(queue, task->arg);
+  free(task);
+  atomic_fetch_sub_explicit(&group->pending, 1, memory_order_release);
+}
+
+static void queue_spawn(Queue *queue, MemTaskGroup *group,
+                        void (*fn)(void *, void *), const void *arg,
+                        size_t arg_size) {
+  QueueTask *task = malloc(sizeof(QueueTask));
+  task->fn = fn;
+  task->group = group;
+  memcpy(task->arg, arg, arg_size);
+  atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+  pthread_mutex_lock(&queue->lock);
+  task->next = queue->head;
+  queue->head = task;
+  pthread_cond_signal(&queue->wakeup);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// Runs queued tasks until the group is done, like 'mem_sched_wait'
+static void queue_wait(Queue *queue, MemTaskGroup *group) {
+  while (atomic_load_explicit(&group->pending, memory_order_acquire) > 0) {
+    pthread_mutex_lock(&queue->lock);
+    QueueTask *task = queue_pop(queue);
+    pthread_mutex_unlock(&queue->lock);
+    if (task != NULL) {
+      queue_execute(queue, task);
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+static void *queue_worker(void *arg) {
+  Queue *queue = arg;
+  pthread_mutex_lock(&queue->lock);
+  while (queue->running) {
+    QueueTask *task = queue_pop(queue);
+    if (task == NULL) {
+      pthread_cond_wait(&queue->wakeup, &queue->lock);
+      continue;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    queue_execute(queue, task);
+    pthread_mutex_lock(&queue->lock);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return NULL;
+}
+
+typedef struct {
+  uint64_t n;
+  uint64_t *out;
+} FibArgs;
+
+typedef struct {
+  int n;
+  int row;
+  uint64_t *out;
+  int8_t cols[16];
+} QueensArgs;
+
+typedef struct {
+  uint32_t *data;
+  uint32_t *tmp;
+  size_t n;
+} SortArgs;
+
+static int queens_safe(const int8_t *cols, int row, int col) {
+  for (int r = 0; r < row; ++r) {
+    int d = cols[r] - col;
+    if (d == 0 || d == row - r || d == r - row) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Tasks spawned by the kernels, counted sequentially
+static size_t fib_spawns(uint64_t n) {
+  return n < 2 ? 0 : 1 + fib_spawns(n - 1) + fib_spawns(n - 2);
+}
+
+static size_t queens_spawns(int8_t *cols, int n, int row) {
+  size_t spawns = 0;
+  for (int col = 0; row < n && col < n; ++col) {
+    if (queens_safe(cols, row, col)) {
+      cols[row] = (int8_t)col;
+      spawns += 1 + queens_spawns(cols, n, row + 1);
+    }
+  }
+  return spawns;
+}
+
+static size_t sort_spawns(size_t n) {
+  return n <= SORT_CUTOFF ? 0 : 1 + sort_spawns(n / 2) + sort_spawns(n - n / 2);
+}
+
+static int compare_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void merge(uint32_t *data, uint32_t *tmp, size_t n) {
+  size_t half = n / 2, i = 0, j = half, k = 0;
+  while (i < half && j < n) {
+    tmp[k++] = data[i] <= data[j] ? data[i++] : data[j++];
+  }
+  memcpy(tmp + k, data + i, (half - i) * sizeof(uint32_t));
+  k += half - i;
+  memcpy(tmp + k, data + j, (n - j) * sizeof(uint32_t));
+  memcpy(data, tmp, n * sizeof(uint32_t));
+}
+
+#define KERNELS(prefix, Sched, spawn, wait)                                    \
+  static void prefix##_fib(Sched *sched, void *arg) {                          \
+    FibArgs *a = arg;                                                          \
+    if (a->n < 2) {                                                            \
+      *a->out = a->n;                                                          \
+      return;                                                                  \
+    }                                                                          \
+    uint64_t x, y;                                                             \
+    MemTaskGroup group = {0};                                                  \
+    FibArgs left = {a->n - 1, &x};                                             \
+    spawn(sched, &group, prefix##_fib, &left, sizeof(left));                   \
+    prefix##_fib(sched, &(FibArgs){a->n - 2, &y});                             \
+    wait(sched, &group);                                                       \
+    *a->out = x + y;                                                           \
+  }                                                                            \
+  static void prefix##_queens(Sched *sched, void *arg) {                       \
+    QueensArgs *a = arg;                                                       \
+    if (a->row == a->n) {                                                      \
+      *a->out = 1;                                                             \
+      return;                                                                  \
+    }                                                                          \
+    uint64_t found[16] = {0};                                                  \
+    MemTaskGroup group = {0};                                                  \
+    for (int col = 0; col < a->n; ++col) {                                     \
+      if (queens_safe(a->cols, a->row, col)) {                                 \
+        QueensArgs next = *a;                                                  \
+        next.cols[a->row] = (int8_t)col;                                       \
+        next.row++;                                                            \
+        next.out = &found[col];                                                \
+        spawn(sched, &group, prefix##_queens, &next, sizeof(next));            \
+      }                                                                        \
+    }                                                                          \
+    wait(sched, &group);                                                       \
+    uint64_t total = 0;                                                        \
+    for (int col = 0; col < a->n; ++col) {                                     \
+      total += found[col];                                                     \
+    }                                                                          \
+    *a->out = total;                                                           \
+  }                                                                            \
+  static void prefix##_sort(Sched *sched, void *arg) {                         \
+    SortArgs *a = arg;                                                         \
+    if (a->n <= SORT_CUTOFF) {                                                 \
+      qsort(a->data, a->n, sizeof(uint32_t), compare_u32);                     \
+      return;                                                                  \
+    }                                                                          \
+    size_t half = a->n / 2;                                                    \
+    MemTaskGroup group = {0};                                                  \
+    SortArgs left = {a->data, a->tmp, half};                                   \
+    spawn(sched, &group, prefix##_sort, &left, sizeof(left));                  \
+    prefix##_sort(sched, &(SortArgs){a->data + half, a->tmp + half,            \
+                                     a->n - half});                            \
+    wait(sched, &group);                                                       \
+    merge(a->data, a->tmp, a->n);                                              \
+  }
+
+#define QUEUE_SPAWN(sched, group, fn, arg, size)                               \
+  queue_spawn((sched), (group), (void (*)(void *, void *))(fn), (arg), (size))
+
+KERNELS(ws, MemScheduler, mem_sched_spawn, mem_sched_wait)
+KERNELS(queue, Queue, QUEUE_SPAWN, queue_wait)
+
+static uint32_t *fill(uint32_t *data) {
+  uint64_t seed = 88172645463325252ull;
+  for (size_t i = 0; i < SORT_N; ++i) {
+    data[i] = (uint32_t)bench_rand(&seed);
+  }
+  return data;
+}
+
+static int sorted(const uint32_t *data) {
+  for (size_t i = 1; i < SORT_N; ++i) {
+    if (data[i - 1] > data[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  // One worker per CPU unless given on the command line
+  size_t n_workers = argc > 1 ? strtoul(argv[1], NULL, 10)
+                              : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_workers == 0) {
+    n_workers = 1;
+  }
+  uint32_t *data = malloc(SORT_N * sizeof(uint32_t));
+  uint32_t *tmp = malloc(SORT_N * sizeof(uint32_t));
+  uint64_t out;
+  int8_t cols[16];
+  size_t fib_tasks = fib_spawns(FIB_N);
+  size_t queens_tasks = queens_spawns(cols, QUEENS_N, 0);
+  size_t sort_tasks = sort_spawns(SORT_N);
+  printf("%zu workers\n", n_workers);
+
+  MemScheduler *sched = mem_sched_init(n_workers, 4096, 0);
+  double start = bench_now();
+  mem_sched_run(sched, ws_fib, &(FibArgs){FIB_N, &out});
+  bench_report("fib(27), work stealing", bench_now() - start, fib_tasks);
+  BENCH_KEEP(out);
+  start = bench_now();
+  mem_sched_run(sched, ws_queens, &(QueensArgs){.n = QUEENS_N, .out = &out});
+  bench_report("nqueens(10), work stealing", bench_now() - start, queens_tasks);
+  BENCH_KEEP(out);
+  fill(data);
+  start = bench_now();
+  mem_sched_run(sched, ws_sort, &(SortArgs){data, tmp, SORT_N});
+  bench_report("sort 2M, work stealing", bench_now() - start, sort_tasks);
+  if (!sorted(data)) {
+    printf("not sorted\n");
+    return 1;
+  }
+  mem_sched_deinit(sched);
+
+  // The calling thread takes part through queue_wait, like a worker
+  Queue queue = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 1};
+  pthread_t *threads = malloc(n_workers * sizeof(pthread_t));
+  for (size_t i = 1; i < n_workers; ++i) {
+    pthread_create(&threads[i], NULL, queue_worker, &queue);
+  }
+  start = bench_now();
+  queue_fib(&queue, &(FibArgs){FIB_N, &out});
+  bench_report("fib(27), mutex queue", bench_now() - start, fib_tasks);
+  BENCH_KEEP(out);
+  start = bench_now();
+  queue_queens(&queue, &(QueensArgs){.n = QUEENS_N, .out = &out});
+  bench_report("nqueens(10), mutex queue", bench_now() - start, queens_tasks);
+  BENCH_KEEP(out);
+  fill(data);
+  start = bench_now();
+  queue_sort(&queue, &(SortArgs){data, tmp, SORT_N});
+  bench_report("sort 2M, mutex queue", bench_now() - start, sort_tasks);
+  if (!sorted(data)) {
+    printf("not sorted\n");
+    return 1;
+  }
+  pthread_mutex_lock(&queue.lock);
+  queue.running = 0;
+  pthread_cond_broadcast(&queue.wakeup);
+  pthread_mutex_unlock(&queue.lock);
+  for (size_t i = 1; i < n_workers; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  free(tmp);
+  free(data);
+  return 0;
+}
@@ -0,0 +1,174 @@
+// 10 million connection timeouts: every new connection schedules a timeout
+// of 10000 to 20000 ticks, most connections close (cancel) or see activity
+// (reschedule) before it fires, and the clock moves one tick every 100
+// connections, so about a million timers are pending at any time. The timer
+// wheel against a binary min-heap of malloc'ed timers, the usual
+// priority-queue approach. Times are per connection.
+#define POOL_IMPL
+#define TIMER_WHEEL_IMPL
+#include "timer_wheel.h"
+
+#include "bench.h"
+
+#define CONNECTIONS 10000000
+#define PER_TICK 100
+#define CANCEL_PERCENT 70
+#define RESCHEDULE_PERCENT 20
+
+static void **handles;   // Timer of every connection
+static uint32_t *live;   // Connections with a pending timer
+static uint32_t *where;  // Position of every connection in live
+static size_t n_live;
+static uint64_t fired;
+
+static void live_remove(uint32_t id) {
+  uint32_t last = live[--n_live];
+  live[where[id]] = last;
+  where[last] = where[id];
+}
+
+typedef struct {
+  uint64_t expires;
+  uint32_t id;
+  size_t index;
+} HeapTimer;
+
+static HeapTimer **heap;
+static size_t heap_size;
+
+static void heap_swap(size_t a, size_t b) {
+  HeapTimer *timer = heap[a];
+  heap[a] = heap[b];
+  heap[b] = timer;
+  heap[a]->index = a;
+  heap[b]->index = b;
+}
+
+static void heap_fix(size_t i) {
+  while (i > 0 && heap[(i - 1) / 2]->expires > heap[i]->expires) {
+    heap_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+  for (;;) {
+    size_t smallest = i;
+    size_t left = 2 * i + 1;
+    if (left < heap_size && heap[left]->expires < heap[smallest]->expires) {
+      smallest = left;
+    }
+    if (left + 1 < heap_size &&
+        heap[left + 1]->expires < heap[smallest]->expires) {
+      smallest = left + 1;
+    }
+    if (smallest == i) {
+      return;
+    }
+    heap_swap(i, smallest);
+    i = smallest;
+  }
+}
+
+static void *heap_schedule(uint64_t expires, uint32_t id) {
+  HeapTimer *timer = malloc(sizeof(HeapTimer));
+  timer->expires = expires;
+  timer->id = id;
+  timer->index = heap_size;
+  heap[heap_size++] = timer;
+  heap_fix(timer->index);
+  return timer;
+}
+
+static void heap_remove(HeapTimer *timer) {
+  size_t i = timer->index;
+  heap_swap(i, --heap_size);
+  if (i < heap_size) {
+    heap_fix(i);
+  }
+  free(timer);
+}
+
+static void heap_reschedule(HeapTimer *timer, uint64_t expires) {
+  timer->expires = expires;
+  heap_fix(timer->index);
+}
+
+static void heap_advance(uint64_t now) {
+  while (heap_size > 0 && heap[0]->expires <= now) {
+    HeapTimer *timer = heap[0];
+    live_remove(timer->id);
+    heap_remove(timer);
+    fired++;
+  }
+}
+
+static MemTimerWheel *wheel;
+
+static void on_timeout(MemTimerWheel *owner, void *arg) {
+  (void)owner;
+  live_remove((uint32_t)(uintptr_t)arg);
+  fired++;
+}
+
+static void *wheel_schedule(uint64_t expires, uint32_t id) {
+  return mem_wheel_schedule(wheel, expires, on_timeout, (void *)(uintptr_t)id);
+}
+
+static void wheel_remove(void *timer) { mem_wheel_cancel(wheel, timer); }
+
+static void wheel_reschedule(void *timer, uint64_t expires) {
+  mem_wheel_reschedule(wheel, timer, expires);
+}
+
+static void wheel_advance(uint64_t now) { mem_wheel_advance(wheel, now); }
+
+#define WORKLOAD(schedule, remove, reschedule, advance)                       \
+  do {                                                                        \
+    uint64_t seed = 88172645463325252ull;                                     \
+    uint64_t now = 0;                                                         \
+    n_live = 0;                                                               \
+    fired = 0;                                                                \
+    for (uint32_t id = 0; id < CONNECTIONS; ++id) {                           \
+      uint64_t r = bench_rand(&seed);                                         \
+      handles[id] = schedule(now + 10000 + r % 10000, id);                    \
+      where[id] = (uint32_t)n_live;                                           \
+      live[n_live++] = id;                                                    \
+      uint32_t other = live[(r >> 16) % n_live];                              \
+      unsigned dice = (unsigned)(r >> 48) % 100;                              \
+      if (dice < CANCEL_PERCENT) {                                            \
+        remove(handles[other]);                                               \
+        live_remove(other);                                                   \
+      } else if (dice < CANCEL_PERCENT + RESCHEDULE_PERCENT) {                \
+        reschedule(handles[other], now + 10000 + (r >> 32) % 10000);          \
+      }                                                                       \
+      if (id % PER_TICK == 0) {                                               \
+        advance(++now);                                                       \
+      }                                                                       \
+    }                                                                         \
+  } while (0)
+
+int main(void) {
+  handles = malloc(CONNECTIONS * sizeof(void *));
+  live = malloc(CONNECTIONS * sizeof(uint32_t));
+  where = malloc(CONNECTIONS * sizeof(uint32_t));
+  heap = malloc(CONNECTIONS * sizeof(HeapTimer *));
+
+  wheel = mem_wheel_init(0, 65536);
+  double start = bench_now();
+  WORKLOAD(wheel_schedule, wheel_remove, wheel_reschedule, wheel_advance);
+  bench_report("timer wheel", bench_now() - start, CONNECTIONS);
+  printf("  %llu fired, %zu pending\n", (unsigned long long)fired,
+         mem_wheel_count(wheel));
+  mem_wheel_deinit(wheel);
+
+  start = bench_now();
+  WORKLOAD(heap_schedule, heap_remove, heap_reschedule, heap_advance);
+  bench_report("min-heap + malloc", bench_now() - start, CONNECTIONS);
+  printf("  %llu fired, %zu pending\n", (unsigned long long)fired, heap_size);
+  while (heap_size > 0) {
+    heap_remove(heap[0]);
+  }
+  free(heap);
+  free(where);
+  free(live);
+  free(handles);
+  return 0;
+}
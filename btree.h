@@ -0,0 +1,610 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+/**
+ * STB-style implementation of an in-memory B+tree mapping 64 bits keys to 64
+ * bits values, ordered by key. The nodes are MEM_BTREE_NODE_BYTES bytes (a
+ * multiple of the cache line size), inner nodes and leaves are carved from
+ * two dedicated sets of MemPools, so a tree of n keys makes about
+ * n / MEM_BTREE_LEAF_KEYS pool allocations instead of n mallocs, and the
+ * leaves are chained for range scans.
+ *
+ * The search inside a node counts the keys smaller (or greater) than the
+ * searched one with SIMD compares when the target supports them (AVX2, or
+ * SSE4.2 for the 64 bits compare), with a branchless scalar loop otherwise.
+ *
+ * 'mem_btree_init' -> Creates an empty tree, the node pools grow
+ * nodes_per_pool nodes at a time.
+ *
+ * 'mem_btree_insert' -> Inserts a key or updates its value.
+ *
+ * 'mem_btree_get' -> Looks a key up.
+ *
+ * 'mem_btree_scan' -> Visits the keys in [lo, hi] in order.
+ *
+ * 'mem_btree_bulk_load' -> Builds an empty tree from sorted keys bottom up,
+ * filling the nodes evenly. The level by level bookkeeping is allocated from
+ * the given arena, which the caller can reset once the call returns.
+ *
+ * 'mem_btree_deinit' -> Frees the tree and all of its nodes.
+ *
+ * @note Keys can't be removed. Not thread safe. The nodes live in MemPools
+ * and bulk loading takes a MemArena, so POOL_IMPL and ARENA_IMPL have to be
+ * defined once as well.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena_allocator.h"
+#include "pool_allocator.h"
+
+// Size of every node, keep it a multiple of the cache line size
+#ifndef MEM_BTREE_NODE_BYTES
+#define MEM_BTREE_NODE_BYTES 256
+#endif
+
+#define MEM_BTREE_LEAF_KEYS ((MEM_BTREE_NODE_BYTES - 16) / 16)
+#define MEM_BTREE_INNER_KEYS ((MEM_BTREE_NODE_BYTES - 16) / 16)
+
+// More than enough levels for any tree that fits in memory
+#define MEM_BTREE_MAX_HEIGHT 32
+
+/**
+ * @param count number of keys
+ * @param next next leaf, in key order
+ * @param keys sorted keys
+ * @param values value of every key
+ */
+typedef struct MemBtreeLeaf {
+  uint32_t count;
+  struct MemBtreeLeaf *next;
+  uint64_t keys[MEM_BTREE_LEAF_KEYS];
+  uint64_t values[MEM_BTREE_LEAF_KEYS];
+} MemBtreeLeaf;
+
+/**
+ * @param count number of keys, the node has count + 1 children
+ * @param keys separators, keys[i] is the smallest key of children[i + 1]
+ * @param children inner nodes or leaves, depending on the level
+ */
+typedef struct {
+  uint64_t count;
+  uint64_t keys[MEM_BTREE_INNER_KEYS];
+  void *children[MEM_BTREE_INNER_KEYS + 1];
+} MemBtreeInner;
+
+/**
+ * @param root root node, a leaf when height is 1
+ * @param height number of levels, 0 for an empty tree
+ * @param size number of keys
+ * @param first leftmost leaf
+ * @param leaf_pools pools of the leaves
+ * @param n_leaf_pools number of leaf pools
+ * @param inner_pools pools of the inner nodes
+ * @param n_inner_pools number of inner pools
+ * @param nodes_per_pool number of nodes of every new pool
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  void *root;
+  size_t height;
+  size_t size;
+  MemBtreeLeaf *first;
+  MemPool **leaf_pools;
+  size_t n_leaf_pools;
+  MemPool **inner_pools;
+  size_t n_inner_pools;
+  size_t nodes_per_pool;
+} MemBtree;
+
+/**
+ * Called on every key of a range scan
+ * @param key key of the entry
+ * @param value value of the entry
+ * @param ctx user context passed to 'mem_btree_scan'
+ * @return 1 to keep scanning, 0 to stop.
+ */
+typedef int (*MemBtreeVisit)(uint64_t key, uint64_t value, void *ctx);
+
+/**
+ * Heap allocates a new empty tree
+ * @param nodes_per_pool nodes added to a pool set when it runs out of them
+ * @return pointer to the tree, or NULL on failure
+ */
+MemBtree *mem_btree_init(size_t nodes_per_pool);
+
+/**
+ * Inserts a key, or updates its value if it's already there
+ * @param tree tree we are writing
+ * @param key key of the entry
+ * @param value value of the entry
+ * @return 1 if the call succeded, 0 otherwise (out of memory).
+ */
+int mem_btree_insert(MemBtree *tree, uint64_t key, uint64_t value);
+
+/**
+ * Looks a key up
+ * @param tree tree we are reading
+ * @param key key we are looking for
+ * @param value where the value is stored if the key is found, can be NULL
+ * @return 1 if the key was found, 0 otherwise.
+ */
+int mem_btree_get(const MemBtree *tree, uint64_t key, uint64_t *value);
+
+/**
+ * Visits the keys in [lo, hi] in increasing order
+ * @param tree tree we are reading
+ * @param lo smallest key visited
+ * @param hi biggest key visited
+ * @param visit callback called on every key
+ * @param ctx user context passed to visit
+ * @return number of keys visited
+ */
+size_t mem_btree_scan(const MemBtree *tree, uint64_t lo, uint64_t hi,
+                      MemBtreeVisit visit, void *ctx);
+
+/**
+ * Builds an empty tree from sorted keys
+ * @param tree tree we are loading, it must be empty
+ * @param keys strictly increasing keys
+ * @param values value of every key
+ * @param n number of keys
+ * @param scratch arena the temporary arrays are allocated from
+ * @return 1 if the call succeded, 0 otherwise (the tree stays empty).
+ */
+int mem_btree_bulk_load(MemBtree *tree, const uint64_t *keys,
+                        const uint64_t *values, size_t n, MemArena *scratch);
+
+/**
+ * Gives the number of keys in the tree
+ * @param tree tree we are interested in
+ * @return number of keys
+ */
+size_t mem_btree_size(const MemBtree *tree);
+
+/**
+ * Frees the memory related to the tree passed as parameter
+ * @param tree tree we are freeing
+ */
+void mem_btree_deinit(MemBtree *tree);
+
+#endif // BTREE_H
+
+#ifdef BTREE_IMPL
+
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+// Number of keys smaller than key (greater, if greater is set), the keys
+// are sorted so it's also the position of the first key not smaller
+static uint32_t mem_btree_count(const uint64_t *keys, uint32_t n, uint64_t key,
+                                int greater) {
+  uint32_t i = 0;
+  uint32_t count = 0;
+#if defined(__AVX2__)
+  // Signed compares only, flipping the sign bit makes them unsigned
+  const __m256i flip = _mm256_set1_epi64x(INT64_MIN);
+  __m256i k = _mm256_xor_si256(_mm256_set1_epi64x((int64_t)key), flip);
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_xor_si256(
+        _mm256_loadu_si256((const __m256i *)(keys + i)), flip);
+    __m256i gt = greater ? _mm256_cmpgt_epi64(v, k) : _mm256_cmpgt_epi64(k, v);
+    count += (uint32_t)__builtin_popcount(
+        _mm256_movemask_pd(_mm256_castsi256_pd(gt)));
+  }
+#elif defined(__SSE4_2__)
+  const __m128i flip = _mm_set1_epi64x(INT64_MIN);
+  __m128i k = _mm_xor_si128(_mm_set1_epi64x((int64_t)key), flip);
+  for (; i + 2 <= n; i += 2) {
+    __m128i v =
+        _mm_xor_si128(_mm_loadu_si128((const __m128i *)(keys + i)), flip);
+    __m128i gt = greater ? _mm_cmpgt_epi64(v, k) : _mm_cmpgt_epi64(k, v);
+    count += (uint32_t)__builtin_popcount(
+        _mm_movemask_pd(_mm_castsi128_pd(gt)));
+  }
+#endif
+  for (; i < n; ++i) {
+    count += greater ? keys[i] > key : keys[i] < key;
+  }
+  return count;
+}
+
+// Child of an inner node to follow for key
+static uint32_t mem_btree_child(const MemBtreeInner *inner, uint64_t key) {
+  // Separators equal to the key send it right
+  uint32_t count = (uint32_t)inner->count;
+  return count - mem_btree_count(inner->keys, count, key, 1);
+}
+
+static void *mem_btree_node_alloc(MemPool ***pools, size_t *n_pools,
+                                  size_t nodes_per_pool, size_t node_size) {
+  void *node = *n_pools > 0 ? mem_pool_alloc((*pools)[*n_pools - 1]) : NULL;
+  if (node != NULL) {
+    return node;
+  }
+  MemPool **grown = realloc(*pools, (*n_pools + 1) * sizeof(MemPool *));
+  if (grown == NULL) {
+    return NULL;
+  }
+  *pools = grown;
+  // Nodes are only freed with the whole tree, LIFO is a plain O(1) bump
+  MemPool *pool =
+      mem_pool_init_ex(node_size, nodes_per_pool, MEM_POOL_REUSE_LIFO);
+  if (pool == NULL) {
+    return NULL;
+  }
+  (*pools)[(*n_pools)++] = pool;
+  return mem_pool_alloc(pool);
+}
+
+static void mem_btree_node_free(MemPool **pools, size_t n_pools, void *node) {
+  for (size_t i = n_pools; node != NULL && i > 0; --i) {
+    if (mem_pool_owns(pools[i - 1], node)) {
+      mem_pool_free(pools[i - 1], node);
+      return;
+    }
+  }
+}
+
+static MemBtreeLeaf *mem_btree_leaf_alloc(MemBtree *tree) {
+  MemBtreeLeaf *leaf =
+      mem_btree_node_alloc(&tree->leaf_pools, &tree->n_leaf_pools,
+                           tree->nodes_per_pool, sizeof(MemBtreeLeaf));
+  if (leaf != NULL) {
+    leaf->count = 0;
+    leaf->next = NULL;
+  }
+  return leaf;
+}
+
+static MemBtreeInner *mem_btree_inner_alloc(MemBtree *tree) {
+  MemBtreeInner *inner =
+      mem_btree_node_alloc(&tree->inner_pools, &tree->n_inner_pools,
+                           tree->nodes_per_pool, sizeof(MemBtreeInner));
+  if (inner != NULL) {
+    inner->count = 0;
+  }
+  return inner;
+}
+
+// Drops every node, the tree is empty again
+static void mem_btree_clear(MemBtree *tree) {
+  for (size_t i = 0; i < tree->n_leaf_pools; ++i) {
+    mem_pool_deinit(tree->leaf_pools[i]);
+  }
+  for (size_t i = 0; i < tree->n_inner_pools; ++i) {
+    mem_pool_deinit(tree->inner_pools[i]);
+  }
+  free(tree->leaf_pools);
+  free(tree->inner_pools);
+  tree->leaf_pools = NULL;
+  tree->inner_pools = NULL;
+  tree->n_leaf_pools = 0;
+  tree->n_inner_pools = 0;
+  tree->root = NULL;
+  tree->first = NULL;
+  tree->height = 0;
+  tree->size = 0;
+}
+
+MemBtree *mem_btree_init(size_t nodes_per_pool) {
+  if (nodes_per_pool == 0) {
+    return NULL;
+  }
+  MemBtree *tree = calloc(1, sizeof(MemBtree));
+  if (tree == NULL) {
+    return NULL;
+  }
+  tree->nodes_per_pool = nodes_per_pool;
+  return tree;
+}
+
+static const MemBtreeLeaf *mem_btree_find_leaf(const MemBtree *tree,
+                                               uint64_t key) {
+  const void *node = tree->root;
+  for (size_t level = tree->height; level > 1; --level) {
+    const MemBtreeInner *inner = node;
+    node = inner->children[mem_btree_child(inner, key)];
+  }
+  return node;
+}
+
+int mem_btree_get(const MemBtree *tree, uint64_t key, uint64_t *value) {
+  if (tree == NULL || tree->root == NULL) {
+    return 0;
+  }
+  const MemBtreeLeaf *leaf = mem_btree_find_leaf(tree, key);
+  uint32_t pos = mem_btree_count(leaf->keys, leaf->count, key, 0);
+  if (pos == leaf->count || leaf->keys[pos] != key) {
+    return 0;
+  }
+  if (value != NULL) {
+    *value = leaf->values[pos];
+  }
+  return 1;
+}
+
+// Inserts separator and right child at pos in a non full inner node
+static void mem_btree_inner_put(MemBtreeInner *inner, uint32_t pos,
+                                uint64_t separator, void *right) {
+  uint32_t count = (uint32_t)inner->count;
+  memmove(&inner->keys[pos + 1], &inner->keys[pos],
+          (count - pos) * sizeof(uint64_t));
+  memmove(&inner->children[pos + 2], &inner->children[pos + 1],
+          (count - pos) * sizeof(void *));
+  inner->keys[pos] = separator;
+  inner->children[pos + 1] = right;
+  inner->count = count + 1;
+}
+
+int mem_btree_insert(MemBtree *tree, uint64_t key, uint64_t value) {
+  if (tree == NULL) {
+    return 0;
+  }
+  if (tree->root == NULL) {
+    MemBtreeLeaf *leaf = mem_btree_leaf_alloc(tree);
+    if (leaf == NULL) {
+      return 0;
+    }
+    tree->root = leaf;
+    tree->first = leaf;
+    tree->height = 1;
+  }
+  MemBtreeInner *path[MEM_BTREE_MAX_HEIGHT];
+  uint32_t slots[MEM_BTREE_MAX_HEIGHT];
+  void *node = tree->root;
+  size_t depth = 0;
+  for (size_t level = tree->height; level > 1; --level) {
+    MemBtreeInner *inner = node;
+    path[depth] = inner;
+    slots[depth] = mem_btree_child(inner, key);
+    node = inner->children[slots[depth++]];
+  }
+  MemBtreeLeaf *leaf = node;
+  uint32_t pos = mem_btree_count(leaf->keys, leaf->count, key, 0);
+  if (pos < leaf->count && leaf->keys[pos] == key) {
+    leaf->values[pos] = value;
+    return 1;
+  }
+  if (leaf->count == MEM_BTREE_LEAF_KEYS) {
+    // Allocate every node the split may need first, a failure then leaves
+    // the tree untouched. Spares go back to the pools.
+    size_t full = 0;
+    while (full < depth &&
+           path[depth - 1 - full]->count == MEM_BTREE_INNER_KEYS) {
+      full++;
+    }
+    MemBtreeLeaf *right = mem_btree_leaf_alloc(tree);
+    MemBtreeInner *spare[MEM_BTREE_MAX_HEIGHT + 1];
+    size_t n_spare = 0;
+    int ok = right != NULL;
+    // One per full ancestor, plus a new root if they are all full
+    size_t needed = full + (full == depth);
+    while (ok && n_spare < needed) {
+      spare[n_spare] = mem_btree_inner_alloc(tree);
+      ok = spare[n_spare] != NULL;
+      n_spare += ok;
+    }
+    if (!ok) {
+      mem_btree_node_free(tree->leaf_pools, tree->n_leaf_pools, right);
+      while (n_spare > 0) {
+        mem_btree_node_free(tree->inner_pools, tree->n_inner_pools,
+                            spare[--n_spare]);
+      }
+      return 0;
+    }
+
+    // Split the leaf, the new key goes in the half it belongs to
+    uint32_t half = (MEM_BTREE_LEAF_KEYS + 1) / 2;
+    right->count = MEM_BTREE_LEAF_KEYS - half;
+    memcpy(right->keys, &leaf->keys[half], right->count * sizeof(uint64_t));
+    memcpy(right->values, &leaf->values[half],
+           right->count * sizeof(uint64_t));
+    leaf->count = half;
+    right->next = leaf->next;
+    leaf->next = right;
+    MemBtreeLeaf *target = leaf;
+    if (pos > half) {
+      target = right;
+      pos -= half;
+    }
+    memmove(&target->keys[pos + 1], &target->keys[pos],
+            (target->count - pos) * sizeof(uint64_t));
+    memmove(&target->values[pos + 1], &target->values[pos],
+            (target->count - pos) * sizeof(uint64_t));
+    target->keys[pos] = key;
+    target->values[pos] = value;
+    target->count++;
+
+    // Push the separator up, splitting the full ancestors on the way
+    uint64_t separator = right->keys[0];
+    void *child = right;
+    while (depth > 0) {
+      MemBtreeInner *inner = path[--depth];
+      uint32_t slot = slots[depth];
+      if (inner->count < MEM_BTREE_INNER_KEYS) {
+        mem_btree_inner_put(inner, slot, separator, child);
+        child = NULL;
+        break;
+      }
+      uint64_t keys[MEM_BTREE_INNER_KEYS + 1];
+      void *children[MEM_BTREE_INNER_KEYS + 2];
+      memcpy(keys, inner->keys, slot * sizeof(uint64_t));
+      keys[slot] = separator;
+      memcpy(&keys[slot + 1], &inner->keys[slot],
+             (MEM_BTREE_INNER_KEYS - slot) * sizeof(uint64_t));
+      memcpy(children, inner->children, (slot + 1) * sizeof(void *));
+      children[slot + 1] = child;
+      memcpy(&children[slot + 2], &inner->children[slot + 1],
+             (MEM_BTREE_INNER_KEYS - slot) * sizeof(void *));
+      uint32_t mid = (MEM_BTREE_INNER_KEYS + 1) / 2;
+      MemBtreeInner *sibling = spare[--n_spare];
+      inner->count = mid;
+      memcpy(inner->keys, keys, mid * sizeof(uint64_t));
+      memcpy(inner->children, children, (mid + 1) * sizeof(void *));
+      sibling->count = MEM_BTREE_INNER_KEYS - mid;
+      memcpy(sibling->keys, &keys[mid + 1],
+             sibling->count * sizeof(uint64_t));
+      memcpy(sibling->children, &children[mid + 1],
+             (sibling->count + 1) * sizeof(void *));
+      separator = keys[mid];
+      child = sibling;
+    }
+    if (child != NULL) {
+      MemBtreeInner *root = spare[--n_spare];
+      root->count = 1;
+      root->keys[0] = separator;
+      root->children[0] = tree->root;
+      root->children[1] = child;
+      tree->root = root;
+      tree->height++;
+    }
+  } else {
+    memmove(&leaf->keys[pos + 1], &leaf->keys[pos],
+            (leaf->count - pos) * sizeof(uint64_t));
+    memmove(&leaf->values[pos + 1], &leaf->values[pos],
+            (leaf->count - pos) * sizeof(uint64_t));
+    leaf->keys[pos] = key;
+    leaf->values[pos] = value;
+    leaf->count++;
+  }
+  tree->size++;
+  return 1;
+}
+
+size_t mem_btree_scan(const MemBtree *tree, uint64_t lo, uint64_t hi,
+                      MemBtreeVisit visit, void *ctx) {
+  if (tree == NULL || tree->root == NULL || visit == NULL || lo > hi) {
+    return 0;
+  }
+  const MemBtreeLeaf *leaf = mem_btree_find_leaf(tree, lo);
+  uint32_t pos = mem_btree_count(leaf->keys, leaf->count, lo, 0);
+  size_t visited = 0;
+  while (leaf != NULL) {
+    for (; pos < leaf->count; ++pos) {
+      if (leaf->keys[pos] > hi) {
+        return visited;
+      }
+      visited++;
+      if (!visit(leaf->keys[pos], leaf->values[pos], ctx)) {
+        return visited;
+      }
+    }
+    leaf = leaf->next;
+    pos = 0;
+  }
+  return visited;
+}
+
+// The arena doesn't align, round the pointer up ourselves
+static void *mem_btree_scratch(MemArena *scratch, size_t bytes) {
+  uint8_t *ptr = mem_arena_alloc(scratch, bytes + sizeof(uint64_t) - 1);
+  if (ptr == NULL) {
+    return NULL;
+  }
+  return (void *)(((uintptr_t)ptr + sizeof(uint64_t) - 1) &
+                  ~(uintptr_t)(sizeof(uint64_t) - 1));
+}
+
+int mem_btree_bulk_load(MemBtree *tree, const uint64_t *keys,
+                        const uint64_t *values, size_t n, MemArena *scratch) {
+  if (tree == NULL || tree->root != NULL || scratch == NULL ||
+      (n > 0 && (keys == NULL || values == NULL))) {
+    return 0;
+  }
+  for (size_t i = 1; i < n; ++i) {
+    if (keys[i - 1] >= keys[i]) {
+      return 0;
+    }
+  }
+  if (n == 0) {
+    return 1;
+  }
+
+  // Leaves first, the n keys spread evenly over as few leaves as possible
+  size_t count = (n + MEM_BTREE_LEAF_KEYS - 1) / MEM_BTREE_LEAF_KEYS;
+  void **nodes = mem_btree_scratch(scratch, count * sizeof(void *));
+  uint64_t *lows = mem_btree_scratch(scratch, count * sizeof(uint64_t));
+  if (nodes == NULL || lows == NULL) {
+    return 0;
+  }
+  MemBtreeLeaf *prev = NULL;
+  size_t next_key = 0;
+  for (size_t i = 0; i < count; ++i) {
+    MemBtreeLeaf *leaf = mem_btree_leaf_alloc(tree);
+    if (leaf == NULL) {
+      mem_btree_clear(tree);
+      return 0;
+    }
+    leaf->count = (uint32_t)(n / count + (i < n % count));
+    memcpy(leaf->keys, &keys[next_key], leaf->count * sizeof(uint64_t));
+    memcpy(leaf->values, &values[next_key], leaf->count * sizeof(uint64_t));
+    next_key += leaf->count;
+    if (prev != NULL) {
+      prev->next = leaf;
+    } else {
+      tree->first = leaf;
+    }
+    prev = leaf;
+    nodes[i] = leaf;
+    lows[i] = leaf->keys[0];
+  }
+  tree->height = 1;
+
+  // Then the inner levels, until a single node is left
+  while (count > 1) {
+    size_t fanout = MEM_BTREE_INNER_KEYS + 1;
+    size_t parents = (count + fanout - 1) / fanout;
+    void **up_nodes = mem_btree_scratch(scratch, parents * sizeof(void *));
+    uint64_t *up_lows = mem_btree_scratch(scratch, parents * sizeof(uint64_t));
+    if (up_nodes == NULL || up_lows == NULL) {
+      mem_btree_clear(tree);
+      return 0;
+    }
+    size_t next_child = 0;
+    for (size_t i = 0; i < parents; ++i) {
+      MemBtreeInner *inner = mem_btree_inner_alloc(tree);
+      if (inner == NULL) {
+        mem_btree_clear(tree);
+        return 0;
+      }
+      size_t children = count / parents + (i < count % parents);
+      inner->count = children - 1;
+      for (size_t c = 0; c < children; ++c) {
+        inner->children[c] = nodes[next_child + c];
+        if (c > 0) {
+          inner->keys[c - 1] = lows[next_child + c];
+        }
+      }
+      up_nodes[i] = inner;
+      up_lows[i] = lows[next_child];
+      next_child += children;
+    }
+    nodes = up_nodes;
+    lows = up_lows;
+    count = parents;
+    tree->height++;
+  }
+  tree->root = nodes[0];
+  tree->size = n;
+  return 1;
+}
+
+size_t mem_btree_size(const MemBtree *tree) {
+  return tree != NULL ? tree->size : 0;
+}
+
+void mem_btree_deinit(MemBtree *tree) {
+  if (tree != NULL) {
+    mem_btree_clear(tree);
+    free(tree);
+  }
+}
+
+#endif // BTREE_IMPL
@@ -0,0 +1,542 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+/**
+ * STB-style implementation of bounded lock-free rings and of a zero-copy
+ * message channel built on them and on 'pool_allocator.h'.
+ *
+ * Rings (they carry pointers):
+ *
+ * 'mem_spsc_init' -> Single producer, single consumer ring. Each side keeps
+ * a cached copy of the other side index, so it only touches the shared cache
+ * line when the ring looks full (or empty).
+ *
+ * 'mem_mpsc_init' -> Multiple producers, single consumer ring. Every slot
+ * has a sequence number, producers claim slots with a CAS on the tail.
+ *
+ * 'push' / 'pop' -> Return 0 / NULL when the ring is full / empty, nobody
+ * ever waits. The SPSC ring also moves batches with a single publication.
+ *
+ * Channel (the payloads are MemPool chunks, only pointers are moved):
+ *
+ * 'mem_channel_init' -> Creates a channel with n_producers producers, each
+ * one owning a pool of payloads_per_producer payloads of payload_size bytes.
+ *
+ * 'mem_channel_acquire' -> A producer gets a payload to fill from its pool.
+ * When the pool is empty it first takes back the payloads the consumer has
+ * returned. Returns NULL if every payload is still in flight.
+ *
+ * 'mem_channel_send' -> The producer hands the payload over to the consumer,
+ * it must not touch it anymore.
+ *
+ * 'mem_channel_recv' -> The consumer gets the next payload, NULL if none is
+ * waiting.
+ *
+ * 'mem_channel_release' -> The consumer is done with a payload. Payloads
+ * are grouped per producer and sent back MEM_CHANNEL_RETURN_BATCH at a time
+ * through a return ring (an SPSC ring from the consumer to the producer), the
+ * groups are also flushed whenever 'mem_channel_recv' finds nothing to read.
+ *
+ * @note Producer i must always be the same thread, and so must the consumer.
+ * The payloads are MemPool chunks, so POOL_IMPL has to be defined once as
+ * well.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool_allocator.h"
+
+// Payloads the consumer collects for a producer before sending them back
+#ifndef MEM_CHANNEL_RETURN_BATCH
+#define MEM_CHANNEL_RETURN_BATCH 32
+#endif
+
+/**
+ * @param head next slot to read, written by the consumer
+ * @param cached_tail last tail seen by the consumer
+ * @param tail next slot to write, written by the producer
+ * @param cached_head last head seen by the producer
+ * @param slots items of the ring
+ * @param mask number of slots minus one
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  _Alignas(64) _Atomic size_t head;
+  size_t cached_tail;
+  _Alignas(64) _Atomic size_t tail;
+  size_t cached_head;
+  _Alignas(64) void **slots;
+  size_t mask;
+} MemSpscRing;
+
+/**
+ * @param seq sequence number telling whether the slot is free or full
+ * @param item item of the slot
+ */
+typedef struct {
+  _Atomic size_t seq;
+  void *item;
+} MemMpscCell;
+
+/**
+ * @param tail next slot claimed by the producers
+ * @param head next slot to read, only touched by the consumer
+ * @param cells slots of the ring
+ * @param mask number of slots minus one
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  _Alignas(64) _Atomic size_t tail;
+  _Alignas(64) size_t head;
+  MemMpscCell *cells;
+  size_t mask;
+} MemMpscRing;
+
+/**
+ * @param pool payloads owned by the producer
+ * @param returns payloads sent back by the consumer
+ * @param pending payloads released by the consumer, not yet sent back
+ * @param n_pending number of pending payloads
+ */
+typedef struct {
+  MemPool *pool;
+  MemSpscRing *returns;
+  void *pending[MEM_CHANNEL_RETURN_BATCH];
+  size_t n_pending;
+} MemChannelProducer;
+
+/**
+ * @param spsc ring of the channel when there is a single producer
+ * @param mpsc ring of the channel otherwise
+ * @param producers producer side state, one per producer
+ * @param n_producers number of producers
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  MemSpscRing *spsc;
+  MemMpscRing *mpsc;
+  MemChannelProducer *producers;
+  size_t n_producers;
+} MemChannel;
+
+/**
+ * Heap allocates a new SPSC ring
+ * @param capacity number of slots, rounded up to a power of two
+ * @return pointer to the ring, or NULL on failure
+ */
+MemSpscRing *mem_spsc_init(size_t capacity);
+
+/**
+ * Pushes an item, producer side
+ * @param ring ring we are writing
+ * @param item item to push, not NULL
+ * @return 1 if the call succeded, 0 if the ring is full.
+ */
+int mem_spsc_push(MemSpscRing *ring, void *item);
+
+/**
+ * Pushes up to n items with a single publication, producer side
+ * @param ring ring we are writing
+ * @param items items to push
+ * @param n number of items
+ * @return number of items pushed
+ */
+size_t mem_spsc_push_batch(MemSpscRing *ring, void *const *items, size_t n);
+
+/**
+ * Pops an item, consumer side
+ * @param ring ring we are reading
+ * @return the oldest item, or NULL if the ring is empty
+ */
+void *mem_spsc_pop(MemSpscRing *ring);
+
+/**
+ * Pops up to n items with a single publication, consumer side
+ * @param ring ring we are reading
+ * @param items where the items are stored
+ * @param n maximum number of items
+ * @return number of items popped
+ */
+size_t mem_spsc_pop_batch(MemSpscRing *ring, void **items, size_t n);
+
+/**
+ * Frees the memory related to the ring passed as parameter
+ * @param ring ring we are freeing
+ */
+void mem_spsc_deinit(MemSpscRing *ring);
+
+/**
+ * Heap allocates a new MPSC ring
+ * @param capacity number of slots, rounded up to a power of two
+ * @return pointer to the ring, or NULL on failure
+ */
+MemMpscRing *mem_mpsc_init(size_t capacity);
+
+/**
+ * Pushes an item, from any producer
+ * @param ring ring we are writing
+ * @param item item to push
+ * @return 1 if the call succeded, 0 if the ring is full.
+ */
+int mem_mpsc_push(MemMpscRing *ring, void *item);
+
+/**
+ * Pops an item, consumer side
+ * @param ring ring we are reading
+ * @return the oldest item, or NULL if the ring is empty
+ */
+void *mem_mpsc_pop(MemMpscRing *ring);
+
+/**
+ * Frees the memory related to the ring passed as parameter
+ * @param ring ring we are freeing
+ */
+void mem_mpsc_deinit(MemMpscRing *ring);
+
+/**
+ * Heap allocates a new channel
+ * @param n_producers number of producers
+ * @param capacity number of payloads the channel can hold in flight
+ * @param payload_size size of every payload
+ * @param payloads_per_producer number of payloads in every producer pool
+ * @return pointer to the channel, or NULL on failure
+ */
+MemChannel *mem_channel_init(size_t n_producers, size_t capacity,
+                             size_t payload_size, size_t payloads_per_producer);
+
+/**
+ * Gets an empty payload, producer side
+ * @param channel channel we are producing for
+ * @param producer index of the calling producer
+ * @return pointer to the payload, or NULL if they are all in flight
+ */
+void *mem_channel_acquire(MemChannel *channel, size_t producer);
+
+/**
+ * Sends a payload to the consumer, producer side
+ * @param channel channel we are producing for
+ * @param producer index of the calling producer
+ * @param payload payload from 'mem_channel_acquire'
+ * @return 1 if the call succeded, 0 if the channel is full (the producer
+ * still owns the payload).
+ */
+int mem_channel_send(MemChannel *channel, size_t producer, void *payload);
+
+/**
+ * Receives the next payload, consumer side
+ * @param channel channel we are consuming from
+ * @return pointer to the payload, or NULL if nothing is waiting
+ */
+void *mem_channel_recv(MemChannel *channel);
+
+/**
+ * Gives a payload back to its producer, consumer side
+ * @param channel channel we are consuming from
+ * @param payload payload from 'mem_channel_recv'
+ */
+void mem_channel_release(MemChannel *channel, void *payload);
+
+/**
+ * Sends every released payload back right away, consumer side
+ * @param channel channel we are consuming from
+ */
+void mem_channel_flush(MemChannel *channel);
+
+/**
+ * Frees the channel, its rings and all the payloads
+ * @param channel channel we are freeing
+ */
+void mem_channel_deinit(MemChannel *channel);
+
+#endif // CHANNEL_H
+
+#ifdef CHANNEL_IMPL
+
+static size_t mem_ring_slots(size_t capacity) {
+  size_t slots = 1;
+  while (slots < capacity) {
+    slots <<= 1;
+  }
+  return slots;
+}
+
+MemSpscRing *mem_spsc_init(size_t capacity) {
+  if (capacity == 0 || capacity > (SIZE_MAX >> 1)) {
+    return NULL;
+  }
+  MemSpscRing *ring = aligned_alloc(64, sizeof(MemSpscRing));
+  if (ring == NULL) {
+    return NULL;
+  }
+  size_t slots = mem_ring_slots(capacity);
+  ring->slots = calloc(slots, sizeof(void *));
+  if (ring->slots == NULL) {
+    free(ring);
+    return NULL;
+  }
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->cached_head = 0;
+  ring->cached_tail = 0;
+  ring->mask = slots - 1;
+  return ring;
+}
+
+size_t mem_spsc_push_batch(MemSpscRing *ring, void *const *items, size_t n) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t space = ring->mask + 1 - (tail - ring->cached_head);
+  if (space < n) {
+    ring->cached_head =
+        atomic_load_explicit(&ring->head, memory_order_acquire);
+    space = ring->mask + 1 - (tail - ring->cached_head);
+  }
+  if (n > space) {
+    n = space;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    ring->slots[(tail + i) & ring->mask] = items[i];
+  }
+  atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+  return n;
+}
+
+int mem_spsc_push(MemSpscRing *ring, void *item) {
+  return mem_spsc_push_batch(ring, &item, 1) == 1;
+}
+
+size_t mem_spsc_pop_batch(MemSpscRing *ring, void **items, size_t n) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t available = ring->cached_tail - head;
+  if (available < n) {
+    ring->cached_tail =
+        atomic_load_explicit(&ring->tail, memory_order_acquire);
+    available = ring->cached_tail - head;
+  }
+  if (n > available) {
+    n = available;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    items[i] = ring->slots[(head + i) & ring->mask];
+  }
+  atomic_store_explicit(&ring->head, head + n, memory_order_release);
+  return n;
+}
+
+void *mem_spsc_pop(MemSpscRing *ring) {
+  void *item;
+  return mem_spsc_pop_batch(ring, &item, 1) == 1 ? item : NULL;
+}
+
+void mem_spsc_deinit(MemSpscRing *ring) {
+  if (ring != NULL) {
+    free(ring->slots);
+    free(ring);
+  }
+}
+
+MemMpscRing *mem_mpsc_init(size_t capacity) {
+  if (capacity == 0 || capacity > (SIZE_MAX >> 1)) {
+    return NULL;
+  }
+  MemMpscRing *ring = aligned_alloc(64, sizeof(MemMpscRing));
+  if (ring == NULL) {
+    return NULL;
+  }
+  size_t slots = mem_ring_slots(capacity);
+  ring->cells = malloc(slots * sizeof(MemMpscCell));
+  if (ring->cells == NULL) {
+    free(ring);
+    return NULL;
+  }
+  // A cell is free for the producer whose position equals its sequence
+  for (size_t i = 0; i < slots; ++i) {
+    atomic_init(&ring->cells[i].seq, i);
+    ring->cells[i].item = NULL;
+  }
+  atomic_init(&ring->tail, 0);
+  ring->head = 0;
+  ring->mask = slots - 1;
+  return ring;
+}
+
+int mem_mpsc_push(MemMpscRing *ring, void *item) {
+  size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  MemMpscCell *cell;
+  for (;;) {
+    cell = &ring->cells[pos & ring->mask];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return 0; // The consumer hasn't freed this cell yet, the ring is full
+    } else {
+      pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    }
+  }
+  cell->item = item;
+  atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+  return 1;
+}
+
+void *mem_mpsc_pop(MemMpscRing *ring) {
+  MemMpscCell *cell = &ring->cells[ring->head & ring->mask];
+  size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+  if (seq != ring->head + 1) {
+    return NULL; // Empty, or the producer of this cell is still writing
+  }
+  void *item = cell->item;
+  // Free the cell for the producers of the next lap
+  atomic_store_explicit(&cell->seq, ring->head + ring->mask + 1,
+                        memory_order_release);
+  ring->head++;
+  return item;
+}
+
+void mem_mpsc_deinit(MemMpscRing *ring) {
+  if (ring != NULL) {
+    free(ring->cells);
+    free(ring);
+  }
+}
+
+MemChannel *mem_channel_init(size_t n_producers, size_t capacity,
+                             size_t payload_size,
+                             size_t payloads_per_producer) {
+  if (n_producers == 0 || payloads_per_producer == 0) {
+    return NULL;
+  }
+  MemChannel *channel = calloc(1, sizeof(MemChannel));
+  if (channel == NULL) {
+    return NULL;
+  }
+  channel->producers = calloc(n_producers, sizeof(MemChannelProducer));
+  if (channel->producers == NULL) {
+    free(channel);
+    return NULL;
+  }
+  channel->n_producers = n_producers;
+  if (n_producers == 1) {
+    channel->spsc = mem_spsc_init(capacity);
+  } else {
+    channel->mpsc = mem_mpsc_init(capacity);
+  }
+  if (channel->spsc == NULL && channel->mpsc == NULL) {
+    mem_channel_deinit(channel);
+    return NULL;
+  }
+  for (size_t i = 0; i < n_producers; ++i) {
+    MemChannelProducer *producer = &channel->producers[i];
+    // LIFO: the payload we hand out is the one most likely still in cache
+    producer->pool = mem_pool_init_ex(payload_size, payloads_per_producer,
+                                      MEM_POOL_REUSE_LIFO);
+    // Big enough for all the payloads, sending them back never fails
+    producer->returns = mem_spsc_init(payloads_per_producer);
+    if (producer->pool == NULL || producer->returns == NULL) {
+      mem_channel_deinit(channel);
+      return NULL;
+    }
+  }
+  return channel;
+}
+
+void *mem_channel_acquire(MemChannel *channel, size_t producer) {
+  if (channel == NULL || producer >= channel->n_producers) {
+    return NULL;
+  }
+  MemChannelProducer *self = &channel->producers[producer];
+  void *payload = mem_pool_alloc(self->pool);
+  if (payload == NULL) {
+    void *returned[MEM_CHANNEL_RETURN_BATCH];
+    size_t n;
+    while ((n = mem_spsc_pop_batch(self->returns, returned,
+                                   MEM_CHANNEL_RETURN_BATCH)) > 0) {
+      for (size_t i = 0; i < n; ++i) {
+        mem_pool_free(self->pool, returned[i]);
+      }
+    }
+    payload = mem_pool_alloc(self->pool);
+  }
+  return payload;
+}
+
+int mem_channel_send(MemChannel *channel, size_t producer, void *payload) {
+  if (channel == NULL || producer >= channel->n_producers || payload == NULL) {
+    return 0;
+  }
+  if (channel->spsc != NULL) {
+    return mem_spsc_push(channel->spsc, payload);
+  }
+  return mem_mpsc_push(channel->mpsc, payload);
+}
+
+void mem_channel_flush(MemChannel *channel) {
+  if (channel == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < channel->n_producers; ++i) {
+    MemChannelProducer *producer = &channel->producers[i];
+    if (producer->n_pending > 0) {
+      mem_spsc_push_batch(producer->returns, producer->pending,
+                          producer->n_pending);
+      producer->n_pending = 0;
+    }
+  }
+}
+
+void *mem_channel_recv(MemChannel *channel) {
+  if (channel == NULL) {
+    return NULL;
+  }
+  void *payload = channel->spsc != NULL ? mem_spsc_pop(channel->spsc)
+                                        : mem_mpsc_pop(channel->mpsc);
+  if (payload == NULL) {
+    // Idle, a good time to give the producers their payloads back
+    mem_channel_flush(channel);
+  }
+  return payload;
+}
+
+void mem_channel_release(MemChannel *channel, void *payload) {
+  if (channel == NULL || payload == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < channel->n_producers; ++i) {
+    MemChannelProducer *producer = &channel->producers[i];
+    if (mem_pool_owns(producer->pool, payload)) {
+      producer->pending[producer->n_pending++] = payload;
+      if (producer->n_pending == MEM_CHANNEL_RETURN_BATCH) {
+        mem_spsc_push_batch(producer->returns, producer->pending,
+                            producer->n_pending);
+        producer->n_pending = 0;
+      }
+      return;
+    }
+  }
+}
+
+void mem_channel_deinit(MemChannel *channel) {
+  if (channel != NULL) {
+    if (channel->producers != NULL) {
+      for (size_t i = 0; i < channel->n_producers; ++i) {
+        mem_pool_deinit(channel->producers[i].pool);
+        mem_spsc_deinit(channel->producers[i].returns);
+      }
+    }
+    mem_spsc_deinit(channel->spsc);
+    mem_mpsc_deinit(channel->mpsc);
+    free(channel->producers);
+    free(channel);
+  }
+}
+
+#endif // CHANNEL_IMPL
@@ -0,0 +1,260 @@
+#ifndef COMPOSE_ALLOC_H
+#define COMPOSE_ALLOC_H
+
+/**
+ * Building blocks to compose the allocators of this collection without
+ * writing the usual "try the pool, else the arena, else malloc" glue by hand.
+ * Every macro stamps out a small family of static inline functions sharing a
+ * prefix, so the composition is resolved by the compiler and a composed
+ * allocator costs the same as the hand written glue.
+ *
+ * Every allocator built with these macros exposes the same three functions:
+ *
+ *   void *name_alloc(size_t bytes);
+ *   void name_free(void *ptr, size_t bytes);
+ *   int name_owns(const void *ptr);
+ *
+ * 'name_free' takes the size passed to 'name_alloc', so compositions that
+ * pick an allocator by size (segregator, bucketizer) never search for the
+ * owner of a pointer.
+ *
+ * Thin wrappers, the instance is an expression evaluated on every call (a
+ * global pointer, usually):
+ *
+ * 'MEM_COMPOSE_POOL' -> Wraps a MemPool, requests bigger than the chunk size
+ * fail.
+ *
+ * 'MEM_COMPOSE_ARENA' -> Wraps a MemArena, freeing is a no-op.
+ *
+ * 'MEM_COMPOSE_STACK' -> Wraps a MemStack, freeing pops the bytes when the
+ * pointer is the last allocation and is a no-op otherwise.
+ *
+ * 'MEM_COMPOSE_MALLOC' -> Wraps malloc and free, it claims to own every
+ * pointer so it belongs at the end of a fallback chain.
+ *
+ * Compositions:
+ *
+ * 'MEM_FALLBACK' -> Tries the primary allocator, then the secondary one. A
+ * pointer is given back to the primary allocator if it owns it.
+ *
+ * 'MEM_SEGREGATOR' -> Requests up to threshold bytes go to the small
+ * allocator, bigger ones to the large allocator.
+ *
+ * 'MEM_BUCKETIZER' -> Requests in (min, max] go to an array of pools, one
+ * every step bytes: pools[i] serves the sizes in
+ * (min + i * step, min + (i + 1) * step]. Other sizes fail.
+ *
+ * 'MEM_AFFIX' / 'MEM_PREFIX' -> Puts an object of the prefix type before
+ * (and of the suffix type after) every allocation of the inner allocator,
+ * 'name_prefix' and 'name_suffix' give access to them. The user pointer is
+ * aligned to _Alignof(max_align_t) whatever the inner allocator: the inner
+ * block is MEM_COMPOSE_ALIGN bytes bigger and the prefix starts at the first
+ * aligned address past its first byte, the byte right before the prefix
+ * records how far that is.
+ *
+ * Example:
+ *
+ *   MemPool *small_pool;
+ *   MemArena *scratch;
+ *   MEM_COMPOSE_POOL(small, small_pool)
+ *   MEM_COMPOSE_ARENA(big, scratch)
+ *   MEM_COMPOSE_MALLOC(heap)
+ *   MEM_FALLBACK(big_or_heap, big, heap)
+ *   MEM_SEGREGATOR(alloc, 64, small, big_or_heap)
+ *
+ *   void *p = alloc_alloc(48);  // From small_pool
+ *   alloc_free(p, 48);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena_allocator.h"
+#include "pool_allocator.h"
+#include "stack_allocator.h"
+
+// Alignment kept by the prefix of 'MEM_AFFIX' and 'MEM_PREFIX'
+#define MEM_COMPOSE_ALIGN _Alignof(max_align_t)
+#define MEM_COMPOSE_ROUND(bytes, align)                                        \
+  (((bytes) + (align) - 1) & ~((size_t)(align) - 1))
+
+_Static_assert(MEM_COMPOSE_ALIGN <= UINT8_MAX, "the padding must fit a byte");
+
+// Aligns a block of an inner allocator, NULL stays NULL
+static inline uint8_t *mem_compose_align_up(uint8_t *raw) {
+  if (raw == NULL) {
+    return NULL;
+  }
+  uint8_t *aligned =
+      (uint8_t *)MEM_COMPOSE_ROUND((uintptr_t)raw + 1, MEM_COMPOSE_ALIGN);
+  aligned[-1] = (uint8_t)(aligned - raw);
+  return aligned;
+}
+
+// Block of the inner allocator an aligned pointer came from
+static inline uint8_t *mem_compose_align_down(uint8_t *aligned) {
+  return aligned - aligned[-1];
+}
+
+#define MEM_COMPOSE_POOL(name, pool)                                           \
+  static inline void *name##_alloc(size_t bytes) {                             \
+    MemPool *p_ = (pool);                                                      \
+    return p_ != NULL && bytes <= p_->chunk_size ? mem_pool_alloc(p_) : NULL;  \
+  }                                                                            \
+  static inline void name##_free(void *ptr, size_t bytes) {                    \
+    (void)bytes;                                                               \
+    mem_pool_free((pool), ptr);                                                \
+  }                                                                            \
+  static inline int name##_owns(const void *ptr) {                             \
+    return mem_pool_owns((pool), ptr);                                         \
+  }
+
+#define MEM_COMPOSE_ARENA(name, arena)                                         \
+  static inline void *name##_alloc(size_t bytes) {                             \
+    return mem_arena_alloc((arena), bytes);                                    \
+  }                                                                            \
+  static inline void name##_free(void *ptr, size_t bytes) {                    \
+    (void)ptr;                                                                 \
+    (void)bytes;                                                               \
+  }                                                                            \
+  static inline int name##_owns(const void *ptr) {                             \
+    return mem_arena_owns((arena), ptr);                                       \
+  }
+
+#define MEM_COMPOSE_STACK(name, stack)                                         \
+  static inline void *name##_alloc(size_t bytes) {                             \
+    return mem_stack_alloc((stack), bytes);                                    \
+  }                                                                            \
+  static inline void name##_free(void *ptr, size_t bytes) {                    \
+    MemStack *s_ = (stack);                                                    \
+    if (s_ != NULL && ptr != NULL &&                                           \
+        (uint8_t *)ptr + bytes == s_->data + s_->size) {                       \
+      mem_stack_pop(s_, bytes);                                                \
+    }                                                                          \
+  }                                                                            \
+  static inline int name##_owns(const void *ptr) {                             \
+    return mem_stack_owns((stack), ptr);                                       \
+  }
+
+#define MEM_COMPOSE_MALLOC(name)                                               \
+  static inline void *name##_alloc(size_t bytes) { return malloc(bytes); }     \
+  static inline void name##_free(void *ptr, size_t bytes) {                    \
+    (void)bytes;                                                               \
+    free(ptr);                                                                 \
+  }                                                                            \
+  static inline int name##_owns(const void *ptr) {                             \
+    (void)ptr;                                                                 \
+    return 1;                                                                  \
+  }
+
+#define MEM_FALLBACK(name, primary, secondary)                                 \
+  static inline void *name##_alloc(size_t bytes) {                             \
+    void *ptr_ = primary##_alloc(bytes);                                       \
+    return ptr_ != NULL ? ptr_ : secondary##_alloc(bytes);                     \
+  }                                                                            \
+  static inline void name##_free(void *ptr, size_t bytes) {                    \
+    if (primary##_owns(ptr)) {                                                 \
+      primary##_free(ptr, bytes);                                              \
+    } else {                                                                   \
+      secondary##_free(ptr, bytes);                                            \
+    }                                                                          \
+  }                                                                            \
+  static inline int name##_owns(const void *ptr) {                             \
+    return primary##_owns(ptr) || secondary##_owns(ptr);                       \
+  }
+
+#define MEM_SEGREGATOR(name, threshold, small, large)                          \
+  static inline void *name##_alloc(size_t bytes) {                             \
+    return bytes <= (threshold) ? small##_alloc(bytes) : large##_alloc(bytes); \
+  }                                                                            \
+  static inline void name##_free(void *ptr, size_t bytes) {                    \
+    if (bytes <= (threshold)) {                                                \
+      small##_free(ptr, bytes);                                                \
+    } else {                                                                   \
+      large##_free(ptr, bytes);                                                \
+    }                                                                          \
+  }                                                                            \
+  static inline int name##_owns(const void *ptr) {                             \
+    return small##_owns(ptr) || large##_owns(ptr);                             \
+  }
+
+#define MEM_BUCKETIZER(name, pools, min, max, step)                            \
+  static inline void *name##_alloc(size_t bytes) {                             \
+    if (bytes <= (min) || bytes > (max)) {                                     \
+      return NULL;                                                             \
+    }                                                                          \
+    return mem_pool_alloc((pools)[(bytes - (min) - 1) / (step)]);              \
+  }                                                                            \
+  static inline void name##_free(void *ptr, size_t bytes) {                    \
+    if (bytes > (min) && bytes <= (max)) {                                     \
+      mem_pool_free((pools)[(bytes - (min) - 1) / (step)], ptr);               \
+    }                                                                          \
+  }                                                                            \
+  static inline int name##_owns(const void *ptr) {                             \
+    for (size_t i_ = 0; i_ < ((max) - (min) + (step) - 1) / (step); ++i_) {    \
+      if (mem_pool_owns((pools)[i_], ptr)) {                                   \
+        return 1;                                                              \
+      }                                                                        \
+    }                                                                          \
+    return 0;                                                                  \
+  }
+
+#define MEM_AFFIX(name, inner, prefix_type, suffix_type)                       \
+  enum {                                                                       \
+    name##_prefix_bytes_ =                                                     \
+        MEM_COMPOSE_ROUND(sizeof(prefix_type), MEM_COMPOSE_ALIGN)              \
+  };                                                                           \
+  static inline size_t name##_total_(size_t bytes) {                           \
+    return MEM_COMPOSE_ALIGN + name##_prefix_bytes_ +                          \
+           MEM_COMPOSE_ROUND(bytes, _Alignof(suffix_type)) +                   \
+           sizeof(suffix_type);                                                \
+  }                                                                            \
+  static inline void *name##_alloc(size_t bytes) {                             \
+    uint8_t *prefix_ =                                                         \
+        mem_compose_align_up(inner##_alloc(name##_total_(bytes)));             \
+    return prefix_ != NULL ? prefix_ + name##_prefix_bytes_ : NULL;            \
+  }                                                                            \
+  static inline void name##_free(void *ptr, size_t bytes) {                    \
+    if (ptr != NULL) {                                                         \
+      inner##_free(                                                            \
+          mem_compose_align_down((uint8_t *)ptr - name##_prefix_bytes_),       \
+          name##_total_(bytes));                                               \
+    }                                                                          \
+  }                                                                            \
+  static inline int name##_owns(const void *ptr) {                             \
+    return inner##_owns((const uint8_t *)ptr - name##_prefix_bytes_ - 1);      \
+  }                                                                            \
+  static inline prefix_type *name##_prefix(void *ptr) {                        \
+    return (prefix_type *)((uint8_t *)ptr - name##_prefix_bytes_);             \
+  }                                                                            \
+  static inline suffix_type *name##_suffix(void *ptr, size_t bytes) {          \
+    return (suffix_type *)((uint8_t *)ptr +                                    \
+                           MEM_COMPOSE_ROUND(bytes, _Alignof(suffix_type)));   \
+  }
+
+#define MEM_PREFIX(name, inner, prefix_type)                                   \
+  enum {                                                                       \
+    name##_prefix_bytes_ =                                                     \
+        MEM_COMPOSE_ROUND(sizeof(prefix_type), MEM_COMPOSE_ALIGN)              \
+  };                                                                           \
+  static inline void *name##_alloc(size_t bytes) {                             \
+    uint8_t *prefix_ = mem_compose_align_up(                                   \
+        inner##_alloc(MEM_COMPOSE_ALIGN + name##_prefix_bytes_ + bytes));      \
+    return prefix_ != NULL ? prefix_ + name##_prefix_bytes_ : NULL;            \
+  }                                                                            \
+  static inline void name##_free(void *ptr, size_t bytes) {                    \
+    if (ptr != NULL) {                                                         \
+      inner##_free(                                                            \
+          mem_compose_align_down((uint8_t *)ptr - name##_prefix_bytes_),       \
+          MEM_COMPOSE_ALIGN + name##_prefix_bytes_ + bytes);                   \
+    }                                                                          \
+  }                                                                            \
+  static inline int name##_owns(const void *ptr) {                             \
+    return inner##_owns((const uint8_t *)ptr - name##_prefix_bytes_ - 1);      \
+  }                                                                            \
+  static inline prefix_type *name##_prefix(void *ptr) {                        \
+    return (prefix_type *)((uint8_t *)ptr - name##_prefix_bytes_);             \
+  }
+
+#endif // COMPOSE_ALLOC_H
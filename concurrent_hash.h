@@ -0,0 +1,327 @@
+#ifndef CONCURRENT_HASH_H
+#define CONCURRENT_HASH_H
+
+/**
+ * STB-style implementation of a concurrent hash table mapping 64 bits keys
+ * to 64 bits values (store a pointer in there if you need more). Collisions
+ * are chained, the chain nodes come from type-stable pools (see
+ * 'pool_allocator.h') so no node is ever unmapped:
+ *  - writers lock the stripe of the bucket they touch, every stripe has its
+ *    own pools, so nodes are allocated and freed under the same lock;
+ *  - readers take no lock at all, they read every node optimistically and
+ *    validate it with the version word of its pool. A node freed (or
+ *    recycled) under a reader fails validation and the lookup starts again.
+ *
+ * 'mem_hash_init' -> Allocates a table with a fixed number of buckets (rounded
+ * up to a power of two) spread over n_stripes locks. Every stripe grows its
+ * nodes nodes_per_pool at a time.
+ *
+ * 'mem_hash_get' -> Looks a key up, from any thread and without locks.
+ *
+ * 'mem_hash_put' -> Inserts a key or updates its value.
+ *
+ * 'mem_hash_remove' -> Removes a key.
+ *
+ * 'mem_hash_deinit' -> Frees the table, nobody can be using it anymore. The
+ * node pools are parked as type-stable pools always are.
+ *
+ * @note The nodes live in MemPools, so POOL_IMPL has to be defined once as
+ * well.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool_allocator.h"
+
+/**
+ * @param key key of the entry
+ * @param value value of the entry
+ * @param next next node of the chain
+ * @param pool pool the node comes from, it never changes once set
+ */
+typedef struct MemHashNode {
+  _Atomic uint64_t key;
+  _Atomic uint64_t value;
+  struct MemHashNode *_Atomic next;
+  MemPool *_Atomic pool;
+} MemHashNode;
+
+/**
+ * @param lock held by the writers of the buckets of the stripe
+ * @param pools type-stable pools of the stripe nodes
+ * @param n_pools number of pools
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  MemPool **pools;
+  size_t n_pools;
+} MemHashStripe;
+
+/**
+ * @param buckets chain heads
+ * @param mask number of buckets minus one
+ * @param stripes writer locks and node pools, bucket i uses stripe
+ * i % n_stripes
+ * @param n_stripes number of stripes
+ * @param nodes_per_pool number of nodes of every new pool
+ * @param size number of keys in the table
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  MemHashNode *_Atomic *buckets;
+  size_t mask;
+  MemHashStripe *stripes;
+  size_t n_stripes;
+  size_t nodes_per_pool;
+  _Atomic size_t size;
+} MemHashTable;
+
+/**
+ * Heap allocates a new hash table
+ * @param n_buckets number of buckets, rounded up to a power of two
+ * @param n_stripes number of writer locks
+ * @param nodes_per_pool nodes added to a stripe when it runs out of them
+ * @return pointer to the table, or NULL on failure
+ */
+MemHashTable *mem_hash_init(size_t n_buckets, size_t n_stripes,
+                            size_t nodes_per_pool);
+
+/**
+ * Looks a key up without taking locks
+ * @param table table we are reading
+ * @param key key we are looking for
+ * @param value where the value is stored if the key is found, can be NULL
+ * @return 1 if the key was found, 0 otherwise.
+ */
+int mem_hash_get(MemHashTable *table, uint64_t key, uint64_t *value);
+
+/**
+ * Inserts a key, or updates its value if it's already there
+ * @param table table we are writing
+ * @param key key of the entry
+ * @param value value of the entry
+ * @return 1 if the call succeded, 0 otherwise (out of memory).
+ */
+int mem_hash_put(MemHashTable *table, uint64_t key, uint64_t value);
+
+/**
+ * Removes a key
+ * @param table table we are writing
+ * @param key key to remove
+ * @return 1 if the key was removed, 0 if it wasn't there.
+ */
+int mem_hash_remove(MemHashTable *table, uint64_t key);
+
+/**
+ * Gives the number of keys in the table
+ * @param table table we are interested in
+ * @return number of keys
+ */
+size_t mem_hash_size(MemHashTable *table);
+
+/**
+ * Frees the memory related to the table passed as parameter
+ * @param table table we are freeing
+ */
+void mem_hash_deinit(MemHashTable *table);
+
+#endif // CONCURRENT_HASH_H
+
+#ifdef CONCURRENT_HASH_IMPL
+
+// splitmix64 finalizer, consecutive keys end up in unrelated buckets
+static size_t mem_hash_bucket(const MemHashTable *table, uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ull;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebull;
+  key ^= key >> 31;
+  return (size_t)key & table->mask;
+}
+
+static MemHashStripe *mem_hash_stripe(MemHashTable *table, size_t bucket) {
+  return &table->stripes[bucket % table->n_stripes];
+}
+
+MemHashTable *mem_hash_init(size_t n_buckets, size_t n_stripes,
+                            size_t nodes_per_pool) {
+  if (n_buckets == 0 || n_stripes == 0 || nodes_per_pool == 0 ||
+      n_buckets > (SIZE_MAX >> 1)) {
+    return NULL;
+  }
+  MemHashTable *table = calloc(1, sizeof(MemHashTable));
+  if (table == NULL) {
+    return NULL;
+  }
+  size_t buckets = 1;
+  while (buckets < n_buckets) {
+    buckets <<= 1;
+  }
+  table->buckets = calloc(buckets, sizeof(MemHashNode *));
+  table->stripes = calloc(n_stripes, sizeof(MemHashStripe));
+  if (table->buckets == NULL || table->stripes == NULL) {
+    free(table->buckets);
+    free(table->stripes);
+    free(table);
+    return NULL;
+  }
+  table->mask = buckets - 1;
+  table->n_stripes = n_stripes;
+  table->nodes_per_pool = nodes_per_pool;
+  for (size_t i = 0; i < n_stripes; ++i) {
+    pthread_mutex_init(&table->stripes[i].lock, NULL);
+  }
+  return table;
+}
+
+int mem_hash_get(MemHashTable *table, uint64_t key, uint64_t *value) {
+  if (table == NULL) {
+    return 0;
+  }
+  size_t bucket = mem_hash_bucket(table, key);
+retry:;
+  MemHashNode *node =
+      atomic_load_explicit(&table->buckets[bucket], memory_order_acquire);
+  while (node != NULL) {
+    MemPool *pool = atomic_load_explicit(&node->pool, memory_order_relaxed);
+    uint64_t version = mem_pool_read_begin(pool, node);
+    uint64_t node_key = atomic_load_explicit(&node->key, memory_order_relaxed);
+    uint64_t node_value =
+        atomic_load_explicit(&node->value, memory_order_relaxed);
+    MemHashNode *next = atomic_load_explicit(&node->next, memory_order_relaxed);
+    // A recycled node may now sit in another chain, start over then too
+    if (!mem_pool_read_validate(pool, node, version) ||
+        mem_hash_bucket(table, node_key) != bucket) {
+      goto retry;
+    }
+    if (node_key == key) {
+      if (value != NULL) {
+        *value = node_value;
+      }
+      return 1;
+    }
+    node = next;
+  }
+  return 0;
+}
+
+// Takes a node from the stripe pools, adding a new pool if they are full
+static MemHashNode *mem_hash_node_alloc(MemHashTable *table,
+                                        MemHashStripe *stripe) {
+  for (size_t i = stripe->n_pools; i > 0; --i) {
+    MemHashNode *node = mem_pool_alloc(stripe->pools[i - 1]);
+    if (node != NULL) {
+      atomic_store_explicit(&node->pool, stripe->pools[i - 1],
+                            memory_order_relaxed);
+      return node;
+    }
+  }
+  MemPool **pools =
+      realloc(stripe->pools, (stripe->n_pools + 1) * sizeof(MemPool *));
+  if (pools == NULL) {
+    return NULL;
+  }
+  stripe->pools = pools;
+  MemPool *pool = mem_pool_init_ex(sizeof(MemHashNode), table->nodes_per_pool,
+                                   MEM_POOL_REUSE_FIFO | MEM_POOL_TYPE_STABLE);
+  if (pool == NULL) {
+    return NULL;
+  }
+  stripe->pools[stripe->n_pools++] = pool;
+  MemHashNode *node = mem_pool_alloc(pool);
+  atomic_store_explicit(&node->pool, pool, memory_order_relaxed);
+  return node;
+}
+
+int mem_hash_put(MemHashTable *table, uint64_t key, uint64_t value) {
+  if (table == NULL) {
+    return 0;
+  }
+  size_t bucket = mem_hash_bucket(table, key);
+  MemHashStripe *stripe = mem_hash_stripe(table, bucket);
+  pthread_mutex_lock(&stripe->lock);
+  MemHashNode *head =
+      atomic_load_explicit(&table->buckets[bucket], memory_order_relaxed);
+  for (MemHashNode *node = head; node != NULL;
+       node = atomic_load_explicit(&node->next, memory_order_relaxed)) {
+    if (atomic_load_explicit(&node->key, memory_order_relaxed) == key) {
+      MemPool *pool = atomic_load_explicit(&node->pool, memory_order_relaxed);
+      mem_pool_write_begin(pool, node);
+      atomic_store_explicit(&node->value, value, memory_order_relaxed);
+      mem_pool_write_end(pool, node);
+      pthread_mutex_unlock(&stripe->lock);
+      return 1;
+    }
+  }
+  MemHashNode *node = mem_hash_node_alloc(table, stripe);
+  if (node == NULL) {
+    pthread_mutex_unlock(&stripe->lock);
+    return 0;
+  }
+  // The node comes out of the pool unpublished, readers ignore it for now
+  MemPool *pool = atomic_load_explicit(&node->pool, memory_order_relaxed);
+  atomic_store_explicit(&node->key, key, memory_order_relaxed);
+  atomic_store_explicit(&node->value, value, memory_order_relaxed);
+  atomic_store_explicit(&node->next, head, memory_order_relaxed);
+  mem_pool_write_end(pool, node);
+  atomic_store_explicit(&table->buckets[bucket], node, memory_order_release);
+  atomic_fetch_add_explicit(&table->size, 1, memory_order_relaxed);
+  pthread_mutex_unlock(&stripe->lock);
+  return 1;
+}
+
+int mem_hash_remove(MemHashTable *table, uint64_t key) {
+  if (table == NULL) {
+    return 0;
+  }
+  size_t bucket = mem_hash_bucket(table, key);
+  MemHashStripe *stripe = mem_hash_stripe(table, bucket);
+  pthread_mutex_lock(&stripe->lock);
+  MemHashNode *_Atomic *link = &table->buckets[bucket];
+  MemHashNode *node;
+  while ((node = atomic_load_explicit(link, memory_order_relaxed)) != NULL) {
+    if (atomic_load_explicit(&node->key, memory_order_relaxed) == key) {
+      MemHashNode *next =
+          atomic_load_explicit(&node->next, memory_order_relaxed);
+      atomic_store_explicit(link, next, memory_order_release);
+      // Readers still on the node fail validation from now on
+      mem_pool_free(atomic_load_explicit(&node->pool, memory_order_relaxed),
+                    node);
+      atomic_fetch_sub_explicit(&table->size, 1, memory_order_relaxed);
+      pthread_mutex_unlock(&stripe->lock);
+      return 1;
+    }
+    link = &node->next;
+  }
+  pthread_mutex_unlock(&stripe->lock);
+  return 0;
+}
+
+size_t mem_hash_size(MemHashTable *table) {
+  if (table == NULL) {
+    return 0;
+  }
+  return atomic_load_explicit(&table->size, memory_order_relaxed);
+}
+
+void mem_hash_deinit(MemHashTable *table) {
+  if (table != NULL) {
+    for (size_t i = 0; i < table->n_stripes; ++i) {
+      MemHashStripe *stripe = &table->stripes[i];
+      for (size_t j = 0; j < stripe->n_pools; ++j) {
+        mem_pool_deinit(stripe->pools[j]);
+      }
+      free(stripe->pools);
+      pthread_mutex_destroy(&stripe->lock);
+    }
+    free(table->stripes);
+    free(table->buckets);
+    free(table);
+  }
+}
+
+#endif // CONCURRENT_HASH_IMPL
@@ -0,0 +1,525 @@
+#ifndef CSR_GRAPH_H
+#define CSR_GRAPH_H
+
+/**
+ * STB-style builder of directed graphs in compressed sparse row form: the
+ * neighbors of vertex v are neighbors[offsets[v]] ... neighbors[offsets[v+1]
+ * - 1]. Vertices are 32 bits ids, edge counts are 64 bits.
+ *
+ * Edges are streamed into growable MemArenas as batches of
+ * MEM_CSR_BATCH_EDGES (source, destination) pairs, nothing is ever copied or
+ * resized while loading. The build then makes three passes over the batches:
+ * it counts the degrees, turns them into offsets with a prefix sum and
+ * scatters every edge in place. The offsets and the neighbors end up in a
+ * single arena owned by the graph.
+ *
+ * 'mem_csr_builder_init' -> Creates a builder whose arenas grow block_size
+ * bytes at a time.
+ *
+ * 'mem_csr_builder_add' -> Adds an edge from the thread owning the builder.
+ *
+ * 'mem_csr_stream_open' / 'mem_csr_stream_add' / 'mem_csr_stream_close' ->
+ * Parallel ingestion: every loading thread opens its own stream (with its
+ * own arena) and adds edges to it without any synchronization. Closing a
+ * stream splices its arena into the builder, the edges aren't copied.
+ *
+ * 'mem_csr_build' -> Builds the graph from all the edges added so far. With a
+ * scheduler (see 'task_scheduler.h') the three passes run in parallel, the
+ * degrees and the scatter cursors are then updated with atomic adds. A
+ * scheduler with a single worker is ignored, the atomics would only slow
+ * the passes down.
+ *
+ * 'mem_csr_neighbors' -> Gives the neighbors of a vertex.
+ *
+ * 'mem_csr_builder_deinit' / 'mem_csr_deinit' -> Frees the builder (and the
+ * edges it holds) / the graph.
+ *
+ * @note The neighbors of a vertex keep the order the edges were added in
+ * when the graph is built without a scheduler (or with a single worker),
+ * their order is unspecified otherwise. During the build the memory peaks
+ * at 8 bytes per edge (the batches) plus 4 bytes per edge and 16 bytes per
+ * vertex (the graph and the scatter cursors), free the builder right after
+ * the build to drop the first part. ARENA_IMPL and TASK_SCHED_IMPL (and
+ * what it requires) have to be defined once as well.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena_allocator.h"
+#include "task_scheduler.h"
+
+// Edges of every batch
+#ifndef MEM_CSR_BATCH_EDGES
+#define MEM_CSR_BATCH_EDGES 4096
+#endif
+
+// Vertices handled by a single task of the parallel prefix sum
+#ifndef MEM_CSR_GRAIN
+#define MEM_CSR_GRAIN 65536
+#endif
+
+/**
+ * @param src source vertex
+ * @param dst destination vertex
+ */
+typedef struct {
+  uint32_t src;
+  uint32_t dst;
+} MemCsrEdge;
+
+/**
+ * @param next next batch
+ * @param count number of edges
+ * @param edges edges of the batch
+ */
+typedef struct MemCsrBatch {
+  struct MemCsrBatch *next;
+  size_t count;
+  MemCsrEdge edges[MEM_CSR_BATCH_EDGES];
+} MemCsrBatch;
+
+/**
+ * @param arena memory of the batches
+ * @param head first batch
+ * @param tail last batch, the one being filled
+ * @param n_edges number of edges
+ * @param n_vertices biggest vertex id seen plus one
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  MemArena *arena;
+  MemCsrBatch *head;
+  MemCsrBatch *tail;
+  uint64_t n_edges;
+  uint64_t n_vertices;
+} MemCsrStream;
+
+/**
+ * @param lock protects the builder against concurrent stream closes
+ * @param block_size block size of every arena
+ * @param local stream of 'mem_csr_builder_add', its arena holds the edges of
+ * all the closed streams too
+ * @param closed batches of the closed streams (its arena is unused)
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  size_t block_size;
+  MemCsrStream local;
+  MemCsrStream closed;
+} MemCsrBuilder;
+
+/**
+ * @param offsets n_vertices + 1 offsets in neighbors
+ * @param neighbors destination of every edge, grouped by source
+ * @param n_vertices number of vertices
+ * @param n_edges number of edges
+ * @param arena memory of offsets and neighbors
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  uint64_t *offsets;
+  uint32_t *neighbors;
+  uint64_t n_vertices;
+  uint64_t n_edges;
+  MemArena *arena;
+} MemCsrGraph;
+
+/**
+ * Heap allocates a new builder
+ * @param block_size size of the arena blocks holding the edges
+ * @return pointer to the builder, or NULL on failure
+ */
+MemCsrBuilder *mem_csr_builder_init(size_t block_size);
+
+/**
+ * Adds an edge, from the thread owning the builder
+ * @param builder builder we are loading
+ * @param src source vertex
+ * @param dst destination vertex
+ * @return 1 if the call succeded, 0 otherwise (out of memory).
+ */
+int mem_csr_builder_add(MemCsrBuilder *builder, uint32_t src, uint32_t dst);
+
+/**
+ * Opens a stream for a loading thread
+ * @param builder builder the stream will be closed into
+ * @return pointer to the stream, or NULL on failure
+ */
+MemCsrStream *mem_csr_stream_open(MemCsrBuilder *builder);
+
+/**
+ * Adds an edge to a stream
+ * @param stream stream of the calling thread
+ * @param src source vertex
+ * @param dst destination vertex
+ * @return 1 if the call succeded, 0 otherwise (out of memory).
+ */
+int mem_csr_stream_add(MemCsrStream *stream, uint32_t src, uint32_t dst);
+
+/**
+ * Moves the edges of a stream into the builder, the stream is freed
+ * @param builder builder the stream was opened from
+ * @param stream stream we are closing
+ * @return 1 if the call succeded, 0 otherwise (the stream is left open).
+ */
+int mem_csr_stream_close(MemCsrBuilder *builder, MemCsrStream *stream);
+
+/**
+ * Builds the graph from every edge added to the builder or to its closed
+ * streams
+ * @param builder builder we are building from
+ * @param n_vertices number of vertices, 0 to use the biggest id plus one
+ * @param sched scheduler running the passes, NULL to run them on the caller
+ * @return pointer to the graph, or NULL on failure (or if an edge uses a
+ * vertex id not below n_vertices)
+ */
+MemCsrGraph *mem_csr_build(MemCsrBuilder *builder, uint64_t n_vertices,
+                           MemScheduler *sched);
+
+/**
+ * Gives the neighbors of a vertex
+ * @param graph graph we are reading
+ * @param vertex vertex we are interested in
+ * @param degree where the number of neighbors is stored
+ * @return pointer to the first neighbor
+ */
+const uint32_t *mem_csr_neighbors(const MemCsrGraph *graph, uint32_t vertex,
+                                  uint64_t *degree);
+
+/**
+ * Frees the builder and all the edges it holds
+ * @param builder builder we are freeing
+ */
+void mem_csr_builder_deinit(MemCsrBuilder *builder);
+
+/**
+ * Frees the memory related to the graph passed as parameter
+ * @param graph graph we are freeing
+ */
+void mem_csr_deinit(MemCsrGraph *graph);
+
+#endif // CSR_GRAPH_H
+
+#ifdef CSR_GRAPH_IMPL
+
+#include <string.h>
+
+MemCsrBuilder *mem_csr_builder_init(size_t block_size) {
+  if (block_size < sizeof(MemCsrBatch)) {
+    block_size = sizeof(MemCsrBatch);
+  }
+  MemCsrBuilder *builder = calloc(1, sizeof(MemCsrBuilder));
+  if (builder == NULL) {
+    return NULL;
+  }
+  builder->local.arena = mem_arena_init_growable(block_size, 0);
+  if (builder->local.arena == NULL) {
+    free(builder);
+    return NULL;
+  }
+  builder->block_size = block_size;
+  pthread_mutex_init(&builder->lock, NULL);
+  return builder;
+}
+
+int mem_csr_stream_add(MemCsrStream *stream, uint32_t src, uint32_t dst) {
+  if (stream == NULL) {
+    return 0;
+  }
+  MemCsrBatch *batch = stream->tail;
+  if (batch == NULL || batch->count == MEM_CSR_BATCH_EDGES) {
+    // Batches are a multiple of 8 bytes, they stay aligned in the arena
+    batch = mem_arena_alloc(stream->arena, sizeof(MemCsrBatch));
+    if (batch == NULL) {
+      return 0;
+    }
+    batch->next = NULL;
+    batch->count = 0;
+    if (stream->tail != NULL) {
+      stream->tail->next = batch;
+    } else {
+      stream->head = batch;
+    }
+    stream->tail = batch;
+  }
+  batch->edges[batch->count++] = (MemCsrEdge){src, dst};
+  stream->n_edges++;
+  uint64_t top = (uint64_t)(src > dst ? src : dst) + 1;
+  if (top > stream->n_vertices) {
+    stream->n_vertices = top;
+  }
+  return 1;
+}
+
+int mem_csr_builder_add(MemCsrBuilder *builder, uint32_t src, uint32_t dst) {
+  return builder != NULL ? mem_csr_stream_add(&builder->local, src, dst) : 0;
+}
+
+MemCsrStream *mem_csr_stream_open(MemCsrBuilder *builder) {
+  if (builder == NULL) {
+    return NULL;
+  }
+  MemCsrStream *stream = calloc(1, sizeof(MemCsrStream));
+  if (stream == NULL) {
+    return NULL;
+  }
+  stream->arena = mem_arena_init_growable(builder->block_size, 0);
+  if (stream->arena == NULL) {
+    free(stream);
+    return NULL;
+  }
+  return stream;
+}
+
+// Appends the batches of a stream to another one
+static void mem_csr_stream_append(MemCsrStream *into,
+                                  const MemCsrStream *from) {
+  if (from->head == NULL) {
+    return;
+  }
+  if (into->tail != NULL) {
+    into->tail->next = from->head;
+  } else {
+    into->head = from->head;
+  }
+  into->tail = from->tail;
+  into->n_edges += from->n_edges;
+  if (from->n_vertices > into->n_vertices) {
+    into->n_vertices = from->n_vertices;
+  }
+}
+
+int mem_csr_stream_close(MemCsrBuilder *builder, MemCsrStream *stream) {
+  if (builder == NULL || stream == NULL) {
+    return 0;
+  }
+  pthread_mutex_lock(&builder->lock);
+  // The closed batches are full, except the last one of every stream
+  if (!mem_arena_splice(builder->local.arena, stream->arena)) {
+    pthread_mutex_unlock(&builder->lock);
+    return 0;
+  }
+  mem_csr_stream_append(&builder->closed, stream);
+  pthread_mutex_unlock(&builder->lock);
+  free(stream);
+  return 1;
+}
+
+/**
+ * State shared by the passes of the build
+ * @param batches every batch, so the passes can be split by index
+ * @param offsets degrees, then offsets of the graph
+ * @param cursors next free slot of every vertex during the scatter
+ * @param neighbors neighbors of the graph
+ * @param partial sum of the degrees of every range of the prefix sum
+ * @param n_vertices number of vertices
+ * @param atomic set when the passes run in parallel
+ */
+typedef struct {
+  MemCsrBatch **batches;
+  uint64_t *offsets;
+  uint64_t *cursors;
+  uint32_t *neighbors;
+  uint64_t *partial;
+  uint64_t n_vertices;
+  int atomic;
+} MemCsrBuild;
+
+static void mem_csr_count(size_t begin, size_t end, void *ctx) {
+  MemCsrBuild *build = ctx;
+  for (size_t b = begin; b < end; ++b) {
+    const MemCsrBatch *batch = build->batches[b];
+    for (size_t i = 0; i < batch->count; ++i) {
+      uint64_t *degree = &build->offsets[batch->edges[i].src + 1];
+      if (build->atomic) {
+        __atomic_fetch_add(degree, 1, __ATOMIC_RELAXED);
+      } else {
+        (*degree)++;
+      }
+    }
+  }
+}
+
+// First half of the prefix sum, the total of every range of vertices
+static void mem_csr_sum(size_t begin, size_t end, void *ctx) {
+  MemCsrBuild *build = ctx;
+  for (size_t r = begin; r < end; ++r) {
+    uint64_t first = r * MEM_CSR_GRAIN;
+    uint64_t last = first + MEM_CSR_GRAIN;
+    if (last > build->n_vertices) {
+      last = build->n_vertices;
+    }
+    uint64_t sum = 0;
+    for (uint64_t v = first; v < last; ++v) {
+      sum += build->offsets[v + 1];
+    }
+    build->partial[r] = sum;
+  }
+}
+
+// Second half, every range scans its degrees starting from its base
+static void mem_csr_scan(size_t begin, size_t end, void *ctx) {
+  MemCsrBuild *build = ctx;
+  for (size_t r = begin; r < end; ++r) {
+    uint64_t first = r * MEM_CSR_GRAIN;
+    uint64_t last = first + MEM_CSR_GRAIN;
+    if (last > build->n_vertices) {
+      last = build->n_vertices;
+    }
+    uint64_t sum = build->partial[r];
+    for (uint64_t v = first; v < last; ++v) {
+      build->cursors[v] = sum;
+      sum += build->offsets[v + 1];
+      build->offsets[v + 1] = sum;
+    }
+  }
+}
+
+static void mem_csr_scatter(size_t begin, size_t end, void *ctx) {
+  MemCsrBuild *build = ctx;
+  for (size_t b = begin; b < end; ++b) {
+    const MemCsrBatch *batch = build->batches[b];
+    for (size_t i = 0; i < batch->count; ++i) {
+      uint64_t *cursor = &build->cursors[batch->edges[i].src];
+      uint64_t slot = build->atomic
+                          ? __atomic_fetch_add(cursor, 1, __ATOMIC_RELAXED)
+                          : (*cursor)++;
+      build->neighbors[slot] = batch->edges[i].dst;
+    }
+  }
+}
+
+// Runs a pass on the scheduler, or on the caller without one
+static void mem_csr_pass(MemScheduler *sched, size_t n, size_t grain,
+                         MemForFn pass, MemCsrBuild *build) {
+  if (sched != NULL) {
+    mem_sched_parallel_for(sched, 0, n, grain, pass, build);
+  } else if (n > 0) {
+    pass(0, n, build);
+  }
+}
+
+MemCsrGraph *mem_csr_build(MemCsrBuilder *builder, uint64_t n_vertices,
+                           MemScheduler *sched) {
+  if (builder == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock(&builder->lock);
+  MemCsrStream all = {0};
+  mem_csr_stream_append(&all, &builder->local);
+  mem_csr_stream_append(&all, &builder->closed);
+  if (n_vertices == 0) {
+    n_vertices = all.n_vertices;
+  }
+  if (all.n_vertices > n_vertices ||
+      n_vertices > SIZE_MAX / (2 * sizeof(uint64_t))) {
+    // Unlink the two lists again, the builder is left as it was
+    if (builder->local.tail != NULL) {
+      builder->local.tail->next = NULL;
+    }
+    pthread_mutex_unlock(&builder->lock);
+    return NULL;
+  }
+
+  MemCsrGraph *graph = calloc(1, sizeof(MemCsrGraph));
+  size_t offsets_bytes = (size_t)(n_vertices + 1) * sizeof(uint64_t);
+  size_t bytes = offsets_bytes + (size_t)all.n_edges * sizeof(uint32_t);
+  // A single block, mapped so the untouched pages cost nothing
+  MemArena *arena = mem_arena_init_growable(bytes, 0);
+  // The atomic adds serialize the cache misses of the passes, a single
+  // worker is better off running them on the caller with plain adds
+  if (sched != NULL && sched->n_workers < 2) {
+    sched = NULL;
+  }
+  MemCsrBuild build = {.n_vertices = n_vertices, .atomic = sched != NULL};
+  size_t n_batches = 0;
+  for (MemCsrBatch *batch = all.head; batch != NULL; batch = batch->next) {
+    n_batches++;
+  }
+  size_t n_ranges = (size_t)((n_vertices + MEM_CSR_GRAIN - 1) / MEM_CSR_GRAIN);
+  // Scratch of the build, it lives as long as the edges
+  MemArena *scratch = builder->local.arena;
+  build.batches = mem_arena_alloc(scratch, n_batches * sizeof(MemCsrBatch *));
+  build.cursors = mem_arena_alloc(scratch, n_vertices * sizeof(uint64_t));
+  build.partial = mem_arena_alloc(scratch, n_ranges * sizeof(uint64_t));
+  if (graph == NULL || arena == NULL ||
+      (build.batches == NULL && n_batches > 0) ||
+      (build.cursors == NULL && n_vertices > 0) ||
+      (build.partial == NULL && n_ranges > 0)) {
+    if (builder->local.tail != NULL) {
+      builder->local.tail->next = NULL;
+    }
+    pthread_mutex_unlock(&builder->lock);
+    mem_arena_deinit(arena);
+    free(graph);
+    return NULL;
+  }
+  graph->arena = arena;
+  graph->offsets = mem_arena_alloc(arena, offsets_bytes);
+  graph->neighbors = mem_arena_alloc(arena, bytes - offsets_bytes);
+  graph->n_vertices = n_vertices;
+  graph->n_edges = all.n_edges;
+  build.offsets = graph->offsets;
+  build.neighbors = graph->neighbors;
+  memset(build.offsets, 0, offsets_bytes);
+  n_batches = 0;
+  for (MemCsrBatch *batch = all.head; batch != NULL; batch = batch->next) {
+    build.batches[n_batches++] = batch;
+  }
+
+  mem_csr_pass(sched, n_batches, 16, mem_csr_count, &build);
+  mem_csr_pass(sched, n_ranges, 1, mem_csr_sum, &build);
+  // Turn the range totals into the base of every range
+  uint64_t base = 0;
+  for (size_t r = 0; r < n_ranges; ++r) {
+    uint64_t sum = build.partial[r];
+    build.partial[r] = base;
+    base += sum;
+  }
+  mem_csr_pass(sched, n_ranges, 1, mem_csr_scan, &build);
+  mem_csr_pass(sched, n_batches, 16, mem_csr_scatter, &build);
+
+  if (builder->local.tail != NULL) {
+    builder->local.tail->next = NULL;
+  }
+  pthread_mutex_unlock(&builder->lock);
+  return graph;
+}
+
+const uint32_t *mem_csr_neighbors(const MemCsrGraph *graph, uint32_t vertex,
+                                  uint64_t *degree) {
+  if (graph == NULL || vertex >= graph->n_vertices) {
+    if (degree != NULL) {
+      *degree = 0;
+    }
+    return NULL;
+  }
+  if (degree != NULL) {
+    *degree = graph->offsets[vertex + 1] - graph->offsets[vertex];
+  }
+  return graph->neighbors + graph->offsets[vertex];
+}
+
+void mem_csr_builder_deinit(MemCsrBuilder *builder) {
+  if (builder != NULL) {
+    mem_arena_deinit(builder->local.arena);
+    pthread_mutex_destroy(&builder->lock);
+    free(builder);
+  }
+}
+
+void mem_csr_deinit(MemCsrGraph *graph) {
+  if (graph != NULL) {
+    mem_arena_deinit(graph->arena);
+    free(graph);
+  }
+}
+
+#endif // CSR_GRAPH_IMPL
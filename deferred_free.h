@@ -0,0 +1,223 @@
+#ifndef DEFERRED_FREE_H
+#define DEFERRED_FREE_H
+
+/**
+ * STB-style implementation of a deferred destruction queue. Releasing huge
+ * regions (munmap of a big arena, free of a big pool) can take milliseconds,
+ * with this queue the thread tearing down an allocator just records what has
+ * to be released and a background reclaimer thread does the actual work, in
+ * batches.
+ *
+ * 'mem_deferred_start' -> Starts the reclaimer thread. The backlog is bounded
+ * to max_backlog releases, when it's full the caller releases the memory
+ * itself instead of waiting.
+ *
+ * 'mem_deferred_release' -> Queues a release. When the reclaimer isn't
+ * running (or the backlog is full) the release happens right away, so it's
+ * always safe to call.
+ *
+ * 'mem_deferred_drain' -> Waits until every queued release has been done.
+ *
+ * 'mem_deferred_stop' -> Drains the queue and stops the reclaimer thread, to
+ * be called at shutdown.
+ *
+ * Pools and arenas compiled with MEM_USE_DEFERRED_FREE defined release their
+ * memory through this queue in 'mem_pool_deinit' and 'mem_arena_deinit'.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Function actually releasing the memory
+ * @param ptr memory to release
+ * @param size size of the memory, as passed to 'mem_deferred_release'
+ */
+typedef void (*MemReleaseFn)(void *ptr, size_t size);
+
+/**
+ * Starts the background reclaimer
+ * @param max_backlog maximum number of releases waiting in the queue
+ * @return 1 if the call succeded, 0 otherwise.
+ */
+int mem_deferred_start(size_t max_backlog);
+
+/**
+ * Queues a release for the background reclaimer
+ * @param release function releasing the memory
+ * @param ptr memory to release
+ * @param size size of the memory
+ */
+void mem_deferred_release(MemReleaseFn release, void *ptr, size_t size);
+
+/**
+ * Waits until all the queued releases have been done
+ */
+void mem_deferred_drain(void);
+
+/**
+ * Drains the queue and stops the background reclaimer
+ */
+void mem_deferred_stop(void);
+
+#endif // DEFERRED_FREE_H
+
+#if defined(DEFERRED_FREE_IMPL) && !defined(DEFERRED_FREE_IMPL_DONE)
+#define DEFERRED_FREE_IMPL_DONE
+
+#include <pthread.h>
+
+typedef struct {
+  MemReleaseFn release;
+  void *ptr;
+  size_t size;
+} MemDeferredEntry;
+
+/**
+ * @param lock protects every other member
+ * @param wakeup signaled when something is queued or the thread must stop
+ * @param idle signaled when the queue is empty and no batch is in progress
+ * @param ring circular buffer of queued releases
+ * @param capacity size of the ring (the maximum backlog)
+ * @param head index of the oldest queued release
+ * @param count number of queued releases
+ * @param busy 1 while the reclaimer is releasing a batch
+ * @param running 1 while the reclaimer is accepting releases
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  pthread_cond_t idle;
+  MemDeferredEntry *ring;
+  size_t capacity;
+  size_t head;
+  size_t count;
+  int busy;
+  int running;
+  pthread_t thread;
+} MemDeferredQueue;
+
+// Releases done by the reclaimer between two checks of the queue
+#define MEM_DEFERRED_BATCH 64
+
+static MemDeferredQueue mem_deferred = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+};
+
+static void *mem_deferred_thread(void *arg) {
+  (void)arg;
+  MemDeferredEntry batch[MEM_DEFERRED_BATCH];
+  pthread_mutex_lock(&mem_deferred.lock);
+  for (;;) {
+    while (mem_deferred.count == 0 && mem_deferred.running) {
+      pthread_cond_wait(&mem_deferred.wakeup, &mem_deferred.lock);
+    }
+    if (mem_deferred.count == 0) {
+      break; // Stopped and drained
+    }
+    size_t n = 0;
+    while (n < MEM_DEFERRED_BATCH && mem_deferred.count > 0) {
+      batch[n++] = mem_deferred.ring[mem_deferred.head];
+      mem_deferred.head = (mem_deferred.head + 1) % mem_deferred.capacity;
+      mem_deferred.count--;
+    }
+    mem_deferred.busy = 1;
+    pthread_mutex_unlock(&mem_deferred.lock);
+
+    for (size_t i = 0; i < n; ++i) {
+      batch[i].release(batch[i].ptr, batch[i].size);
+    }
+
+    pthread_mutex_lock(&mem_deferred.lock);
+    mem_deferred.busy = 0;
+    if (mem_deferred.count == 0) {
+      pthread_cond_broadcast(&mem_deferred.idle);
+    }
+  }
+  pthread_cond_broadcast(&mem_deferred.idle);
+  pthread_mutex_unlock(&mem_deferred.lock);
+  return NULL;
+}
+
+int mem_deferred_start(size_t max_backlog) {
+  if (max_backlog == 0) {
+    return 0;
+  }
+  pthread_mutex_lock(&mem_deferred.lock);
+  if (mem_deferred.running) {
+    pthread_mutex_unlock(&mem_deferred.lock);
+    return 0;
+  }
+  mem_deferred.ring = malloc(max_backlog * sizeof(MemDeferredEntry));
+  if (mem_deferred.ring == NULL) {
+    pthread_mutex_unlock(&mem_deferred.lock);
+    return 0;
+  }
+  mem_deferred.capacity = max_backlog;
+  mem_deferred.head = 0;
+  mem_deferred.count = 0;
+  mem_deferred.running = 1;
+  if (pthread_create(&mem_deferred.thread, NULL, mem_deferred_thread, NULL)) {
+    free(mem_deferred.ring);
+    mem_deferred.ring = NULL;
+    mem_deferred.running = 0;
+    pthread_mutex_unlock(&mem_deferred.lock);
+    return 0;
+  }
+  pthread_mutex_unlock(&mem_deferred.lock);
+  return 1;
+}
+
+void mem_deferred_release(MemReleaseFn release, void *ptr, size_t size) {
+  if (release == NULL || ptr == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&mem_deferred.lock);
+  if (mem_deferred.running && mem_deferred.count < mem_deferred.capacity) {
+    size_t tail =
+        (mem_deferred.head + mem_deferred.count) % mem_deferred.capacity;
+    mem_deferred.ring[tail].release = release;
+    mem_deferred.ring[tail].ptr = ptr;
+    mem_deferred.ring[tail].size = size;
+    mem_deferred.count++;
+    pthread_cond_signal(&mem_deferred.wakeup);
+    pthread_mutex_unlock(&mem_deferred.lock);
+    return;
+  }
+  pthread_mutex_unlock(&mem_deferred.lock);
+  // Not running or backlog full, pay the price here
+  release(ptr, size);
+}
+
+void mem_deferred_drain(void) {
+  pthread_mutex_lock(&mem_deferred.lock);
+  while (mem_deferred.count > 0 || mem_deferred.busy) {
+    pthread_cond_wait(&mem_deferred.idle, &mem_deferred.lock);
+  }
+  pthread_mutex_unlock(&mem_deferred.lock);
+}
+
+void mem_deferred_stop(void) {
+  pthread_mutex_lock(&mem_deferred.lock);
+  if (!mem_deferred.running) {
+    pthread_mutex_unlock(&mem_deferred.lock);
+    return;
+  }
+  // The thread empties the queue before exiting
+  mem_deferred.running = 0;
+  pthread_cond_signal(&mem_deferred.wakeup);
+  pthread_mutex_unlock(&mem_deferred.lock);
+  pthread_join(mem_deferred.thread, NULL);
+
+  pthread_mutex_lock(&mem_deferred.lock);
+  free(mem_deferred.ring);
+  mem_deferred.ring = NULL;
+  mem_deferred.capacity = 0;
+  pthread_mutex_unlock(&mem_deferred.lock);
+}
+
+#undef MEM_DEFERRED_BATCH
+
+#endif // DEFERRED_FREE_IMPL
@@ -0,0 +1,650 @@
+#ifndef HAMT_H
+#define HAMT_H
+
+/**
+ * STB-style implementation of a persistent (immutable) hash array mapped
+ * trie mapping 64 bits keys to 64 bits values. Every update returns a new
+ * version of the map and leaves the old one untouched: only the nodes on the
+ * path from the root to the key are copied (at most 13 of them), the rest is
+ * shared between the versions.
+ *
+ * Every node has two 32 bits bitmaps (entries stored inline and children)
+ * followed by the entries and the child pointers, so its size depends on how
+ * many of them it has. Nodes come either from:
+ *  - size-classed MemPools, one class every 16 bytes. A class that runs out
+ *    of chunks gets one more pool, like the node pools of 'btree.h'. Nodes
+ *    are reference counted, releasing a version frees the nodes no other
+ *    version uses;
+ *  - a MemArena the caller owns, for versions that all die together: there
+ *    are no reference counts to update and everything is freed at once by
+ *    resetting (or deinit'ing) the arena.
+ *
+ * 'mem_hamt_init' / 'mem_hamt_init_arena' -> Creates a node store of one
+ * kind or the other. A MemHamtMap zero initialized is the empty map.
+ *
+ * 'mem_hamt_get' -> Looks a key up in a version.
+ *
+ * 'mem_hamt_put' / 'mem_hamt_remove' -> Writes a new version with the key
+ * inserted (or updated) / removed.
+ *
+ * 'mem_hamt_retain' / 'mem_hamt_release' -> Takes / drops a reference to a
+ * version. Every version written by put and remove holds one reference.
+ * Both are no-ops for arena stores.
+ *
+ * 'mem_hamt_deinit' -> Frees the store, every version is gone with it (the
+ * arena of an arena store stays with the caller).
+ *
+ * @note Not thread safe: writes and releases must be serialized, reading
+ * versions nobody is releasing is fine from any thread. POOL_IMPL (and
+ * ARENA_IMPL for arena stores) has to be defined once as well.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena_allocator.h"
+#include "pool_allocator.h"
+
+typedef struct MemHamtNode MemHamtNode;
+
+/**
+ * Node pools of one size class
+ * @param pools pools of the class
+ * @param n_pools number of pools
+ * @param hint index of the pool that most likely has a free node
+ */
+typedef struct {
+  MemPool **pools;
+  size_t n_pools;
+  size_t hint;
+} MemHamtClass;
+
+/**
+ * @param classes node pools of every size class, NULL for an arena store
+ * @param n_classes number of size classes
+ * @param nodes_per_pool number of nodes of every new pool
+ * @param arena node arena, NULL for a pool store
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  MemHamtClass *classes;
+  size_t n_classes;
+  size_t nodes_per_pool;
+  MemArena *arena;
+} MemHamt;
+
+/**
+ * A version of the map, zero initialize it for the empty map
+ * @param root root node, NULL for the empty map
+ * @param size number of keys
+ */
+typedef struct {
+  MemHamtNode *root;
+  size_t size;
+} MemHamtMap;
+
+/**
+ * Heap allocates a new store whose nodes come from size-classed pools
+ * @param nodes_per_pool nodes added to a size class when it runs out of them
+ * @return pointer to the store, or NULL on failure
+ */
+MemHamt *mem_hamt_init(size_t nodes_per_pool);
+
+/**
+ * Heap allocates a new store whose nodes come from an arena
+ * @param arena arena of the nodes, the versions die when it's reset
+ * @return pointer to the store, or NULL on failure
+ */
+MemHamt *mem_hamt_init_arena(MemArena *arena);
+
+/**
+ * Looks a key up
+ * @param map version we are reading
+ * @param key key we are looking for
+ * @param value where the value is stored if the key is found, can be NULL
+ * @return 1 if the key was found, 0 otherwise.
+ */
+int mem_hamt_get(const MemHamtMap *map, uint64_t key, uint64_t *value);
+
+/**
+ * Writes a new version with a key inserted, or its value updated
+ * @param hamt store of the nodes
+ * @param map version we start from, left untouched
+ * @param key key of the entry
+ * @param value value of the entry
+ * @param out new version, it must not be map
+ * @return 1 if the call succeded, 0 otherwise (out of memory).
+ */
+int mem_hamt_put(MemHamt *hamt, const MemHamtMap *map, uint64_t key,
+                 uint64_t value, MemHamtMap *out);
+
+/**
+ * Writes a new version without a key
+ * @param hamt store of the nodes
+ * @param map version we start from, left untouched
+ * @param key key to remove, it may be missing
+ * @param out new version, it must not be map
+ * @return 1 if the call succeded, 0 otherwise (out of memory).
+ */
+int mem_hamt_remove(MemHamt *hamt, const MemHamtMap *map, uint64_t key,
+                    MemHamtMap *out);
+
+/**
+ * Takes a reference to a version, to be dropped with 'mem_hamt_release'
+ * @param hamt store of the nodes
+ * @param map version we want to keep
+ */
+void mem_hamt_retain(MemHamt *hamt, const MemHamtMap *map);
+
+/**
+ * Drops a reference to a version, the map is emptied
+ * @param hamt store of the nodes
+ * @param map version we are done with
+ */
+void mem_hamt_release(MemHamt *hamt, MemHamtMap *map);
+
+/**
+ * Gives the number of keys of a version
+ * @param map version we are interested in
+ * @return number of keys
+ */
+size_t mem_hamt_size(const MemHamtMap *map);
+
+/**
+ * Frees the memory related to the store passed as parameter
+ * @param hamt store we are freeing
+ */
+void mem_hamt_deinit(MemHamt *hamt);
+
+#endif // HAMT_H
+
+#ifdef HAMT_IMPL
+
+#include <string.h>
+
+#define MEM_HAMT_BITS 5
+#define MEM_HAMT_MASK ((1u << MEM_HAMT_BITS) - 1)
+// Header plus 32 inline entries, the biggest node there is
+#define MEM_HAMT_MAX_NODE (16 + 32 * 2 * sizeof(uint64_t))
+#define MEM_HAMT_CLASS_STEP 16
+
+/**
+ * @param refs number of versions and parents pointing to the node
+ * @param datamap hash slots holding an entry inline
+ * @param nodemap hash slots holding a child
+ * @param pool index of the pool of its size class holding the node
+ * @param slots key and value of every entry, then every child pointer
+ */
+struct MemHamtNode {
+  uint32_t refs;
+  uint32_t datamap;
+  uint32_t nodemap;
+  uint32_t pool;
+  uint64_t slots[];
+};
+
+// splitmix64 finalizer, a bijection: two keys never have the same hash
+static uint64_t mem_hamt_hash(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ull;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebull;
+  key ^= key >> 31;
+  return key;
+}
+
+static uint32_t mem_hamt_bit(uint64_t hash, unsigned shift) {
+  return 1u << ((hash >> shift) & MEM_HAMT_MASK);
+}
+
+static unsigned mem_hamt_rank(uint32_t map, uint32_t bit) {
+  return (unsigned)__builtin_popcount(map & (bit - 1));
+}
+
+static size_t mem_hamt_node_size(uint32_t datamap, uint32_t nodemap) {
+  return sizeof(MemHamtNode) +
+         (2 * (size_t)__builtin_popcount(datamap) +
+          (size_t)__builtin_popcount(nodemap)) *
+             sizeof(uint64_t);
+}
+
+static MemHamtNode **mem_hamt_children(MemHamtNode *node) {
+  return (MemHamtNode **)&node->slots[2 * __builtin_popcount(node->datamap)];
+}
+
+// Size class of a node, the smallest one is 2 steps (a node with one entry)
+static size_t mem_hamt_class(size_t bytes) {
+  return (bytes + MEM_HAMT_CLASS_STEP - 1) / MEM_HAMT_CLASS_STEP - 2;
+}
+
+MemHamt *mem_hamt_init(size_t nodes_per_pool) {
+  if (nodes_per_pool == 0) {
+    return NULL;
+  }
+  MemHamt *hamt = calloc(1, sizeof(MemHamt));
+  if (hamt == NULL) {
+    return NULL;
+  }
+  hamt->n_classes = mem_hamt_class(MEM_HAMT_MAX_NODE) + 1;
+  hamt->classes = calloc(hamt->n_classes, sizeof(MemHamtClass));
+  if (hamt->classes == NULL) {
+    free(hamt);
+    return NULL;
+  }
+  hamt->nodes_per_pool = nodes_per_pool;
+  return hamt;
+}
+
+MemHamt *mem_hamt_init_arena(MemArena *arena) {
+  if (arena == NULL) {
+    return NULL;
+  }
+  MemHamt *hamt = calloc(1, sizeof(MemHamt));
+  if (hamt == NULL) {
+    return NULL;
+  }
+  hamt->arena = arena;
+  return hamt;
+}
+
+// Takes a node from the pools of a class, adding a new pool if they are full
+static MemHamtNode *mem_hamt_pool_alloc(MemHamt *hamt, size_t index) {
+  MemHamtClass *size_class = &hamt->classes[index];
+  for (size_t i = size_class->hint; i < size_class->n_pools; ++i) {
+    MemHamtNode *node = mem_pool_alloc(size_class->pools[i]);
+    if (node != NULL) {
+      size_class->hint = i;
+      node->pool = (uint32_t)i;
+      return node;
+    }
+  }
+  if (size_class->n_pools == UINT32_MAX) {
+    return NULL;
+  }
+  MemPool **pools =
+      realloc(size_class->pools, (size_class->n_pools + 1) * sizeof(MemPool *));
+  if (pools == NULL) {
+    return NULL;
+  }
+  size_class->pools = pools;
+  MemPool *pool = mem_pool_init_ex((index + 2) * MEM_HAMT_CLASS_STEP,
+                                   hamt->nodes_per_pool, MEM_POOL_REUSE_LIFO);
+  if (pool == NULL) {
+    return NULL;
+  }
+  size_class->hint = size_class->n_pools;
+  size_class->pools[size_class->n_pools++] = pool;
+  MemHamtNode *node = mem_pool_alloc(pool);
+  node->pool = (uint32_t)size_class->hint;
+  return node;
+}
+
+static MemHamtNode *mem_hamt_node_alloc(MemHamt *hamt, uint32_t datamap,
+                                        uint32_t nodemap) {
+  size_t bytes = mem_hamt_node_size(datamap, nodemap);
+  MemHamtNode *node;
+  if (hamt->arena != NULL) {
+    // The arena doesn't align, round the pointer up ourselves
+    size_t align = sizeof(uint64_t);
+    uint8_t *raw = mem_arena_alloc(hamt->arena, bytes + align - 1);
+    node = raw == NULL ? NULL
+                       : (MemHamtNode *)(((uintptr_t)raw + align - 1) &
+                                         ~(uintptr_t)(align - 1));
+    if (node != NULL) {
+      node->pool = 0;
+    }
+  } else {
+    node = mem_hamt_pool_alloc(hamt, mem_hamt_class(bytes));
+  }
+  if (node != NULL) {
+    node->refs = 1;
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+  }
+  return node;
+}
+
+static void mem_hamt_node_retain(MemHamt *hamt, MemHamtNode *node) {
+  if (hamt->arena == NULL && node != NULL) {
+    node->refs++;
+  }
+}
+
+static void mem_hamt_node_release(MemHamt *hamt, MemHamtNode *node) {
+  if (hamt->arena != NULL || node == NULL || --node->refs > 0) {
+    return;
+  }
+  MemHamtNode **children = mem_hamt_children(node);
+  for (int i = 0; i < __builtin_popcount(node->nodemap); ++i) {
+    mem_hamt_node_release(hamt, children[i]);
+  }
+  size_t bytes = mem_hamt_node_size(node->datamap, node->nodemap);
+  MemHamtClass *size_class = &hamt->classes[mem_hamt_class(bytes)];
+  if (node->pool < size_class->hint) {
+    size_class->hint = node->pool;
+  }
+  mem_pool_free(size_class->pools[node->pool], node);
+}
+
+/**
+ * Copies a node into a new one with other bitmaps. The entry at skip_data
+ * (an index, or -1) and the child at skip_child are left out, a gap is left
+ * at gap_data and gap_child for the caller to fill. The children copied are
+ * retained.
+ */
+static MemHamtNode *mem_hamt_node_copy(MemHamt *hamt, MemHamtNode *node,
+                                       uint32_t datamap, uint32_t nodemap,
+                                       int skip_data, int gap_data,
+                                       int skip_child, int gap_child) {
+  MemHamtNode *copy = mem_hamt_node_alloc(hamt, datamap, nodemap);
+  if (copy == NULL) {
+    return NULL;
+  }
+  int n_data = __builtin_popcount(node->datamap);
+  int to = 0;
+  for (int from = 0; from < n_data; ++from) {
+    if (to == gap_data) {
+      to++;
+    }
+    if (from != skip_data) {
+      copy->slots[2 * to] = node->slots[2 * from];
+      copy->slots[2 * to + 1] = node->slots[2 * from + 1];
+      to++;
+    }
+  }
+  MemHamtNode **src = mem_hamt_children(node);
+  MemHamtNode **dst = mem_hamt_children(copy);
+  int n_children = __builtin_popcount(node->nodemap);
+  to = 0;
+  for (int from = 0; from < n_children; ++from) {
+    if (to == gap_child) {
+      to++;
+    }
+    if (from != skip_child) {
+      dst[to] = src[from];
+      mem_hamt_node_retain(hamt, dst[to]);
+      to++;
+    }
+  }
+  return copy;
+}
+
+int mem_hamt_get(const MemHamtMap *map, uint64_t key, uint64_t *value) {
+  if (map == NULL) {
+    return 0;
+  }
+  uint64_t hash = mem_hamt_hash(key);
+  MemHamtNode *node = map->root;
+  for (unsigned shift = 0; node != NULL; shift += MEM_HAMT_BITS) {
+    uint32_t bit = mem_hamt_bit(hash, shift);
+    if (node->datamap & bit) {
+      unsigned index = mem_hamt_rank(node->datamap, bit);
+      if (node->slots[2 * index] != key) {
+        return 0;
+      }
+      if (value != NULL) {
+        *value = node->slots[2 * index + 1];
+      }
+      return 1;
+    }
+    if (!(node->nodemap & bit)) {
+      return 0;
+    }
+    node = mem_hamt_children(node)[mem_hamt_rank(node->nodemap, bit)];
+  }
+  return 0;
+}
+
+// Node holding two entries whose hashes agree below shift
+static MemHamtNode *mem_hamt_pair(MemHamt *hamt, uint64_t key_a,
+                                  uint64_t value_a, uint64_t key_b,
+                                  uint64_t value_b, unsigned shift) {
+  uint64_t hash_a = mem_hamt_hash(key_a);
+  uint64_t hash_b = mem_hamt_hash(key_b);
+  uint32_t bit_a = mem_hamt_bit(hash_a, shift);
+  uint32_t bit_b = mem_hamt_bit(hash_b, shift);
+  if (bit_a == bit_b) {
+    MemHamtNode *child = mem_hamt_pair(hamt, key_a, value_a, key_b, value_b,
+                                       shift + MEM_HAMT_BITS);
+    if (child == NULL) {
+      return NULL;
+    }
+    MemHamtNode *node = mem_hamt_node_alloc(hamt, 0, bit_a);
+    if (node == NULL) {
+      mem_hamt_node_release(hamt, child);
+      return NULL;
+    }
+    mem_hamt_children(node)[0] = child;
+    return node;
+  }
+  MemHamtNode *node = mem_hamt_node_alloc(hamt, bit_a | bit_b, 0);
+  if (node == NULL) {
+    return NULL;
+  }
+  int first = bit_a < bit_b ? 0 : 1;
+  node->slots[2 * first] = key_a;
+  node->slots[2 * first + 1] = value_a;
+  node->slots[2 * (1 - first)] = key_b;
+  node->slots[2 * (1 - first) + 1] = value_b;
+  return node;
+}
+
+// New version of node with the key put, the size grows by *added
+static MemHamtNode *mem_hamt_put_rec(MemHamt *hamt, MemHamtNode *node,
+                                     uint64_t hash, uint64_t key,
+                                     uint64_t value, unsigned shift,
+                                     size_t *added) {
+  uint32_t bit = mem_hamt_bit(hash, shift);
+  if (node->datamap & bit) {
+    int index = (int)mem_hamt_rank(node->datamap, bit);
+    uint64_t old_key = node->slots[2 * index];
+    uint64_t old_value = node->slots[2 * index + 1];
+    if (old_key == key) {
+      MemHamtNode *copy = mem_hamt_node_copy(hamt, node, node->datamap,
+                                             node->nodemap, -1, -1, -1, -1);
+      if (copy != NULL) {
+        copy->slots[2 * index + 1] = value;
+      }
+      return copy;
+    }
+    // Two keys in one slot, they move down to a new child
+    MemHamtNode *child = mem_hamt_pair(hamt, old_key, old_value, key, value,
+                                       shift + MEM_HAMT_BITS);
+    if (child == NULL) {
+      return NULL;
+    }
+    uint32_t nodemap = node->nodemap | bit;
+    int gap = (int)mem_hamt_rank(nodemap, bit);
+    MemHamtNode *copy = mem_hamt_node_copy(hamt, node, node->datamap & ~bit,
+                                           nodemap, index, -1, -1, gap);
+    if (copy == NULL) {
+      mem_hamt_node_release(hamt, child);
+      return NULL;
+    }
+    mem_hamt_children(copy)[gap] = child;
+    *added = 1;
+    return copy;
+  }
+  if (node->nodemap & bit) {
+    int index = (int)mem_hamt_rank(node->nodemap, bit);
+    MemHamtNode *child =
+        mem_hamt_put_rec(hamt, mem_hamt_children(node)[index], hash, key,
+                         value, shift + MEM_HAMT_BITS, added);
+    if (child == NULL) {
+      return NULL;
+    }
+    MemHamtNode *copy = mem_hamt_node_copy(hamt, node, node->datamap,
+                                           node->nodemap, -1, -1, index, index);
+    if (copy == NULL) {
+      mem_hamt_node_release(hamt, child);
+      return NULL;
+    }
+    mem_hamt_children(copy)[index] = child;
+    return copy;
+  }
+  uint32_t datamap = node->datamap | bit;
+  int gap = (int)mem_hamt_rank(datamap, bit);
+  MemHamtNode *copy = mem_hamt_node_copy(hamt, node, datamap, node->nodemap,
+                                         -1, gap, -1, -1);
+  if (copy != NULL) {
+    copy->slots[2 * gap] = key;
+    copy->slots[2 * gap + 1] = value;
+    *added = 1;
+  }
+  return copy;
+}
+
+int mem_hamt_put(MemHamt *hamt, const MemHamtMap *map, uint64_t key,
+                 uint64_t value, MemHamtMap *out) {
+  if (hamt == NULL || map == NULL || out == NULL || out == map) {
+    return 0;
+  }
+  MemHamtNode *root;
+  size_t added = 0;
+  if (map->root == NULL) {
+    uint32_t bit = mem_hamt_bit(mem_hamt_hash(key), 0);
+    root = mem_hamt_node_alloc(hamt, bit, 0);
+    if (root != NULL) {
+      root->slots[0] = key;
+      root->slots[1] = value;
+      added = 1;
+    }
+  } else {
+    root = mem_hamt_put_rec(hamt, map->root, mem_hamt_hash(key), key, value,
+                            0, &added);
+  }
+  if (root == NULL) {
+    return 0;
+  }
+  out->root = root;
+  out->size = map->size + added;
+  return 1;
+}
+
+/**
+ * New version of node without the key, in *out (NULL when it's left empty)
+ * @return 1 if the key was removed, 0 if it wasn't there, -1 when out of
+ * memory
+ */
+static int mem_hamt_remove_rec(MemHamt *hamt, MemHamtNode *node,
+                               uint64_t hash, uint64_t key, unsigned shift,
+                               MemHamtNode **out) {
+  uint32_t bit = mem_hamt_bit(hash, shift);
+  if (node->datamap & bit) {
+    int index = (int)mem_hamt_rank(node->datamap, bit);
+    if (node->slots[2 * index] != key) {
+      return 0;
+    }
+    if (node->datamap == bit && node->nodemap == 0) {
+      *out = NULL;
+      return 1;
+    }
+    *out = mem_hamt_node_copy(hamt, node, node->datamap & ~bit, node->nodemap,
+                              index, -1, -1, -1);
+    return *out != NULL ? 1 : -1;
+  }
+  if (!(node->nodemap & bit)) {
+    return 0;
+  }
+  int index = (int)mem_hamt_rank(node->nodemap, bit);
+  MemHamtNode *child;
+  int removed = mem_hamt_remove_rec(hamt, mem_hamt_children(node)[index],
+                                    hash, key, shift + MEM_HAMT_BITS, &child);
+  if (removed != 1) {
+    return removed;
+  }
+  // Children always hold two entries or more, a single entry left in the
+  // child goes back inline (here, or further up if we would be left with it
+  // alone)
+  if (child->nodemap == 0 && __builtin_popcount(child->datamap) == 1) {
+    if (node->datamap == 0 && node->nodemap == bit) {
+      // The child is a new node nobody else sees yet, its entry is moved to
+      // this level in place (it stays there if this node is the root)
+      child->datamap = bit;
+      *out = child;
+      return 1;
+    }
+    uint32_t datamap = node->datamap | bit;
+    int gap = (int)mem_hamt_rank(datamap, bit);
+    *out = mem_hamt_node_copy(hamt, node, datamap, node->nodemap & ~bit, -1,
+                              gap, index, -1);
+    if (*out != NULL) {
+      (*out)->slots[2 * gap] = child->slots[0];
+      (*out)->slots[2 * gap + 1] = child->slots[1];
+    }
+    mem_hamt_node_release(hamt, child);
+    return *out != NULL ? 1 : -1;
+  }
+  *out = mem_hamt_node_copy(hamt, node, node->datamap, node->nodemap, -1, -1,
+                            index, index);
+  if (*out == NULL) {
+    mem_hamt_node_release(hamt, child);
+    return -1;
+  }
+  mem_hamt_children(*out)[index] = child;
+  return 1;
+}
+
+int mem_hamt_remove(MemHamt *hamt, const MemHamtMap *map, uint64_t key,
+                    MemHamtMap *out) {
+  if (hamt == NULL || map == NULL || out == NULL || out == map) {
+    return 0;
+  }
+  MemHamtNode *root = NULL;
+  int removed = map->root != NULL
+                    ? mem_hamt_remove_rec(hamt, map->root, mem_hamt_hash(key),
+                                          key, 0, &root)
+                    : 0;
+  if (removed < 0) {
+    return 0;
+  }
+  if (removed == 0) {
+    // Nothing to remove, the new version shares the old one
+    mem_hamt_node_retain(hamt, map->root);
+    *out = *map;
+    return 1;
+  }
+  out->root = root;
+  out->size = map->size - 1;
+  return 1;
+}
+
+void mem_hamt_retain(MemHamt *hamt, const MemHamtMap *map) {
+  if (hamt != NULL && map != NULL) {
+    mem_hamt_node_retain(hamt, map->root);
+  }
+}
+
+void mem_hamt_release(MemHamt *hamt, MemHamtMap *map) {
+  if (hamt != NULL && map != NULL) {
+    mem_hamt_node_release(hamt, map->root);
+    map->root = NULL;
+    map->size = 0;
+  }
+}
+
+size_t mem_hamt_size(const MemHamtMap *map) {
+  return map != NULL ? map->size : 0;
+}
+
+void mem_hamt_deinit(MemHamt *hamt) {
+  if (hamt != NULL) {
+    for (size_t i = 0; hamt->classes != NULL && i < hamt->n_classes; ++i) {
+      for (size_t j = 0; j < hamt->classes[i].n_pools; ++j) {
+        mem_pool_deinit(hamt->classes[i].pools[j]);
+      }
+      free(hamt->classes[i].pools);
+    }
+    free(hamt->classes);
+    free(hamt);
+  }
+}
+
+#undef MEM_HAMT_BITS
+#undef MEM_HAMT_MASK
+#undef MEM_HAMT_MAX_NODE
+#undef MEM_HAMT_CLASS_STEP
+
+#endif // HAMT_IMPL
@@ -0,0 +1,151 @@
+#ifndef LARGE_ALLOC_H
+#define LARGE_ALLOC_H
+
+/**
+ * STB-style helpers for big buffers whose address doesn't need to stay the
+ * same when they grow (handle-indexed arrays, columns, buffers only reached
+ * through an owner). Buffers of MEM_LARGE_THRESHOLD bytes or more get their
+ * own anonymous mapping, so growing them moves page table entries with
+ * mremap instead of allocating a new buffer and copying it: the kernel grows
+ * the mapping in place when the next addresses are free and moves it
+ * otherwise, the contents are never copied. Smaller buffers go through
+ * aligned_alloc.
+ *
+ * 'mem_large_alloc' -> Allocates a buffer aligned to align bytes (a power of
+ * two up to the page size). Mapped buffers are zero filled, the others are
+ * not initialized.
+ *
+ * 'mem_large_realloc' -> Resizes a buffer, keeping its contents up to the
+ * smaller of the two sizes. The buffer may move.
+ *
+ * 'mem_large_free' -> Frees a buffer.
+ *
+ * The caller keeps track of the size of every buffer and passes it back, it's
+ * what tells a mapped buffer from a heap one.
+ *
+ * @note mremap is Linux only. It's called through syscall(2), so it's there
+ * whether or not _GNU_SOURCE was defined before <sys/mman.h>. On the other
+ * systems growing a mapped buffer maps a new one and copies the contents.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Buffers this big (or bigger) are mapped on their own
+#ifndef MEM_LARGE_THRESHOLD
+#define MEM_LARGE_THRESHOLD (128 * 1024)
+#endif
+
+/**
+ * Allocates a buffer
+ * @param bytes size of the buffer
+ * @param align alignment of the buffer, a power of two up to the page size
+ * @return pointer to the buffer, or NULL on failure
+ */
+void *mem_large_alloc(size_t bytes, size_t align);
+
+/**
+ * Resizes a buffer, it may move
+ * @param ptr buffer from 'mem_large_alloc' or 'mem_large_realloc'
+ * @param old_bytes current size of the buffer
+ * @param new_bytes size we want
+ * @param align alignment passed to 'mem_large_alloc'
+ * @return pointer to the resized buffer, or NULL on failure (ptr is left
+ * untouched)
+ */
+void *mem_large_realloc(void *ptr, size_t old_bytes, size_t new_bytes,
+                        size_t align);
+
+/**
+ * Frees a buffer
+ * @param ptr buffer we are freeing
+ * @param bytes current size of the buffer
+ */
+void mem_large_free(void *ptr, size_t bytes);
+
+#endif // LARGE_ALLOC_H
+
+#if defined(LARGE_ALLOC_IMPL) && !defined(LARGE_ALLOC_IMPL_DONE)
+#define LARGE_ALLOC_IMPL_DONE
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+// glibc only declares mremap with _GNU_SOURCE, the raw syscall is always there
+#include <linux/mman.h>
+#include <sys/syscall.h>
+#define MEM_LARGE_MREMAP(ptr, old_bytes, new_bytes)                            \
+  ((void *)syscall(SYS_mremap, (ptr), (old_bytes), (new_bytes),                \
+                   MREMAP_MAYMOVE))
+#endif
+
+static size_t mem_large_map_size(size_t bytes) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (bytes + page - 1) & ~(page - 1);
+}
+
+static void *mem_large_heap_alloc(size_t bytes, size_t align) {
+  // aligned_alloc wants a multiple of the alignment
+  bytes = (bytes + align - 1) & ~(align - 1);
+  return aligned_alloc(align, bytes == 0 ? align : bytes);
+}
+
+void *mem_large_alloc(size_t bytes, size_t align) {
+  if (align == 0 || (align & (align - 1)) != 0 ||
+      bytes > SIZE_MAX - (size_t)sysconf(_SC_PAGESIZE)) {
+    return NULL;
+  }
+  if (bytes < MEM_LARGE_THRESHOLD) {
+    return mem_large_heap_alloc(bytes, align);
+  }
+  void *ptr = mmap(NULL, mem_large_map_size(bytes), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void *mem_large_realloc(void *ptr, size_t old_bytes, size_t new_bytes,
+                        size_t align) {
+  if (ptr == NULL) {
+    return mem_large_alloc(new_bytes, align);
+  }
+  if (new_bytes > SIZE_MAX - (size_t)sysconf(_SC_PAGESIZE)) {
+    return NULL;
+  }
+  if (old_bytes >= MEM_LARGE_THRESHOLD && new_bytes >= MEM_LARGE_THRESHOLD) {
+    size_t old_map = mem_large_map_size(old_bytes);
+    size_t new_map = mem_large_map_size(new_bytes);
+    if (old_map == new_map) {
+      return ptr;
+    }
+#ifdef MEM_LARGE_MREMAP
+    void *moved = MEM_LARGE_MREMAP(ptr, old_map, new_map);
+    return moved == MAP_FAILED ? NULL : moved;
+#endif
+  }
+  // Heap buffers, crossing the threshold, or not Linux: allocate and copy
+  void *moved = mem_large_alloc(new_bytes, align);
+  if (moved == NULL) {
+    return NULL;
+  }
+  memcpy(moved, ptr, old_bytes < new_bytes ? old_bytes : new_bytes);
+  mem_large_free(ptr, old_bytes);
+  return moved;
+}
+
+void mem_large_free(void *ptr, size_t bytes) {
+  if (ptr == NULL) {
+    return;
+  }
+  if (bytes >= MEM_LARGE_THRESHOLD) {
+    munmap(ptr, mem_large_map_size(bytes));
+  } else {
+    free(ptr);
+  }
+}
+
+#undef MEM_LARGE_MREMAP
+
+#endif // LARGE_ALLOC_IMPL
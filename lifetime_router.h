@@ -0,0 +1,618 @@
+#ifndef LIFETIME_ROUTER_H
+#define LIFETIME_ROUTER_H
+
+/**
+ * STB-style implementation of an allocation router that places objects
+ * according to how long the objects of their allocation site live:
+ *  - sites whose objects die young go to the current arena epoch of the
+ *    calling thread (a growable MemArena plus a count of live objects). Once
+ *    an object no longer fits the epoch_bytes of an epoch the thread moves to
+ *    a new one, and an old epoch is reset and recycled as soon as its last
+ *    object is freed;
+ *  - everything else goes to the size class pools of 'size_class_allocator.h'
+ *    (or to malloc when no class fits or the class is exhausted).
+ *
+ * Sites are identified by the return address of 'mem_router_alloc' (or by
+ * any non zero value passed to 'mem_router_alloc_site'), lifetimes are
+ * measured in router allocations done between the alloc and the free of an
+ * object.
+ *
+ * 'mem_router_init' -> Creates a router, it starts in profiling mode.
+ *
+ * 'mem_router_profile' -> Switches profiling on or off. While profiling every
+ * allocation goes to the pools and the lifetime of every object is recorded.
+ * Switching it off decides which sites are short lived: the ones with at
+ * least MEM_ROUTER_SHORT_PERCENT percent of their objects dying within
+ * short_lifetime allocations.
+ *
+ * 'mem_router_alloc' / 'mem_router_alloc_site' -> Allocate bytes, the memory
+ * is 16 bytes aligned (the size classes are rounded up to multiples of 16).
+ *
+ * 'mem_router_free' -> Gives the memory back, with the size passed to alloc.
+ *
+ * 'mem_router_deinit' -> Frees the router and all of its memory.
+ *
+ * Wrong predictions are safe: an object that outlives its epoch just keeps
+ * the epoch memory alive until it's freed. The lifetime of the objects freed
+ * from epochs is still tracked, and a site whose objects stop dying young
+ * goes back to the pools.
+ *
+ * @note Every object carries a 16 bytes header. The pools and the arenas are
+ * the ones of this collection, so POOL_IMPL, ARENA_IMPL and
+ * SIZE_CLASS_ALLOC_IMPL have to be defined once as well.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena_allocator.h"
+#include "size_class_allocator.h"
+
+// Percentage of short lived objects making a site short lived
+#ifndef MEM_ROUTER_SHORT_PERCENT
+#define MEM_ROUTER_SHORT_PERCENT 90
+#endif
+
+// Sites tracked by a router, the ones past this are always sent to the pools
+#ifndef MEM_ROUTER_SITES
+#define MEM_ROUTER_SITES 4096
+#endif
+#if MEM_ROUTER_SITES > 65535
+#error "MEM_ROUTER_SITES must fit the 16 bits site index of the headers"
+#endif
+
+/**
+ * @param classes chunk sizes of the pools, ascending
+ * @param n_classes number of classes
+ * @param chunks_per_class number of chunks of every pool
+ * @param epoch_bytes bytes handed out by an epoch before moving to a new one
+ * @param short_lifetime objects freed within this many allocations are short
+ * lived
+ */
+typedef struct {
+  const size_t *classes;
+  size_t n_classes;
+  size_t chunks_per_class;
+  size_t epoch_bytes;
+  uint32_t short_lifetime;
+} MemRouterConfig;
+
+typedef struct MemRouter MemRouter;
+
+/**
+ * Heap allocates a new router, in profiling mode
+ * @param config pools and epochs configuration, it's copied
+ * @return pointer to the router, or NULL on failure
+ */
+MemRouter *mem_router_init(const MemRouterConfig *config);
+
+/**
+ * Switches the profiling mode on or off, switching it off updates the
+ * predictions of every site
+ * @param router router we want to configure
+ * @param enabled 1 to profile, 0 to route by prediction
+ */
+void mem_router_profile(MemRouter *router, int enabled);
+
+/**
+ * Allocates bytes, the site is the caller
+ * @param router router we want to allocate from
+ * @param bytes number of bytes requested
+ * @return pointer to the memory, or NULL on failure
+ */
+void *mem_router_alloc(MemRouter *router, size_t bytes);
+
+/**
+ * Allocates bytes for an explicit site
+ * @param router router we want to allocate from
+ * @param bytes number of bytes requested
+ * @param site any value identifying the allocation site, 0 is no site (never
+ * profiled, its memory always comes from the pools)
+ * @return pointer to the memory, or NULL on failure
+ */
+void *mem_router_alloc_site(MemRouter *router, size_t bytes, uintptr_t site);
+
+/**
+ * Gives memory back to the router, from any thread
+ * @param router router the memory comes from
+ * @param ptr memory to give back
+ * @param bytes size passed to the alloc
+ */
+void mem_router_free(MemRouter *router, void *ptr, size_t bytes);
+
+/**
+ * Frees the router and all of its memory, no other thread can be using it
+ * @param router router we are freeing
+ */
+void mem_router_deinit(MemRouter *router);
+
+#endif // LIFETIME_ROUTER_H
+
+#ifdef LIFETIME_ROUTER_IMPL
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define MEM_ROUTER_KIND_POOL 0
+#define MEM_ROUTER_KIND_EPOCH 1
+#define MEM_ROUTER_KIND_HEAP 2
+
+// Table entries looked at before giving up on a site
+#define MEM_ROUTER_PROBES 16
+// Samples needed before a site prediction changes
+#define MEM_ROUTER_MIN_SAMPLES 32
+// Samples of a site after which the old ones count half as much
+#define MEM_ROUTER_WINDOW 1024
+// Allocations a thread counts before moving the shared clock
+#define MEM_ROUTER_CLOCK_BATCH 32
+// Recycled epochs kept around, the others are unmapped
+#define MEM_ROUTER_SPARE_EPOCHS 8
+
+/**
+ * @param epoch epoch of the object, NULL outside of epochs
+ * @param birth router clock when the object was allocated
+ * @param site index of the allocation site
+ * @param kind where the object lives (MEM_ROUTER_KIND_*)
+ */
+typedef struct {
+  void *epoch;
+  uint32_t birth;
+  uint16_t site;
+  uint16_t kind;
+} MemRouterHeader;
+
+_Static_assert(sizeof(MemRouterHeader) == 16, "header must keep alignment");
+
+/**
+ * @param key site identifier, 0 while the entry is empty
+ * @param short_frees objects of the site that died young
+ * @param long_frees objects of the site that didn't
+ * @param short_lived 1 if the site is predicted short lived
+ */
+typedef struct {
+  _Atomic uintptr_t key;
+  _Atomic uint64_t short_frees;
+  _Atomic uint64_t long_frees;
+  _Atomic int short_lived;
+} MemRouterSite;
+
+/**
+ * @param arena memory of the epoch
+ * @param used bytes handed out so far, only touched by the owner thread
+ * @param live objects still allocated, plus one while a thread owns it
+ * @param prev previous epoch of the router
+ * @param next next epoch of the router
+ * @param next_spare next recycled epoch
+ */
+typedef struct MemRouterEpoch {
+  MemArena *arena;
+  size_t used;
+  _Atomic size_t live;
+  struct MemRouterEpoch *prev;
+  struct MemRouterEpoch *next;
+  struct MemRouterEpoch *next_spare;
+} MemRouterEpoch;
+
+/**
+ * @param router router the state belongs to
+ * @param epoch current epoch of the thread
+ * @param ticks allocations not yet added to the shared clock
+ * @param next next thread state of the router
+ */
+typedef struct MemRouterThread {
+  MemRouter *router;
+  MemRouterEpoch *epoch;
+  uint32_t ticks;
+  struct MemRouterThread *next;
+} MemRouterThread;
+
+/**
+ * @param config configuration passed to 'mem_router_init'
+ * @param pools size class pools, protected by pools_lock
+ * @param pools_lock protects pools
+ * @param lock protects epochs, spares and threads
+ * @param epochs every epoch of the router
+ * @param spares recycled epochs
+ * @param n_spares number of recycled epochs
+ * @param threads state of every thread using the router
+ * @param key thread specific key of the thread states
+ * @param clock router allocations so far
+ * @param profiling 1 while in profiling mode
+ * @param sites allocation sites table
+ */
+struct MemRouter {
+  MemRouterConfig config;
+  MemSizeClassAlloc *pools;
+  pthread_mutex_t pools_lock;
+  pthread_mutex_t lock;
+  MemRouterEpoch *epochs;
+  MemRouterEpoch *spares;
+  size_t n_spares;
+  MemRouterThread *threads;
+  pthread_key_t key;
+  _Atomic uint32_t clock;
+  _Atomic int profiling;
+  MemRouterSite sites[MEM_ROUTER_SITES];
+};
+
+static MemRouterEpoch *mem_router_epoch_get(MemRouter *router) {
+  pthread_mutex_lock(&router->lock);
+  MemRouterEpoch *epoch = router->spares;
+  if (epoch != NULL) {
+    router->spares = epoch->next_spare;
+    router->n_spares--;
+    pthread_mutex_unlock(&router->lock);
+  } else {
+    pthread_mutex_unlock(&router->lock);
+    epoch = calloc(1, sizeof(MemRouterEpoch));
+    if (epoch == NULL) {
+      return NULL;
+    }
+    epoch->arena = mem_arena_init_growable(router->config.epoch_bytes, 0);
+    if (epoch->arena == NULL) {
+      free(epoch);
+      return NULL;
+    }
+    pthread_mutex_lock(&router->lock);
+    epoch->next = router->epochs;
+    if (router->epochs != NULL) {
+      router->epochs->prev = epoch;
+    }
+    router->epochs = epoch;
+    pthread_mutex_unlock(&router->lock);
+  }
+  epoch->used = 0;
+  atomic_store_explicit(&epoch->live, 1, memory_order_relaxed);
+  return epoch;
+}
+
+static void mem_router_epoch_destroy(MemRouterEpoch *epoch) {
+  mem_arena_deinit(epoch->arena);
+  free(epoch);
+}
+
+// Drops a reference to the epoch, the last one recycles it
+static void mem_router_epoch_put(MemRouter *router, MemRouterEpoch *epoch) {
+  if (atomic_fetch_sub_explicit(&epoch->live, 1, memory_order_acq_rel) != 1) {
+    return;
+  }
+  mem_arena_reset(epoch->arena);
+  pthread_mutex_lock(&router->lock);
+  if (router->n_spares < MEM_ROUTER_SPARE_EPOCHS) {
+    epoch->next_spare = router->spares;
+    router->spares = epoch;
+    router->n_spares++;
+    pthread_mutex_unlock(&router->lock);
+    return;
+  }
+  if (epoch->prev != NULL) {
+    epoch->prev->next = epoch->next;
+  } else {
+    router->epochs = epoch->next;
+  }
+  if (epoch->next != NULL) {
+    epoch->next->prev = epoch->prev;
+  }
+  pthread_mutex_unlock(&router->lock);
+  mem_router_epoch_destroy(epoch);
+}
+
+// Runs when a thread exits, its current epoch is retired
+static void mem_router_thread_exit(void *arg) {
+  MemRouterThread *thread = arg;
+  MemRouter *router = thread->router;
+  if (thread->epoch != NULL) {
+    mem_router_epoch_put(router, thread->epoch);
+  }
+  pthread_mutex_lock(&router->lock);
+  for (MemRouterThread **link = &router->threads; *link != NULL;
+       link = &(*link)->next) {
+    if (*link == thread) {
+      *link = thread->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&router->lock);
+  free(thread);
+}
+
+static MemRouterThread *mem_router_thread(MemRouter *router) {
+  MemRouterThread *thread = pthread_getspecific(router->key);
+  if (thread != NULL) {
+    return thread;
+  }
+  thread = calloc(1, sizeof(MemRouterThread));
+  if (thread == NULL) {
+    return NULL;
+  }
+  thread->router = router;
+  if (pthread_setspecific(router->key, thread)) {
+    free(thread);
+    return NULL;
+  }
+  pthread_mutex_lock(&router->lock);
+  thread->next = router->threads;
+  router->threads = thread;
+  pthread_mutex_unlock(&router->lock);
+  return thread;
+}
+
+// Advances the clock, in batches to keep the threads off the shared counter
+static uint32_t mem_router_tick(MemRouter *router, MemRouterThread *thread) {
+  uint32_t ticks = 1;
+  if (thread != NULL) {
+    if (++thread->ticks < MEM_ROUTER_CLOCK_BATCH) {
+      return atomic_load_explicit(&router->clock, memory_order_relaxed);
+    }
+    ticks = thread->ticks;
+    thread->ticks = 0;
+  }
+  return atomic_fetch_add_explicit(&router->clock, ticks,
+                                   memory_order_relaxed) +
+         ticks;
+}
+
+// Index of the site, MEM_ROUTER_SITES if its neighbourhood of the table is
+// full or for site 0
+static uint16_t mem_router_site(MemRouter *router, uintptr_t key) {
+  if (key == 0) {
+    return MEM_ROUTER_SITES; // 0 marks empty entries, it isn't a site
+  }
+  size_t hash = (size_t)(((uint64_t)key * 0x9e3779b97f4a7c15ull) >> 32);
+  for (size_t probe = 0; probe < MEM_ROUTER_PROBES; ++probe) {
+    size_t index = (hash + probe) % MEM_ROUTER_SITES;
+    MemRouterSite *site = &router->sites[index];
+    uintptr_t found = atomic_load_explicit(&site->key, memory_order_acquire);
+    if (found == 0 &&
+        atomic_compare_exchange_strong_explicit(
+            &site->key, &found, key, memory_order_acq_rel,
+            memory_order_acquire)) {
+      return (uint16_t)index;
+    }
+    if (found == key) {
+      return (uint16_t)index;
+    }
+  }
+  return MEM_ROUTER_SITES;
+}
+
+static int mem_router_is_short(uint64_t short_frees, uint64_t long_frees) {
+  uint64_t total = short_frees + long_frees;
+  return total >= MEM_ROUTER_MIN_SAMPLES &&
+         short_frees * 100 >= total * MEM_ROUTER_SHORT_PERCENT;
+}
+
+static void mem_router_record(MemRouter *router, MemRouterHeader *header) {
+  int in_epoch = header->kind == MEM_ROUTER_KIND_EPOCH;
+  if (header->site >= MEM_ROUTER_SITES ||
+      (!in_epoch &&
+       !atomic_load_explicit(&router->profiling, memory_order_relaxed))) {
+    return;
+  }
+  MemRouterSite *site = &router->sites[header->site];
+  uint32_t now = atomic_load_explicit(&router->clock, memory_order_relaxed);
+  if (now - header->birth <= router->config.short_lifetime) {
+    uint64_t short_frees = atomic_fetch_add_explicit(
+                               &site->short_frees, 1, memory_order_relaxed) +
+                           1;
+    if (short_frees >= MEM_ROUTER_WINDOW) {
+      // Halving both keeps the ratio, and a site that has been short lived
+      // for long still goes back to the pools soon after it changes
+      atomic_store_explicit(&site->short_frees, short_frees / 2,
+                            memory_order_relaxed);
+      atomic_store_explicit(
+          &site->long_frees,
+          atomic_load_explicit(&site->long_frees, memory_order_relaxed) / 2,
+          memory_order_relaxed);
+    }
+    return;
+  }
+  uint64_t long_frees =
+      atomic_fetch_add_explicit(&site->long_frees, 1, memory_order_relaxed) +
+      1;
+  uint64_t short_frees =
+      atomic_load_explicit(&site->short_frees, memory_order_relaxed);
+  if (in_epoch && short_frees + long_frees >= MEM_ROUTER_MIN_SAMPLES &&
+      !mem_router_is_short(short_frees, long_frees)) {
+    // Mispredicted, send the site back to the pools
+    atomic_store_explicit(&site->short_lived, 0, memory_order_relaxed);
+  }
+}
+
+MemRouter *mem_router_init(const MemRouterConfig *config) {
+  if (config == NULL || config->epoch_bytes == 0) {
+    return NULL;
+  }
+  MemRouter *router = calloc(1, sizeof(MemRouter));
+  if (router == NULL) {
+    return NULL;
+  }
+  router->config = *config;
+  // Classes that aren't multiples of 16 would misalign every other chunk
+  size_t *classes = malloc(config->n_classes * sizeof(size_t));
+  if (classes == NULL && config->n_classes > 0) {
+    free(router);
+    return NULL;
+  }
+  size_t n_classes = 0;
+  for (size_t i = 0; i < config->n_classes; ++i) {
+    if (config->classes[i] > SIZE_MAX - 15) {
+      break;
+    }
+    size_t size = (config->classes[i] + 15) & ~(size_t)15;
+    if (n_classes == 0 || classes[n_classes - 1] != size) {
+      classes[n_classes++] = size;
+    }
+  }
+  router->pools =
+      mem_size_class_init(classes, n_classes, config->chunks_per_class);
+  free(classes);
+  if (router->pools == NULL) {
+    free(router);
+    return NULL;
+  }
+  if (pthread_key_create(&router->key, mem_router_thread_exit)) {
+    mem_size_class_deinit(router->pools);
+    free(router);
+    return NULL;
+  }
+  pthread_mutex_init(&router->pools_lock, NULL);
+  pthread_mutex_init(&router->lock, NULL);
+  atomic_init(&router->profiling, 1);
+  return router;
+}
+
+void mem_router_profile(MemRouter *router, int enabled) {
+  if (router == NULL) {
+    return;
+  }
+  atomic_store_explicit(&router->profiling, enabled, memory_order_relaxed);
+  if (enabled) {
+    return;
+  }
+  for (size_t i = 0; i < MEM_ROUTER_SITES; ++i) {
+    MemRouterSite *site = &router->sites[i];
+    uint64_t short_frees = atomic_exchange_explicit(&site->short_frees, 0,
+                                                    memory_order_relaxed);
+    uint64_t long_frees = atomic_exchange_explicit(&site->long_frees, 0,
+                                                   memory_order_relaxed);
+    atomic_store_explicit(&site->short_lived,
+                          mem_router_is_short(short_frees, long_frees),
+                          memory_order_relaxed);
+  }
+}
+
+static void *mem_router_epoch_alloc(MemRouter *router, MemRouterThread *thread,
+                                    size_t total) {
+  MemRouterEpoch *epoch = thread->epoch;
+  size_t epoch_bytes = router->config.epoch_bytes;
+  // Moving on before the arena grows keeps recycled epochs on their first
+  // block, whose pages are already faulted in. A grown arena gives that block
+  // back on reset and the next epoch starts on fresh pages
+  if (epoch == NULL ||
+      (epoch->used > 0 && (epoch->used >= epoch_bytes ||
+                           total > epoch_bytes - epoch->used))) {
+    if (epoch != NULL) {
+      mem_router_epoch_put(router, epoch);
+    }
+    epoch = thread->epoch = mem_router_epoch_get(router);
+    if (epoch == NULL) {
+      return NULL;
+    }
+  }
+  MemRouterHeader *header = mem_arena_alloc(epoch->arena, total);
+  if (header == NULL) {
+    return NULL;
+  }
+  epoch->used += total;
+  atomic_fetch_add_explicit(&epoch->live, 1, memory_order_relaxed);
+  header->epoch = epoch;
+  return header;
+}
+
+void *mem_router_alloc_site(MemRouter *router, size_t bytes, uintptr_t site) {
+  if (router == NULL || bytes > SIZE_MAX - 2 * sizeof(MemRouterHeader)) {
+    return NULL;
+  }
+  // Arena allocations are rounded too, so every object stays aligned
+  size_t total = (bytes + sizeof(MemRouterHeader) + 15) & ~(size_t)15;
+  MemRouterThread *thread = mem_router_thread(router);
+  uint32_t now = mem_router_tick(router, thread);
+  uint16_t index = mem_router_site(router, site);
+
+  MemRouterHeader *header = NULL;
+  uint16_t kind = MEM_ROUTER_KIND_EPOCH;
+  if (thread != NULL && index < MEM_ROUTER_SITES &&
+      !atomic_load_explicit(&router->profiling, memory_order_relaxed) &&
+      atomic_load_explicit(&router->sites[index].short_lived,
+                           memory_order_relaxed)) {
+    header = mem_router_epoch_alloc(router, thread, total);
+  }
+  if (header == NULL) {
+    kind = MEM_ROUTER_KIND_POOL;
+    pthread_mutex_lock(&router->pools_lock);
+    header = mem_size_class_alloc(router->pools, total);
+    pthread_mutex_unlock(&router->pools_lock);
+    if (header == NULL) {
+      kind = MEM_ROUTER_KIND_HEAP;
+      header = malloc(total);
+      if (header == NULL) {
+        return NULL;
+      }
+    }
+    header->epoch = NULL;
+  }
+  header->birth = now;
+  header->site = index;
+  header->kind = kind;
+  return header + 1;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((noinline)) void *mem_router_alloc(MemRouter *router,
+                                                 size_t bytes) {
+  return mem_router_alloc_site(
+      router, bytes, (uintptr_t)__builtin_return_address(0));
+}
+#else
+void *mem_router_alloc(MemRouter *router, size_t bytes) {
+  // No way to tell the callers apart, they all share one site
+  return mem_router_alloc_site(router, bytes, 1);
+}
+#endif
+
+void mem_router_free(MemRouter *router, void *ptr, size_t bytes) {
+  if (router == NULL || ptr == NULL) {
+    return;
+  }
+  MemRouterHeader *header = (MemRouterHeader *)ptr - 1;
+  mem_router_record(router, header);
+  switch (header->kind) {
+  case MEM_ROUTER_KIND_EPOCH:
+    mem_router_epoch_put(router, header->epoch);
+    break;
+  case MEM_ROUTER_KIND_POOL:
+    pthread_mutex_lock(&router->pools_lock);
+    mem_size_class_free(router->pools, header,
+                        (bytes + sizeof(MemRouterHeader) + 15) & ~(size_t)15);
+    pthread_mutex_unlock(&router->pools_lock);
+    break;
+  default:
+    free(header);
+    break;
+  }
+}
+
+void mem_router_deinit(MemRouter *router) {
+  if (router == NULL) {
+    return;
+  }
+  // The calling thread may have a state the key destructor will never see
+  pthread_setspecific(router->key, NULL);
+  pthread_key_delete(router->key);
+  while (router->threads != NULL) {
+    MemRouterThread *next = router->threads->next;
+    free(router->threads);
+    router->threads = next;
+  }
+  while (router->epochs != NULL) {
+    MemRouterEpoch *next = router->epochs->next;
+    mem_router_epoch_destroy(router->epochs);
+    router->epochs = next;
+  }
+  mem_size_class_deinit(router->pools);
+  pthread_mutex_destroy(&router->pools_lock);
+  pthread_mutex_destroy(&router->lock);
+  free(router);
+}
+
+#undef MEM_ROUTER_KIND_POOL
+#undef MEM_ROUTER_KIND_EPOCH
+#undef MEM_ROUTER_KIND_HEAP
+#undef MEM_ROUTER_PROBES
+#undef MEM_ROUTER_MIN_SAMPLES
+#undef MEM_ROUTER_WINDOW
+#undef MEM_ROUTER_CLOCK_BATCH
+#undef MEM_ROUTER_SPARE_EPOCHS
+
+#endif // LIFETIME_ROUTER_IMPL
@@ -0,0 +1,323 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+/**
+ * STB-style implementation of a fixed-memory cache mapping 64 bits keys to
+ * values of a fixed size. Every entry (key, links and value) is a chunk of a
+ * single MemPool sized for the capacity, so the memory of the cache is
+ * allocated once at init: when the cache is full the victim entry is
+ * unlinked and its chunk rewritten in place for the new key, nothing goes
+ * back to the pool. Keys are found through an intrusive chained hash index.
+ *
+ * Two eviction policies:
+ *  - MEM_LRU_EXACT: the least recently used entry, kept at the tail of a
+ *    doubly linked list every hit moves to the front;
+ *  - MEM_LRU_CLOCK: a hit only sets a reference bit, a hand sweeps the pool
+ *    chunks clearing the bits and evicts the first entry it finds without
+ *    one. A cheaper hit path (no list to update) for an approximation of LRU.
+ *
+ * 'mem_lru_init' -> Allocates a cache of capacity entries with values of
+ * value_size bytes.
+ *
+ * 'mem_lru_get' -> Returns a pointer to the value of a key, NULL if it isn't
+ * cached, and marks the entry as used.
+ *
+ * 'mem_lru_put' -> Inserts (or updates) a key, copying value_size bytes from
+ * value unless it's NULL, and returns a pointer to the value in the cache so
+ * it can also be filled in place.
+ *
+ * 'mem_lru_remove' -> Drops a key, its chunk goes back to the pool.
+ *
+ * 'mem_lru_deinit' -> Frees the cache.
+ *
+ * @note A value pointer is valid until the next put or remove. Not thread
+ * safe. The entries live in a MemPool, so POOL_IMPL has to be defined once
+ * as well.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool_allocator.h"
+
+#define MEM_LRU_EXACT 0
+#define MEM_LRU_CLOCK 1
+
+/**
+ * @param key key of the entry
+ * @param hnext next entry of the hash chain
+ * @param prev previous entry of the LRU list (more recently used)
+ * @param next next entry of the LRU list (less recently used)
+ * @param referenced reference bit of the CLOCK policy
+ * @note The value follows the header, aligned to MEM_LRU_ALIGN bytes.
+ */
+typedef struct MemLruEntry {
+  uint64_t key;
+  struct MemLruEntry *hnext;
+  struct MemLruEntry *prev;
+  struct MemLruEntry *next;
+  uint8_t referenced;
+} MemLruEntry;
+
+/**
+ * @param pool entries of the cache
+ * @param buckets hash chain heads
+ * @param mask number of buckets minus one
+ * @param lru sentinel of the LRU list, lru.next is the most recently used
+ * entry and lru.prev the least recently used one
+ * @param hand next chunk looked at by the CLOCK policy
+ * @param value_size size of every value
+ * @param size number of cached keys
+ * @param policy MEM_LRU_EXACT or MEM_LRU_CLOCK
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  MemPool *pool;
+  MemLruEntry **buckets;
+  size_t mask;
+  MemLruEntry lru;
+  size_t hand;
+  size_t value_size;
+  size_t size;
+  int policy;
+} MemLruCache;
+
+/**
+ * Heap allocates a new cache, all of its memory included
+ * @param capacity maximum number of cached keys
+ * @param value_size size of every value
+ * @param policy MEM_LRU_EXACT or MEM_LRU_CLOCK
+ * @return pointer to the cache, or NULL on failure
+ */
+MemLruCache *mem_lru_init(size_t capacity, size_t value_size, int policy);
+
+/**
+ * Looks a key up and marks it as used
+ * @param cache cache we are reading
+ * @param key key we are looking for
+ * @return pointer to the value, or NULL if the key isn't cached
+ */
+void *mem_lru_get(MemLruCache *cache, uint64_t key);
+
+/**
+ * Inserts a key (or updates its value), evicting an entry if the cache is
+ * full
+ * @param cache cache we are writing
+ * @param key key of the entry
+ * @param value value_size bytes copied in the entry, can be NULL
+ * @return pointer to the value in the cache, or NULL on failure
+ */
+void *mem_lru_put(MemLruCache *cache, uint64_t key, const void *value);
+
+/**
+ * Removes a key
+ * @param cache cache we are writing
+ * @param key key to remove
+ * @return 1 if the key was removed, 0 if it wasn't cached.
+ */
+int mem_lru_remove(MemLruCache *cache, uint64_t key);
+
+/**
+ * Gives the number of cached keys
+ * @param cache cache we are interested in
+ * @return number of cached keys
+ */
+size_t mem_lru_size(const MemLruCache *cache);
+
+/**
+ * Frees the memory related to the cache passed as parameter
+ * @param cache cache we are freeing
+ */
+void mem_lru_deinit(MemLruCache *cache);
+
+#endif // LRU_CACHE_H
+
+#ifdef LRU_CACHE_IMPL
+
+#include <string.h>
+
+#define MEM_LRU_ALIGN 16
+#define MEM_LRU_HEADER                                                         \
+  ((sizeof(MemLruEntry) + MEM_LRU_ALIGN - 1) & ~(size_t)(MEM_LRU_ALIGN - 1))
+#define MEM_LRU_VALUE(entry) ((uint8_t *)(entry) + MEM_LRU_HEADER)
+
+static size_t mem_lru_bucket(const MemLruCache *cache, uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ull;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebull;
+  key ^= key >> 31;
+  return (size_t)key & cache->mask;
+}
+
+static void mem_lru_list_remove(MemLruEntry *entry) {
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+}
+
+static void mem_lru_list_push(MemLruCache *cache, MemLruEntry *entry) {
+  entry->prev = &cache->lru;
+  entry->next = cache->lru.next;
+  cache->lru.next->prev = entry;
+  cache->lru.next = entry;
+}
+
+static void mem_lru_hash_remove(MemLruCache *cache, MemLruEntry *entry) {
+  MemLruEntry **link = &cache->buckets[mem_lru_bucket(cache, entry->key)];
+  while (*link != entry) {
+    link = &(*link)->hnext;
+  }
+  *link = entry->hnext;
+}
+
+MemLruCache *mem_lru_init(size_t capacity, size_t value_size, int policy) {
+  if (capacity == 0 || capacity > (SIZE_MAX >> 1) ||
+      (policy != MEM_LRU_EXACT && policy != MEM_LRU_CLOCK)) {
+    return NULL;
+  }
+  MemLruCache *cache = calloc(1, sizeof(MemLruCache));
+  if (cache == NULL) {
+    return NULL;
+  }
+  size_t buckets = 1;
+  while (buckets < capacity) {
+    buckets <<= 1;
+  }
+  size_t chunk = MEM_LRU_HEADER + ((value_size + MEM_LRU_ALIGN - 1) &
+                                   ~(size_t)(MEM_LRU_ALIGN - 1));
+  cache->pool = mem_pool_init_ex(chunk, capacity, MEM_POOL_REUSE_LIFO);
+  cache->buckets = calloc(buckets, sizeof(MemLruEntry *));
+  if (cache->pool == NULL || cache->buckets == NULL) {
+    mem_lru_deinit(cache);
+    return NULL;
+  }
+  cache->mask = buckets - 1;
+  cache->lru.prev = &cache->lru;
+  cache->lru.next = &cache->lru;
+  cache->value_size = value_size;
+  cache->policy = policy;
+  return cache;
+}
+
+static MemLruEntry *mem_lru_find(MemLruCache *cache, uint64_t key) {
+  MemLruEntry *entry = cache->buckets[mem_lru_bucket(cache, key)];
+  while (entry != NULL && entry->key != key) {
+    entry = entry->hnext;
+  }
+  return entry;
+}
+
+static void mem_lru_touch(MemLruCache *cache, MemLruEntry *entry) {
+  if (cache->policy == MEM_LRU_CLOCK) {
+    entry->referenced = 1;
+  } else if (cache->lru.next != entry) {
+    mem_lru_list_remove(entry);
+    mem_lru_list_push(cache, entry);
+  }
+}
+
+void *mem_lru_get(MemLruCache *cache, uint64_t key) {
+  if (cache == NULL) {
+    return NULL;
+  }
+  MemLruEntry *entry = mem_lru_find(cache, key);
+  if (entry == NULL) {
+    return NULL;
+  }
+  mem_lru_touch(cache, entry);
+  return MEM_LRU_VALUE(entry);
+}
+
+// Picks the entry to recycle, the pool is full so every chunk is an entry
+static MemLruEntry *mem_lru_victim(MemLruCache *cache) {
+  if (cache->policy == MEM_LRU_EXACT) {
+    MemLruEntry *entry = cache->lru.prev;
+    mem_lru_list_remove(entry);
+    return entry;
+  }
+  MemPool *pool = cache->pool;
+  for (;;) {
+    MemLruEntry *entry =
+        (MemLruEntry *)(pool->data + cache->hand * pool->chunk_size);
+    if (++cache->hand == pool->n_chunks) {
+      cache->hand = 0;
+    }
+    if (!entry->referenced) {
+      return entry;
+    }
+    entry->referenced = 0; // Second chance, evicted next lap if unused
+  }
+}
+
+void *mem_lru_put(MemLruCache *cache, uint64_t key, const void *value) {
+  if (cache == NULL) {
+    return NULL;
+  }
+  MemLruEntry *entry = mem_lru_find(cache, key);
+  if (entry != NULL) {
+    mem_lru_touch(cache, entry);
+  } else {
+    entry = mem_pool_alloc(cache->pool);
+    if (entry == NULL) {
+      // Full, the victim chunk is reused in place for the new key
+      entry = mem_lru_victim(cache);
+      mem_lru_hash_remove(cache, entry);
+    } else {
+      cache->size++;
+    }
+    entry->key = key;
+    entry->referenced = 0;
+    entry->hnext = NULL;
+    // At the end of the chain: keys that stay cached for long are the hot
+    // ones, and the lookups for them don't have to skip the newcomers
+    MemLruEntry **link = &cache->buckets[mem_lru_bucket(cache, key)];
+    while (*link != NULL) {
+      link = &(*link)->hnext;
+    }
+    *link = entry;
+    if (cache->policy == MEM_LRU_EXACT) {
+      mem_lru_list_push(cache, entry);
+    }
+  }
+  if (value != NULL) {
+    memcpy(MEM_LRU_VALUE(entry), value, cache->value_size);
+  }
+  return MEM_LRU_VALUE(entry);
+}
+
+int mem_lru_remove(MemLruCache *cache, uint64_t key) {
+  if (cache == NULL) {
+    return 0;
+  }
+  MemLruEntry *entry = mem_lru_find(cache, key);
+  if (entry == NULL) {
+    return 0;
+  }
+  mem_lru_hash_remove(cache, entry);
+  if (cache->policy == MEM_LRU_EXACT) {
+    mem_lru_list_remove(entry);
+  }
+  mem_pool_free(cache->pool, entry);
+  cache->size--;
+  return 1;
+}
+
+size_t mem_lru_size(const MemLruCache *cache) {
+  return cache != NULL ? cache->size : 0;
+}
+
+void mem_lru_deinit(MemLruCache *cache) {
+  if (cache != NULL) {
+    mem_pool_deinit(cache->pool);
+    free(cache->buckets);
+    free(cache);
+  }
+}
+
+#undef MEM_LRU_ALIGN
+#undef MEM_LRU_HEADER
+#undef MEM_LRU_VALUE
+
+#endif // LRU_CACHE_IMPL
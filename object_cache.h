@@ -0,0 +1,321 @@
+#ifndef OBJECT_CACHE_H
+#define OBJECT_CACHE_H
+
+/**
+ * STB-style implementation of an object cache built on top of
+ * 'pool_allocator.h'. Objects with expensive internal state (initialized
+ * mutexes, pre-sized buffers...) are kept constructed while they sit in the
+ * cache: the constructor runs on every object when a new slab (MemPool) is
+ * created and the destructor only when the slab is reclaimed, so alloc and
+ * free just hand out and take back objects that are ready to be used.
+ *
+ * The user is expected to give objects back in their constructed state, the
+ * same way they got them.
+ *
+ * 'mem_object_cache_init' -> Allocates a new cache for objects of the given
+ * size, slabs are created on demand with objects_per_slab objects each.
+ *
+ * 'mem_object_cache_alloc' -> Returns a constructed object, creating a new
+ * slab if all the current ones are in use. Returns NULL if the slab couldn't
+ * be allocated or the constructor failed.
+ *
+ * 'mem_object_cache_free' -> Gives an object back to its slab, without
+ * running the destructor. Objects that are already free are ignored. When
+ * MEM_USE_PAGE_HEAP is defined the slab memory is made of whole pages, so the
+ * slab of an object is found with a pagemap lookup (see 'pagemap.h'),
+ * otherwise the slabs are searched.
+ *
+ * 'mem_object_cache_reap' -> Destroys the slabs with no object in use, running
+ * the destructor on all of their objects. Returns the number of slabs freed.
+ *
+ * 'mem_object_cache_deinit' -> Destroys every slab and the cache itself.
+ *
+ * @note The slabs are plain MemPools, so POOL_IMPL has to be defined once as
+ * well.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool_allocator.h"
+
+/**
+ * Constructor called on every object of a new slab
+ * @param object object to construct
+ * @param ctx user context passed to 'mem_object_cache_init'
+ * @return 1 if the object was constructed, 0 otherwise.
+ */
+typedef int (*MemObjectCtor)(void *object, void *ctx);
+
+/**
+ * Destructor called on every object of a slab being reclaimed
+ * @param object object to destroy
+ * @param ctx user context passed to 'mem_object_cache_init'
+ */
+typedef void (*MemObjectDtor)(void *object, void *ctx);
+
+/**
+ * @param pool chunks of the slab, every one of them holds a constructed object
+ * @param used number of objects handed out
+ * @param next next slab of the cache
+ * @param pprev link pointing to this slab
+ */
+typedef struct MemObjectSlab {
+  MemPool *pool;
+  size_t used;
+  struct MemObjectSlab *next;
+  struct MemObjectSlab **pprev;
+} MemObjectSlab;
+
+/**
+ * @param object_size size of the objects, rounded up to keep them aligned
+ * @param objects_per_slab number of objects in every slab
+ * @param ctor constructor, can be NULL
+ * @param dtor destructor, can be NULL
+ * @param ctx user context passed to ctor and dtor
+ * @param slabs list of slabs, the ones with free objects are kept first
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  size_t object_size;
+  size_t objects_per_slab;
+  MemObjectCtor ctor;
+  MemObjectDtor dtor;
+  void *ctx;
+  MemObjectSlab *slabs;
+} MemObjectCache;
+
+/**
+ * Heap allocates a new object cache and returns the pointer to it
+ * @param object_size size of a single object
+ * @param objects_per_slab number of objects created at once
+ * @param ctor constructor run once per object when its slab is created
+ * @param dtor destructor run once per object when its slab is reclaimed
+ * @param ctx user context passed to ctor and dtor
+ * @return pointer to the initialized cache, or NULL on failure
+ */
+MemObjectCache *mem_object_cache_init(size_t object_size,
+                                      size_t objects_per_slab,
+                                      MemObjectCtor ctor, MemObjectDtor dtor,
+                                      void *ctx);
+
+/**
+ * Gets a constructed object from the cache
+ * @param cache cache we want to get the object from
+ * @return pointer to the object, or NULL on failure
+ */
+void *mem_object_cache_alloc(MemObjectCache *cache);
+
+/**
+ * Gives a (still constructed) object back to the cache
+ * @param cache cache owning the object
+ * @param object object we are giving back
+ */
+void mem_object_cache_free(MemObjectCache *cache, void *object);
+
+/**
+ * Destroys the slabs that have no object in use
+ * @param cache cache we want to shrink
+ * @return number of slabs destroyed
+ */
+size_t mem_object_cache_reap(MemObjectCache *cache);
+
+/**
+ * Destroys every object and frees the memory related to the cache
+ * @param cache cache we are freeing
+ */
+void mem_object_cache_deinit(MemObjectCache *cache);
+
+#endif // OBJECT_CACHE_H
+
+#ifdef OBJECT_CACHE_IMPL
+
+// Objects often hold mutexes or doubles, keep them at least this aligned
+#define MEM_OBJECT_ALIGNMENT 16
+
+#ifdef MEM_USE_PAGE_HEAP
+// Slab owning every page of slab memory, shared by all the caches
+static MemPagemap mem_object_slab_map;
+#endif
+
+static void mem_object_slab_link(MemObjectCache *cache, MemObjectSlab *slab) {
+  slab->next = cache->slabs;
+  if (slab->next != NULL) {
+    slab->next->pprev = &slab->next;
+  }
+  slab->pprev = &cache->slabs;
+  cache->slabs = slab;
+}
+
+static void mem_object_slab_unlink(MemObjectSlab *slab) {
+  *slab->pprev = slab->next;
+  if (slab->next != NULL) {
+    slab->next->pprev = slab->pprev;
+  }
+}
+
+static void mem_object_slab_destroy(MemObjectCache *cache, MemObjectSlab *slab,
+                                    size_t constructed) {
+  MemPool *pool = slab->pool;
+#ifdef MEM_USE_PAGE_HEAP
+  mem_pagemap_set(&mem_object_slab_map, pool->data,
+                  pool->n_chunks * pool->chunk_size, NULL);
+#endif
+  if (cache->dtor != NULL) {
+    for (size_t i = 0; i < constructed; ++i) {
+      cache->dtor(pool->data + i * pool->chunk_size, cache->ctx);
+    }
+  }
+  mem_pool_deinit(pool);
+  free(slab);
+}
+
+static MemObjectSlab *mem_object_slab_create(MemObjectCache *cache) {
+  MemObjectSlab *slab = malloc(sizeof(MemObjectSlab));
+  if (slab == NULL) {
+    return NULL;
+  }
+  MemPool *pool = mem_pool_init(cache->object_size, cache->objects_per_slab);
+  if (pool == NULL) {
+    free(slab);
+    return NULL;
+  }
+  slab->pool = pool;
+  slab->used = 0;
+#ifdef MEM_USE_PAGE_HEAP
+  if (!mem_pagemap_set(&mem_object_slab_map, pool->data,
+                       pool->n_chunks * pool->chunk_size, slab)) {
+    mem_object_slab_destroy(cache, slab, 0);
+    return NULL;
+  }
+#endif
+  if (cache->ctor != NULL) {
+    for (size_t i = 0; i < cache->objects_per_slab; ++i) {
+      if (!cache->ctor(pool->data + i * pool->chunk_size, cache->ctx)) {
+        // Undo the objects we managed to construct
+        mem_object_slab_destroy(cache, slab, i);
+        return NULL;
+      }
+    }
+  }
+  mem_object_slab_link(cache, slab);
+  return slab;
+}
+
+// Slab holding an object, NULL if no slab of the cache has it
+static MemObjectSlab *mem_object_slab_find(MemObjectCache *cache,
+                                           void *object) {
+#ifdef MEM_USE_PAGE_HEAP
+  (void)cache;
+  MemObjectSlab *slab = mem_pagemap_get(&mem_object_slab_map, object);
+  return slab != NULL && mem_pool_owns(slab->pool, object) ? slab : NULL;
+#else
+  for (MemObjectSlab *slab = cache->slabs; slab != NULL; slab = slab->next) {
+    if (mem_pool_owns(slab->pool, object)) {
+      return slab;
+    }
+  }
+  return NULL;
+#endif
+}
+
+MemObjectCache *mem_object_cache_init(size_t object_size,
+                                      size_t objects_per_slab,
+                                      MemObjectCtor ctor, MemObjectDtor dtor,
+                                      void *ctx) {
+  if (object_size == 0 || objects_per_slab == 0 ||
+      object_size > SIZE_MAX - MEM_OBJECT_ALIGNMENT) {
+    return NULL;
+  }
+  MemObjectCache *new_cache = malloc(sizeof(MemObjectCache));
+  if (new_cache == NULL) {
+    return NULL;
+  }
+  new_cache->object_size = (object_size + MEM_OBJECT_ALIGNMENT - 1) &
+                           ~(size_t)(MEM_OBJECT_ALIGNMENT - 1);
+  new_cache->objects_per_slab = objects_per_slab;
+  new_cache->ctor = ctor;
+  new_cache->dtor = dtor;
+  new_cache->ctx = ctx;
+  new_cache->slabs = NULL;
+  return new_cache;
+}
+
+void *mem_object_cache_alloc(MemObjectCache *cache) {
+  if (cache == NULL) {
+    return NULL;
+  }
+  // Slabs with free objects are usually at the front of the list
+  MemObjectSlab *slab = cache->slabs;
+  while (slab != NULL && slab->used == cache->objects_per_slab) {
+    slab = slab->next;
+  }
+  if (slab == NULL) {
+    slab = mem_object_slab_create(cache);
+    if (slab == NULL) {
+      return NULL;
+    }
+  } else if (slab != cache->slabs) {
+    mem_object_slab_unlink(slab);
+    mem_object_slab_link(cache, slab);
+  }
+  void *object = mem_pool_alloc(slab->pool);
+  slab->used++;
+  return object;
+}
+
+void mem_object_cache_free(MemObjectCache *cache, void *object) {
+  if (cache == NULL || object == NULL) {
+    return;
+  }
+  MemObjectSlab *slab = mem_object_slab_find(cache, object);
+  if (slab == NULL) {
+    return;
+  }
+  // A double free must not count, or the slab could be reaped while in use
+  if (!mem_pool_is_allocated(slab->pool, object)) {
+    return;
+  }
+  mem_pool_free(slab->pool, object);
+  slab->used--;
+  // The slab has room again, move it to the front
+  if (slab != cache->slabs) {
+    mem_object_slab_unlink(slab);
+    mem_object_slab_link(cache, slab);
+  }
+}
+
+size_t mem_object_cache_reap(MemObjectCache *cache) {
+  if (cache == NULL) {
+    return 0;
+  }
+  size_t reaped = 0;
+  MemObjectSlab *slab = cache->slabs;
+  while (slab != NULL) {
+    MemObjectSlab *next = slab->next;
+    if (slab->used == 0) {
+      mem_object_slab_unlink(slab);
+      mem_object_slab_destroy(cache, slab, cache->objects_per_slab);
+      reaped++;
+    }
+    slab = next;
+  }
+  return reaped;
+}
+
+void mem_object_cache_deinit(MemObjectCache *cache) {
+  if (cache != NULL) {
+    MemObjectSlab *slab = cache->slabs;
+    while (slab != NULL) {
+      MemObjectSlab *next = slab->next;
+      mem_object_slab_destroy(cache, slab, cache->objects_per_slab);
+      slab = next;
+    }
+    free(cache);
+  }
+}
+
+#undef MEM_OBJECT_ALIGNMENT
+
+#endif // OBJECT_CACHE_IMPL
@@ -0,0 +1,401 @@
+#ifndef PAGE_HEAP_H
+#define PAGE_HEAP_H
+
+/**
+ * STB-style implementation of a central page heap. Instead of having every
+ * pool and arena go to calloc on its own, memory is reserved from the OS in
+ * large mmapped regions and handed out as page-aligned spans (from a single
+ * page up to many MB). Freed spans are coalesced with their free neighbours so
+ * pages can be shared between allocators over time.
+ *
+ * 'mem_page_heap_alloc' -> Returns a page-aligned span of at least n_pages
+ * pages, or NULL if the OS refuses to give us more memory. The content of the
+ * span is undefined.
+ *
+ * 'mem_page_heap_calloc' -> Same as 'mem_page_heap_alloc' but the span is
+ * guaranteed to be zeroed. Spans coming straight from a fresh region are not
+ * touched, so this is as cheap as calloc for large requests.
+ *
+ * 'mem_page_heap_free' -> Gives a span back to the heap, merging it with the
+ * adjacent free spans.
+ *
+ * 'mem_page_heap_trim' -> Gives the physical pages of every free span back to
+ * the OS, the spans stay in the heap and come back zero filled.
+ *
+ * 'mem_page_heap_lookup' -> Returns the span containing a pointer (any pointer
+ * inside the span works, not only its start), or NULL if the pointer wasn't
+ * handed out by the page heap.
+ *
+ * Pools and arenas draw their memory from the page heap when they're compiled
+ * with MEM_USE_PAGE_HEAP defined (the implementation of this header must be
+ * defined once in that case). Every span is also recorded in the global owner
+ * map of 'pagemap.h', so PAGEMAP_IMPL has to be defined once as well.
+ *
+ * @note The heap is global and protected by a mutex, regions are never given
+ * back to the OS.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef MEM_PAGE_SHIFT
+#define MEM_PAGE_SHIFT 12
+#endif
+#define MEM_PAGE_SIZE ((size_t)1 << MEM_PAGE_SHIFT)
+
+// Number of pages needed to hold the given amount of bytes
+#define MEM_PAGES_FOR(bytes) (((bytes) + MEM_PAGE_SIZE - 1) >> MEM_PAGE_SHIFT)
+
+// Size of the regions requested to the OS, bigger spans get their own region
+#ifndef MEM_PAGE_HEAP_REGION_SIZE
+#define MEM_PAGE_HEAP_REGION_SIZE ((size_t)64 << 20)
+#endif
+
+// Spans shorter than this (in pages) have an exact-size free list
+#define MEM_PAGE_HEAP_SMALL_SPANS 128
+
+/**
+ * @param start first byte of the span (page aligned)
+ * @param n_pages length of the span in pages
+ * @param free 1 if the span is sitting in one of the free lists
+ * @param zeroed 1 if the span content is known to be all zeroes
+ * @param prev previous span in the free list
+ * @param next next span in the free list
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct MemSpan {
+  uint8_t *start;
+  size_t n_pages;
+  int free;
+  int zeroed;
+  struct MemSpan *prev;
+  struct MemSpan *next;
+} MemSpan;
+
+/**
+ * Takes a span of at least n_pages pages from the page heap
+ * @param n_pages number of pages requested
+ * @return pointer to the first byte of the span, or NULL on failure
+ */
+void *mem_page_heap_alloc(size_t n_pages);
+
+/**
+ * Takes a zeroed span of at least n_pages pages from the page heap
+ * @param n_pages number of pages requested
+ * @return pointer to the first byte of the span, or NULL on failure
+ */
+void *mem_page_heap_calloc(size_t n_pages);
+
+/**
+ * Gives a span back to the page heap
+ * @param ptr pointer returned by 'mem_page_heap_alloc' or
+ * 'mem_page_heap_calloc'
+ */
+void mem_page_heap_free(void *ptr);
+
+/**
+ * Releases the physical memory of the free spans
+ * @return number of bytes given back to the OS
+ */
+size_t mem_page_heap_trim(void);
+
+/**
+ * Finds the span containing the pointer passed as parameter
+ * @param ptr any pointer inside a span
+ * @return the span owning ptr, or NULL if ptr doesn't belong to the page heap
+ */
+MemSpan *mem_page_heap_lookup(const void *ptr);
+
+#include "pagemap.h"
+
+#endif // PAGE_HEAP_H
+
+#if defined(PAGE_HEAP_IMPL) && !defined(PAGE_HEAP_IMPL_DONE)
+#define PAGE_HEAP_IMPL_DONE
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * @param lock protects every other member
+ * @param free_lists sentinels of the free lists, the last one holds every span
+ * with at least MEM_PAGE_HEAP_SMALL_SPANS pages
+ * @param spans maps the pages to their span, allocated spans have every page
+ * mapped while free spans only have their first and last page
+ * @param spare_spans recycled span descriptors
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  MemSpan free_lists[MEM_PAGE_HEAP_SMALL_SPANS + 1];
+  MemPagemap spans;
+  MemSpan *spare_spans;
+  int initialized;
+} MemPageHeap;
+
+static MemPageHeap mem_page_heap = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void *mem_page_heap_map(size_t bytes) {
+  void *ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static MemSpan *mem_page_heap_new_span(void) {
+  if (mem_page_heap.spare_spans == NULL) {
+    // Carve a whole page worth of descriptors at once
+    MemSpan *batch = mem_page_heap_map(MEM_PAGE_SIZE);
+    if (batch == NULL) {
+      return NULL;
+    }
+    for (size_t i = 0; i < MEM_PAGE_SIZE / sizeof(MemSpan); ++i) {
+      batch[i].next = mem_page_heap.spare_spans;
+      mem_page_heap.spare_spans = &batch[i];
+    }
+  }
+  MemSpan *span = mem_page_heap.spare_spans;
+  mem_page_heap.spare_spans = span->next;
+  memset(span, 0, sizeof(MemSpan));
+  return span;
+}
+
+static void mem_page_heap_delete_span(MemSpan *span) {
+  span->next = mem_page_heap.spare_spans;
+  mem_page_heap.spare_spans = span;
+}
+
+static MemSpan *mem_page_heap_span_at(const uint8_t *page) {
+  return mem_pagemap_get(&mem_page_heap.spans, page);
+}
+
+static int mem_page_heap_set_range(MemSpan *span, int all_pages) {
+  if (all_pages) {
+    return mem_pagemap_set(&mem_page_heap.spans, span->start,
+                           span->n_pages << MEM_PAGE_SHIFT, span);
+  }
+  // Free spans only need their boundaries to be found by the neighbours
+  uint8_t *last = span->start + ((span->n_pages - 1) << MEM_PAGE_SHIFT);
+  return mem_pagemap_set(&mem_page_heap.spans, span->start, 1, span) &&
+         mem_pagemap_set(&mem_page_heap.spans, last, 1, span);
+}
+
+static void mem_page_heap_list_push(MemSpan *span) {
+  size_t index = span->n_pages < MEM_PAGE_HEAP_SMALL_SPANS
+                     ? span->n_pages
+                     : MEM_PAGE_HEAP_SMALL_SPANS;
+  MemSpan *head = &mem_page_heap.free_lists[index];
+  span->free = 1;
+  span->prev = head;
+  span->next = head->next;
+  head->next->prev = span;
+  head->next = span;
+}
+
+static void mem_page_heap_list_remove(MemSpan *span) {
+  span->prev->next = span->next;
+  span->next->prev = span->prev;
+  span->prev = span->next = NULL;
+  span->free = 0;
+}
+
+static void mem_page_heap_init_lists(void) {
+  for (size_t i = 0; i <= MEM_PAGE_HEAP_SMALL_SPANS; ++i) {
+    MemSpan *head = &mem_page_heap.free_lists[i];
+    head->prev = head->next = head;
+  }
+  mem_page_heap.initialized = 1;
+}
+
+static MemSpan *mem_page_heap_grow(size_t n_pages) {
+  size_t region_pages = MEM_PAGES_FOR(MEM_PAGE_HEAP_REGION_SIZE);
+  if (n_pages > region_pages) {
+    region_pages = n_pages;
+  }
+  uint8_t *base = mem_page_heap_map(region_pages << MEM_PAGE_SHIFT);
+  if (base == NULL) {
+    return NULL;
+  }
+  MemSpan *span = mem_page_heap_new_span();
+  if (span == NULL) {
+    munmap(base, region_pages << MEM_PAGE_SHIFT);
+    return NULL;
+  }
+  span->start = base;
+  span->n_pages = region_pages;
+  span->zeroed = 1; // Fresh anonymous mappings are zero filled
+  if (!mem_page_heap_set_range(span, 0)) {
+    munmap(base, region_pages << MEM_PAGE_SHIFT);
+    mem_page_heap_delete_span(span);
+    return NULL;
+  }
+  mem_page_heap_list_push(span);
+  return span;
+}
+
+static MemSpan *mem_page_heap_find(size_t n_pages) {
+  // Exact-size lists first, then best fit in the list of the large spans
+  for (size_t i = n_pages; i < MEM_PAGE_HEAP_SMALL_SPANS; ++i) {
+    MemSpan *head = &mem_page_heap.free_lists[i];
+    if (head->next != head) {
+      return head->next;
+    }
+  }
+  MemSpan *head = &mem_page_heap.free_lists[MEM_PAGE_HEAP_SMALL_SPANS];
+  MemSpan *best = NULL;
+  for (MemSpan *s = head->next; s != head; s = s->next) {
+    if (s->n_pages >= n_pages &&
+        (best == NULL || s->n_pages < best->n_pages ||
+         (s->n_pages == best->n_pages && s->start < best->start))) {
+      best = s;
+    }
+  }
+  return best;
+}
+
+static void mem_page_heap_owner_free(void *owner, void *ptr) {
+  if (((MemSpan *)owner)->start == ptr) {
+    mem_page_heap_free(ptr);
+  }
+}
+
+static void *mem_page_heap_take(size_t n_pages, int zero) {
+  if (n_pages == 0 || n_pages > (SIZE_MAX >> MEM_PAGE_SHIFT)) {
+    return NULL;
+  }
+  pthread_mutex_lock(&mem_page_heap.lock);
+  if (!mem_page_heap.initialized) {
+    mem_page_heap_init_lists();
+    mem_owner_set_free(MEM_OWNER_SPAN, mem_page_heap_owner_free);
+  }
+  MemSpan *span = mem_page_heap_find(n_pages);
+  if (span == NULL) {
+    span = mem_page_heap_grow(n_pages);
+  }
+  if (span == NULL) {
+    pthread_mutex_unlock(&mem_page_heap.lock);
+    return NULL;
+  }
+  mem_page_heap_list_remove(span);
+
+  // Split the tail off and put it back in the free lists
+  if (span->n_pages > n_pages) {
+    MemSpan *rest = mem_page_heap_new_span();
+    if (rest != NULL) {
+      rest->start = span->start + (n_pages << MEM_PAGE_SHIFT);
+      rest->n_pages = span->n_pages - n_pages;
+      rest->zeroed = span->zeroed;
+      if (mem_page_heap_set_range(rest, 0)) {
+        span->n_pages = n_pages;
+        mem_page_heap_list_push(rest);
+      } else {
+        // The neighbours couldn't find it, hand out the whole span instead
+        mem_page_heap_delete_span(rest);
+      }
+    }
+  }
+  if (!mem_page_heap_set_range(span, 1) ||
+      !mem_owner_set(span->start, span->n_pages << MEM_PAGE_SHIFT,
+                     MEM_OWNER_SPAN, span)) {
+    mem_page_heap_set_range(span, 0);
+    mem_page_heap_list_push(span);
+    pthread_mutex_unlock(&mem_page_heap.lock);
+    return NULL;
+  }
+  int zeroed = span->zeroed;
+  span->zeroed = 0;
+  pthread_mutex_unlock(&mem_page_heap.lock);
+
+  if (zero && !zeroed) {
+    memset(span->start, 0, span->n_pages << MEM_PAGE_SHIFT);
+  }
+  return span->start;
+}
+
+void *mem_page_heap_alloc(size_t n_pages) {
+  return mem_page_heap_take(n_pages, 0);
+}
+
+void *mem_page_heap_calloc(size_t n_pages) {
+  return mem_page_heap_take(n_pages, 1);
+}
+
+size_t mem_page_heap_trim(void) {
+  size_t trimmed = 0;
+  pthread_mutex_lock(&mem_page_heap.lock);
+  if (mem_page_heap.initialized) {
+    for (size_t i = 0; i <= MEM_PAGE_HEAP_SMALL_SPANS; ++i) {
+      MemSpan *head = &mem_page_heap.free_lists[i];
+      for (MemSpan *s = head->next; s != head; s = s->next) {
+        size_t bytes = s->n_pages << MEM_PAGE_SHIFT;
+        // Zeroed spans were never touched, or already trimmed
+        if (!s->zeroed && madvise(s->start, bytes, MADV_DONTNEED) == 0) {
+          s->zeroed = 1;
+          trimmed += bytes;
+        }
+      }
+    }
+  }
+  pthread_mutex_unlock(&mem_page_heap.lock);
+  return trimmed;
+}
+
+static MemSpan *mem_page_heap_lookup_locked(const void *ptr) {
+  MemSpan *span = mem_page_heap_span_at(ptr);
+  // Interior pages of free spans are stale, don't trust them
+  if (span == NULL || span->free || (const uint8_t *)ptr < span->start ||
+      (const uint8_t *)ptr >= span->start + (span->n_pages << MEM_PAGE_SHIFT)) {
+    return NULL;
+  }
+  return span;
+}
+
+MemSpan *mem_page_heap_lookup(const void *ptr) {
+  if (ptr == NULL) {
+    return NULL;
+  }
+  pthread_mutex_lock(&mem_page_heap.lock);
+  MemSpan *span = mem_page_heap_lookup_locked(ptr);
+  pthread_mutex_unlock(&mem_page_heap.lock);
+  return span;
+}
+
+void mem_page_heap_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&mem_page_heap.lock);
+  MemSpan *span = mem_page_heap_lookup_locked(ptr);
+  if (span == NULL || span->start != ptr) {
+    // Not a span we handed out, or a double free
+    pthread_mutex_unlock(&mem_page_heap.lock);
+    return;
+  }
+  mem_owner_set(span->start, span->n_pages << MEM_PAGE_SHIFT, MEM_OWNER_NONE,
+                NULL);
+
+  // Coalesce with the span on the left
+  MemSpan *left = mem_page_heap_span_at(span->start - MEM_PAGE_SIZE);
+  if (left != NULL && left->free &&
+      left->start + (left->n_pages << MEM_PAGE_SHIFT) == span->start) {
+    mem_page_heap_list_remove(left);
+    span->start = left->start;
+    span->n_pages += left->n_pages;
+    span->zeroed = span->zeroed && left->zeroed;
+    mem_page_heap_delete_span(left);
+  }
+  // Coalesce with the span on the right
+  uint8_t *end = span->start + (span->n_pages << MEM_PAGE_SHIFT);
+  MemSpan *right = mem_page_heap_span_at(end);
+  if (right != NULL && right->free && right->start == end) {
+    mem_page_heap_list_remove(right);
+    span->n_pages += right->n_pages;
+    span->zeroed = span->zeroed && right->zeroed;
+    mem_page_heap_delete_span(right);
+  }
+  mem_page_heap_set_range(span, 0);
+  mem_page_heap_list_push(span);
+  pthread_mutex_unlock(&mem_page_heap.lock);
+}
+
+#endif // PAGE_HEAP_IMPL
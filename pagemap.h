@@ -0,0 +1,277 @@
+#ifndef PAGEMAP_H
+#define PAGEMAP_H
+
+/**
+ * STB-style implementation of a 3-level radix tree pagemap. It maps every
+ * page of the address space to a pointer-sized value and it's indexed directly
+ * by the address bits, so a lookup is three dependent loads with no hashing
+ * and no locks. Readers never block, writers publish new tree nodes with a
+ * compare-and-swap so they can race with each other too.
+ *
+ * 'mem_pagemap_get' -> Returns the value stored for the page containing the
+ * address passed as parameter, or NULL if nothing was ever stored there.
+ *
+ * 'mem_pagemap_set' -> Stores a value for every page overlapping the range
+ * [addr, addr + bytes). Returns 1 on success, 0 if a tree node couldn't be
+ * allocated.
+ *
+ * On top of it there's a global owner map, that records which allocator owns
+ * each page so that a pointer can be given back without knowing where it came
+ * from:
+ *
+ * 'mem_owner_set' -> Records the owner (and its kind) of a range of pages.
+ *
+ * 'mem_owner_get' -> Returns the owner of the page containing a pointer.
+ *
+ * 'mem_free' -> Gives a pointer back to whatever allocator owns it. Chunks of
+ * pools go back to their pool, spans go back to the page heap and arena memory
+ * is ignored (it is released when the arena is reset). Allocators install the
+ * function handling their kind of owner with 'mem_owner_set_free'.
+ *
+ * @note Only the low 48 bits of the addresses are used, which covers the user
+ * address space of x86-64 and aarch64 with 4 level page tables.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef MEM_PAGE_SHIFT
+#define MEM_PAGE_SHIFT 12
+#endif
+
+#define MEM_PAGEMAP_ADDRESS_BITS 48
+#define MEM_PAGEMAP_BITS (MEM_PAGEMAP_ADDRESS_BITS - MEM_PAGE_SHIFT)
+#define MEM_PAGEMAP_LEAF_BITS (MEM_PAGEMAP_BITS / 3)
+#define MEM_PAGEMAP_MID_BITS (MEM_PAGEMAP_BITS / 3)
+#define MEM_PAGEMAP_ROOT_BITS                                                  \
+  (MEM_PAGEMAP_BITS - MEM_PAGEMAP_LEAF_BITS - MEM_PAGEMAP_MID_BITS)
+
+// Kinds of owners tracked by the global owner map
+#define MEM_OWNER_NONE 0
+#define MEM_OWNER_SPAN 1
+#define MEM_OWNER_POOL 2
+#define MEM_OWNER_ARENA 3
+#define MEM_OWNER_KINDS 4
+
+/**
+ * Function giving a pointer back to its owner, one per kind of owner
+ * @param owner owner recorded with 'mem_owner_set'
+ * @param ptr pointer passed to 'mem_free'
+ */
+typedef void (*MemOwnerFreeFn)(void *owner, void *ptr);
+
+typedef struct {
+  _Atomic(uintptr_t) values[1 << MEM_PAGEMAP_LEAF_BITS];
+} MemPagemapLeaf;
+
+typedef struct {
+  _Atomic(MemPagemapLeaf *) leaves[1 << MEM_PAGEMAP_MID_BITS];
+} MemPagemapMid;
+
+/**
+ * @param root first level of the tree, the other levels are allocated lazily
+ * @note A zero-initialized MemPagemap is an empty map, static instances don't
+ * need any initialization.
+ */
+typedef struct {
+  _Atomic(MemPagemapMid *) root[1 << MEM_PAGEMAP_ROOT_BITS];
+} MemPagemap;
+
+/**
+ * Looks up the value stored for the page containing addr
+ * @param map pagemap to search
+ * @param addr any address
+ * @return the stored value, or NULL if the page has no value
+ */
+void *mem_pagemap_get(MemPagemap *map, const void *addr);
+
+/**
+ * Stores value for all the pages overlapping [addr, addr + bytes)
+ * @param map pagemap to update
+ * @param addr first address of the range
+ * @param bytes length of the range in bytes
+ * @param value value to store, NULL clears the range
+ * @return 1 if the call succeded, 0 otherwise.
+ */
+int mem_pagemap_set(MemPagemap *map, const void *addr, size_t bytes,
+                    void *value);
+
+/**
+ * Records the owner of all the pages overlapping [addr, addr + bytes)
+ * @param addr first address of the range
+ * @param bytes length of the range in bytes
+ * @param kind one of the MEM_OWNER_* constants
+ * @param owner allocator owning the range (MemPool, MemArena or MemSpan)
+ * @return 1 if the call succeded, 0 otherwise.
+ */
+int mem_owner_set(const void *addr, size_t bytes, int kind, void *owner);
+
+/**
+ * Finds the owner of the page containing ptr
+ * @param ptr any pointer
+ * @param kind if not NULL, receives the kind of the owner
+ * @return the owner, or NULL if the page isn't owned by anyone
+ */
+void *mem_owner_get(const void *ptr, int *kind);
+
+/**
+ * Sets the function used by 'mem_free' for a kind of owner, allocators call it
+ * when they start recording their pages
+ * @param kind one of the MEM_OWNER_* constants
+ * @param free_fn function giving a pointer back to an owner of that kind
+ */
+void mem_owner_set_free(int kind, MemOwnerFreeFn free_fn);
+
+/**
+ * Gives a pointer back to the allocator that owns it
+ * @param ptr pointer to free, NULL is ignored
+ */
+void mem_free(void *ptr);
+
+#endif // PAGEMAP_H
+
+#if defined(PAGEMAP_IMPL) && !defined(PAGEMAP_IMPL_DONE)
+#define PAGEMAP_IMPL_DONE
+
+#include <sys/mman.h>
+
+#define MEM_PAGEMAP_KIND_MASK ((uintptr_t)3)
+
+static MemPagemap mem_owner_map;
+static _Atomic(MemOwnerFreeFn) mem_owner_free_fns[MEM_OWNER_KINDS];
+
+static void *mem_pagemap_new_node(size_t bytes) {
+  // Nodes are big and mostly empty, mmap keeps the untouched parts free
+  void *node = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return node == MAP_FAILED ? NULL : node;
+}
+
+static MemPagemapLeaf *mem_pagemap_leaf(MemPagemap *map, uintptr_t page,
+                                        int create) {
+  size_t i_root = (page >> (MEM_PAGEMAP_MID_BITS + MEM_PAGEMAP_LEAF_BITS)) &
+                  ((1 << MEM_PAGEMAP_ROOT_BITS) - 1);
+  size_t i_mid = (page >> MEM_PAGEMAP_LEAF_BITS) &
+                 ((1 << MEM_PAGEMAP_MID_BITS) - 1);
+
+  MemPagemapMid *mid =
+      atomic_load_explicit(&map->root[i_root], memory_order_acquire);
+  if (mid == NULL) {
+    if (!create) {
+      return NULL;
+    }
+    MemPagemapMid *fresh = mem_pagemap_new_node(sizeof(MemPagemapMid));
+    if (fresh == NULL) {
+      return NULL;
+    }
+    if (atomic_compare_exchange_strong_explicit(&map->root[i_root], &mid,
+                                                fresh, memory_order_acq_rel,
+                                                memory_order_acquire)) {
+      mid = fresh;
+    } else {
+      // Somebody else published the node first, use theirs
+      munmap(fresh, sizeof(MemPagemapMid));
+    }
+  }
+
+  MemPagemapLeaf *leaf =
+      atomic_load_explicit(&mid->leaves[i_mid], memory_order_acquire);
+  if (leaf == NULL) {
+    if (!create) {
+      return NULL;
+    }
+    MemPagemapLeaf *fresh = mem_pagemap_new_node(sizeof(MemPagemapLeaf));
+    if (fresh == NULL) {
+      return NULL;
+    }
+    if (atomic_compare_exchange_strong_explicit(&mid->leaves[i_mid], &leaf,
+                                                fresh, memory_order_acq_rel,
+                                                memory_order_acquire)) {
+      leaf = fresh;
+    } else {
+      munmap(fresh, sizeof(MemPagemapLeaf));
+    }
+  }
+  return leaf;
+}
+
+void *mem_pagemap_get(MemPagemap *map, const void *addr) {
+  uintptr_t page = (uintptr_t)addr >> MEM_PAGE_SHIFT;
+  MemPagemapLeaf *leaf = mem_pagemap_leaf(map, page, 0);
+  if (leaf == NULL) {
+    return NULL;
+  }
+  size_t i_leaf = page & ((1 << MEM_PAGEMAP_LEAF_BITS) - 1);
+  return (void *)atomic_load_explicit(&leaf->values[i_leaf],
+                                      memory_order_acquire);
+}
+
+int mem_pagemap_set(MemPagemap *map, const void *addr, size_t bytes,
+                    void *value) {
+  if (bytes == 0) {
+    return 1;
+  }
+  uintptr_t first = (uintptr_t)addr >> MEM_PAGE_SHIFT;
+  uintptr_t last = ((uintptr_t)addr + bytes - 1) >> MEM_PAGE_SHIFT;
+  uintptr_t page = first;
+  while (page <= last) {
+    MemPagemapLeaf *leaf = mem_pagemap_leaf(map, page, value != NULL);
+    size_t i_leaf = page & ((1 << MEM_PAGEMAP_LEAF_BITS) - 1);
+    size_t in_leaf = ((size_t)1 << MEM_PAGEMAP_LEAF_BITS) - i_leaf;
+    if (leaf == NULL) {
+      if (value != NULL) {
+        return 0;
+      }
+      // Nothing to clear in a leaf that doesn't exist
+      page += in_leaf;
+      continue;
+    }
+    for (; i_leaf < ((size_t)1 << MEM_PAGEMAP_LEAF_BITS) && page <= last;
+         ++i_leaf, ++page) {
+      atomic_store_explicit(&leaf->values[i_leaf], (uintptr_t)value,
+                            memory_order_release);
+    }
+  }
+  return 1;
+}
+
+int mem_owner_set(const void *addr, size_t bytes, int kind, void *owner) {
+  // Owners are at least 4 bytes aligned, the kind lives in the low bits
+  void *value =
+      owner == NULL ? NULL : (void *)((uintptr_t)owner | (uintptr_t)kind);
+  return mem_pagemap_set(&mem_owner_map, addr, bytes, value);
+}
+
+void *mem_owner_get(const void *ptr, int *kind) {
+  uintptr_t value = (uintptr_t)mem_pagemap_get(&mem_owner_map, ptr);
+  if (kind != NULL) {
+    *kind = (int)(value & MEM_PAGEMAP_KIND_MASK);
+  }
+  return (void *)(value & ~MEM_PAGEMAP_KIND_MASK);
+}
+
+void mem_owner_set_free(int kind, MemOwnerFreeFn free_fn) {
+  if (kind > MEM_OWNER_NONE && kind < MEM_OWNER_KINDS) {
+    atomic_store_explicit(&mem_owner_free_fns[kind], free_fn,
+                          memory_order_release);
+  }
+}
+
+void mem_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  int kind;
+  void *owner = mem_owner_get(ptr, &kind);
+  MemOwnerFreeFn free_fn =
+      atomic_load_explicit(&mem_owner_free_fns[kind], memory_order_acquire);
+  // Arena memory (and anything we don't know about) is left alone
+  if (owner != NULL && free_fn != NULL) {
+    free_fn(owner, ptr);
+  }
+}
+
+#undef MEM_PAGEMAP_KIND_MASK
+
+#endif // PAGEMAP_IMPL
@@ -18,21 +18,92 @@
  * 'pool_alloc' -> finds the first free chunk of memory inside the pool and
  * returns a void pointer that points to that chunk
  *
+ * 'pool_init_ex' -> same as 'pool_init' but lets you pick the order freed
+ * chunks are handed out again:
+ *  - MEM_POOL_REUSE_LOWEST (the 'pool_init' default): the free chunk with the
+ *    lowest address, keeps the working set compact at the low end of the pool;
+ *  - MEM_POOL_REUSE_LIFO: the last freed chunk, it's most likely still in
+ *    cache;
+ *  - MEM_POOL_REUSE_FIFO: the chunk freed the longest time ago, a freed chunk
+ *    is reused as late as possible, which narrows the window where a stale
+ *    pointer (use after free, ABA) hits a recycled chunk.
+ * LIFO and FIFO keep a queue of free chunk indices next to the ledger, so
+ * their alloc and free are O(1). Every policy prefetches the chunk it expects
+ * to hand out next.
+ *
  * 'pool_free' -> gives back a pointer (chunk) to the memory pool, making it a
  * candidate for future allocations
  *
  * 'pool_deinit' -> frees all the memory related to the pool (the pool itself
  * was heap allocated so it frees it too)
+ *
+ * @note Pools created with the MEM_POOL_TYPE_STABLE flag are type-stable: a
+ * freed chunk stays mapped and keeps its type forever, even 'pool_deinit'
+ * only parks the memory, to be reused by the next type-stable pool with the
+ * same geometry. Every chunk has a version word, kept outside of the chunks,
+ * so readers that don't take locks can read a chunk optimistically and
+ * validate what they read afterwards:
+ *
+ *   uint64_t v = mem_pool_read_begin(pool, node);
+ *   Node copy = *node;
+ *   if (!mem_pool_read_validate(pool, node, v)) { retry }
+ *
+ * The version is odd while the chunk is free or being written. A chunk comes
+ * out of 'pool_alloc' in the written state, 'mem_pool_write_end' publishes it
+ * once initialized, and later in place updates are wrapped in
+ * 'mem_pool_write_begin' / 'mem_pool_write_end'. Freeing a chunk makes every
+ * read in progress on it fail validation. FIFO reuse is a good fit, it keeps
+ * freed chunks out of circulation as long as possible.
+ *
+ * @note When MEM_USE_PAGE_HEAP is defined the chunks are carved from a span of
+ * the central page heap (see 'page_heap.h') instead of calloc, and they can be
+ * given back with the generic 'mem_free' of 'pagemap.h'. When
+ * MEM_USE_DEFERRED_FREE is defined 'pool_deinit' hands the chunks memory to
+ * the background reclaimer of 'deferred_free.h' instead of freeing it inline.
+ *
+ * @note Pools are colored: the first chunk of each new pool is shifted by the
+ * next multiple of MEM_POOL_CACHE_LINE (cycling through MEM_POOL_COLORS
+ * colors), so pools with page-aligned memory and power-of-two chunks don't
+ * fight for the same cache sets. Define MEM_POOL_COLORS as 1 to disable it.
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+#ifdef MEM_USE_PAGE_HEAP
+#include "page_heap.h"
+#endif
+#ifdef MEM_USE_DEFERRED_FREE
+#include "deferred_free.h"
+#endif
+
+// Reuse policies of 'mem_pool_init_ex'
+#define MEM_POOL_REUSE_LOWEST 0
+#define MEM_POOL_REUSE_LIFO 1
+#define MEM_POOL_REUSE_FIFO 2
+#define MEM_POOL_REUSE_MASK 3
+// Type-stable pool, can be combined with a reuse policy
+#define MEM_POOL_TYPE_STABLE 4
+
 /**
  * @param chunk_size number of bytes occupied by each chunk
  * @param n_chunks number of chunks alloacted at initialization
- * @param data pointer to the "raw" memory allocated for the pool
+ * @param data pointer to the first chunk of the pool
+ * @param color offset of the first chunk from the start of the memory
+ * allocated for the pool (a multiple of the cache line size)
  * @oaram ledger bitmap to check for free chunks
+ * @param flags reuse policy (MEM_POOL_REUSE_*) and MEM_POOL_TYPE_STABLE
+ * @param hint no chunk below this index is free (lowest address policy)
+ * @param ledger_full one bit per ledger byte, set when its 8 chunks are all in
+ * use, followed by one bit per word of those bits, set when the word is all
+ * ones. The lowest address search skips full regions with them (lowest
+ * address policy only)
+ * @param free_slots indices of the free chunks, in reuse order (LIFO and FIFO
+ * policies only)
+ * @param free_head position of the first free index in free_slots (FIFO)
+ * @param free_count number of indices in free_slots
+ * @param versions version word of every chunk (type-stable pools only)
  * @note The user isn't supposed access any of the struct members manually,
  * stick to using the provided functions.
  */
@@ -40,7 +111,15 @@ typedef struct {
   size_t chunk_size;
   size_t n_chunks;
   uint8_t *data;
+  size_t color;
   uint8_t *ledger;
+  int flags;
+  size_t hint;
+  uint64_t *ledger_full;
+  size_t *free_slots;
+  size_t free_head;
+  size_t free_count;
+  _Atomic uint64_t *versions;
 } MemPool;
 
 /**
@@ -52,7 +131,17 @@ typedef struct {
 MemPool *mem_pool_init(size_t chunk_size, size_t n_chunks);
 
 /**
- * Gets the first free chunk in the pool and returns the pointer to it
+ * Heap allocates a new memory pool with the given reuse policy
+ * @param chunk_size number of bytes required for a single chunk
+ * @param n_chunks number of chunks our pool must hold
+ * @param flags reuse policy, one of the MEM_POOL_REUSE_* values, optionally
+ * or'ed with MEM_POOL_TYPE_STABLE
+ * @return pointer to the initialized memory pool, or NULL on failure
+ */
+MemPool *mem_pool_init_ex(size_t chunk_size, size_t n_chunks, int flags);
+
+/**
+ * Gets a free chunk (picked by the reuse policy) and returns the pointer to it
  * @param pool memory pool we want to get a chunk from
  * @return pointer to a free chunk, or NULL if no free chunk is available
  */
@@ -66,6 +155,65 @@ void *mem_pool_alloc(MemPool *pool);
  */
 void mem_pool_free(MemPool *pool, void *chunk);
 
+/**
+ * Checks whether a pointer belongs to the chunks of the pool
+ * @param pool memory pool we are interested in
+ * @param ptr pointer to check
+ * @return 1 if ptr points inside the pool chunks, 0 otherwise.
+ */
+int mem_pool_owns(const MemPool *pool, const void *ptr);
+
+/**
+ * Checks whether a pointer is the start of a chunk handed out by the pool
+ * @param pool memory pool we are interested in
+ * @param ptr pointer to check
+ * @return 1 if ptr is an allocated chunk of the pool, 0 if it's free, points
+ * inside a chunk or outside of the pool.
+ */
+int mem_pool_is_allocated(const MemPool *pool, const void *ptr);
+
+/**
+ * Starts an optimistic read of a chunk of a type-stable pool
+ * @param pool type-stable pool owning the chunk
+ * @param chunk chunk we are about to read
+ * @return version to pass to 'mem_pool_read_validate', odd if the chunk is
+ * free or being written (the read is bound to fail)
+ */
+uint64_t mem_pool_read_begin(const MemPool *pool, const void *chunk);
+
+/**
+ * Checks that a chunk didn't change since 'mem_pool_read_begin'
+ * @param pool type-stable pool owning the chunk
+ * @param chunk chunk we have read
+ * @param version value returned by 'mem_pool_read_begin'
+ * @return 1 if what was read is consistent, 0 otherwise.
+ */
+int mem_pool_read_validate(const MemPool *pool, const void *chunk,
+                           uint64_t version);
+
+/**
+ * Marks a chunk of a type-stable pool as being written, readers will fail
+ * validation until 'mem_pool_write_end'
+ * @param pool type-stable pool owning the chunk
+ * @param chunk chunk we are about to write
+ */
+void mem_pool_write_begin(MemPool *pool, void *chunk);
+
+/**
+ * Publishes a chunk after 'mem_pool_alloc' or 'mem_pool_write_begin'
+ * @param pool type-stable pool owning the chunk
+ * @param chunk chunk we have written
+ */
+void mem_pool_write_end(MemPool *pool, void *chunk);
+
+/**
+ * Gives the physical pages covered only by free chunks back to the OS, the
+ * chunks stay usable (they'll be zero filled on their next touch)
+ * @param pool memory pool we want to trim
+ * @return number of bytes given back
+ */
+size_t mem_pool_trim(MemPool *pool);
+
 /**
  * Frees the memory related to the pool passed as parameter
  * @param pool memory pool we are freeing
@@ -74,47 +222,337 @@ void mem_pool_deinit(MemPool *pool);
 
 #endif // POOL_H
 
-#ifdef POOL_IMPL
+#if defined(POOL_IMPL) && !defined(POOL_IMPL_DONE)
+#define POOL_IMPL_DONE
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 // Macros to manipulate the bitmap ledger
 #define SET_BIT(bitmap, index) (bitmap[(index) / 8] |= (1 << ((index) % 8)))
 #define CLEAR_BIT(bitmap, index) (bitmap[(index) / 8] &= ~(1 << ((index) % 8)))
 #define CHECK_BIT(bitmap, index) (bitmap[(index) / 8] & (1 << ((index) % 8)))
 
+// Slab colors: the first chunk of consecutive pools is shifted by a rotating
+// multiple of the cache line, so the hot chunks of pools with the same layout
+// don't all map to the same cache sets
+#ifndef MEM_POOL_CACHE_LINE
+#define MEM_POOL_CACHE_LINE 64
+#endif
+#ifndef MEM_POOL_COLORS
+#define MEM_POOL_COLORS 8
+#endif
+
+static _Atomic size_t mem_pool_next_color = 0;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MEM_POOL_PREFETCH(addr) __builtin_prefetch((addr), 1)
+#else
+#define MEM_POOL_PREFETCH(addr) ((void)(addr))
+#endif
+
+/**
+ * Memory of a type-stable pool that has been deinitialized
+ * @param raw memory allocated for the chunks (color included)
+ * @param color offset of the first chunk
+ * @param chunk_size size of the chunks
+ * @param n_chunks number of chunks
+ * @param versions version words of the chunks, all odd
+ * @param next next parked slab
+ */
+typedef struct MemPoolParked {
+  uint8_t *raw;
+  size_t color;
+  size_t chunk_size;
+  size_t n_chunks;
+  _Atomic uint64_t *versions;
+  struct MemPoolParked *next;
+} MemPoolParked;
+
+static MemPoolParked *mem_pool_parked = NULL;
+static pthread_mutex_t mem_pool_parked_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Takes a parked slab with the same geometry, NULL if there is none
+static MemPoolParked *mem_pool_unpark(size_t chunk_size, size_t n_chunks) {
+  pthread_mutex_lock(&mem_pool_parked_lock);
+  MemPoolParked **link = &mem_pool_parked;
+  while (*link != NULL && ((*link)->chunk_size != chunk_size ||
+                           (*link)->n_chunks != n_chunks)) {
+    link = &(*link)->next;
+  }
+  MemPoolParked *parked = *link;
+  if (parked != NULL) {
+    *link = parked->next;
+  }
+  pthread_mutex_unlock(&mem_pool_parked_lock);
+  return parked;
+}
+
+static uint8_t *mem_pool_data_alloc(size_t bytes) {
+#ifdef MEM_USE_PAGE_HEAP
+  return mem_page_heap_calloc(MEM_PAGES_FOR(bytes));
+#else
+  return calloc(bytes, sizeof(uint8_t));
+#endif
+}
+
+static void mem_pool_data_release(void *raw, size_t bytes) {
+  (void)bytes;
+#ifdef MEM_USE_PAGE_HEAP
+  mem_page_heap_free(raw);
+#else
+  free(raw);
+#endif
+}
+
+static void mem_pool_data_free(uint8_t *raw, size_t bytes) {
+#ifdef MEM_USE_DEFERRED_FREE
+  mem_deferred_release(mem_pool_data_release, raw, bytes);
+#else
+  mem_pool_data_release(raw, bytes);
+#endif
+}
+
+#ifdef MEM_USE_PAGE_HEAP
+static void mem_pool_owner_free(void *owner, void *chunk) {
+  mem_pool_free(owner, chunk);
+}
+#endif
+
+// Keeps the memory of a type-stable pool for the next pool like it
+static void mem_pool_park(MemPool *pool) {
+  MemPoolParked *parked = malloc(sizeof(MemPoolParked));
+  if (parked == NULL) {
+    return;
+  }
+  // A pool that failed to initialize has no ledger and no chunk in use
+  for (size_t i = 0; pool->ledger != NULL && i < pool->n_chunks; ++i) {
+    if (CHECK_BIT(pool->ledger, i)) {
+      mem_pool_write_begin(pool, pool->data + i * pool->chunk_size);
+    }
+  }
+#ifdef MEM_USE_PAGE_HEAP
+  mem_owner_set(pool->data, pool->n_chunks * pool->chunk_size, MEM_OWNER_NONE,
+                NULL);
+#endif
+  parked->raw = pool->data - pool->color;
+  parked->color = pool->color;
+  parked->chunk_size = pool->chunk_size;
+  parked->n_chunks = pool->n_chunks;
+  parked->versions = pool->versions;
+  pthread_mutex_lock(&mem_pool_parked_lock);
+  parked->next = mem_pool_parked;
+  mem_pool_parked = parked;
+  pthread_mutex_unlock(&mem_pool_parked_lock);
+}
+
+// Gives back the chunk memory of a pool
+static void mem_pool_data_release_all(MemPool *pool) {
+  if (pool->versions != NULL) {
+    // Type-stable memory is never given back, not even if it can't be parked
+    mem_pool_park(pool);
+  } else {
+    mem_pool_data_free(pool->data - pool->color,
+                       pool->n_chunks * pool->chunk_size + pool->color);
+  }
+}
+
 MemPool *mem_pool_init(size_t chunk_size, size_t n_chunks) {
-  MemPool *new_pool = malloc(sizeof(MemStack));
+  return mem_pool_init_ex(chunk_size, n_chunks, MEM_POOL_REUSE_LOWEST);
+}
+
+MemPool *mem_pool_init_ex(size_t chunk_size, size_t n_chunks, int flags) {
+  int policy = flags & MEM_POOL_REUSE_MASK;
+  if (policy == MEM_POOL_REUSE_MASK) {
+    return NULL; // Unknown policy
+  }
+  MemPool *new_pool = calloc(1, sizeof(MemPool));
   if (new_pool == NULL) {
     return NULL;
   }
 
-  new_pool->data = calloc(n_chunks, chunk_size);
-  if (new_pool->data == NULL) {
-    free(new_pool);
-    return NULL;
+  MemPoolParked *parked = NULL;
+  if (flags & MEM_POOL_TYPE_STABLE) {
+    parked = mem_pool_unpark(chunk_size, n_chunks);
+  }
+  size_t color;
+  uint8_t *raw;
+  if (parked != NULL) {
+    // Same memory, same type: readers still holding pointers stay safe
+    color = parked->color;
+    raw = parked->raw;
+    new_pool->versions = parked->versions;
+    free(parked);
+  } else {
+    size_t slab = atomic_fetch_add_explicit(&mem_pool_next_color, 1,
+                                            memory_order_relaxed);
+    color = (slab % MEM_POOL_COLORS) * MEM_POOL_CACHE_LINE;
+    if (chunk_size != 0 && n_chunks > (SIZE_MAX - color) / chunk_size) {
+      free(new_pool);
+      return NULL;
+    }
+    raw = mem_pool_data_alloc(n_chunks * chunk_size + color);
+    if (raw == NULL) {
+      free(new_pool);
+      return NULL;
+    }
+    if (flags & MEM_POOL_TYPE_STABLE) {
+      if (n_chunks > SIZE_MAX / sizeof(uint64_t)) {
+        new_pool->versions = NULL;
+      } else {
+        new_pool->versions = malloc(n_chunks * sizeof(uint64_t));
+      }
+      if (new_pool->versions == NULL && n_chunks > 0) {
+        // Nobody has seen this memory yet, it can go back right away
+        mem_pool_data_free(raw, n_chunks * chunk_size + color);
+        free(new_pool);
+        return NULL;
+      }
+      for (size_t i = 0; i < n_chunks; ++i) {
+        atomic_init(&new_pool->versions[i], 1); // Free
+      }
+    }
   }
+  new_pool->data = raw + color;
+  new_pool->color = color;
+  new_pool->chunk_size = chunk_size;
+  new_pool->n_chunks = n_chunks;
+  new_pool->flags = flags;
 
   // Calculate ledger size in bytes, rounding up to cover all bits for chunks
   size_t ledger_size = (n_chunks + 7) / 8;
   new_pool->ledger = calloc(ledger_size, sizeof(uint8_t));
   if (new_pool->ledger == NULL) {
-    free(new_pool->data);
+    mem_pool_data_release_all(new_pool);
     free(new_pool);
     return NULL;
   }
 
-  new_pool->chunk_size = chunk_size;
-  new_pool->n_chunks = n_chunks;
+  if (policy == MEM_POOL_REUSE_LOWEST) {
+    size_t words = (ledger_size + 63) / 64;
+    new_pool->ledger_full = calloc(words + (words + 63) / 64, sizeof(uint64_t));
+    if (new_pool->ledger_full == NULL && ledger_size > 0) {
+      mem_pool_data_release_all(new_pool);
+      free(new_pool->ledger);
+      free(new_pool);
+      return NULL;
+    }
+  } else {
+    if (n_chunks <= SIZE_MAX / sizeof(size_t)) {
+      new_pool->free_slots = malloc(n_chunks * sizeof(size_t));
+    }
+    if (new_pool->free_slots == NULL && n_chunks > 0) {
+      mem_pool_data_release_all(new_pool);
+      free(new_pool->ledger);
+      free(new_pool);
+      return NULL;
+    }
+    // Either way the first allocations go from the start of the pool
+    for (size_t i = 0; i < n_chunks; ++i) {
+      new_pool->free_slots[i] =
+          policy == MEM_POOL_REUSE_LIFO ? n_chunks - 1 - i : i;
+    }
+    new_pool->free_count = n_chunks;
+  }
+
+#ifdef MEM_USE_PAGE_HEAP
+  // Lets 'mem_free' route the chunks back to this pool
+  mem_owner_set_free(MEM_OWNER_POOL, mem_pool_owner_free);
+  mem_owner_set(new_pool->data, n_chunks * chunk_size, MEM_OWNER_POOL,
+                new_pool);
+#endif
   return new_pool;
 }
 
+// First clear bit of a bitmap at or after from, n if there is none
+static size_t mem_pool_first_clear(const uint64_t *bits, size_t from,
+                                   size_t n) {
+  for (size_t word = from / 64; word * 64 < n; ++word) {
+    uint64_t clear = ~bits[word];
+    if (word == from / 64) {
+      clear &= ~(uint64_t)0 << (from % 64);
+    }
+    if (clear != 0) {
+      size_t i = word * 64 + (size_t)__builtin_ctzll(clear);
+      return i < n ? i : n;
+    }
+  }
+  return n;
+}
+
+// Lowest free index at or above the hint, n_chunks if the pool is full
+static size_t mem_pool_find_lowest(MemPool *pool) {
+  if (pool->hint >= pool->n_chunks) {
+    return pool->n_chunks;
+  }
+  size_t n_bytes = (pool->n_chunks + 7) / 8;
+  size_t n_words = (n_bytes + 63) / 64;
+  // Ledger bytes with a free chunk in the word of the hint, then the first
+  // word with one after it
+  size_t byte = mem_pool_first_clear(pool->ledger_full, pool->hint / 8,
+                                     (pool->hint / 512 + 1) * 64);
+  if (byte == (pool->hint / 512 + 1) * 64) {
+    size_t word = mem_pool_first_clear(pool->ledger_full + n_words,
+                                       pool->hint / 512 + 1, n_words);
+    if (word == n_words) {
+      return pool->n_chunks;
+    }
+    byte = mem_pool_first_clear(pool->ledger_full, word * 64, n_bytes);
+  }
+  if (byte >= n_bytes) {
+    return pool->n_chunks;
+  }
+  unsigned free_bits = ~pool->ledger[byte] & 0xFFu;
+  size_t index = byte * 8 + (size_t)__builtin_ctz(free_bits);
+  return index < pool->n_chunks ? index : pool->n_chunks;
+}
+
 void *mem_pool_alloc(MemPool *pool) {
-  for (size_t i = 0; i < pool->n_chunks; ++i) {
-    if (!CHECK_BIT(pool->ledger, i)) { // Check if chunk i is free
-      SET_BIT(pool->ledger, i);        // Mark chunk i as allocated
-      return pool->data + (i * pool->chunk_size);
+  size_t index;
+  switch (pool->flags & MEM_POOL_REUSE_MASK) {
+  case MEM_POOL_REUSE_LIFO:
+    if (pool->free_count == 0) {
+      return NULL;
+    }
+    index = pool->free_slots[--pool->free_count];
+    if (pool->free_count > 0) {
+      MEM_POOL_PREFETCH(pool->data + pool->free_slots[pool->free_count - 1] *
+                                         pool->chunk_size);
+    }
+    break;
+  case MEM_POOL_REUSE_FIFO:
+    if (pool->free_count == 0) {
+      return NULL;
+    }
+    index = pool->free_slots[pool->free_head];
+    pool->free_head = (pool->free_head + 1) % pool->n_chunks;
+    if (--pool->free_count > 0) {
+      MEM_POOL_PREFETCH(pool->data +
+                        pool->free_slots[pool->free_head] * pool->chunk_size);
     }
+    break;
+  default:
+    index = mem_pool_find_lowest(pool);
+    if (index == pool->n_chunks) {
+      return NULL; // No free chunks available
+    }
+    pool->hint = index + 1;
+    if (index + 1 < pool->n_chunks && !CHECK_BIT(pool->ledger, index + 1)) {
+      MEM_POOL_PREFETCH(pool->data + (index + 1) * pool->chunk_size);
+    }
+    break;
   }
-  return NULL; // No free chunks available
+  SET_BIT(pool->ledger, index); // Mark chunk index as allocated
+  if (pool->ledger_full != NULL && pool->ledger[index / 8] == 0xFF) {
+    uint64_t *word = &pool->ledger_full[index / 512];
+    *word |= (uint64_t)1 << (index / 8 % 64);
+    if (*word == ~(uint64_t)0) {
+      uint64_t *top = pool->ledger_full + (pool->n_chunks + 511) / 512;
+      top[index / 32768] |= (uint64_t)1 << (index / 512 % 64);
+    }
+  }
+  return pool->data + (index * pool->chunk_size);
 }
 
 void mem_pool_free(MemPool *pool, void *chunk) {
@@ -125,15 +563,119 @@ void mem_pool_free(MemPool *pool, void *chunk) {
 
   // Calculate the index of the chunk being deallocated
   size_t index = ((uint8_t *)chunk - pool->data) / pool->chunk_size;
-  if (index < pool->n_chunks) {
-    CLEAR_BIT(pool->ledger, index); // Mark chunk as free
+  if (index >= pool->n_chunks || !CHECK_BIT(pool->ledger, index)) {
+    return; // Not ours or already free
+  }
+  if (pool->versions != NULL) {
+    mem_pool_write_begin(pool, chunk); // Fails the reads in progress
+  }
+  CLEAR_BIT(pool->ledger, index); // Mark chunk as free
+  switch (pool->flags & MEM_POOL_REUSE_MASK) {
+  case MEM_POOL_REUSE_LIFO:
+    pool->free_slots[pool->free_count++] = index;
+    break;
+  case MEM_POOL_REUSE_FIFO:
+    pool->free_slots[(pool->free_head + pool->free_count++) % pool->n_chunks] =
+        index;
+    break;
+  default:
+    pool->ledger_full[index / 512] &= ~((uint64_t)1 << (index / 8 % 64));
+    pool->ledger_full[(pool->n_chunks + 511) / 512 + index / 32768] &=
+        ~((uint64_t)1 << (index / 512 % 64));
+    if (index < pool->hint) {
+      pool->hint = index;
+    }
+    break;
+  }
+}
+
+int mem_pool_owns(const MemPool *pool, const void *ptr) {
+  return pool != NULL && (const uint8_t *)ptr >= pool->data &&
+         (const uint8_t *)ptr < pool->data + pool->n_chunks * pool->chunk_size;
+}
+
+int mem_pool_is_allocated(const MemPool *pool, const void *ptr) {
+  if (!mem_pool_owns(pool, ptr)) {
+    return 0;
+  }
+  size_t offset = (size_t)((const uint8_t *)ptr - pool->data);
+  return offset % pool->chunk_size == 0 &&
+         CHECK_BIT(pool->ledger, offset / pool->chunk_size) != 0;
+}
+
+uint64_t mem_pool_read_begin(const MemPool *pool, const void *chunk) {
+  size_t index = ((const uint8_t *)chunk - pool->data) / pool->chunk_size;
+  return atomic_load_explicit(&pool->versions[index], memory_order_acquire);
+}
+
+int mem_pool_read_validate(const MemPool *pool, const void *chunk,
+                           uint64_t version) {
+  size_t index = ((const uint8_t *)chunk - pool->data) / pool->chunk_size;
+  // Keeps the reads of the chunk from moving past the version check
+  atomic_thread_fence(memory_order_acquire);
+  return (version & 1) == 0 &&
+         atomic_load_explicit(&pool->versions[index], memory_order_relaxed) ==
+             version;
+}
+
+void mem_pool_write_begin(MemPool *pool, void *chunk) {
+  size_t index = ((uint8_t *)chunk - pool->data) / pool->chunk_size;
+  uint64_t version =
+      atomic_load_explicit(&pool->versions[index], memory_order_relaxed);
+  if ((version & 1) == 0) {
+    atomic_store_explicit(&pool->versions[index], version + 1,
+                          memory_order_relaxed);
+    // Keeps the writes to the chunk after the version change
+    atomic_thread_fence(memory_order_release);
+  }
+}
+
+void mem_pool_write_end(MemPool *pool, void *chunk) {
+  size_t index = ((uint8_t *)chunk - pool->data) / pool->chunk_size;
+  uint64_t version =
+      atomic_load_explicit(&pool->versions[index], memory_order_relaxed);
+  if (version & 1) {
+    atomic_store_explicit(&pool->versions[index], version + 1,
+                          memory_order_release);
+  }
+}
+
+static size_t mem_pool_trim_range(uint8_t *start, uint8_t *end) {
+  uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t first = ((uintptr_t)start + page - 1) & ~(page - 1);
+  uintptr_t last = (uintptr_t)end & ~(page - 1);
+  if (last <= first || madvise((void *)first, last - first, MADV_DONTNEED)) {
+    return 0;
+  }
+  return last - first;
+}
+
+size_t mem_pool_trim(MemPool *pool) {
+  if (pool == NULL || pool->data == NULL || pool->ledger == NULL) {
+    return 0;
+  }
+  // Walk the runs of free chunks, only whole pages inside a run can go
+  size_t trimmed = 0;
+  size_t run = 0;
+  for (size_t i = 0; i <= pool->n_chunks; ++i) {
+    if (i < pool->n_chunks && !CHECK_BIT(pool->ledger, i)) {
+      continue;
+    }
+    if (i > run) {
+      trimmed += mem_pool_trim_range(pool->data + run * pool->chunk_size,
+                                     pool->data + i * pool->chunk_size);
+    }
+    run = i + 1;
   }
+  return trimmed;
 }
 
 void mem_pool_deinit(MemPool *pool) {
   if (pool != NULL) {
-    free(pool->data);
+    mem_pool_data_release_all(pool);
     free(pool->ledger);
+    free(pool->ledger_full);
+    free(pool->free_slots);
     free(pool);
   }
 }
@@ -141,5 +683,6 @@ void mem_pool_deinit(MemPool *pool) {
 #undef SET_BIT
 #undef CLEAR_BIT
 #undef CHECK_BIT
+#undef MEM_POOL_PREFETCH
 
 #endif // POOL_IMPL
@@ -0,0 +1,453 @@
+#ifndef RECLAIM_H
+#define RECLAIM_H
+
+/**
+ * STB-style implementation of a memory pressure listener. Allocator instances
+ * register themselves together with a trim function, and when the system
+ * runs short of memory every registered instance is asked to give its unused
+ * pages back to the OS (pools, arenas and the page heap keep their free
+ * memory around otherwise).
+ *
+ * Pressure is detected by a background thread polling, every interval_ms:
+ * - the "some avg10" value of the Linux PSI file (/proc/pressure/memory);
+ * - the "high" and "max" counters of the cgroup v2 memory.events file, any
+ *   increase since the last poll counts as pressure;
+ * - the resident set size of the process against a fixed limit.
+ *
+ * 'mem_reclaim_register' -> Registers an instance with its trim function and
+ * an optional mutex, held while trimming, that the user also holds while
+ * using the instance (pools and arenas aren't thread-safe on their own).
+ *
+ * 'mem_reclaim_unregister' -> Removes an instance, it must be called before
+ * the instance is deinitialized. It waits for a trim of the instance in
+ * progress and it can be called while holding the instance mutex.
+ *
+ * 'mem_reclaim_trigger' -> Trims every registered instance right away, it's
+ * what the background thread calls and it's handy for tests.
+ *
+ * 'mem_reclaim_start' / 'mem_reclaim_stop' -> Start and stop the background
+ * thread.
+ *
+ * The 'mem_reclaim_register_pool', '_arena' and '_page_heap' helpers are
+ * available when the respective headers are included before this one.
+ *
+ * @note No lock of the registry is held while a trim function runs, and the
+ * instance mutex is only ever try-locked while holding one. A trim function
+ * that needs the instance mutex must get it through the lock parameter of
+ * 'mem_reclaim_register' rather than locking it itself, or unregistering with
+ * the mutex held can deadlock.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Trim function of a registered instance
+ * @param instance instance passed to 'mem_reclaim_register'
+ * @return number of bytes given back to the OS
+ */
+typedef size_t (*MemTrimFn)(void *instance);
+
+/**
+ * @param interval_ms time between two polls
+ * @param psi_threshold pressure is reported when "some avg10" (percentage of
+ * time stalled on memory in the last 10 seconds) is above this, 0 disables it
+ * @param rss_limit pressure is reported when the resident set size goes over
+ * this many bytes, 0 disables it
+ * @param psi_path PSI file to read, NULL means "/proc/pressure/memory"
+ * @param events_path cgroup events file to read, NULL means
+ * "/sys/fs/cgroup/memory.events"
+ */
+typedef struct {
+  unsigned interval_ms;
+  double psi_threshold;
+  size_t rss_limit;
+  const char *psi_path;
+  const char *events_path;
+} MemReclaimConfig;
+
+/**
+ * Registers an instance to be trimmed under memory pressure
+ * @param instance allocator instance
+ * @param trim function trimming the instance
+ * @param lock mutex held while trimming, can be NULL
+ * @return 1 if the call succeded, 0 otherwise.
+ */
+int mem_reclaim_register(void *instance, MemTrimFn trim,
+                         pthread_mutex_t *lock);
+
+/**
+ * Removes an instance from the registry
+ * @param instance instance passed to 'mem_reclaim_register'
+ */
+void mem_reclaim_unregister(void *instance);
+
+/**
+ * Trims every registered instance
+ * @return number of bytes given back to the OS
+ */
+size_t mem_reclaim_trigger(void);
+
+/**
+ * Starts the background thread watching the memory pressure
+ * @param config polling configuration, it's copied
+ * @return 1 if the call succeded, 0 otherwise.
+ */
+int mem_reclaim_start(const MemReclaimConfig *config);
+
+/**
+ * Stops the background thread, waiting for it to exit
+ */
+void mem_reclaim_stop(void);
+
+#ifdef POOL_H
+int mem_reclaim_register_pool(MemPool *pool, pthread_mutex_t *lock);
+#endif
+#ifdef ARENA_H
+int mem_reclaim_register_arena(MemArena *arena, pthread_mutex_t *lock);
+#endif
+#ifdef PAGE_HEAP_H
+int mem_reclaim_register_page_heap(void);
+#endif
+
+#endif // RECLAIM_H
+
+#ifdef RECLAIM_IMPL
+
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @param instance registered instance
+ * @param trim trim function of the instance
+ * @param lock mutex of the instance, can be NULL
+ * @param removed 1 once unregistered
+ * @param trimming 1 while the trim function runs
+ * @param pinned 1 while a trim pass holds the entry, it frees it if it has
+ * been removed in the meantime
+ */
+typedef struct {
+  void *instance;
+  MemTrimFn trim;
+  pthread_mutex_t *lock;
+  int removed;
+  int trimming;
+  int pinned;
+} MemReclaimEntry;
+
+/**
+ * @param lock protects the registry, the entries and the thread state
+ * @param trim_lock serializes the trim passes
+ * @param wakeup signaled to stop the background thread
+ * @param trimmed signaled when a trim function returns
+ * @param entries registered instances
+ * @param size number of registered instances
+ * @param capacity number of entries allocated
+ * @param thread background thread, valid while running is 1
+ * @param running 1 while the background thread is supposed to run
+ * @param config configuration of the background thread
+ * @param last_events last sum of the cgroup high and max counters
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_mutex_t trim_lock;
+  pthread_cond_t wakeup;
+  pthread_cond_t trimmed;
+  MemReclaimEntry **entries;
+  size_t size;
+  size_t capacity;
+  pthread_t thread;
+  int running;
+  MemReclaimConfig config;
+  unsigned long long last_events;
+} MemReclaimer;
+
+static MemReclaimer mem_reclaimer = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .trim_lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+    .trimmed = PTHREAD_COND_INITIALIZER,
+};
+
+int mem_reclaim_register(void *instance, MemTrimFn trim,
+                         pthread_mutex_t *lock) {
+  if (instance == NULL || trim == NULL) {
+    return 0;
+  }
+  MemReclaimEntry *entry = calloc(1, sizeof(MemReclaimEntry));
+  if (entry == NULL) {
+    return 0;
+  }
+  entry->instance = instance;
+  entry->trim = trim;
+  entry->lock = lock;
+  pthread_mutex_lock(&mem_reclaimer.lock);
+  if (mem_reclaimer.size == mem_reclaimer.capacity) {
+    size_t capacity = mem_reclaimer.capacity ? mem_reclaimer.capacity * 2 : 16;
+    MemReclaimEntry **entries =
+        realloc(mem_reclaimer.entries, capacity * sizeof(MemReclaimEntry *));
+    if (entries == NULL) {
+      pthread_mutex_unlock(&mem_reclaimer.lock);
+      free(entry);
+      return 0;
+    }
+    mem_reclaimer.entries = entries;
+    mem_reclaimer.capacity = capacity;
+  }
+  mem_reclaimer.entries[mem_reclaimer.size++] = entry;
+  pthread_mutex_unlock(&mem_reclaimer.lock);
+  return 1;
+}
+
+void mem_reclaim_unregister(void *instance) {
+  pthread_mutex_lock(&mem_reclaimer.lock);
+  for (size_t i = 0; i < mem_reclaimer.size; ++i) {
+    MemReclaimEntry *entry = mem_reclaimer.entries[i];
+    if (entry->instance != instance) {
+      continue;
+    }
+    mem_reclaimer.entries[i] = mem_reclaimer.entries[--mem_reclaimer.size];
+    entry->removed = 1;
+    // The instance may be freed right after. A trim in progress holds the
+    // instance mutex, so the caller can't be holding it while we wait.
+    while (entry->trimming) {
+      pthread_cond_wait(&mem_reclaimer.trimmed, &mem_reclaimer.lock);
+    }
+    if (!entry->pinned) {
+      free(entry);
+    }
+    break;
+  }
+  pthread_mutex_unlock(&mem_reclaimer.lock);
+}
+
+// Locks the instance of an entry, 0 if it got removed while we waited
+static int mem_reclaim_acquire(MemReclaimEntry *entry) {
+  pthread_mutex_lock(&mem_reclaimer.lock);
+  // Only try-lock under the registry lock: the owner of the instance mutex
+  // may be waiting for the registry lock to unregister
+  while (!entry->removed && entry->lock != NULL &&
+         pthread_mutex_trylock(entry->lock) != 0) {
+    pthread_mutex_unlock(&mem_reclaimer.lock);
+    sched_yield();
+    pthread_mutex_lock(&mem_reclaimer.lock);
+  }
+  int acquired = !entry->removed;
+  entry->trimming = acquired;
+  pthread_mutex_unlock(&mem_reclaimer.lock);
+  return acquired;
+}
+
+size_t mem_reclaim_trigger(void) {
+  size_t trimmed = 0;
+  pthread_mutex_lock(&mem_reclaimer.trim_lock);
+  // Registration can go on while we trim, so work on a snapshot
+  pthread_mutex_lock(&mem_reclaimer.lock);
+  size_t size = mem_reclaimer.size;
+  if (size == 0) {
+    pthread_mutex_unlock(&mem_reclaimer.lock);
+    pthread_mutex_unlock(&mem_reclaimer.trim_lock);
+    return 0;
+  }
+  MemReclaimEntry **snapshot = malloc(size * sizeof(MemReclaimEntry *));
+  if (snapshot != NULL) {
+    for (size_t i = 0; i < size; ++i) {
+      snapshot[i] = mem_reclaimer.entries[i];
+      snapshot[i]->pinned = 1;
+    }
+  }
+  pthread_mutex_unlock(&mem_reclaimer.lock);
+  if (snapshot != NULL) {
+    for (size_t i = 0; i < size; ++i) {
+      MemReclaimEntry *entry = snapshot[i];
+      if (!mem_reclaim_acquire(entry)) {
+        continue;
+      }
+      trimmed += entry->trim(entry->instance);
+      // Last use of the mutex, unregister can return once trimming is 0
+      if (entry->lock != NULL) {
+        pthread_mutex_unlock(entry->lock);
+      }
+      pthread_mutex_lock(&mem_reclaimer.lock);
+      entry->trimming = 0;
+      pthread_cond_broadcast(&mem_reclaimer.trimmed);
+      pthread_mutex_unlock(&mem_reclaimer.lock);
+    }
+    pthread_mutex_lock(&mem_reclaimer.lock);
+    for (size_t i = 0; i < size; ++i) {
+      snapshot[i]->pinned = 0;
+      if (snapshot[i]->removed) {
+        free(snapshot[i]);
+      }
+    }
+    pthread_mutex_unlock(&mem_reclaimer.lock);
+    free(snapshot);
+  }
+  pthread_mutex_unlock(&mem_reclaimer.trim_lock);
+  return trimmed;
+}
+
+static int mem_reclaim_psi_pressure(const MemReclaimConfig *config) {
+  if (config->psi_threshold <= 0) {
+    return 0;
+  }
+  FILE *file = fopen(config->psi_path, "r");
+  if (file == NULL) {
+    return 0;
+  }
+  // First line: "some avg10=0.00 avg60=0.00 avg300=0.00 total=0"
+  double avg10 = 0;
+  int found = fscanf(file, "some avg10=%lf", &avg10) == 1;
+  fclose(file);
+  return found && avg10 > config->psi_threshold;
+}
+
+static int mem_reclaim_events_pressure(const MemReclaimConfig *config) {
+  FILE *file = fopen(config->events_path, "r");
+  if (file == NULL) {
+    return 0;
+  }
+  char key[32];
+  unsigned long long value, events = 0;
+  while (fscanf(file, "%31s %llu", key, &value) == 2) {
+    if (strcmp(key, "high") == 0 || strcmp(key, "max") == 0) {
+      events += value;
+    }
+  }
+  fclose(file);
+  int pressure = events > mem_reclaimer.last_events;
+  mem_reclaimer.last_events = events;
+  return pressure;
+}
+
+static int mem_reclaim_rss_pressure(const MemReclaimConfig *config) {
+  if (config->rss_limit == 0) {
+    return 0;
+  }
+  FILE *file = fopen("/proc/self/statm", "r");
+  if (file == NULL) {
+    return 0;
+  }
+  unsigned long long total, resident;
+  int found = fscanf(file, "%llu %llu", &total, &resident) == 2;
+  fclose(file);
+  return found && resident * (unsigned long long)sysconf(_SC_PAGESIZE) >
+                      config->rss_limit;
+}
+
+static void *mem_reclaim_thread(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&mem_reclaimer.lock);
+  while (mem_reclaimer.running) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    unsigned interval = mem_reclaimer.config.interval_ms;
+    deadline.tv_sec += interval / 1000;
+    deadline.tv_nsec += (long)(interval % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&mem_reclaimer.wakeup, &mem_reclaimer.lock,
+                           &deadline);
+    if (!mem_reclaimer.running) {
+      break;
+    }
+    MemReclaimConfig config = mem_reclaimer.config;
+    pthread_mutex_unlock(&mem_reclaimer.lock);
+
+    // Evaluate everything, the cgroup counters must be sampled every time
+    int pressure = mem_reclaim_events_pressure(&config);
+    pressure |= mem_reclaim_psi_pressure(&config);
+    pressure |= mem_reclaim_rss_pressure(&config);
+    if (pressure) {
+      mem_reclaim_trigger();
+    }
+    pthread_mutex_lock(&mem_reclaimer.lock);
+  }
+  pthread_mutex_unlock(&mem_reclaimer.lock);
+  return NULL;
+}
+
+int mem_reclaim_start(const MemReclaimConfig *config) {
+  if (config == NULL) {
+    return 0;
+  }
+  pthread_mutex_lock(&mem_reclaimer.lock);
+  if (mem_reclaimer.running) {
+    pthread_mutex_unlock(&mem_reclaimer.lock);
+    return 0;
+  }
+  mem_reclaimer.config = *config;
+  if (mem_reclaimer.config.interval_ms == 0) {
+    mem_reclaimer.config.interval_ms = 1000;
+  }
+  if (mem_reclaimer.config.psi_path == NULL) {
+    mem_reclaimer.config.psi_path = "/proc/pressure/memory";
+  }
+  if (mem_reclaimer.config.events_path == NULL) {
+    mem_reclaimer.config.events_path = "/sys/fs/cgroup/memory.events";
+  }
+  mem_reclaimer.running = 1;
+  pthread_mutex_unlock(&mem_reclaimer.lock);
+
+  // Take the baseline, only the events raised from now on count
+  mem_reclaim_events_pressure(&mem_reclaimer.config);
+  if (pthread_create(&mem_reclaimer.thread, NULL, mem_reclaim_thread, NULL)) {
+    pthread_mutex_lock(&mem_reclaimer.lock);
+    mem_reclaimer.running = 0;
+    pthread_mutex_unlock(&mem_reclaimer.lock);
+    return 0;
+  }
+  return 1;
+}
+
+void mem_reclaim_stop(void) {
+  pthread_mutex_lock(&mem_reclaimer.lock);
+  if (!mem_reclaimer.running) {
+    pthread_mutex_unlock(&mem_reclaimer.lock);
+    return;
+  }
+  mem_reclaimer.running = 0;
+  pthread_cond_signal(&mem_reclaimer.wakeup);
+  pthread_mutex_unlock(&mem_reclaimer.lock);
+  pthread_join(mem_reclaimer.thread, NULL);
+}
+
+#ifdef POOL_H
+static size_t mem_reclaim_trim_pool(void *pool) { return mem_pool_trim(pool); }
+
+int mem_reclaim_register_pool(MemPool *pool, pthread_mutex_t *lock) {
+  return mem_reclaim_register(pool, mem_reclaim_trim_pool, lock);
+}
+#endif
+
+#ifdef ARENA_H
+static size_t mem_reclaim_trim_arena(void *arena) {
+  return mem_arena_trim(arena);
+}
+
+int mem_reclaim_register_arena(MemArena *arena, pthread_mutex_t *lock) {
+  return mem_reclaim_register(arena, mem_reclaim_trim_arena, lock);
+}
+#endif
+
+#ifdef PAGE_HEAP_H
+static size_t mem_reclaim_trim_page_heap(void *unused) {
+  (void)unused;
+  return mem_page_heap_trim();
+}
+
+int mem_reclaim_register_page_heap(void) {
+  // The page heap is global and locks itself, any unique address works
+  static char page_heap_instance;
+  return mem_reclaim_register(&page_heap_instance, mem_reclaim_trim_page_heap,
+                              NULL);
+}
+#endif
+
+#endif // RECLAIM_IMPL
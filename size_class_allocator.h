@@ -0,0 +1,164 @@
+#ifndef SIZE_CLASS_ALLOC_H
+#define SIZE_CLASS_ALLOC_H
+
+/**
+ * STB-style implementation of a size class front end over
+ * 'pool_allocator.h'. Every size class gets its own MemPool, a request is
+ * served by the pool of the smallest class that fits it. The classes usually
+ * come from the header written by 'mem_size_hist_generate' (see
+ * 'size_histogram.h'):
+ *
+ *   #include "mem_size_classes.h"
+ *   MemSizeClassAlloc *alloc = mem_size_class_init(
+ *       mem_size_classes, MEM_SIZE_CLASS_COUNT, 1024);
+ *
+ * 'mem_size_class_init' -> Allocates one pool of chunks_per_class chunks for
+ * each class. The classes must be sorted in ascending order.
+ *
+ * 'mem_size_class_alloc' -> Returns a chunk of the smallest class holding
+ * bytes, or NULL if the request is bigger than the biggest class or its pool
+ * is exhausted.
+ *
+ * 'mem_size_class_free' -> Gives a chunk back, the caller passes the size it
+ * requested so the class is found without searching the pools.
+ *
+ * 'mem_size_class_deinit' -> Frees every pool and the front end itself.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool_allocator.h"
+
+/**
+ * @param n_classes number of size classes
+ * @param classes chunk size of each class, ascending
+ * @param pools one pool per class
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  size_t n_classes;
+  size_t *classes;
+  MemPool **pools;
+} MemSizeClassAlloc;
+
+/**
+ * Heap allocates a new size class front end
+ * @param classes chunk sizes, in ascending order
+ * @param n_classes number of classes
+ * @param chunks_per_class number of chunks of every pool
+ * @return pointer to the front end, or NULL on failure
+ */
+MemSizeClassAlloc *mem_size_class_init(const size_t *classes,
+                                       size_t n_classes,
+                                       size_t chunks_per_class);
+
+/**
+ * Allocates a chunk from the smallest class fitting the request
+ * @param alloc front end we want to allocate from
+ * @param bytes number of bytes requested
+ * @return pointer to the chunk, or NULL on failure
+ */
+void *mem_size_class_alloc(MemSizeClassAlloc *alloc, size_t bytes);
+
+/**
+ * Gives a chunk back to its class
+ * @param alloc front end owning the chunk
+ * @param ptr chunk to give back
+ * @param bytes size passed to 'mem_size_class_alloc'
+ */
+void mem_size_class_free(MemSizeClassAlloc *alloc, void *ptr, size_t bytes);
+
+/**
+ * Frees the memory related to the front end passed as parameter
+ * @param alloc front end we are freeing
+ */
+void mem_size_class_deinit(MemSizeClassAlloc *alloc);
+
+#endif // SIZE_CLASS_ALLOC_H
+
+#if defined(SIZE_CLASS_ALLOC_IMPL) && !defined(SIZE_CLASS_ALLOC_IMPL_DONE)
+#define SIZE_CLASS_ALLOC_IMPL_DONE
+
+// Index of the smallest class holding bytes, n_classes if none does
+static size_t mem_size_class_index(MemSizeClassAlloc *alloc, size_t bytes) {
+  size_t lo = 0, hi = alloc->n_classes;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (alloc->classes[mid] < bytes) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+MemSizeClassAlloc *mem_size_class_init(const size_t *classes,
+                                       size_t n_classes,
+                                       size_t chunks_per_class) {
+  if (classes == NULL || n_classes == 0) {
+    return NULL;
+  }
+  MemSizeClassAlloc *new_alloc = calloc(1, sizeof(MemSizeClassAlloc));
+  if (new_alloc == NULL) {
+    return NULL;
+  }
+  new_alloc->classes = malloc(n_classes * sizeof(size_t));
+  new_alloc->pools = calloc(n_classes, sizeof(MemPool *));
+  if (new_alloc->classes == NULL || new_alloc->pools == NULL) {
+    mem_size_class_deinit(new_alloc);
+    return NULL;
+  }
+  new_alloc->n_classes = n_classes;
+  for (size_t i = 0; i < n_classes; ++i) {
+    if (i > 0 && classes[i] <= classes[i - 1]) {
+      mem_size_class_deinit(new_alloc);
+      return NULL;
+    }
+    new_alloc->classes[i] = classes[i];
+    new_alloc->pools[i] = mem_pool_init(classes[i], chunks_per_class);
+    if (new_alloc->pools[i] == NULL) {
+      mem_size_class_deinit(new_alloc);
+      return NULL;
+    }
+  }
+  return new_alloc;
+}
+
+void *mem_size_class_alloc(MemSizeClassAlloc *alloc, size_t bytes) {
+  if (alloc == NULL) {
+    return NULL;
+  }
+  size_t index = mem_size_class_index(alloc, bytes);
+  if (index == alloc->n_classes) {
+    return NULL;
+  }
+  return mem_pool_alloc(alloc->pools[index]);
+}
+
+void mem_size_class_free(MemSizeClassAlloc *alloc, void *ptr, size_t bytes) {
+  if (alloc == NULL || ptr == NULL) {
+    return;
+  }
+  size_t index = mem_size_class_index(alloc, bytes);
+  if (index < alloc->n_classes) {
+    mem_pool_free(alloc->pools[index], ptr);
+  }
+}
+
+void mem_size_class_deinit(MemSizeClassAlloc *alloc) {
+  if (alloc != NULL) {
+    if (alloc->pools != NULL) {
+      for (size_t i = 0; i < alloc->n_classes; ++i) {
+        mem_pool_deinit(alloc->pools[i]);
+      }
+    }
+    free(alloc->pools);
+    free(alloc->classes);
+    free(alloc);
+  }
+}
+
+#endif // SIZE_CLASS_ALLOC_IMPL
@@ -0,0 +1,318 @@
+#ifndef SIZE_HISTOGRAM_H
+#define SIZE_HISTOGRAM_H
+
+/**
+ * STB-style implementation of an allocation size histogram, and of a size
+ * class generator driven by it. The idea is to record which sizes a program
+ * actually asks for, save the histogram, and later turn it into a table of
+ * size classes (see 'size_class_allocator.h') that wastes as little memory as
+ * possible for the given number of classes.
+ *
+ * Sizes up to MEM_HIST_EXACT_MAX bytes are recorded with an 8 bytes
+ * granularity, bigger ones in 16 buckets per power of two. Recording is a
+ * single relaxed atomic increment, so a histogram can be shared by threads.
+ *
+ * 'mem_size_hist_init' / 'mem_size_hist_deinit' -> Allocate and free a
+ * histogram.
+ *
+ * 'mem_size_hist_record' -> Records one allocation of the given size.
+ *
+ * 'mem_hist_arena_alloc', 'mem_hist_stack_alloc', 'mem_hist_pool_alloc' ->
+ * Record the size and forward the call to the allocator, they are available
+ * when the allocator headers are included before this one.
+ *
+ * 'mem_size_hist_save' / 'mem_size_hist_load' -> Write and read the histogram
+ * as text, one "size count" line per non-empty bucket. Loading adds to the
+ * histogram, so several runs can be merged.
+ *
+ * 'mem_size_hist_generate' -> Offline step: picks the n_classes sizes that
+ * minimize the internal fragmentation of the recorded allocations and writes
+ * them as a C header defining 'MEM_SIZE_CLASS_COUNT' and 'mem_size_classes'.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MEM_HIST_EXACT_MAX 4096
+#define MEM_HIST_GRANULE 8
+#define MEM_HIST_SUB_BUCKETS 16
+#define MEM_HIST_MAX_SHIFT 48
+
+#define MEM_HIST_EXACT_BUCKETS (MEM_HIST_EXACT_MAX / MEM_HIST_GRANULE + 1)
+#define MEM_HIST_BUCKETS                                                       \
+  (MEM_HIST_EXACT_BUCKETS +                                                    \
+   (MEM_HIST_MAX_SHIFT - 12) * MEM_HIST_SUB_BUCKETS)
+
+/**
+ * @param counts number of allocations recorded in each bucket
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  _Atomic uint64_t counts[MEM_HIST_BUCKETS];
+} MemSizeHist;
+
+/**
+ * Heap allocates a new, empty, histogram
+ * @return pointer to the histogram, or NULL on failure
+ */
+MemSizeHist *mem_size_hist_init(void);
+
+/**
+ * Records an allocation
+ * @param hist histogram to update
+ * @param bytes size of the allocation
+ */
+void mem_size_hist_record(MemSizeHist *hist, size_t bytes);
+
+/**
+ * Writes the histogram as text
+ * @param hist histogram to save
+ * @param out stream to write to
+ * @return 1 if the call succeded, 0 otherwise.
+ */
+int mem_size_hist_save(MemSizeHist *hist, FILE *out);
+
+/**
+ * Adds the counts of a saved histogram to hist
+ * @param hist histogram to update
+ * @param in stream written by 'mem_size_hist_save'
+ * @return 1 if the call succeded, 0 otherwise.
+ */
+int mem_size_hist_load(MemSizeHist *hist, FILE *in);
+
+/**
+ * Computes the size classes minimizing the internal fragmentation and writes
+ * them as a C header
+ * @param hist recorded histogram
+ * @param n_classes maximum number of classes to generate
+ * @param alignment every class is a multiple of this (a power of two)
+ * @param out stream the header is written to
+ * @return number of classes written, 0 on failure
+ */
+size_t mem_size_hist_generate(MemSizeHist *hist, size_t n_classes,
+                              size_t alignment, FILE *out);
+
+/**
+ * Frees the histogram passed as parameter
+ * @param hist histogram to free
+ */
+void mem_size_hist_deinit(MemSizeHist *hist);
+
+#ifdef ARENA_H
+static inline void *mem_hist_arena_alloc(MemSizeHist *hist, MemArena *arena,
+                                         size_t bytes) {
+  mem_size_hist_record(hist, bytes);
+  return mem_arena_alloc(arena, bytes);
+}
+#endif
+
+#ifdef STACK_ALLOC_H
+static inline void *mem_hist_stack_alloc(MemSizeHist *hist, MemStack *stack,
+                                         size_t bytes) {
+  mem_size_hist_record(hist, bytes);
+  return mem_stack_alloc(stack, bytes);
+}
+#endif
+
+#ifdef POOL_H
+// Pools have a fixed chunk size, bytes is what the caller actually needs
+static inline void *mem_hist_pool_alloc(MemSizeHist *hist, MemPool *pool,
+                                        size_t bytes) {
+  mem_size_hist_record(hist, bytes);
+  return mem_pool_alloc(pool);
+}
+#endif
+
+#endif // SIZE_HISTOGRAM_H
+
+#if defined(SIZE_HISTOGRAM_IMPL) && !defined(SIZE_HISTOGRAM_IMPL_DONE)
+#define SIZE_HISTOGRAM_IMPL_DONE
+
+#include <string.h>
+
+static size_t mem_size_hist_bucket(size_t bytes) {
+  if (bytes <= MEM_HIST_EXACT_MAX) {
+    return (bytes + MEM_HIST_GRANULE - 1) / MEM_HIST_GRANULE;
+  }
+  // bytes is in (2^shift, 2^(shift + 1)], split in equal sub buckets
+  size_t shift = 63 - (size_t)__builtin_clzll((unsigned long long)bytes - 1);
+  if (shift >= MEM_HIST_MAX_SHIFT) {
+    return MEM_HIST_BUCKETS - 1;
+  }
+  size_t step = ((size_t)1 << shift) / MEM_HIST_SUB_BUCKETS;
+  size_t sub = (bytes - ((size_t)1 << shift) - 1) / step;
+  return MEM_HIST_EXACT_BUCKETS + (shift - 12) * MEM_HIST_SUB_BUCKETS + sub;
+}
+
+// Largest size falling in a bucket
+static size_t mem_size_hist_bucket_size(size_t bucket) {
+  if (bucket < MEM_HIST_EXACT_BUCKETS) {
+    return bucket * MEM_HIST_GRANULE;
+  }
+  bucket -= MEM_HIST_EXACT_BUCKETS;
+  size_t shift = 12 + bucket / MEM_HIST_SUB_BUCKETS;
+  size_t step = ((size_t)1 << shift) / MEM_HIST_SUB_BUCKETS;
+  return ((size_t)1 << shift) + (bucket % MEM_HIST_SUB_BUCKETS + 1) * step;
+}
+
+MemSizeHist *mem_size_hist_init(void) {
+  return calloc(1, sizeof(MemSizeHist));
+}
+
+void mem_size_hist_record(MemSizeHist *hist, size_t bytes) {
+  if (hist != NULL) {
+    atomic_fetch_add_explicit(&hist->counts[mem_size_hist_bucket(bytes)], 1,
+                              memory_order_relaxed);
+  }
+}
+
+int mem_size_hist_save(MemSizeHist *hist, FILE *out) {
+  if (hist == NULL || out == NULL) {
+    return 0;
+  }
+  fprintf(out, "# mem_size_hist v1\n");
+  for (size_t i = 0; i < MEM_HIST_BUCKETS; ++i) {
+    uint64_t count =
+        atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+    if (count != 0) {
+      fprintf(out, "%zu %llu\n", mem_size_hist_bucket_size(i),
+              (unsigned long long)count);
+    }
+  }
+  return ferror(out) == 0;
+}
+
+int mem_size_hist_load(MemSizeHist *hist, FILE *in) {
+  if (hist == NULL || in == NULL) {
+    return 0;
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), in) != NULL) {
+    size_t size;
+    unsigned long long count;
+    if (line[0] == '#') {
+      continue;
+    }
+    if (sscanf(line, "%zu %llu", &size, &count) != 2) {
+      return 0;
+    }
+    atomic_fetch_add_explicit(&hist->counts[mem_size_hist_bucket(size)],
+                              count, memory_order_relaxed);
+  }
+  return 1;
+}
+
+size_t mem_size_hist_generate(MemSizeHist *hist, size_t n_classes,
+                              size_t alignment, FILE *out) {
+  if (hist == NULL || out == NULL || n_classes == 0 || alignment == 0 ||
+      (alignment & (alignment - 1)) != 0) {
+    return 0;
+  }
+  // Distinct sizes (rounded to the alignment) with their counts, ascending
+  size_t *sizes = malloc(MEM_HIST_BUCKETS * sizeof(size_t));
+  double *counts = malloc(MEM_HIST_BUCKETS * sizeof(double));
+  if (sizes == NULL || counts == NULL) {
+    free(sizes);
+    free(counts);
+    return 0;
+  }
+  size_t m = 0;
+  for (size_t i = 0; i < MEM_HIST_BUCKETS; ++i) {
+    uint64_t count =
+        atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+    size_t size = mem_size_hist_bucket_size(i);
+    size = size == 0 ? alignment : (size + alignment - 1) & ~(alignment - 1);
+    if (m > 0 && sizes[m - 1] == size) {
+      counts[m - 1] += (double)count;
+    } else {
+      sizes[m] = size;
+      counts[m] = (double)count;
+      m++;
+    }
+  }
+  size_t k = n_classes < m ? n_classes : m;
+
+  /*
+   * waste[c][j] is the minimum waste of covering the first j sizes with c
+   * classes, the last class being sizes[j - 1]. A class S covering the sizes
+   * (i, j] wastes S * count(i, j] - bytes(i, j], computed with prefix sums.
+   */
+  double *cnt = calloc(m + 1, sizeof(double));
+  double *byt = calloc(m + 1, sizeof(double));
+  double *waste = malloc((k + 1) * (m + 1) * sizeof(double));
+  size_t *from = malloc((k + 1) * (m + 1) * sizeof(size_t));
+  size_t *classes = malloc((k + 1) * sizeof(size_t));
+  size_t written = 0;
+  if (cnt != NULL && byt != NULL && waste != NULL && from != NULL &&
+      classes != NULL && m > 0) {
+    for (size_t j = 0; j < m; ++j) {
+      cnt[j + 1] = cnt[j] + counts[j];
+      byt[j + 1] = byt[j] + counts[j] * (double)sizes[j];
+    }
+#define WASTE(c, j) waste[(c) * (m + 1) + (j)]
+#define FROM(c, j) from[(c) * (m + 1) + (j)]
+    for (size_t j = 1; j <= m; ++j) {
+      WASTE(1, j) = (double)sizes[j - 1] * cnt[j] - byt[j];
+      FROM(1, j) = 0;
+    }
+    for (size_t c = 2; c <= k; ++c) {
+      for (size_t j = c; j <= m; ++j) {
+        double best = -1;
+        size_t best_i = c - 1;
+        for (size_t i = c - 1; i < j; ++i) {
+          double w = WASTE(c - 1, i) +
+                     (double)sizes[j - 1] * (cnt[j] - cnt[i]) -
+                     (byt[j] - byt[i]);
+          if (best < 0 || w < best) {
+            best = w;
+            best_i = i;
+          }
+        }
+        WASTE(c, j) = best;
+        FROM(c, j) = best_i;
+      }
+    }
+    // Walk back from the biggest size to recover the classes
+    size_t j = m;
+    for (size_t c = k; c >= 1; --c) {
+      classes[c - 1] = sizes[j - 1];
+      j = FROM(c, j);
+    }
+    double total = WASTE(k, m);
+#undef WASTE
+#undef FROM
+
+    fprintf(out, "// Generated by mem_size_hist_generate: %zu classes, ", k);
+    fprintf(out, "%.0f bytes of internal fragmentation\n", total);
+    fprintf(out, "// on %.0f recorded allocations\n", cnt[m]);
+    fprintf(out, "#ifndef MEM_SIZE_CLASSES_H\n#define MEM_SIZE_CLASSES_H\n\n");
+    fprintf(out, "#include <stddef.h>\n\n");
+    fprintf(out, "#define MEM_SIZE_CLASS_COUNT %zu\n\n", k);
+    fprintf(out, "static const size_t mem_size_classes[MEM_SIZE_CLASS_COUNT]");
+    fprintf(out, " = {");
+    for (size_t c = 0; c < k; ++c) {
+      fprintf(out, "%s%s%zu", c == 0 ? "" : ",", c % 8 == 0 ? "\n    " : " ",
+              classes[c]);
+    }
+    fprintf(out, "\n};\n\n#endif // MEM_SIZE_CLASSES_H\n");
+    written = ferror(out) == 0 ? k : 0;
+  }
+  free(sizes);
+  free(counts);
+  free(cnt);
+  free(byt);
+  free(waste);
+  free(from);
+  free(classes);
+  return written;
+}
+
+void mem_size_hist_deinit(MemSizeHist *hist) { free(hist); }
+
+#endif // SIZE_HISTOGRAM_IMPL
@@ -0,0 +1,327 @@
+#ifndef SMALL_ALLOC_H
+#define SMALL_ALLOC_H
+
+/**
+ * STB-style implementation of a small object allocator with sharded free
+ * lists. Objects of the same size class are carved from 64 KB pages and every
+ * page keeps its own free lists, so consecutive allocations stay close to each
+ * other in memory and threads freeing into different pages never meet.
+ *
+ * Each page has three lists:
+ * - 'free' is the list the allocation pops from, it's only touched by the
+ *   thread owning the heap, so the hot path is a plain pointer pop;
+ * - 'local_free' collects the blocks freed by the owner thread, it's merged
+ *   into 'free' only once 'free' is empty;
+ * - 'thread_free' collects the blocks freed by other threads with an atomic
+ *   push, it's taken with a single atomic exchange when 'free' is empty.
+ *
+ * 'mem_small_heap_init' -> Allocates a new heap owned by the calling thread.
+ * Only the owner can allocate from it, any thread can free into it.
+ *
+ * 'mem_small_alloc' -> Returns a block of at least the requested size (up to
+ * MEM_SMALL_MAX_SIZE bytes), or NULL if the size is too big or the OS is out of
+ * memory.
+ *
+ * 'mem_small_free' -> Gives a block back to the page it came from. It doesn't
+ * need the heap, the page is found by masking the pointer.
+ *
+ * 'mem_small_heap_deinit' -> Releases all the memory of the heap. Blocks that
+ * are still in use become invalid.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MEM_SMALL_PAGE_SHIFT 16
+#define MEM_SMALL_PAGE_SIZE ((size_t)1 << MEM_SMALL_PAGE_SHIFT)
+
+// Pages are reserved from the OS in segments of this many pages
+#define MEM_SMALL_SEGMENT_PAGES 64
+
+// Size classes are multiples of 16 bytes up to MEM_SMALL_MAX_SIZE
+#define MEM_SMALL_GRANULE 16
+#define MEM_SMALL_MAX_SIZE 1024
+#define MEM_SMALL_CLASSES (MEM_SMALL_MAX_SIZE / MEM_SMALL_GRANULE)
+
+typedef struct MemSmallBlock {
+  struct MemSmallBlock *next;
+} MemSmallBlock;
+
+struct MemSmallHeap;
+
+/**
+ * @param free blocks ready to be handed out, owner thread only
+ * @param local_free blocks freed by the owner thread
+ * @param thread_free blocks freed by the other threads
+ * @param heap heap owning the page
+ * @param block_size size of the blocks carved from this page
+ * @param used blocks currently handed out (remote frees are counted when they
+ * get collected)
+ * @param n_blocks number of blocks in the page
+ * @param prev previous page in the heap list
+ * @param next next page in the heap list
+ * @note The page header lives at the start of its own 64 KB page.
+ */
+typedef struct MemSmallPage {
+  MemSmallBlock *free;
+  MemSmallBlock *local_free;
+  _Atomic(MemSmallBlock *) thread_free;
+  struct MemSmallHeap *heap;
+  size_t block_size;
+  size_t used;
+  size_t n_blocks;
+  struct MemSmallPage *prev;
+  struct MemSmallPage *next;
+} MemSmallPage;
+
+/**
+ * @param owner identifies the thread owning the heap
+ * @param pages per size class list of pages, the head is the page we're
+ * currently allocating from
+ * @param spare_pages empty pages ready to be reused by any size class
+ * @param segments raw memory reserved from the OS
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct MemSmallHeap {
+  const void *owner;
+  MemSmallPage *pages[MEM_SMALL_CLASSES];
+  MemSmallPage *spare_pages;
+  void *segments;
+} MemSmallHeap;
+
+/**
+ * Heap allocates a new small object heap owned by the calling thread
+ * @return pointer to the new heap, or NULL on failure
+ */
+MemSmallHeap *mem_small_heap_init(void);
+
+/**
+ * Allocates a block of at least the requested size
+ * @param heap heap owned by the calling thread
+ * @param bytes size of the block
+ * @return pointer to the block, or NULL on failure
+ */
+void *mem_small_alloc(MemSmallHeap *heap, size_t bytes);
+
+/**
+ * Gives a block back to its page, can be called from any thread
+ * @param ptr block previously returned by 'mem_small_alloc'
+ */
+void mem_small_free(void *ptr);
+
+/**
+ * Frees all the memory related to the heap passed as parameter
+ * @param heap heap to free
+ */
+void mem_small_heap_deinit(MemSmallHeap *heap);
+
+#endif // SMALL_ALLOC_H
+
+#ifdef SMALL_ALLOC_IMPL
+
+#include <sys/mman.h>
+
+// Every thread has a distinct address for this, it's used as a thread id
+static _Thread_local char mem_small_thread_id;
+
+#define MEM_SMALL_SEGMENT_SIZE (MEM_SMALL_SEGMENT_PAGES * MEM_SMALL_PAGE_SIZE)
+
+// The first page of every segment is used to link the segments together
+typedef struct MemSmallSegment {
+  struct MemSmallSegment *next;
+  void *base;
+} MemSmallSegment;
+
+static int mem_small_grow(MemSmallHeap *heap) {
+  // Over-reserve so the segment can be aligned to the page size
+  size_t bytes = MEM_SMALL_SEGMENT_SIZE + MEM_SMALL_PAGE_SIZE;
+  uint8_t *raw = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    return 0;
+  }
+  uintptr_t mask = MEM_SMALL_PAGE_SIZE - 1;
+  uint8_t *base = (uint8_t *)(((uintptr_t)raw + mask) & ~mask);
+  if (base > raw) {
+    munmap(raw, base - raw);
+  }
+  uint8_t *end = base + MEM_SMALL_SEGMENT_SIZE;
+  if (end < raw + bytes) {
+    munmap(end, raw + bytes - end);
+  }
+
+  MemSmallSegment *segment = (MemSmallSegment *)base;
+  segment->base = base;
+  segment->next = heap->segments;
+  heap->segments = segment;
+  for (size_t i = MEM_SMALL_SEGMENT_PAGES - 1; i > 0; --i) {
+    MemSmallPage *page = (MemSmallPage *)(base + i * MEM_SMALL_PAGE_SIZE);
+    page->next = heap->spare_pages;
+    heap->spare_pages = page;
+  }
+  return 1;
+}
+
+static MemSmallPage *mem_small_new_page(MemSmallHeap *heap, size_t cls) {
+  if (heap->spare_pages == NULL && !mem_small_grow(heap)) {
+    return NULL;
+  }
+  MemSmallPage *page = heap->spare_pages;
+  heap->spare_pages = page->next;
+
+  size_t block_size = (cls + 1) * MEM_SMALL_GRANULE;
+  size_t header = (sizeof(MemSmallPage) + MEM_SMALL_GRANULE - 1) &
+                  ~(size_t)(MEM_SMALL_GRANULE - 1);
+  page->heap = heap;
+  page->block_size = block_size;
+  page->used = 0;
+  page->n_blocks = (MEM_SMALL_PAGE_SIZE - header) / block_size;
+  page->local_free = NULL;
+  atomic_store_explicit(&page->thread_free, NULL, memory_order_relaxed);
+
+  // Thread the free list in address order so allocations walk forward
+  uint8_t *first = (uint8_t *)page + header;
+  MemSmallBlock *list = NULL;
+  for (size_t i = page->n_blocks; i > 0; --i) {
+    MemSmallBlock *block = (MemSmallBlock *)(first + (i - 1) * block_size);
+    block->next = list;
+    list = block;
+  }
+  page->free = list;
+
+  page->prev = NULL;
+  page->next = heap->pages[cls];
+  if (page->next != NULL) {
+    page->next->prev = page;
+  }
+  heap->pages[cls] = page;
+  return page;
+}
+
+static void mem_small_collect(MemSmallPage *page) {
+  // Deferred local frees first, they don't need any atomic operation
+  if (page->local_free != NULL) {
+    page->free = page->local_free;
+    page->local_free = NULL;
+  }
+  MemSmallBlock *remote = atomic_exchange_explicit(&page->thread_free, NULL,
+                                                   memory_order_acquire);
+  while (remote != NULL) {
+    MemSmallBlock *next = remote->next;
+    remote->next = page->free;
+    page->free = remote;
+    page->used--;
+    remote = next;
+  }
+}
+
+static void mem_small_unlink(MemSmallHeap *heap, size_t cls,
+                             MemSmallPage *page) {
+  if (page->prev != NULL) {
+    page->prev->next = page->next;
+  } else {
+    heap->pages[cls] = page->next;
+  }
+  if (page->next != NULL) {
+    page->next->prev = page->prev;
+  }
+}
+
+static void *mem_small_alloc_slow(MemSmallHeap *heap, size_t cls) {
+  MemSmallPage *page = heap->pages[cls];
+  while (page != NULL) {
+    MemSmallPage *next = page->next;
+    mem_small_collect(page);
+    if (page->used == 0 && page != heap->pages[cls]) {
+      // Completely free pages go back to the heap for any size class
+      mem_small_unlink(heap, cls, page);
+      page->next = heap->spare_pages;
+      heap->spare_pages = page;
+    } else if (page->free != NULL) {
+      // Move the page to the front so the fast path finds it next time
+      if (page != heap->pages[cls]) {
+        mem_small_unlink(heap, cls, page);
+        page->prev = NULL;
+        page->next = heap->pages[cls];
+        page->next->prev = page;
+        heap->pages[cls] = page;
+      }
+      break;
+    }
+    page = next;
+  }
+  if (page == NULL) {
+    page = mem_small_new_page(heap, cls);
+    if (page == NULL) {
+      return NULL;
+    }
+  }
+  MemSmallBlock *block = page->free;
+  page->free = block->next;
+  page->used++;
+  return block;
+}
+
+MemSmallHeap *mem_small_heap_init(void) {
+  MemSmallHeap *new_heap = calloc(1, sizeof(MemSmallHeap));
+  if (new_heap == NULL) {
+    return NULL;
+  }
+  new_heap->owner = &mem_small_thread_id;
+  return new_heap;
+}
+
+void *mem_small_alloc(MemSmallHeap *heap, size_t bytes) {
+  if (heap == NULL || bytes > MEM_SMALL_MAX_SIZE) {
+    return NULL;
+  }
+  size_t cls = bytes == 0 ? 0 : (bytes - 1) / MEM_SMALL_GRANULE;
+  MemSmallPage *page = heap->pages[cls];
+  if (page != NULL && page->free != NULL) {
+    MemSmallBlock *block = page->free;
+    page->free = block->next;
+    page->used++;
+    return block;
+  }
+  return mem_small_alloc_slow(heap, cls);
+}
+
+void mem_small_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  MemSmallPage *page =
+      (MemSmallPage *)((uintptr_t)ptr & ~(uintptr_t)(MEM_SMALL_PAGE_SIZE - 1));
+  MemSmallBlock *block = ptr;
+  if (page->heap->owner == &mem_small_thread_id) {
+    block->next = page->local_free;
+    page->local_free = block;
+    page->used--;
+    return;
+  }
+  MemSmallBlock *head =
+      atomic_load_explicit(&page->thread_free, memory_order_relaxed);
+  do {
+    block->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&page->thread_free, &head,
+                                                  block, memory_order_release,
+                                                  memory_order_relaxed));
+}
+
+void mem_small_heap_deinit(MemSmallHeap *heap) {
+  if (heap != NULL) {
+    MemSmallSegment *segment = heap->segments;
+    while (segment != NULL) {
+      MemSmallSegment *next = segment->next;
+      munmap(segment->base, MEM_SMALL_SEGMENT_SIZE);
+      segment = next;
+    }
+    free(heap);
+  }
+}
+
+#undef MEM_SMALL_SEGMENT_SIZE
+
+#endif // SMALL_ALLOC_IMPL
@@ -0,0 +1,360 @@
+#ifndef SOA_POOL_H
+#define SOA_POOL_H
+
+/**
+ * STB-style implementation of a struct-of-arrays pool. Instead of storing
+ * whole objects in fixed size chunks like 'pool_allocator.h', every field of
+ * the objects lives in its own column array, so a loop touching a single
+ * field only streams that field through the cache and can be vectorized.
+ *
+ * The columns are kept dense: the live objects always occupy the indexes
+ * [0, size) of every column. Removing an object moves the last one into the
+ * hole (swap-remove), so objects are referred to through handles instead of
+ * pointers or indexes. A handle keeps working until its object is freed, a
+ * generation counter makes stale handles fail instead of aliasing a new
+ * object.
+ *
+ * 'mem_soa_pool_init' -> Allocates a pool with one column per field size
+ * passed as parameter, every column is aligned to MEM_SOA_ALIGNMENT bytes.
+ *
+ * 'mem_soa_pool_alloc' -> Appends a new object at the end of the columns and
+ * returns its handle, or MEM_SOA_INVALID_HANDLE if the pool is full.
+ *
+ * 'mem_soa_pool_free' -> Removes the object referred by the handle, moving the
+ * last object in its place.
+ *
+ * 'mem_soa_pool_get' -> Returns a pointer to one field of an object.
+ *
+ * 'mem_soa_pool_column' / 'mem_soa_pool_size' -> Dense column array and
+ * number of live objects, what the per-field loops iterate over.
+ *
+ * 'mem_soa_pool_grow' -> Raises the capacity of the pool, the handles stay
+ * valid. Columns are reached through handles only, so they are free to move:
+ * big columns are mappings of their own (see 'large_alloc.h') that mremap
+ * grows without copying them.
+ *
+ * 'mem_soa_pool_deinit' -> Frees all the memory related to the pool.
+ *
+ * @note The columns are allocated with 'large_alloc.h', so LARGE_ALLOC_IMPL
+ * has to be defined once as well.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "large_alloc.h"
+
+#ifndef MEM_SOA_ALIGNMENT
+#define MEM_SOA_ALIGNMENT 64
+#endif
+
+// Handles pack the slot index in the low half and its generation in the high
+// half, generations start at 1 so a zeroed handle is never valid
+typedef uint64_t MemSoaHandle;
+#define MEM_SOA_INVALID_HANDLE ((MemSoaHandle)0)
+
+/**
+ * @param n_columns number of fields (columns) of the objects
+ * @param field_sizes size in bytes of each field
+ * @param columns dense arrays, one per field
+ * @param column_bytes bytes allocated for each column
+ * @param size number of live objects
+ * @param capacity maximum number of objects
+ * @param dense_to_slot handle slot of the object stored at each dense index
+ * @param slot_to_dense dense index of the object of each slot, or the next
+ * free slot for the slots that aren't in use
+ * @param generations current generation of each slot
+ * @param free_slot first slot of the free list
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct {
+  size_t n_columns;
+  size_t *field_sizes;
+  uint8_t **columns;
+  size_t *column_bytes;
+  size_t size;
+  size_t capacity;
+  uint32_t *dense_to_slot;
+  uint32_t *slot_to_dense;
+  uint32_t *generations;
+  uint32_t free_slot;
+} MemSoaPool;
+
+/**
+ * Heap allocates a new SoA pool and returns the pointer to it
+ * @param field_sizes size in bytes of each field of the objects
+ * @param n_columns number of fields
+ * @param capacity maximum number of objects the pool can hold
+ * @return pointer to the initialized pool, or NULL on failure
+ */
+MemSoaPool *mem_soa_pool_init(const size_t *field_sizes, size_t n_columns,
+                              size_t capacity);
+
+/**
+ * Adds a new object at the end of the columns, its fields are zeroed
+ * @param pool pool we want to allocate from
+ * @return handle of the new object, or MEM_SOA_INVALID_HANDLE if full
+ */
+MemSoaHandle mem_soa_pool_alloc(MemSoaPool *pool);
+
+/**
+ * Removes an object, the last object of the columns takes its place
+ * @param pool pool owning the object
+ * @param handle handle of the object
+ * @return 1 if the call succeded, 0 if the handle is stale or invalid.
+ */
+int mem_soa_pool_free(MemSoaPool *pool, MemSoaHandle handle);
+
+/**
+ * Raises the capacity of the pool, the handles stay valid
+ * @param pool pool we want to grow
+ * @param capacity new maximum number of objects, lower values are ignored
+ * @return 1 if the call succeded, 0 otherwise (the pool keeps its capacity).
+ * @note The columns may move, pointers to fields and columns are invalidated.
+ */
+int mem_soa_pool_grow(MemSoaPool *pool, size_t capacity);
+
+/**
+ * Returns a pointer to a field of an object, it stays valid until the next
+ * call to 'mem_soa_pool_free' (or 'mem_soa_pool_grow')
+ * @param pool pool owning the object
+ * @param handle handle of the object
+ * @param column index of the field
+ * @return pointer to the field, or NULL if the handle is stale or invalid
+ */
+void *mem_soa_pool_get(MemSoaPool *pool, MemSoaHandle handle, size_t column);
+
+/**
+ * Returns the dense array of a field, valid for 'mem_soa_pool_size' objects
+ * @param pool pool owning the column
+ * @param column index of the field
+ * @return pointer to the first element of the column
+ */
+void *mem_soa_pool_column(MemSoaPool *pool, size_t column);
+
+/**
+ * @param pool pool we are interested in
+ * @return number of live objects in the pool
+ */
+size_t mem_soa_pool_size(MemSoaPool *pool);
+
+/**
+ * Returns the handle of the object stored at a dense index
+ * @param pool pool owning the object
+ * @param index dense index, lower than 'mem_soa_pool_size'
+ * @return handle of the object
+ */
+MemSoaHandle mem_soa_pool_handle(MemSoaPool *pool, size_t index);
+
+/**
+ * Frees the memory related to the pool passed as parameter
+ * @param pool pool we are freeing
+ */
+void mem_soa_pool_deinit(MemSoaPool *pool);
+
+#endif // SOA_POOL_H
+
+#ifdef SOA_POOL_IMPL
+
+#include <string.h>
+
+#define MEM_SOA_SLOT(handle) ((uint32_t)(handle))
+#define MEM_SOA_GENERATION(handle) ((uint32_t)((handle) >> 32))
+#define MEM_SOA_MAKE_HANDLE(slot, generation)                                  \
+  (((MemSoaHandle)(generation) << 32) | (MemSoaHandle)(slot))
+
+MemSoaPool *mem_soa_pool_init(const size_t *field_sizes, size_t n_columns,
+                              size_t capacity) {
+  if (capacity >= UINT32_MAX) {
+    return NULL;
+  }
+  MemSoaPool *new_pool = calloc(1, sizeof(MemSoaPool));
+  if (new_pool == NULL) {
+    return NULL;
+  }
+  new_pool->n_columns = n_columns;
+  new_pool->capacity = capacity;
+  new_pool->field_sizes = calloc(n_columns, sizeof(size_t));
+  new_pool->columns = calloc(n_columns, sizeof(uint8_t *));
+  new_pool->column_bytes = calloc(n_columns, sizeof(size_t));
+  new_pool->dense_to_slot = calloc(capacity, sizeof(uint32_t));
+  new_pool->slot_to_dense = calloc(capacity, sizeof(uint32_t));
+  new_pool->generations = calloc(capacity, sizeof(uint32_t));
+  if (new_pool->field_sizes == NULL || new_pool->columns == NULL ||
+      new_pool->column_bytes == NULL || new_pool->dense_to_slot == NULL ||
+      new_pool->slot_to_dense == NULL || new_pool->generations == NULL) {
+    mem_soa_pool_deinit(new_pool);
+    return NULL;
+  }
+  for (size_t i = 0; i < n_columns; ++i) {
+    new_pool->field_sizes[i] = field_sizes[i];
+    if (field_sizes[i] != 0 && capacity > SIZE_MAX / field_sizes[i]) {
+      mem_soa_pool_deinit(new_pool);
+      return NULL;
+    }
+    new_pool->columns[i] =
+        mem_large_alloc(capacity * field_sizes[i], MEM_SOA_ALIGNMENT);
+    if (new_pool->columns[i] == NULL) {
+      mem_soa_pool_deinit(new_pool);
+      return NULL;
+    }
+    new_pool->column_bytes[i] = capacity * field_sizes[i];
+  }
+  // Every slot starts in the free list, in order
+  for (size_t i = 0; i < capacity; ++i) {
+    new_pool->slot_to_dense[i] = (uint32_t)(i + 1);
+    new_pool->generations[i] = 1;
+  }
+  new_pool->free_slot = 0;
+  return new_pool;
+}
+
+MemSoaHandle mem_soa_pool_alloc(MemSoaPool *pool) {
+  if (pool == NULL || pool->size == pool->capacity) {
+    return MEM_SOA_INVALID_HANDLE;
+  }
+  uint32_t slot = pool->free_slot;
+  pool->free_slot = pool->slot_to_dense[slot];
+
+  size_t index = pool->size++;
+  pool->slot_to_dense[slot] = (uint32_t)index;
+  pool->dense_to_slot[index] = slot;
+  for (size_t i = 0; i < pool->n_columns; ++i) {
+    memset(pool->columns[i] + index * pool->field_sizes[i], 0,
+           pool->field_sizes[i]);
+  }
+  return MEM_SOA_MAKE_HANDLE(slot, pool->generations[slot]);
+}
+
+static int mem_soa_pool_valid(MemSoaPool *pool, MemSoaHandle handle) {
+  uint32_t slot = MEM_SOA_SLOT(handle);
+  return pool != NULL && slot < pool->capacity &&
+         pool->generations[slot] == MEM_SOA_GENERATION(handle);
+}
+
+int mem_soa_pool_free(MemSoaPool *pool, MemSoaHandle handle) {
+  if (!mem_soa_pool_valid(pool, handle)) {
+    return 0;
+  }
+  uint32_t slot = MEM_SOA_SLOT(handle);
+  size_t index = pool->slot_to_dense[slot];
+  size_t last = --pool->size;
+
+  // Move the last object into the hole so the columns stay dense
+  if (index != last) {
+    for (size_t i = 0; i < pool->n_columns; ++i) {
+      size_t field = pool->field_sizes[i];
+      memcpy(pool->columns[i] + index * field, pool->columns[i] + last * field,
+             field);
+    }
+    uint32_t moved = pool->dense_to_slot[last];
+    pool->dense_to_slot[index] = moved;
+    pool->slot_to_dense[moved] = (uint32_t)index;
+  }
+
+  // Bump the generation so the old handle stops working, skipping 0
+  if (++pool->generations[slot] == 0) {
+    pool->generations[slot] = 1;
+  }
+  pool->slot_to_dense[slot] = pool->free_slot;
+  pool->free_slot = slot;
+  return 1;
+}
+
+int mem_soa_pool_grow(MemSoaPool *pool, size_t capacity) {
+  if (pool == NULL || capacity >= UINT32_MAX) {
+    return 0;
+  }
+  if (capacity <= pool->capacity) {
+    return 1;
+  }
+  for (size_t i = 0; i < pool->n_columns; ++i) {
+    if (pool->field_sizes[i] != 0 &&
+        capacity > SIZE_MAX / pool->field_sizes[i]) {
+      return 0;
+    }
+  }
+  // Every array is grown on its own, one failing leaves the ones already
+  // grown bigger than needed, which is harmless
+  uint32_t **index_arrays[] = {&pool->dense_to_slot, &pool->slot_to_dense,
+                               &pool->generations};
+  for (size_t i = 0; i < sizeof(index_arrays) / sizeof(*index_arrays); ++i) {
+    uint32_t *grown = realloc(*index_arrays[i], capacity * sizeof(uint32_t));
+    if (grown == NULL) {
+      return 0;
+    }
+    *index_arrays[i] = grown;
+  }
+  for (size_t i = 0; i < pool->n_columns; ++i) {
+    size_t bytes = capacity * pool->field_sizes[i];
+    if (bytes <= pool->column_bytes[i]) {
+      continue;
+    }
+    uint8_t *grown = mem_large_realloc(pool->columns[i], pool->column_bytes[i],
+                                       bytes, MEM_SOA_ALIGNMENT);
+    if (grown == NULL) {
+      return 0;
+    }
+    pool->columns[i] = grown;
+    pool->column_bytes[i] = bytes;
+  }
+  // The free list always ends with the old capacity, the first new slot
+  for (size_t i = pool->capacity; i < capacity; ++i) {
+    pool->slot_to_dense[i] = (uint32_t)(i + 1);
+    pool->generations[i] = 1;
+  }
+  pool->capacity = capacity;
+  return 1;
+}
+
+void *mem_soa_pool_get(MemSoaPool *pool, MemSoaHandle handle, size_t column) {
+  if (!mem_soa_pool_valid(pool, handle) || column >= pool->n_columns) {
+    return NULL;
+  }
+  size_t index = pool->slot_to_dense[MEM_SOA_SLOT(handle)];
+  return pool->columns[column] + index * pool->field_sizes[column];
+}
+
+void *mem_soa_pool_column(MemSoaPool *pool, size_t column) {
+  if (pool == NULL || column >= pool->n_columns) {
+    return NULL;
+  }
+  return pool->columns[column];
+}
+
+size_t mem_soa_pool_size(MemSoaPool *pool) {
+  return pool == NULL ? 0 : pool->size;
+}
+
+MemSoaHandle mem_soa_pool_handle(MemSoaPool *pool, size_t index) {
+  if (pool == NULL || index >= pool->size) {
+    return MEM_SOA_INVALID_HANDLE;
+  }
+  uint32_t slot = pool->dense_to_slot[index];
+  return MEM_SOA_MAKE_HANDLE(slot, pool->generations[slot]);
+}
+
+void mem_soa_pool_deinit(MemSoaPool *pool) {
+  if (pool != NULL) {
+    if (pool->columns != NULL) {
+      for (size_t i = 0; i < pool->n_columns; ++i) {
+        mem_large_free(pool->columns[i],
+                       pool->column_bytes != NULL ? pool->column_bytes[i] : 0);
+      }
+    }
+    free(pool->columns);
+    free(pool->column_bytes);
+    free(pool->field_sizes);
+    free(pool->dense_to_slot);
+    free(pool->slot_to_dense);
+    free(pool->generations);
+    free(pool);
+  }
+}
+
+#undef MEM_SOA_SLOT
+#undef MEM_SOA_GENERATION
+#undef MEM_SOA_MAKE_HANDLE
+
+#endif // SOA_POOL_IMPL
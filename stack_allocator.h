@@ -55,6 +55,14 @@ void *mem_stack_alloc(MemStack *stack, size_t bytes);
  */
 int mem_stack_pop(MemStack *stack, size_t bytes);
 
+/**
+ * Checks whether a pointer belongs to the stack memory
+ * @param stack pointer to the stack we are interested in
+ * @param ptr pointer to check
+ * @return 1 if ptr points inside the stack memory, 0 otherwise.
+ */
+int mem_stack_owns(const MemStack *stack, const void *ptr);
+
 /**
  * Frees all the memory related to the memory stack passed as parameter
  * @param stack memory stack you want to free
@@ -63,7 +71,8 @@ void mem_stack_deinit(MemStack *stack);
 
 #endif // STACK_ALLOC_H
 
-#ifdef MEM_STACK_IMPL
+#if defined(MEM_STACK_IMPL) && !defined(MEM_STACK_IMPL_DONE)
+#define MEM_STACK_IMPL_DONE
 
 MemStack *mem_stack_init(size_t bytes) {
   MemStack *new_stack = malloc(sizeof(MemStack));
@@ -82,9 +91,9 @@ MemStack *mem_stack_init(size_t bytes) {
 
 void *mem_stack_alloc(MemStack *stack, size_t bytes) {
   if (stack == NULL) {
-    return;
+    return NULL;
   }
-  if (stack->size + bytes > stack->capacity) {
+  if (bytes > stack->capacity - stack->size) {
     return NULL;
   }
   void *ptr = stack->data + stack->size;
@@ -92,9 +101,9 @@ void *mem_stack_alloc(MemStack *stack, size_t bytes) {
   return ptr;
 }
 
-void mem_stack_pop(MemStack *stack, size_t bytes) {
+int mem_stack_pop(MemStack *stack, size_t bytes) {
   if (stack == NULL) {
-    return;
+    return 0;
   }
   if (bytes > stack->size) {
     // Trying to free too many bytes
@@ -104,7 +113,12 @@ void mem_stack_pop(MemStack *stack, size_t bytes) {
   return 1;
 }
 
-void mem_stack_free(MemStack *stack) {
+int mem_stack_owns(const MemStack *stack, const void *ptr) {
+  return stack != NULL && (const uint8_t *)ptr >= stack->data &&
+         (const uint8_t *)ptr < stack->data + stack->capacity;
+}
+
+void mem_stack_deinit(MemStack *stack) {
   if (stack != NULL) {
     free(stack->data);
     free(stack);
@@ -0,0 +1,645 @@
+#ifndef TASK_SCHED_H
+#define TASK_SCHED_H
+
+/**
+ * STB-style implementation of a work-stealing task scheduler whose task
+ * descriptors never go through malloc. Every worker thread owns:
+ *  - a Chase-Lev deque: the owner pushes and takes tasks at the bottom, idle
+ *    workers steal them from the top;
+ *  - a MemPool of task descriptors: a task is allocated from the pool of the
+ *    worker spawning it, when another worker runs it (after stealing it) the
+ *    descriptor goes back through a lock-free remote free list that the owner
+ *    drains into its pool;
+ *  - a MemStack for scratch memory, released when the task using it returns.
+ *
+ * 'mem_sched_init' -> Starts n_workers worker threads, each one able to have
+ * tasks_per_worker spawned tasks in flight and scratch_bytes of scratch.
+ *
+ * 'mem_sched_run' -> Runs a function on the workers and waits for it, this is
+ * how a thread outside of the scheduler gets work done.
+ *
+ * 'mem_sched_spawn' -> Spawns a task in a group (fork). The argument is
+ * copied into the task descriptor, so it can live on the caller stack. When
+ * called outside of a worker, when the worker pool is exhausted or when the
+ * argument doesn't fit in a descriptor the task simply runs inline.
+ *
+ * 'mem_sched_wait' -> Waits for all the tasks of a group (join). The waiting
+ * worker runs other tasks in the meantime instead of blocking.
+ *
+ * 'mem_sched_parallel_for' -> Splits [begin, end) in ranges of at most grain
+ * iterations and runs body on them in parallel.
+ *
+ * 'mem_sched_scratch' -> Scratch memory for the running task, it's released
+ * automatically when the task returns.
+ *
+ * 'mem_sched_deinit' -> Stops the workers and frees everything, no call to
+ * 'mem_sched_run' can be in progress.
+ *
+ * Example (fork-join fibonacci):
+ *
+ *   void fib(MemScheduler *sched, void *arg) {
+ *     FibArgs *a = arg;
+ *     if (a->n < 2) { *a->out = a->n; return; }
+ *     uint64_t x, y;
+ *     MemTaskGroup group = {0};
+ *     mem_sched_spawn(sched, &group, fib, &(FibArgs){a->n - 1, &x},
+ *                     sizeof(FibArgs));
+ *     fib(sched, &(FibArgs){a->n - 2, &y});
+ *     mem_sched_wait(sched, &group);
+ *     *a->out = x + y;
+ *   }
+ *
+ * @note Task descriptors and scratch are MemPools and MemStacks, so POOL_IMPL
+ * and MEM_STACK_IMPL have to be defined once as well.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool_allocator.h"
+#include "stack_allocator.h"
+
+// Bytes of argument a task descriptor can hold
+#ifndef MEM_TASK_ARG_BYTES
+#define MEM_TASK_ARG_BYTES 48
+#endif
+
+typedef struct MemScheduler MemScheduler;
+
+/**
+ * Function run by a task
+ * @param sched scheduler running the task
+ * @param arg copy of the argument passed to 'mem_sched_spawn'
+ */
+typedef void (*MemTaskFn)(MemScheduler *sched, void *arg);
+
+/**
+ * Body of 'mem_sched_parallel_for'
+ * @param begin first iteration of the range
+ * @param end one past the last iteration of the range
+ * @param ctx user context passed to 'mem_sched_parallel_for'
+ */
+typedef void (*MemForFn)(size_t begin, size_t end, void *ctx);
+
+/**
+ * Tasks spawned together and waited for together, zero initialize it
+ * @param pending number of tasks of the group that haven't finished yet
+ */
+typedef struct {
+  _Atomic size_t pending;
+} MemTaskGroup;
+
+/**
+ * Starts a new scheduler and returns the pointer to it
+ * @param n_workers number of worker threads
+ * @param tasks_per_worker task descriptors in the pool of every worker
+ * @param scratch_bytes scratch memory of every worker
+ * @return pointer to the scheduler, or NULL on failure
+ */
+MemScheduler *mem_sched_init(size_t n_workers, size_t tasks_per_worker,
+                             size_t scratch_bytes);
+
+/**
+ * Runs fn(sched, arg) on one of the workers and waits until it returns
+ * @param sched scheduler we want to use
+ * @param fn function to run
+ * @param arg argument of fn
+ */
+void mem_sched_run(MemScheduler *sched, MemTaskFn fn, void *arg);
+
+/**
+ * Spawns a new task in a group
+ * @param sched scheduler we are running on
+ * @param group group the task belongs to
+ * @param fn function run by the task
+ * @param arg argument of fn, copied into the task
+ * @param arg_size size of the argument, bigger than MEM_TASK_ARG_BYTES the
+ * task runs inline
+ * @return 1 if the task was spawned, 0 if it has already run inline, -1 if
+ * sched, group or fn is NULL (nothing is run).
+ */
+int mem_sched_spawn(MemScheduler *sched, MemTaskGroup *group, MemTaskFn fn,
+                    const void *arg, size_t arg_size);
+
+/**
+ * Waits for all the tasks of a group, running other tasks meanwhile
+ * @param sched scheduler we are running on
+ * @param group group we are waiting for
+ */
+void mem_sched_wait(MemScheduler *sched, MemTaskGroup *group);
+
+/**
+ * Runs body over [begin, end) in parallel, in ranges of at most grain
+ * iterations
+ * @param sched scheduler we want to use
+ * @param begin first iteration
+ * @param end one past the last iteration
+ * @param grain maximum number of iterations of a single range
+ * @param body function run on every range
+ * @param ctx user context passed to body
+ */
+void mem_sched_parallel_for(MemScheduler *sched, size_t begin, size_t end,
+                            size_t grain, MemForFn body, void *ctx);
+
+/**
+ * Reserves scratch memory for the running task, released when it returns
+ * @param sched scheduler we are running on
+ * @param bytes number of bytes requested
+ * @return pointer to the scratch memory (16 bytes aligned), or NULL if we
+ * aren't on a worker or its scratch is exhausted
+ */
+void *mem_sched_scratch(MemScheduler *sched, size_t bytes);
+
+/**
+ * Stops the workers and frees the scheduler
+ * @param sched scheduler we are freeing
+ */
+void mem_sched_deinit(MemScheduler *sched);
+
+#endif // TASK_SCHED_H
+
+#if defined(TASK_SCHED_IMPL) && !defined(TASK_SCHED_IMPL_DONE)
+#define TASK_SCHED_IMPL_DONE
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+/**
+ * @param fn function run by the task
+ * @param group group of the task
+ * @param owner index of the worker whose pool the task comes from
+ * @param next link of the remote free list
+ * @param arg copy of the argument
+ */
+typedef struct MemTask {
+  MemTaskFn fn;
+  MemTaskGroup *group;
+  size_t owner;
+  struct MemTask *next;
+  _Alignas(16) uint8_t arg[MEM_TASK_ARG_BYTES];
+} MemTask;
+
+/**
+ * Chase-Lev deque with a fixed number of slots, it never overflows because
+ * a worker can't have more tasks in flight than the chunks of its pool
+ * @param top index stolen from
+ * @param bottom index pushed to and taken from by the owner
+ * @param slots circular buffer of tasks
+ * @param mask number of slots minus one
+ */
+typedef struct {
+  _Atomic int64_t top;
+  _Atomic int64_t bottom;
+  MemTask *_Atomic *slots;
+  int64_t mask;
+} MemTaskDeque;
+
+/**
+ * Task submitted by 'mem_sched_run' from outside of the workers
+ * @param fn function to run
+ * @param arg argument of fn
+ * @param done 1 once fn has returned
+ * @param next next submitted task
+ */
+typedef struct MemSchedRoot {
+  MemTaskFn fn;
+  void *arg;
+  int done;
+  struct MemSchedRoot *next;
+} MemSchedRoot;
+
+/**
+ * @param sched scheduler the worker belongs to
+ * @param index position of the worker in the scheduler
+ * @param deque tasks spawned by the worker
+ * @param tasks pool of task descriptors, only touched by the worker
+ * @param remote_free descriptors of this worker freed by other workers
+ * @param scratch scratch memory of the tasks run by the worker
+ * @param seed state of the victim selection
+ * @param thread the worker thread
+ */
+typedef struct {
+  MemScheduler *sched;
+  size_t index;
+  MemTaskDeque deque;
+  MemPool *tasks;
+  MemTask *_Atomic remote_free;
+  MemStack *scratch;
+  uint64_t seed;
+  pthread_t thread;
+} MemSchedWorker;
+
+/**
+ * @param workers the worker array
+ * @param n_workers number of workers
+ * @param lock protects roots and sleeping workers
+ * @param wakeup signaled when there is work for sleeping workers
+ * @param root_done signaled when a root task is done
+ * @param roots tasks submitted by 'mem_sched_run'
+ * @param pushes number of tasks made available so far
+ * @param sleepers number of workers sleeping on wakeup
+ * @param running 0 once the workers must exit
+ */
+struct MemScheduler {
+  MemSchedWorker *workers;
+  size_t n_workers;
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  pthread_cond_t root_done;
+  MemSchedRoot *roots;
+  _Atomic uint64_t pushes;
+  _Atomic size_t sleepers;
+  _Atomic int running;
+};
+
+// Steal rounds without finding work before a worker goes to sleep
+#define MEM_SCHED_IDLE_ROUNDS 64
+
+static _Thread_local MemSchedWorker *mem_sched_self;
+
+static MemSchedWorker *mem_sched_worker(MemScheduler *sched) {
+  MemSchedWorker *self = mem_sched_self;
+  return self != NULL && self->sched == sched ? self : NULL;
+}
+
+static void mem_sched_deque_push(MemTaskDeque *deque, MemTask *task) {
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  atomic_store_explicit(&deque->slots[b & deque->mask], task,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+}
+
+static MemTask *mem_sched_deque_take(MemTaskDeque *deque) {
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+  if (t > b) {
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return NULL;
+  }
+  MemTask *_Atomic *slot = &deque->slots[b & deque->mask];
+  MemTask *task = atomic_load_explicit(slot, memory_order_relaxed);
+  if (t == b) {
+    // Last task, race against the thieves for it
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+      task = NULL;
+    }
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+  }
+  return task;
+}
+
+static MemTask *mem_sched_deque_steal(MemTaskDeque *deque) {
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  if (t >= b) {
+    return NULL;
+  }
+  MemTask *_Atomic *slot = &deque->slots[t & deque->mask];
+  MemTask *task = atomic_load_explicit(slot, memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return NULL; // Lost the race, the caller tries somewhere else
+  }
+  return task;
+}
+
+static MemTask *mem_sched_task_alloc(MemSchedWorker *self) {
+  MemTask *task = mem_pool_alloc(self->tasks);
+  if (task == NULL) {
+    // Take back the descriptors other workers have freed
+    MemTask *list = atomic_exchange_explicit(&self->remote_free, NULL,
+                                             memory_order_acquire);
+    while (list != NULL) {
+      MemTask *next = list->next;
+      mem_pool_free(self->tasks, list);
+      list = next;
+    }
+    task = mem_pool_alloc(self->tasks);
+  }
+  return task;
+}
+
+static void mem_sched_task_free(MemSchedWorker *self, MemTask *task) {
+  if (task->owner == self->index) {
+    mem_pool_free(self->tasks, task);
+    return;
+  }
+  MemSchedWorker *owner = &self->sched->workers[task->owner];
+  MemTask *head =
+      atomic_load_explicit(&owner->remote_free, memory_order_relaxed);
+  do {
+    task->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &owner->remote_free, &head, task, memory_order_release,
+      memory_order_relaxed));
+}
+
+static void mem_sched_execute(MemSchedWorker *self, MemTask *task) {
+  size_t mark = self->scratch->size;
+  task->fn(self->sched, task->arg);
+  mem_stack_pop(self->scratch, self->scratch->size - mark);
+  MemTaskGroup *group = task->group;
+  mem_sched_task_free(self, task);
+  // Last touch of the group, the waiter may return right after this
+  atomic_fetch_sub_explicit(&group->pending, 1, memory_order_release);
+}
+
+static MemTask *mem_sched_steal(MemSchedWorker *self) {
+  MemScheduler *sched = self->sched;
+  // xorshift64, a random first victim spreads the thieves
+  self->seed ^= self->seed << 13;
+  self->seed ^= self->seed >> 7;
+  self->seed ^= self->seed << 17;
+  size_t start = (size_t)(self->seed % sched->n_workers);
+  for (size_t i = 0; i < sched->n_workers; ++i) {
+    size_t victim = (start + i) % sched->n_workers;
+    if (victim != self->index) {
+      MemTask *task = mem_sched_deque_steal(&sched->workers[victim].deque);
+      if (task != NULL) {
+        return task;
+      }
+    }
+  }
+  return NULL;
+}
+
+static void mem_sched_run_root(MemSchedWorker *self, MemSchedRoot *root) {
+  MemScheduler *sched = self->sched;
+  size_t mark = self->scratch->size;
+  root->fn(sched, root->arg);
+  mem_stack_pop(self->scratch, self->scratch->size - mark);
+  pthread_mutex_lock(&sched->lock);
+  root->done = 1;
+  pthread_cond_broadcast(&sched->root_done);
+  pthread_mutex_unlock(&sched->lock);
+}
+
+static void *mem_sched_worker_thread(void *arg) {
+  MemSchedWorker *self = arg;
+  MemScheduler *sched = self->sched;
+  mem_sched_self = self;
+  unsigned idle = 0;
+  while (atomic_load_explicit(&sched->running, memory_order_acquire)) {
+    uint64_t pushes = atomic_load(&sched->pushes);
+    MemTask *task = mem_sched_deque_take(&self->deque);
+    if (task == NULL) {
+      task = mem_sched_steal(self);
+    }
+    if (task != NULL) {
+      mem_sched_execute(self, task);
+      idle = 0;
+      continue;
+    }
+    if (++idle < MEM_SCHED_IDLE_ROUNDS) {
+      sched_yield();
+      continue;
+    }
+    pthread_mutex_lock(&sched->lock);
+    MemSchedRoot *root = sched->roots;
+    if (root != NULL) {
+      sched->roots = root->next;
+      pthread_mutex_unlock(&sched->lock);
+      mem_sched_run_root(self, root);
+      idle = 0;
+      continue;
+    }
+    // Spawners bump pushes before looking at sleepers, we do the opposite,
+    // so either we see their task or they see us sleeping
+    atomic_fetch_add(&sched->sleepers, 1);
+    if (atomic_load(&sched->pushes) == pushes &&
+        atomic_load_explicit(&sched->running, memory_order_relaxed)) {
+      pthread_cond_wait(&sched->wakeup, &sched->lock);
+    }
+    atomic_fetch_sub(&sched->sleepers, 1);
+    pthread_mutex_unlock(&sched->lock);
+    // Woken up for a root task or a spawn, look for both right away
+    idle = MEM_SCHED_IDLE_ROUNDS - 1;
+  }
+  return NULL;
+}
+
+static void mem_sched_notify(MemScheduler *sched) {
+  atomic_fetch_add(&sched->pushes, 1);
+  if (atomic_load(&sched->sleepers) > 0) {
+    pthread_mutex_lock(&sched->lock);
+    pthread_cond_signal(&sched->wakeup);
+    pthread_mutex_unlock(&sched->lock);
+  }
+}
+
+static void mem_sched_worker_release(MemSchedWorker *worker) {
+  free(worker->deque.slots);
+  mem_pool_deinit(worker->tasks);
+  mem_stack_deinit(worker->scratch);
+}
+
+// Stops the first started workers, then frees everything
+static void mem_sched_destroy(MemScheduler *sched, size_t started) {
+  pthread_mutex_lock(&sched->lock);
+  atomic_store_explicit(&sched->running, 0, memory_order_release);
+  pthread_cond_broadcast(&sched->wakeup);
+  pthread_mutex_unlock(&sched->lock);
+  for (size_t i = 0; i < started; ++i) {
+    pthread_join(sched->workers[i].thread, NULL);
+  }
+  for (size_t i = 0; i < sched->n_workers; ++i) {
+    mem_sched_worker_release(&sched->workers[i]);
+  }
+  pthread_mutex_destroy(&sched->lock);
+  pthread_cond_destroy(&sched->wakeup);
+  pthread_cond_destroy(&sched->root_done);
+  free(sched->workers);
+  free(sched);
+}
+
+MemScheduler *mem_sched_init(size_t n_workers, size_t tasks_per_worker,
+                             size_t scratch_bytes) {
+  if (n_workers == 0 || tasks_per_worker == 0) {
+    return NULL;
+  }
+  MemScheduler *sched = calloc(1, sizeof(MemScheduler));
+  if (sched == NULL) {
+    return NULL;
+  }
+  sched->workers = calloc(n_workers, sizeof(MemSchedWorker));
+  if (sched->workers == NULL) {
+    free(sched);
+    return NULL;
+  }
+  sched->n_workers = n_workers;
+  pthread_mutex_init(&sched->lock, NULL);
+  pthread_cond_init(&sched->wakeup, NULL);
+  pthread_cond_init(&sched->root_done, NULL);
+  atomic_init(&sched->running, 1);
+
+  size_t slots = 1;
+  while (slots < tasks_per_worker) {
+    slots <<= 1;
+  }
+  for (size_t i = 0; i < n_workers; ++i) {
+    MemSchedWorker *worker = &sched->workers[i];
+    worker->sched = sched;
+    worker->index = i;
+    worker->seed = 0x9e3779b97f4a7c15ull * (i + 1);
+    worker->deque.mask = (int64_t)slots - 1;
+    worker->deque.slots = calloc(slots, sizeof(MemTask *));
+    // LIFO: O(1) and the descriptor we get back is still in cache
+    worker->tasks = mem_pool_init_ex(sizeof(MemTask), tasks_per_worker,
+                                     MEM_POOL_REUSE_LIFO);
+    worker->scratch = mem_stack_init(scratch_bytes);
+    if (worker->deque.slots == NULL || worker->tasks == NULL ||
+        worker->scratch == NULL) {
+      mem_sched_destroy(sched, 0);
+      return NULL;
+    }
+  }
+  // Workers steal from each other, start them once they all exist
+  for (size_t i = 0; i < n_workers; ++i) {
+    if (pthread_create(&sched->workers[i].thread, NULL,
+                       mem_sched_worker_thread, &sched->workers[i])) {
+      mem_sched_destroy(sched, i);
+      return NULL;
+    }
+  }
+  return sched;
+}
+
+void mem_sched_run(MemScheduler *sched, MemTaskFn fn, void *arg) {
+  if (sched == NULL || fn == NULL) {
+    return;
+  }
+  if (mem_sched_worker(sched) != NULL) {
+    // Already on a worker, nothing to hand over
+    fn(sched, arg);
+    return;
+  }
+  MemSchedRoot root = {.fn = fn, .arg = arg};
+  pthread_mutex_lock(&sched->lock);
+  root.next = sched->roots;
+  sched->roots = &root;
+  atomic_fetch_add(&sched->pushes, 1);
+  pthread_cond_signal(&sched->wakeup);
+  while (!root.done) {
+    pthread_cond_wait(&sched->root_done, &sched->lock);
+  }
+  pthread_mutex_unlock(&sched->lock);
+}
+
+int mem_sched_spawn(MemScheduler *sched, MemTaskGroup *group, MemTaskFn fn,
+                    const void *arg, size_t arg_size) {
+  if (sched == NULL || group == NULL || fn == NULL) {
+    return -1;
+  }
+  MemSchedWorker *self = mem_sched_worker(sched);
+  MemTask *task = self != NULL && arg_size <= MEM_TASK_ARG_BYTES
+                      ? mem_sched_task_alloc(self)
+                      : NULL;
+  if (task == NULL) {
+    // Not on a worker, out of descriptors or an argument too big to be
+    // copied, run it right away (the argument is still on the caller stack)
+    size_t mark = self != NULL ? self->scratch->size : 0;
+    fn(sched, (void *)arg);
+    if (self != NULL) {
+      mem_stack_pop(self->scratch, self->scratch->size - mark);
+    }
+    return 0;
+  }
+  task->fn = fn;
+  task->group = group;
+  task->owner = self->index;
+  if (arg_size > 0) {
+    memcpy(task->arg, arg, arg_size);
+  }
+  atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+  mem_sched_deque_push(&self->deque, task);
+  mem_sched_notify(sched);
+  return 1;
+}
+
+void mem_sched_wait(MemScheduler *sched, MemTaskGroup *group) {
+  if (sched == NULL || group == NULL) {
+    return;
+  }
+  MemSchedWorker *self = mem_sched_worker(sched);
+  while (atomic_load_explicit(&group->pending, memory_order_acquire) > 0) {
+    // Tasks of the group are either in our deque or being run by thieves
+    MemTask *task = self != NULL ? mem_sched_deque_take(&self->deque) : NULL;
+    if (task == NULL && self != NULL) {
+      task = mem_sched_steal(self);
+    }
+    if (task != NULL) {
+      mem_sched_execute(self, task);
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+/**
+ * Argument of the parallel for tasks
+ * @param begin first iteration of the range
+ * @param end one past the last iteration of the range
+ * @param grain maximum number of iterations run without splitting
+ * @param body user function
+ * @param ctx user context
+ */
+typedef struct {
+  size_t begin;
+  size_t end;
+  size_t grain;
+  MemForFn body;
+  void *ctx;
+} MemSchedFor;
+
+static void mem_sched_for_task(MemScheduler *sched, void *arg) {
+  MemSchedFor range = *(MemSchedFor *)arg;
+  MemTaskGroup group = {0};
+  // Hand the upper halves out until the range is small enough
+  while (range.end - range.begin > range.grain) {
+    size_t mid = range.begin + (range.end - range.begin) / 2;
+    MemSchedFor upper = range;
+    upper.begin = mid;
+    mem_sched_spawn(sched, &group, mem_sched_for_task, &upper,
+                    sizeof(MemSchedFor));
+    range.end = mid;
+  }
+  range.body(range.begin, range.end, range.ctx);
+  mem_sched_wait(sched, &group);
+}
+
+void mem_sched_parallel_for(MemScheduler *sched, size_t begin, size_t end,
+                            size_t grain, MemForFn body, void *ctx) {
+  if (sched == NULL || body == NULL || begin >= end) {
+    return;
+  }
+  MemSchedFor range = {begin, end, grain > 0 ? grain : 1, body, ctx};
+  mem_sched_run(sched, mem_sched_for_task, &range);
+}
+
+void *mem_sched_scratch(MemScheduler *sched, size_t bytes) {
+  MemSchedWorker *self = mem_sched_worker(sched);
+  if (self == NULL || bytes > SIZE_MAX - 15) {
+    return NULL;
+  }
+  // Keep every scratch allocation 16 bytes aligned
+  return mem_stack_alloc(self->scratch, (bytes + 15) & ~(size_t)15);
+}
+
+void mem_sched_deinit(MemScheduler *sched) {
+  if (sched != NULL) {
+    mem_sched_destroy(sched, sched->n_workers);
+  }
+}
+
+#undef MEM_SCHED_IDLE_ROUNDS
+
+#endif // TASK_SCHED_IMPL
@@ -0,0 +1,21 @@
+#ifndef TEST_H
+#define TEST_H
+
+/**
+ * Minimal checking helpers shared by the tests, a failed check prints where
+ * it failed and stops the program.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+              #cond);                                                          \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
+
+#endif // TEST_H
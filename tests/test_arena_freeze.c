@@ -0,0 +1,104 @@
+#define ARENA_IMPL
+#include "arena_allocator.h"
+
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test.h"
+
+#define BLOCK (64 * 1024)
+
+// Runs fn in a child process, gives its exit status or the signal it died of
+static int in_child(void (*fn)(uint8_t *), uint8_t *data, int *sig) {
+  pid_t pid = fork();
+  CHECK(pid >= 0);
+  if (pid == 0) {
+    fn(data);
+    _exit(0);
+  }
+  int status = 0;
+  CHECK(waitpid(pid, &status, 0) == pid);
+  *sig = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void child_read(uint8_t *data) { _exit(data[0] == 42 ? 0 : 1); }
+
+// The sanitizers catch the fault otherwise, and exit instead
+static void child_write(uint8_t *data) {
+  signal(SIGSEGV, SIG_DFL);
+  data[0] = 1;
+}
+
+static void test_freeze(void) {
+  MemArena *arena = mem_arena_init_growable(BLOCK, 50);
+  CHECK(arena != NULL);
+  uint8_t *chunks[100];
+  for (int i = 0; i < 100; ++i) {
+    chunks[i] = mem_arena_alloc(arena, 5000);
+    memset(chunks[i], 42, 5000);
+  }
+  // Blocks spliced from another growable arena are frozen too
+  MemArena *child = mem_arena_init_growable(4096, 0);
+  uint8_t *spliced = mem_arena_alloc(child, 100);
+  memset(spliced, 42, 100);
+  CHECK(mem_arena_splice(arena, child));
+
+  CHECK(mem_arena_freeze(arena));
+  CHECK(mem_arena_freeze(arena)); // Already frozen
+  CHECK(atomic_load(&arena->spare) == NULL);
+  CHECK(mem_arena_alloc(arena, 1) == NULL);
+  for (int i = 0; i < 100; ++i) {
+    CHECK(chunks[i][0] == 42 && chunks[i][4999] == 42);
+  }
+  int sig = 0;
+  CHECK(in_child(child_read, chunks[0], &sig) == 0 && sig == 0);
+  CHECK(in_child(child_read, spliced, &sig) == 0 && sig == 0);
+  // Writes fault, in the current block and in the retired ones
+  in_child(child_write, chunks[99], &sig);
+  CHECK(sig == SIGSEGV);
+  in_child(child_write, chunks[0], &sig);
+  CHECK(sig == SIGSEGV);
+  in_child(child_write, spliced, &sig);
+  CHECK(sig == SIGSEGV);
+
+  // A frozen arena can't be spliced, in either direction
+  MemArena *other = mem_arena_init_growable(4096, 0);
+  CHECK(!mem_arena_splice(arena, other) && !mem_arena_splice(other, arena));
+  mem_arena_deinit(other);
+
+  // Resetting gives write access back
+  mem_arena_reset(arena);
+  uint8_t *chunk = mem_arena_alloc(arena, 100);
+  CHECK(chunk != NULL);
+  memset(chunk, 7, 100);
+  CHECK(in_child(child_write, chunk, &sig) == 0 && sig == 0);
+  // Frozen arenas are deinit'ed as usual
+  CHECK(mem_arena_freeze(arena));
+  mem_arena_deinit(arena);
+}
+
+static void test_refused(void) {
+  // Fixed size arenas share their pages with the heap
+  MemArena *fixed = mem_arena_init(1000);
+  CHECK(!mem_arena_freeze(fixed));
+  CHECK(mem_arena_alloc(fixed, 10) != NULL);
+
+  MemArena *arena = mem_arena_init_growable(4096, 0);
+  uint8_t *data = mem_arena_alloc(arena, 100);
+  CHECK(mem_arena_splice(arena, fixed));
+  CHECK(!mem_arena_freeze(arena));
+  // Left untouched, still writable
+  memset(data, 1, 100);
+  CHECK(mem_arena_alloc(arena, 10) != NULL);
+  mem_arena_deinit(arena);
+  CHECK(!mem_arena_freeze(NULL));
+}
+
+int main(void) {
+  test_freeze();
+  test_refused();
+  return 0;
+}
@@ -0,0 +1,95 @@
+#define ARENA_IMPL
+#include "arena_allocator.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "test.h"
+
+#define BLOCK (64 * 1024)
+
+// Waits up to a second for the helper thread to prepare the next block
+static int wait_spare(MemArena *arena) {
+  for (int i = 0; i < 1000; ++i) {
+    if (atomic_load(&arena->spare) != NULL) {
+      return 1;
+    }
+    usleep(1000);
+  }
+  return 0;
+}
+
+static void test_growth(void) {
+  MemArena *arena = mem_arena_init_growable(BLOCK, 0);
+  CHECK(arena != NULL);
+  CHECK(mem_arena_alloc(arena, 0) != NULL);
+  uint8_t *chunks[100];
+  for (int i = 0; i < 100; ++i) {
+    chunks[i] = mem_arena_alloc(arena, 5000);
+    CHECK(chunks[i] != NULL);
+    memset(chunks[i], i, 5000);
+  }
+  // Bigger than a block, gets a block of its own
+  uint8_t *big = mem_arena_alloc(arena, 3 * BLOCK);
+  CHECK(big != NULL);
+  memset(big, 0xFF, 3 * BLOCK);
+  for (int i = 0; i < 100; ++i) {
+    CHECK(chunks[i][0] == i && chunks[i][4999] == i);
+    CHECK(mem_arena_owns(arena, chunks[i] + 4999));
+  }
+  CHECK(arena->blocks != NULL);
+  CHECK(atomic_load(&arena->spare) == NULL); // Prefaulting is disabled
+
+  // Reset keeps only the current block
+  mem_arena_reset(arena);
+  CHECK(arena->blocks == NULL && arena->size == 0);
+  CHECK(!mem_arena_owns(arena, chunks[0]));
+  CHECK(mem_arena_alloc(arena, 100) != NULL);
+  mem_arena_deinit(arena);
+
+  CHECK(mem_arena_init_growable(0, 0) == NULL);
+  CHECK(mem_arena_init_growable(BLOCK, 101) == NULL);
+}
+
+static void test_prefault(void) {
+  MemArena *arena = mem_arena_init_growable(BLOCK, 50);
+  CHECK(arena != NULL);
+  CHECK(mem_arena_alloc(arena, BLOCK / 2 - 1) != NULL);
+  usleep(10000);
+  CHECK(atomic_load(&arena->spare) == NULL); // Below the mark
+  CHECK(mem_arena_alloc(arena, 1) != NULL);
+  CHECK(wait_spare(arena));
+
+  // The rollover takes the prepared block
+  uint8_t *spare = atomic_load(&arena->spare)->data;
+  uint8_t *next = mem_arena_alloc(arena, BLOCK);
+  CHECK(next == spare);
+  // Filling it asked for the block after it
+  CHECK(wait_spare(arena));
+  CHECK(atomic_load(&arena->spare)->data != next);
+  mem_arena_deinit(arena);
+
+  // Arenas torn down with requests in flight don't leave them behind
+  for (int i = 0; i < 100; ++i) {
+    arena = mem_arena_init_growable(BLOCK, 1);
+    CHECK(mem_arena_alloc(arena, BLOCK / 50) != NULL);
+    mem_arena_deinit(arena);
+  }
+}
+
+static void test_fixed(void) {
+  MemArena *arena = mem_arena_init(1000);
+  CHECK(arena != NULL);
+  CHECK(mem_arena_alloc(arena, 1000) != NULL);
+  CHECK(mem_arena_alloc(arena, 1) == NULL);
+  mem_arena_reset(arena);
+  CHECK(mem_arena_alloc(arena, 1) != NULL);
+  mem_arena_deinit(arena);
+}
+
+int main(void) {
+  test_growth();
+  test_prefault();
+  test_fixed();
+  return 0;
+}
@@ -0,0 +1,92 @@
+#define MEM_USE_PAGE_HEAP
+#define PAGE_HEAP_IMPL
+#define PAGEMAP_IMPL
+#define POOL_IMPL
+#define ARENA_IMPL
+#include "arena_allocator.h"
+#include "pagemap.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "test.h"
+
+#define WORKERS 4
+#define RESULTS 1000
+
+typedef struct {
+  MemArena *arena;
+  uint32_t *results[RESULTS];
+  int id;
+} Worker;
+
+static void *build(void *arg) {
+  Worker *worker = arg;
+  for (int i = 0; i < RESULTS; ++i) {
+    worker->results[i] = mem_arena_alloc(worker->arena, 100 * sizeof(uint32_t));
+    CHECK(worker->results[i] != NULL);
+    for (int j = 0; j < 100; ++j) {
+      worker->results[i][j] = (uint32_t)(worker->id * RESULTS + i);
+    }
+  }
+  return NULL;
+}
+
+static void test_parallel_build(void) {
+  MemArena *parent = mem_arena_init_growable(16 * 1024, 0);
+  CHECK(parent != NULL);
+  uint8_t *own = mem_arena_alloc(parent, 64);
+  Worker workers[WORKERS];
+  pthread_t threads[WORKERS];
+  for (int w = 0; w < WORKERS; ++w) {
+    workers[w].id = w;
+    // Mixes fixed and growable children, some of them prefaulting
+    workers[w].arena = w == 0 ? mem_arena_init(RESULTS * 400)
+                              : mem_arena_init_growable(32 * 1024, 25 * w);
+    CHECK(workers[w].arena != NULL);
+    pthread_create(&threads[w], NULL, build, &workers[w]);
+  }
+  for (int w = 0; w < WORKERS; ++w) {
+    pthread_join(threads[w], NULL);
+    CHECK(mem_arena_splice(parent, workers[w].arena));
+  }
+  // Nothing moved, every result now belongs to the parent
+  for (int w = 0; w < WORKERS; ++w) {
+    for (int i = 0; i < RESULTS; ++i) {
+      uint32_t *result = workers[w].results[i];
+      CHECK(result[0] == (uint32_t)(w * RESULTS + i));
+      CHECK(result[99] == result[0]);
+      CHECK(mem_arena_owns(parent, result));
+      int kind;
+      CHECK(mem_owner_get(result, &kind) == parent && kind == MEM_OWNER_ARENA);
+    }
+  }
+  CHECK(mem_arena_owns(parent, own));
+  // The parent keeps allocating in its own current block
+  CHECK(mem_arena_alloc(parent, 64) == own + 64);
+
+  // Reset drops the adopted blocks along with the parent's own
+  mem_arena_reset(parent);
+  CHECK(parent->blocks == NULL);
+  CHECK(!mem_arena_owns(parent, workers[1].results[0]));
+  mem_arena_deinit(parent);
+}
+
+static void test_rejected(void) {
+  MemArena *arena = mem_arena_init_growable(4096, 0);
+  CHECK(!mem_arena_splice(arena, arena));
+  CHECK(!mem_arena_splice(arena, NULL));
+  CHECK(!mem_arena_splice(NULL, arena));
+  MemArena *child = mem_arena_init_growable(4096, 0);
+  CHECK(mem_arena_alloc(child, 10) != NULL);
+  CHECK(mem_arena_freeze(child));
+  CHECK(!mem_arena_splice(arena, child)); // Frozen arenas stay whole
+  mem_arena_deinit(child);
+  mem_arena_deinit(arena);
+}
+
+int main(void) {
+  test_parallel_build();
+  test_rejected();
+  return 0;
+}
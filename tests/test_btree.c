@@ -0,0 +1,137 @@
+#define POOL_IMPL
+#define ARENA_IMPL
+#define BTREE_IMPL
+#include "btree.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+#define KEYS 300000
+
+static uint64_t keys[KEYS];
+static uint64_t values[KEYS];
+static size_t n_keys;
+static uint64_t seed = 88172645463325252ull;
+
+static uint64_t next_rand(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static int compare(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Checks the keys come in increasing order with the value they were given
+static uint64_t last;
+static size_t visited;
+
+static int visit(uint64_t key, uint64_t value, void *ctx) {
+  (void)ctx;
+  CHECK(visited == 0 || key > last);
+  CHECK(value == key * 2);
+  last = key;
+  visited++;
+  return 1;
+}
+
+static int stop_after_ten(uint64_t key, uint64_t value, void *ctx) {
+  (void)key;
+  (void)value;
+  return ++*(size_t *)ctx < 10;
+}
+
+static size_t scan(const MemBtree *tree, uint64_t lo, uint64_t hi) {
+  visited = 0;
+  size_t count = mem_btree_scan(tree, lo, hi, visit, NULL);
+  CHECK(count == visited);
+  return count;
+}
+
+static void test_random_inserts(void) {
+  MemBtree *tree = mem_btree_init(1024);
+  CHECK(tree != NULL && mem_btree_size(tree) == 0);
+  CHECK(!mem_btree_get(tree, 1, NULL) && scan(tree, 0, UINT64_MAX) == 0);
+  for (size_t i = 0; i < KEYS; ++i) {
+    // Duplicates, and keys with the high bit set for the signed compares
+    keys[i] = next_rand() % (KEYS * 4);
+    if (i % 5 == 0) {
+      keys[i] |= 0xF000000000000000ull;
+    }
+    CHECK(mem_btree_insert(tree, keys[i], keys[i] * 2));
+  }
+  qsort(keys, KEYS, sizeof(uint64_t), compare);
+  for (size_t i = 0; i < KEYS; ++i) {
+    if (n_keys == 0 || keys[n_keys - 1] != keys[i]) {
+      keys[n_keys++] = keys[i];
+    }
+  }
+  CHECK(mem_btree_size(tree) == n_keys);
+  for (size_t i = 0; i < n_keys; ++i) {
+    uint64_t value = 0;
+    CHECK(mem_btree_get(tree, keys[i], &value) && value == keys[i] * 2);
+    int next_is_key = i + 1 < n_keys && keys[i + 1] == keys[i] + 1;
+    CHECK(mem_btree_get(tree, keys[i] + 1, NULL) == next_is_key);
+  }
+  // Updates don't add keys
+  CHECK(mem_btree_insert(tree, keys[7], 1));
+  CHECK(mem_btree_size(tree) == n_keys);
+  uint64_t value = 0;
+  CHECK(mem_btree_get(tree, keys[7], &value) && value == 1);
+  CHECK(mem_btree_insert(tree, keys[7], keys[7] * 2));
+
+  CHECK(scan(tree, 0, UINT64_MAX) == n_keys);
+  CHECK(scan(tree, keys[100], keys[200]) == 101);
+  CHECK(scan(tree, keys[100] + 1, keys[200] - 1) == 99);
+  CHECK(scan(tree, keys[200], keys[100]) == 0);
+  size_t count = 0;
+  CHECK(mem_btree_scan(tree, 0, UINT64_MAX, stop_after_ten, &count) == 10);
+  mem_btree_deinit(tree);
+}
+
+static void test_bulk_load(void) {
+  MemArena *scratch = mem_arena_init_growable(4096, 0);
+  CHECK(scratch != NULL);
+  // Every node count of the small trees, then bigger steps
+  for (size_t n = 0; n < 3000; n += n < 40 ? 1 : 397) {
+    MemBtree *tree = mem_btree_init(64);
+    for (size_t i = 0; i < n; ++i) {
+      values[i] = keys[i] * 2;
+    }
+    CHECK(mem_btree_bulk_load(tree, keys, values, n, scratch));
+    mem_arena_reset(scratch);
+    CHECK(mem_btree_size(tree) == n);
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t value = 0;
+      CHECK(mem_btree_get(tree, keys[i], &value) && value == keys[i] * 2);
+    }
+    CHECK(scan(tree, 0, UINT64_MAX) == n);
+    // The evenly filled nodes still split right
+    for (size_t i = 0; i < 200; ++i) {
+      uint64_t key = next_rand();
+      CHECK(mem_btree_insert(tree, key, key * 2));
+    }
+    CHECK(scan(tree, 0, UINT64_MAX) == mem_btree_size(tree));
+    // Only empty trees can be loaded
+    CHECK(!mem_btree_bulk_load(tree, keys, values, n, scratch));
+    mem_btree_deinit(tree);
+  }
+  MemBtree *tree = mem_btree_init(64);
+  const uint64_t unsorted[] = {1, 3, 3};
+  CHECK(!mem_btree_bulk_load(tree, unsorted, values, 3, scratch));
+  CHECK(mem_btree_size(tree) == 0 && !mem_btree_get(tree, 1, NULL));
+  mem_btree_deinit(tree);
+  mem_arena_deinit(scratch);
+}
+
+int main(void) {
+  test_random_inserts();
+  test_bulk_load();
+  return 0;
+}
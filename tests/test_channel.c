@@ -0,0 +1,143 @@
+#define POOL_IMPL
+#define CHANNEL_IMPL
+#include "channel.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include "test.h"
+
+#define PRODUCERS 4
+#define MESSAGES 100000
+
+static int items[16];
+
+static void test_rings(void) {
+  void *batch[16];
+  for (size_t i = 0; i < 16; ++i) {
+    batch[i] = &items[i];
+  }
+  // 5 slots are rounded up to 8
+  MemSpscRing *spsc = mem_spsc_init(5);
+  CHECK(spsc != NULL && mem_spsc_pop(spsc) == NULL);
+  CHECK(mem_spsc_push_batch(spsc, batch, 16) == 8);
+  CHECK(!mem_spsc_push(spsc, &items[8]));
+  CHECK(mem_spsc_pop(spsc) == &items[0]);
+  CHECK(mem_spsc_push(spsc, &items[8]));
+  void *out[16];
+  CHECK(mem_spsc_pop_batch(spsc, out, 16) == 8);
+  for (size_t i = 0; i < 8; ++i) {
+    CHECK(out[i] == &items[i + 1]);
+  }
+  CHECK(mem_spsc_pop(spsc) == NULL);
+  mem_spsc_deinit(spsc);
+  CHECK(mem_spsc_init(0) == NULL);
+
+  MemMpscRing *mpsc = mem_mpsc_init(4);
+  CHECK(mpsc != NULL && mem_mpsc_pop(mpsc) == NULL);
+  for (size_t i = 0; i < 4; ++i) {
+    CHECK(mem_mpsc_push(mpsc, &items[i]));
+  }
+  CHECK(!mem_mpsc_push(mpsc, &items[4]));
+  // Slots come back around once they're read
+  for (size_t round = 0; round < 10; ++round) {
+    CHECK(mem_mpsc_pop(mpsc) == &items[round % 5]);
+    CHECK(mem_mpsc_push(mpsc, &items[(round + 4) % 5]));
+  }
+  mem_mpsc_deinit(mpsc);
+}
+
+static void test_payloads_are_returned(void) {
+  MemChannel *channel = mem_channel_init(1, 16, 64, 4);
+  CHECK(channel != NULL);
+  void *payloads[4];
+  for (size_t i = 0; i < 4; ++i) {
+    payloads[i] = mem_channel_acquire(channel, 0);
+    CHECK(payloads[i] != NULL);
+    CHECK(mem_channel_send(channel, 0, payloads[i]));
+  }
+  // All in flight
+  CHECK(mem_channel_acquire(channel, 0) == NULL);
+  for (size_t i = 0; i < 4; ++i) {
+    CHECK(mem_channel_recv(channel) == payloads[i]);
+    mem_channel_release(channel, payloads[i]);
+  }
+  // Released, but the batch isn't full and nothing flushed it yet
+  CHECK(mem_channel_acquire(channel, 0) == NULL);
+  CHECK(mem_channel_recv(channel) == NULL); // Flushes
+  void *again = mem_channel_acquire(channel, 0);
+  CHECK(again == payloads[0] || again == payloads[1] ||
+        again == payloads[2] || again == payloads[3]);
+  CHECK(mem_channel_send(channel, 0, again));
+  mem_channel_deinit(channel);
+}
+
+typedef struct {
+  MemChannel *channel;
+  size_t id;
+  size_t payload_size;
+} Producer;
+
+// Every message carries its producer, its sequence number at both ends of
+// the payload
+static void *produce(void *arg) {
+  Producer *producer = arg;
+  size_t last = producer->payload_size / sizeof(size_t) - 1;
+  for (size_t i = 0; i < MESSAGES;) {
+    size_t *payload = mem_channel_acquire(producer->channel, producer->id);
+    if (payload == NULL) {
+      sched_yield();
+      continue;
+    }
+    payload[0] = producer->id;
+    payload[1] = i;
+    payload[last] = i;
+    while (!mem_channel_send(producer->channel, producer->id, payload)) {
+      sched_yield();
+    }
+    i++;
+  }
+  return NULL;
+}
+
+static void test_ordering(size_t n_producers, size_t payload_size) {
+  MemChannel *channel = mem_channel_init(n_producers, 256, payload_size, 64);
+  CHECK(channel != NULL);
+  Producer producers[PRODUCERS];
+  pthread_t threads[PRODUCERS];
+  for (size_t i = 0; i < n_producers; ++i) {
+    producers[i] = (Producer){channel, i, payload_size};
+    pthread_create(&threads[i], NULL, produce, &producers[i]);
+  }
+  // Messages of a producer arrive in the order they were sent
+  size_t next[PRODUCERS] = {0};
+  size_t last = payload_size / sizeof(size_t) - 1;
+  for (size_t received = 0; received < n_producers * MESSAGES;) {
+    size_t *payload = mem_channel_recv(channel);
+    if (payload == NULL) {
+      sched_yield();
+      continue;
+    }
+    CHECK(payload[0] < n_producers);
+    CHECK(payload[1] == next[payload[0]]++ && payload[last] == payload[1]);
+    mem_channel_release(channel, payload);
+    received++;
+  }
+  for (size_t i = 0; i < n_producers; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  CHECK(mem_channel_recv(channel) == NULL);
+  mem_channel_deinit(channel);
+}
+
+int main(void) {
+  test_rings();
+  test_payloads_are_returned();
+  test_ordering(1, 64);
+  test_ordering(1, 1024);
+  test_ordering(PRODUCERS, 64);
+  test_ordering(PRODUCERS, 65536);
+  CHECK(mem_channel_init(0, 16, 64, 4) == NULL);
+  return 0;
+}
@@ -0,0 +1,130 @@
+#define POOL_IMPL
+#define ARENA_IMPL
+#define MEM_STACK_IMPL
+#include "compose_allocator.h"
+
+#include <string.h>
+
+#include "test.h"
+
+static MemPool *small_pool;
+static MemArena *scratch;
+static MemStack *stack;
+static MemPool *buckets[4];
+
+MEM_COMPOSE_POOL(small, small_pool)
+MEM_COMPOSE_ARENA(big, scratch)
+MEM_COMPOSE_STACK(frame, stack)
+MEM_COMPOSE_MALLOC(heap)
+MEM_FALLBACK(big_or_heap, big, heap)
+MEM_SEGREGATOR(alloc, 64, small, big_or_heap)
+MEM_FALLBACK(small_or_heap, small, heap)
+MEM_BUCKETIZER(sized, buckets, 0, 128, 32)
+
+typedef struct {
+  uint32_t magic;
+  uint32_t size;
+} Header;
+
+typedef struct {
+  uint16_t canary;
+} Footer;
+
+MEM_AFFIX(guarded, frame, Header, Footer)
+MEM_PREFIX(tagged, frame, char)
+
+static void test_segregator_and_fallback(void) {
+  uint8_t *a = alloc_alloc(48);
+  uint8_t *b = alloc_alloc(1000);
+  CHECK(a != NULL && b != NULL);
+  CHECK(small_owns(a) && !small_owns(b) && big_owns(b));
+  CHECK(alloc_owns(a) && alloc_owns(b));
+  alloc_free(a, 48);
+  CHECK(alloc_alloc(1) == a); // Back in the pool
+
+  // The arena is full, the heap takes over and its pointers go back to it
+  uint8_t *c = alloc_alloc(5000);
+  CHECK(c != NULL && !big_owns(c));
+  memset(c, 1, 5000);
+  alloc_free(c, 5000);
+
+  // Fallback picks the owner when freeing
+  uint8_t *chunks[20];
+  for (int i = 0; i < 20; ++i) {
+    chunks[i] = small_or_heap_alloc(64);
+    CHECK(chunks[i] != NULL);
+  }
+  CHECK(!small_owns(chunks[19])); // The pool has 16 chunks, one already used
+  for (int i = 0; i < 20; ++i) {
+    small_or_heap_free(chunks[i], 64);
+  }
+  CHECK(small_alloc(65) == NULL);
+}
+
+static void test_bucketizer(void) {
+  for (int i = 0; i < 4; ++i) {
+    buckets[i] = mem_pool_init(32 * (i + 1), 8);
+    CHECK(buckets[i] != NULL);
+  }
+  uint8_t *a = sized_alloc(1);
+  uint8_t *b = sized_alloc(33);
+  uint8_t *c = sized_alloc(128);
+  CHECK(mem_pool_owns(buckets[0], a) && mem_pool_owns(buckets[1], b));
+  CHECK(mem_pool_owns(buckets[3], c) && sized_owns(c));
+  CHECK(sized_alloc(0) == NULL && sized_alloc(129) == NULL);
+  sized_free(b, 64);
+  CHECK(sized_alloc(40) == b);
+  int x;
+  CHECK(!sized_owns(&x));
+  for (int i = 0; i < 4; ++i) {
+    mem_pool_deinit(buckets[i]);
+  }
+}
+
+static void test_affixes(void) {
+  // Odd sized allocations leave the stack top unaligned on purpose
+  CHECK(frame_alloc(3) != NULL);
+  uint8_t *ptrs[10];
+  for (size_t i = 0; i < 10; ++i) {
+    ptrs[i] = guarded_alloc(i * 7 + 1);
+    CHECK(ptrs[i] != NULL);
+    CHECK((uintptr_t)ptrs[i] % MEM_COMPOSE_ALIGN == 0);
+    CHECK((uintptr_t)guarded_prefix(ptrs[i]) % _Alignof(Header) == 0);
+    guarded_prefix(ptrs[i])->magic = 0xC0FFEE;
+    guarded_prefix(ptrs[i])->size = (uint32_t)(i * 7 + 1);
+    guarded_suffix(ptrs[i], i * 7 + 1)->canary = (uint16_t)i;
+    memset(ptrs[i], 0xAA, i * 7 + 1);
+    CHECK(guarded_owns(ptrs[i]));
+  }
+  for (size_t i = 0; i < 10; ++i) {
+    CHECK(guarded_prefix(ptrs[i])->magic == 0xC0FFEE);
+    CHECK(guarded_suffix(ptrs[i], i * 7 + 1)->canary == i);
+  }
+  // Freeing the last allocation pops exactly what it took
+  size_t before = stack->size;
+  uint8_t *top = guarded_alloc(5);
+  guarded_free(top, 5);
+  CHECK(stack->size == before);
+
+  char *name = tagged_alloc(10);
+  CHECK(name != NULL && (uintptr_t)name % MEM_COMPOSE_ALIGN == 0);
+  *tagged_prefix(name) = 'x';
+  before = stack->size;
+  char *last = tagged_alloc(1);
+  tagged_free(last, 1);
+  CHECK(stack->size == before && *tagged_prefix(name) == 'x');
+}
+
+int main(void) {
+  small_pool = mem_pool_init(64, 16);
+  scratch = mem_arena_init(4096);
+  stack = mem_stack_init(1 << 16);
+  CHECK(small_pool != NULL && scratch != NULL && stack != NULL);
+  test_segregator_and_fallback();
+  test_bucketizer();
+  test_affixes();
+  mem_stack_deinit(stack);
+  mem_arena_deinit(scratch);
+  mem_pool_deinit(small_pool);
+  return 0;
+}
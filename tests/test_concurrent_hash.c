@@ -0,0 +1,116 @@
+#define POOL_IMPL
+#define CONCURRENT_HASH_IMPL
+#include "concurrent_hash.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "test.h"
+
+// Keys below STABLE_KEYS never leave the table, the writers churn the others
+#define STABLE_KEYS 1000
+#define KEYS 2000
+#define ROUNDS 200
+
+static MemHashTable *table;
+static _Atomic int stop;
+static _Atomic uint64_t lookups;
+
+static void test_single_thread(void) {
+  MemHashTable *small = mem_hash_init(8, 2, 4);
+  CHECK(small != NULL);
+  uint64_t value = 0;
+  CHECK(!mem_hash_get(small, 1, &value));
+  // Many more keys than buckets and nodes per pool, the chains and the
+  // stripe pools grow
+  for (uint64_t key = 0; key < 500; ++key) {
+    CHECK(mem_hash_put(small, key, key * 3));
+  }
+  CHECK(mem_hash_size(small) == 500);
+  CHECK(mem_hash_put(small, 7, 70) && mem_hash_size(small) == 500);
+  CHECK(mem_hash_get(small, 7, &value) && value == 70);
+  CHECK(mem_hash_get(small, 499, NULL));
+  CHECK(mem_hash_remove(small, 7));
+  CHECK(!mem_hash_get(small, 7, NULL) && !mem_hash_remove(small, 7));
+  for (uint64_t key = 0; key < 500; key += 2) {
+    mem_hash_remove(small, key);
+  }
+  CHECK(mem_hash_size(small) == 249);
+  for (uint64_t key = 1; key < 500; key += 2) {
+    CHECK(key == 7 || (mem_hash_get(small, key, &value) && value == key * 3));
+  }
+  mem_hash_deinit(small);
+
+  CHECK(mem_hash_init(0, 1, 1) == NULL && mem_hash_init(1, 0, 1) == NULL);
+  CHECK(!mem_hash_get(NULL, 1, NULL) && !mem_hash_put(NULL, 1, 1));
+}
+
+// Stable keys are always found with one of their two values, the others
+// only ever have one of theirs
+static void *reader(void *arg) {
+  (void)arg;
+  while (!atomic_load(&stop)) {
+    for (uint64_t key = 0; key < KEYS; ++key) {
+      uint64_t value;
+      if (mem_hash_get(table, key, &value)) {
+        CHECK(value == key * 3 || value == key * 5);
+      } else {
+        CHECK(key >= STABLE_KEYS);
+      }
+      atomic_fetch_add_explicit(&lookups, 1, memory_order_relaxed);
+    }
+  }
+  return NULL;
+}
+
+// Even rounds insert (or update) the churned keys, odd rounds remove them.
+// The two writers share the stripes but not the keys
+static void *writer(void *arg) {
+  uint64_t first = (uintptr_t)arg;
+  for (int round = 0; round < ROUNDS; ++round) {
+    for (uint64_t key = STABLE_KEYS + first; key < KEYS; key += 2) {
+      if (round & 1) {
+        CHECK(mem_hash_remove(table, key));
+      } else {
+        CHECK(mem_hash_put(table, key, key * (round & 2 ? 5 : 3)));
+      }
+    }
+    for (uint64_t key = first; key < STABLE_KEYS; key += 2) {
+      CHECK(mem_hash_put(table, key, key * (round & 1 ? 5 : 3)));
+    }
+  }
+  return NULL;
+}
+
+static void test_readers_and_writers(void) {
+  table = mem_hash_init(256, 16, 64);
+  CHECK(table != NULL);
+  for (uint64_t key = 0; key < STABLE_KEYS; ++key) {
+    CHECK(mem_hash_put(table, key, key * 3));
+  }
+  pthread_t readers[2], writers[2];
+  for (uintptr_t i = 0; i < 2; ++i) {
+    pthread_create(&readers[i], NULL, reader, NULL);
+    pthread_create(&writers[i], NULL, writer, (void *)i);
+  }
+  for (int i = 0; i < 2; ++i) {
+    pthread_join(writers[i], NULL);
+  }
+  atomic_store(&stop, 1);
+  for (int i = 0; i < 2; ++i) {
+    pthread_join(readers[i], NULL);
+  }
+  CHECK(atomic_load(&lookups) > 0);
+  // Every round removes what the one before inserted
+  CHECK(mem_hash_size(table) == STABLE_KEYS);
+  for (uint64_t key = STABLE_KEYS; key < KEYS; ++key) {
+    CHECK(!mem_hash_get(table, key, NULL));
+  }
+  mem_hash_deinit(table);
+}
+
+int main(void) {
+  test_single_thread();
+  test_readers_and_writers();
+  return 0;
+}
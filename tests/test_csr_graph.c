@@ -0,0 +1,153 @@
+#define POOL_IMPL
+#define ARENA_IMPL
+#define MEM_STACK_IMPL
+#define TASK_SCHED_IMPL
+#define CSR_GRAPH_IMPL
+#include "stack_allocator.h"
+#include "csr_graph.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+#define VERTICES 20000
+#define EDGES 300000
+#define THREADS 4
+
+static uint32_t srcs[EDGES];
+static uint32_t dsts[EDGES];
+static uint64_t degrees[VERTICES];
+static uint64_t sums[VERTICES];
+
+static void make_edges(void) {
+  uint64_t seed = 88172645463325252ull;
+  for (size_t i = 0; i < EDGES; ++i) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    // Skewed sources, so some vertices have thousands of neighbors
+    srcs[i] = (uint32_t)(seed % 16 == 0 ? seed % 64 : seed % VERTICES);
+    dsts[i] = (uint32_t)((seed >> 32) % VERTICES);
+    if (i == 0) {
+      dsts[i] = VERTICES - 1; // The biggest id sets the vertex count
+    }
+    degrees[srcs[i]]++;
+    sums[srcs[i]] += dsts[i];
+  }
+}
+
+// The neighbors match the edges, in any order
+static void check_graph(const MemCsrGraph *graph) {
+  CHECK(graph != NULL);
+  CHECK(graph->n_vertices == VERTICES && graph->n_edges == EDGES);
+  CHECK(graph->offsets[0] == 0 && graph->offsets[VERTICES] == EDGES);
+  for (uint32_t v = 0; v < VERTICES; ++v) {
+    uint64_t degree = 0;
+    const uint32_t *neighbors = mem_csr_neighbors(graph, v, &degree);
+    CHECK(degree == degrees[v]);
+    uint64_t sum = 0;
+    for (uint64_t k = 0; k < degree; ++k) {
+      sum += neighbors[k];
+    }
+    CHECK(sum == sums[v]);
+  }
+}
+
+// Without a scheduler the neighbors keep the order of the edges
+static void check_order(const MemCsrGraph *graph) {
+  uint64_t degree = 0;
+  const uint32_t *neighbors = mem_csr_neighbors(graph, 3, &degree);
+  size_t k = 0;
+  for (size_t i = 0; i < EDGES; ++i) {
+    if (srcs[i] == 3) {
+      CHECK(k < degree && neighbors[k++] == dsts[i]);
+    }
+  }
+  CHECK(k == degree);
+}
+
+static void test_serial(void) {
+  MemCsrBuilder *builder = mem_csr_builder_init(1 << 16);
+  CHECK(builder != NULL);
+  for (size_t i = 0; i < EDGES; ++i) {
+    CHECK(mem_csr_builder_add(builder, srcs[i], dsts[i]));
+  }
+  MemCsrGraph *graph = mem_csr_build(builder, 0, NULL);
+  check_graph(graph);
+  check_order(graph);
+  mem_csr_deinit(graph);
+  // A single worker runs the passes on the caller, in order too
+  MemScheduler *sched = mem_sched_init(1, 64, 0);
+  graph = mem_csr_build(builder, 0, sched);
+  check_graph(graph);
+  check_order(graph);
+  mem_csr_deinit(graph);
+  mem_sched_deinit(sched);
+  // Too few vertices for the ids, the builder is left as it was
+  CHECK(mem_csr_build(builder, VERTICES - 1, NULL) == NULL);
+  graph = mem_csr_build(builder, VERTICES, NULL);
+  check_graph(graph);
+  mem_csr_deinit(graph);
+  mem_csr_builder_deinit(builder);
+}
+
+static MemCsrBuilder *shared;
+
+static void *load(void *arg) {
+  size_t id = (size_t)arg;
+  MemCsrStream *stream = mem_csr_stream_open(shared);
+  CHECK(stream != NULL);
+  for (size_t i = id; i < EDGES; i += THREADS) {
+    CHECK(mem_csr_stream_add(stream, srcs[i], dsts[i]));
+  }
+  CHECK(mem_csr_stream_close(shared, stream));
+  return NULL;
+}
+
+static void test_parallel(void) {
+  shared = mem_csr_builder_init(1 << 16);
+  pthread_t threads[THREADS];
+  for (size_t i = 0; i < THREADS; ++i) {
+    pthread_create(&threads[i], NULL, load, (void *)i);
+  }
+  for (size_t i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  MemScheduler *sched = mem_sched_init(THREADS, 256, 0);
+  CHECK(sched != NULL);
+  MemCsrGraph *graph = mem_csr_build(shared, 0, sched);
+  check_graph(graph);
+  mem_csr_deinit(graph);
+  // The builder can be built again, serially this time
+  graph = mem_csr_build(shared, 0, NULL);
+  check_graph(graph);
+  mem_csr_deinit(graph);
+  mem_sched_deinit(sched);
+  mem_csr_builder_deinit(shared);
+}
+
+static void test_empty(void) {
+  MemCsrBuilder *builder = mem_csr_builder_init(0);
+  MemCsrGraph *graph = mem_csr_build(builder, 0, NULL);
+  CHECK(graph != NULL && graph->n_vertices == 0 && graph->n_edges == 0);
+  mem_csr_deinit(graph);
+  // Isolated vertices get an empty neighbor list
+  graph = mem_csr_build(builder, 10, NULL);
+  uint64_t degree = 1;
+  mem_csr_neighbors(graph, 9, &degree);
+  CHECK(graph->n_vertices == 10 && degree == 0);
+  mem_csr_deinit(graph);
+  mem_csr_builder_deinit(builder);
+  CHECK(mem_csr_build(NULL, 0, NULL) == NULL);
+  CHECK(!mem_csr_builder_add(NULL, 1, 2));
+}
+
+int main(void) {
+  make_edges();
+  test_serial();
+  test_parallel();
+  test_empty();
+  return 0;
+}
@@ -0,0 +1,107 @@
+#define MEM_USE_DEFERRED_FREE
+#define DEFERRED_FREE_IMPL
+#define POOL_IMPL
+#define ARENA_IMPL
+#include "arena_allocator.h"
+#include "deferred_free.h"
+#include "pool_allocator.h"
+
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "test.h"
+
+static atomic_size_t released, released_inline;
+static pthread_t caller;
+
+// Blocks the reclaimer while set, so the backlog fills up
+static atomic_int gate, blocked;
+
+static void count_release(void *ptr, size_t size) {
+  (void)size;
+  if (pthread_equal(pthread_self(), caller)) {
+    atomic_fetch_add(&released_inline, 1);
+  } else {
+    atomic_store(&blocked, 1);
+    while (atomic_load(&gate)) {
+      usleep(100);
+    }
+  }
+  atomic_fetch_add(&released, 1);
+  free(ptr);
+}
+
+static void reset_counts(void) {
+  atomic_store(&released, 0);
+  atomic_store(&released_inline, 0);
+  atomic_store(&blocked, 0);
+}
+
+static void test_not_running(void) {
+  reset_counts();
+  mem_deferred_release(count_release, malloc(16), 16);
+  CHECK(released == 1 && released_inline == 1);
+  mem_deferred_release(count_release, NULL, 16); // Ignored
+  mem_deferred_drain();                          // Nothing to wait for
+  mem_deferred_stop();
+  CHECK(released == 1);
+}
+
+static void test_background_release(void) {
+  reset_counts();
+  CHECK(mem_deferred_start(1000));
+  CHECK(!mem_deferred_start(1000)); // Already running
+  for (int i = 0; i < 500; ++i) {
+    mem_deferred_release(count_release, malloc(64), 64);
+  }
+  mem_deferred_drain();
+  CHECK(released == 500 && released_inline == 0);
+  mem_deferred_stop();
+}
+
+static void test_bounded_backlog(void) {
+  reset_counts();
+  CHECK(mem_deferred_start(8));
+  atomic_store(&gate, 1);
+  // The reclaimer takes the first release and blocks on it
+  mem_deferred_release(count_release, malloc(64), 64);
+  while (!atomic_load(&blocked)) {
+    usleep(100);
+  }
+  for (int i = 0; i < 8; ++i) {
+    mem_deferred_release(count_release, malloc(64), 64);
+  }
+  CHECK(released_inline == 0);
+  // The backlog is full, the caller releases it itself
+  mem_deferred_release(count_release, malloc(64), 64);
+  CHECK(released_inline == 1 && released == 1);
+  atomic_store(&gate, 0);
+  mem_deferred_stop(); // Drains before stopping
+  CHECK(released == 10 && released_inline == 1);
+  // Stopped, back to releasing right away
+  mem_deferred_release(count_release, malloc(64), 64);
+  CHECK(released == 11 && released_inline == 2);
+}
+
+static void test_allocators(void) {
+  CHECK(mem_deferred_start(64));
+  for (int i = 0; i < 100; ++i) {
+    MemPool *pool = mem_pool_init(1024, 1024);
+    CHECK(pool != NULL && mem_pool_alloc(pool) != NULL);
+    mem_pool_deinit(pool);
+    MemArena *arena = mem_arena_init_growable(1 << 20, 0);
+    CHECK(arena != NULL);
+    CHECK(mem_arena_alloc(arena, 3 << 20) != NULL);
+    mem_arena_deinit(arena);
+  }
+  mem_deferred_stop(); // Leaks show up under the address sanitizer
+}
+
+int main(void) {
+  caller = pthread_self();
+  test_not_running();
+  test_background_release();
+  test_bounded_backlog();
+  test_allocators();
+  return 0;
+}
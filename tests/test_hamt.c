@@ -0,0 +1,192 @@
+#define POOL_IMPL
+#define ARENA_IMPL
+#define HAMT_IMPL
+#include "hamt.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+#define KEYS 3000
+#define VERSIONS 64
+#define UPDATES 2000
+
+// Reference model, the keys and values of every version
+static uint8_t present[VERSIONS][KEYS];
+static uint64_t values[VERSIONS][KEYS];
+static MemHamtMap versions[VERSIONS];
+static uint64_t seed = 88172645463325252ull;
+
+static uint64_t next_rand(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static void check_version(size_t i) {
+  size_t size = 0;
+  for (uint64_t key = 0; key < KEYS; ++key) {
+    uint64_t value = 0;
+    int found = mem_hamt_get(&versions[i], key, &value);
+    CHECK(found == present[i][key]);
+    CHECK(!found || value == values[i][key]);
+    size += present[i][key];
+  }
+  CHECK(mem_hamt_size(&versions[i]) == size);
+}
+
+// Nodes of the pool store still in use
+static size_t live_nodes(const MemHamt *hamt) {
+  size_t live = 0;
+  for (size_t c = 0; c < hamt->n_classes; ++c) {
+    for (size_t p = 0; p < hamt->classes[c].n_pools; ++p) {
+      const MemPool *pool = hamt->classes[c].pools[p];
+      for (size_t i = 0; i < pool->n_chunks; ++i) {
+        const uint8_t *chunk = pool->data + i * pool->chunk_size;
+        live += (size_t)mem_pool_is_allocated(pool, chunk);
+      }
+    }
+  }
+  return live;
+}
+
+// Every version derives from a random older one, which stays as it was
+static void write_versions(MemHamt *hamt, int release_some) {
+  memset(versions, 0, sizeof(versions));
+  memset(present, 0, sizeof(present));
+  for (size_t i = 1; i < VERSIONS; ++i) {
+    size_t from = next_rand() % i;
+    memcpy(present[i], present[from], sizeof(present[i]));
+    memcpy(values[i], values[from], sizeof(values[i]));
+    MemHamtMap current = versions[from];
+    mem_hamt_retain(hamt, &current);
+    for (size_t u = 0; u < UPDATES; ++u) {
+      uint64_t key = next_rand() % KEYS;
+      MemHamtMap next;
+      if (next_rand() % 3 != 0) {
+        uint64_t value = next_rand();
+        CHECK(mem_hamt_put(hamt, &current, key, value, &next));
+        present[i][key] = 1;
+        values[i][key] = value;
+      } else {
+        CHECK(mem_hamt_remove(hamt, &current, key, &next));
+        present[i][key] = 0;
+      }
+      mem_hamt_release(hamt, &current);
+      current = next;
+    }
+    versions[i] = current;
+    if (release_some && i % 5 == 0) {
+      size_t dead = next_rand() % i;
+      mem_hamt_release(hamt, &versions[dead]);
+      CHECK(versions[dead].root == NULL && versions[dead].size == 0);
+      memset(present[dead], 0, sizeof(present[dead]));
+    }
+  }
+  for (size_t i = 0; i < VERSIONS; ++i) {
+    check_version(i);
+  }
+}
+
+// Removes every key from the last version, down to the empty map
+static void empty_last(MemHamt *hamt) {
+  MemHamtMap current = versions[VERSIONS - 1];
+  mem_hamt_retain(hamt, &current);
+  for (uint64_t key = 0; key < KEYS; ++key) {
+    MemHamtMap next;
+    CHECK(mem_hamt_remove(hamt, &current, key, &next));
+    mem_hamt_release(hamt, &current);
+    current = next;
+  }
+  CHECK(current.root == NULL && current.size == 0);
+  check_version(VERSIONS - 1);
+}
+
+static void test_pools(void) {
+  MemHamt *hamt = mem_hamt_init(256);
+  CHECK(hamt != NULL);
+  write_versions(hamt, 1);
+  empty_last(hamt);
+  CHECK(live_nodes(hamt) > 0);
+  // Once every version is released no node is left
+  for (size_t i = 0; i < VERSIONS; ++i) {
+    mem_hamt_release(hamt, &versions[i]);
+  }
+  CHECK(live_nodes(hamt) == 0);
+  // Updating a key copies the path only, the other nodes are shared
+  MemHamtMap map = {0};
+  for (uint64_t key = 0; key < KEYS; ++key) {
+    MemHamtMap next;
+    CHECK(mem_hamt_put(hamt, &map, key, key, &next));
+    mem_hamt_release(hamt, &map);
+    map = next;
+  }
+  size_t before = live_nodes(hamt);
+  MemHamtMap updated;
+  CHECK(mem_hamt_put(hamt, &map, 7, 70, &updated));
+  CHECK(live_nodes(hamt) - before <= 13);
+  uint64_t value = 0;
+  CHECK(mem_hamt_get(&map, 7, &value) && value == 7);
+  CHECK(mem_hamt_get(&updated, 7, &value) && value == 70);
+  CHECK(mem_hamt_size(&updated) == KEYS);
+  mem_hamt_release(hamt, &map);
+  mem_hamt_release(hamt, &updated);
+  CHECK(live_nodes(hamt) == 0);
+  mem_hamt_deinit(hamt);
+}
+
+// Two keys in one slot of the root, removing either one leaves the other at
+// the root, found again and not added twice
+static void test_collapse(void) {
+  MemHamt *hamt = mem_hamt_init(16);
+  for (uint64_t removed = 0; removed < 2; ++removed) {
+    uint64_t keys[2] = {1, 2}, kept_value = removed ? 10 : 20;
+    while (mem_hamt_bit(mem_hamt_hash(keys[1]), 0) !=
+           mem_hamt_bit(mem_hamt_hash(keys[0]), 0)) {
+      keys[1]++;
+    }
+    MemHamtMap empty = {0}, one, two, left, again;
+    CHECK(mem_hamt_put(hamt, &empty, keys[0], 10, &one));
+    CHECK(mem_hamt_put(hamt, &one, keys[1], 20, &two));
+    CHECK(mem_hamt_remove(hamt, &two, keys[removed], &left));
+    uint64_t kept = keys[1 - removed];
+    uint64_t value = 0;
+    CHECK(mem_hamt_size(&left) == 1);
+    CHECK(mem_hamt_get(&left, kept, &value) && value == kept_value);
+    CHECK(!mem_hamt_get(&left, keys[removed], NULL));
+    CHECK(mem_hamt_put(hamt, &left, kept, 30, &again));
+    CHECK(mem_hamt_size(&again) == 1);
+    CHECK(mem_hamt_get(&again, kept, &value) && value == 30);
+    mem_hamt_release(hamt, &one);
+    mem_hamt_release(hamt, &two);
+    mem_hamt_release(hamt, &left);
+    mem_hamt_release(hamt, &again);
+  }
+  CHECK(live_nodes(hamt) == 0);
+  mem_hamt_deinit(hamt);
+}
+
+static void test_arena(void) {
+  MemArena *arena = mem_arena_init_growable(1 << 20, 0);
+  MemHamt *hamt = mem_hamt_init_arena(arena);
+  CHECK(hamt != NULL);
+  write_versions(hamt, 0);
+  empty_last(hamt);
+  // Releases are no-ops, the versions die with the arena
+  mem_hamt_release(hamt, &versions[1]);
+  mem_hamt_deinit(hamt);
+  mem_arena_deinit(arena);
+
+  MemHamtMap empty = {0};
+  CHECK(!mem_hamt_get(&empty, 1, NULL) && mem_hamt_size(&empty) == 0);
+  CHECK(mem_hamt_init_arena(NULL) == NULL);
+}
+
+int main(void) {
+  test_pools();
+  test_collapse();
+  test_arena();
+  return 0;
+}
@@ -0,0 +1,69 @@
+#define LARGE_ALLOC_IMPL
+#include "large_alloc.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test.h"
+
+#define BIG (4 * MEM_LARGE_THRESHOLD)
+
+static int all_equal(const uint8_t *bytes, size_t n, uint8_t value) {
+  for (size_t i = 0; i < n; ++i) {
+    if (bytes[i] != value) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void test_alloc(void) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  for (size_t align = 1; align <= page; align *= 2) {
+    uint8_t *small = mem_large_alloc(100, align);
+    CHECK(small != NULL && (uintptr_t)small % align == 0);
+    memset(small, 1, 100);
+    mem_large_free(small, 100);
+  }
+  // Mapped on their own: page aligned and zero filled
+  uint8_t *big = mem_large_alloc(BIG, 64);
+  CHECK(big != NULL && (uintptr_t)big % page == 0);
+  CHECK(all_equal(big, BIG, 0));
+  mem_large_free(big, BIG);
+
+  CHECK(mem_large_alloc(10, 0) == NULL && mem_large_alloc(10, 24) == NULL);
+  CHECK(mem_large_alloc(SIZE_MAX, 64) == NULL);
+  mem_large_free(NULL, BIG);
+}
+
+static void test_realloc(void) {
+  uint8_t *buffer = mem_large_realloc(NULL, 0, BIG, 64);
+  CHECK(buffer != NULL);
+  memset(buffer, 7, BIG);
+  // Grown with mremap, the new bytes are zero
+  buffer = mem_large_realloc(buffer, BIG, 64 * BIG, 64);
+  CHECK(buffer != NULL);
+  CHECK(all_equal(buffer, BIG, 7) && all_equal(buffer + BIG, 63 * BIG, 0));
+  // Same number of pages, same buffer
+  uint8_t *same = mem_large_realloc(buffer, 64 * BIG, 64 * BIG - 1, 64);
+  CHECK(same == buffer);
+  buffer = mem_large_realloc(buffer, 64 * BIG - 1, 2 * BIG, 64);
+  CHECK(buffer != NULL && all_equal(buffer, BIG, 7));
+  // Below the threshold, copied to the heap and back
+  buffer = mem_large_realloc(buffer, 2 * BIG, 1000, 64);
+  CHECK(buffer != NULL && (uintptr_t)buffer % 64 == 0);
+  CHECK(all_equal(buffer, 1000, 7));
+  buffer = mem_large_realloc(buffer, 1000, BIG, 64);
+  CHECK(buffer != NULL && all_equal(buffer, 1000, 7));
+  // A failed resize leaves the buffer as it was
+  CHECK(mem_large_realloc(buffer, BIG, SIZE_MAX, 64) == NULL);
+  CHECK(all_equal(buffer, 1000, 7));
+  mem_large_free(buffer, BIG);
+}
+
+int main(void) {
+  test_alloc();
+  test_realloc();
+  return 0;
+}
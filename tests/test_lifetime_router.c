@@ -0,0 +1,170 @@
+#define MEM_USE_PAGE_HEAP
+#define PAGE_HEAP_IMPL
+#define PAGEMAP_IMPL
+#define POOL_IMPL
+#define ARENA_IMPL
+#define SIZE_CLASS_ALLOC_IMPL
+#define LIFETIME_ROUTER_IMPL
+#include "lifetime_router.h"
+#include "pagemap.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+// Sites differing in their lowest bit only are still apart
+#define SHORT_SITE 0x1000
+#define LONG_SITE 0x1001
+#define KEPT 3000
+
+static const size_t classes[] = {32, 64, 128, 256};
+static void *kept[KEPT];
+
+// Kind of owner of the memory, epochs are arenas and the rest are pools
+static int owner_kind(const void *ptr) {
+  int kind = MEM_OWNER_NONE;
+  mem_owner_get(ptr, &kind);
+  return kind;
+}
+
+static void *alloc_filled(MemRouter *router, size_t bytes, uintptr_t site,
+                          int value) {
+  uint8_t *memory = mem_router_alloc_site(router, bytes, site);
+  CHECK(memory != NULL);
+  CHECK((uintptr_t)memory % 16 == 0);
+  memset(memory, value, bytes);
+  return memory;
+}
+
+// One short lived and one long lived object per iteration
+static void run_profile(MemRouter *router) {
+  for (size_t i = 0; i < 2000; ++i) {
+    void *temporary = alloc_filled(router, 40, SHORT_SITE, 1);
+    kept[i] = alloc_filled(router, 100, LONG_SITE, 2);
+    mem_router_free(router, temporary, 40);
+  }
+  for (size_t i = 0; i < 2000; ++i) {
+    mem_router_free(router, kept[i], 100);
+  }
+}
+
+static void test_routing(MemRouter *router) {
+  // Everything goes to the pools while profiling
+  void *profiled = alloc_filled(router, 40, SHORT_SITE, 0);
+  CHECK(owner_kind(profiled) == MEM_OWNER_POOL);
+  mem_router_free(router, profiled, 40);
+  run_profile(router);
+  mem_router_profile(router, 0);
+
+  void *temporary = alloc_filled(router, 40, SHORT_SITE, 0);
+  void *lasting = alloc_filled(router, 40, LONG_SITE, 0);
+  CHECK(owner_kind(temporary) == MEM_OWNER_ARENA);
+  CHECK(owner_kind(lasting) == MEM_OWNER_POOL);
+  mem_router_free(router, temporary, 40);
+  mem_router_free(router, lasting, 40);
+  // Site 0 isn't tracked
+  void *untracked = alloc_filled(router, 40, 0, 0);
+  CHECK(owner_kind(untracked) == MEM_OWNER_POOL);
+  mem_router_free(router, untracked, 40);
+
+  // Sizes past the largest class are routed to malloc
+  void *large = mem_router_alloc(router, 5000);
+  CHECK(large != NULL && owner_kind(large) == MEM_OWNER_NONE);
+  mem_router_free(router, large, 5000);
+}
+
+static void test_epochs_are_recycled(MemRouter *router) {
+  // 100 times the bytes of an epoch, the freed epochs keep coming back
+  void *owners[4];
+  size_t n_owners = 0;
+  for (size_t i = 0; i < 100 * 65536 / 64; ++i) {
+    void *temporary = alloc_filled(router, 40, SHORT_SITE, 3);
+    void *owner = mem_owner_get(temporary, NULL);
+    size_t o = 0;
+    while (o < n_owners && owners[o] != owner) {
+      o++;
+    }
+    if (o == n_owners) {
+      CHECK(n_owners < 4);
+      owners[n_owners++] = owner;
+    }
+    mem_router_free(router, temporary, 40);
+  }
+}
+
+static void test_misprediction(MemRouter *router) {
+  // The short site starts keeping its objects, they outlive their epochs
+  for (size_t i = 0; i < KEPT; ++i) {
+    kept[i] = alloc_filled(router, 40, SHORT_SITE, (int)(i & 0xFF));
+  }
+  CHECK(owner_kind(kept[0]) == MEM_OWNER_ARENA);
+  for (size_t i = 0; i < KEPT; ++i) {
+    uint8_t *bytes = kept[i];
+    CHECK(bytes[0] == (i & 0xFF) && bytes[39] == (i & 0xFF));
+    mem_router_free(router, kept[i], 40);
+  }
+  // Enough long lived frees from the epochs send the site back to the pools
+  void *demoted = alloc_filled(router, 40, SHORT_SITE, 0);
+  CHECK(owner_kind(demoted) == MEM_OWNER_POOL);
+  mem_router_free(router, demoted, 40);
+}
+
+typedef struct {
+  MemRouter *router;
+  void *objects[1000];
+} Batch;
+
+static void *alloc_batch(void *arg) {
+  Batch *batch = arg;
+  for (size_t i = 0; i < 1000; ++i) {
+    batch->objects[i] = alloc_filled(batch->router, 64, LONG_SITE, 4);
+  }
+  return NULL;
+}
+
+static void *alloc_short(void *arg) {
+  MemRouter *router = arg;
+  for (size_t i = 0; i < 100000; ++i) {
+    mem_router_free(router, alloc_filled(router, 40, SHORT_SITE, 5), 40);
+  }
+  return NULL;
+}
+
+static void test_threads(MemRouter *router) {
+  // Objects of a thread that exited are freed by another one
+  static Batch batch;
+  batch.router = router;
+  pthread_t thread;
+  pthread_create(&thread, NULL, alloc_batch, &batch);
+  pthread_join(thread, NULL);
+  for (size_t i = 0; i < 1000; ++i) {
+    uint8_t *bytes = batch.objects[i];
+    CHECK(bytes[0] == 4 && bytes[63] == 4);
+    mem_router_free(router, bytes, 64);
+  }
+  pthread_t threads[4];
+  for (int i = 0; i < 4; ++i) {
+    pthread_create(&threads[i], NULL, alloc_short, router);
+  }
+  for (int i = 0; i < 4; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+int main(void) {
+  MemRouterConfig config = {classes, 4, 4096, 65536, 100};
+  MemRouter *router = mem_router_init(&config);
+  CHECK(router != NULL);
+  test_routing(router);
+  test_epochs_are_recycled(router);
+  test_misprediction(router);
+  test_threads(router);
+  mem_router_deinit(router);
+
+  config.epoch_bytes = 0;
+  CHECK(mem_router_init(&config) == NULL);
+  mem_router_free(NULL, NULL, 0);
+  return 0;
+}
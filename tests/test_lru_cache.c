@@ -0,0 +1,127 @@
+#define POOL_IMPL
+#define LRU_CACHE_IMPL
+#include "lru_cache.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+#define CAPACITY 64
+#define KEYS 200
+#define OPS 200000
+
+static uint64_t seed = 88172645463325252ull;
+
+static uint64_t next_rand(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+// Reference model of the exact policy, order[0] is the most recently used
+static uint64_t order[CAPACITY];
+static size_t n_order;
+
+static size_t order_find(uint64_t key) {
+  size_t i = 0;
+  while (i < n_order && order[i] != key) {
+    i++;
+  }
+  return i;
+}
+
+static void order_use(uint64_t key, size_t at) {
+  if (at == n_order && n_order < CAPACITY) {
+    n_order++;
+  } else if (at == n_order) {
+    at = n_order - 1; // The least recently used key goes away
+  }
+  memmove(order + 1, order, at * sizeof(uint64_t));
+  order[0] = key;
+}
+
+static void test_exact_matches_model(void) {
+  MemLruCache *cache = mem_lru_init(CAPACITY, 3 * sizeof(uint64_t),
+                                    MEM_LRU_EXACT);
+  CHECK(cache != NULL);
+  for (size_t op = 0; op < OPS; ++op) {
+    uint64_t key = next_rand() % KEYS;
+    unsigned kind = (unsigned)(next_rand() % 10);
+    size_t at = order_find(key);
+    if (kind < 5) {
+      uint64_t *value = mem_lru_get(cache, key);
+      CHECK((value != NULL) == (at < n_order));
+      if (value != NULL) {
+        CHECK(value[0] == key * 3 && value[2] == key);
+        order_use(key, at);
+      }
+    } else if (kind < 9) {
+      uint64_t value[3] = {key * 3, key, key};
+      CHECK(mem_lru_put(cache, key, value) != NULL);
+      order_use(key, at);
+    } else {
+      CHECK(mem_lru_remove(cache, key) == (at < n_order));
+      if (at < n_order) {
+        memmove(order + at, order + at + 1,
+                (n_order - at - 1) * sizeof(uint64_t));
+        n_order--;
+      }
+    }
+    CHECK(mem_lru_size(cache) == n_order);
+  }
+  mem_lru_deinit(cache);
+}
+
+static void test_chunks_are_recycled(void) {
+  MemLruCache *cache = mem_lru_init(4, sizeof(uint64_t), MEM_LRU_EXACT);
+  uint64_t *values[4];
+  for (uint64_t key = 0; key < 4; ++key) {
+    values[key] = mem_lru_put(cache, key, &key);
+  }
+  mem_lru_get(cache, 0);
+  // Key 1 is the least recently used, the new key takes its chunk
+  uint64_t key = 10;
+  CHECK(mem_lru_put(cache, key, &key) == values[1]);
+  CHECK(mem_lru_get(cache, 1) == NULL && *values[1] == 10);
+  // Filled in place
+  uint64_t *value = mem_lru_put(cache, 11, NULL);
+  *value = 11;
+  CHECK(mem_lru_get(cache, 11) == value && value == values[2]);
+  CHECK(cache->pool->n_chunks == 4 && mem_lru_size(cache) == 4);
+  mem_lru_deinit(cache);
+}
+
+static void test_clock(void) {
+  MemLruCache *cache = mem_lru_init(CAPACITY, sizeof(uint64_t),
+                                    MEM_LRU_CLOCK);
+  CHECK(cache != NULL);
+  // A third of the lookups go to 8 hot keys, the CLOCK keeps them
+  for (size_t op = 0; op < OPS; ++op) {
+    uint64_t key = next_rand() % 3 == 0 ? next_rand() % 8 : next_rand() % 100;
+    uint64_t *value = mem_lru_get(cache, key);
+    if (value != NULL) {
+      CHECK(*value == key);
+    } else {
+      mem_lru_put(cache, key, &key);
+    }
+    if (op % 1000 == 0) {
+      mem_lru_remove(cache, 8 + next_rand() % 92);
+    }
+    CHECK(mem_lru_size(cache) <= CAPACITY);
+  }
+  for (uint64_t key = 0; key < 8; ++key) {
+    CHECK(mem_lru_get(cache, key) != NULL);
+  }
+  mem_lru_deinit(cache);
+
+  CHECK(mem_lru_get(NULL, 1) == NULL && mem_lru_put(NULL, 1, NULL) == NULL);
+}
+
+int main(void) {
+  test_exact_matches_model();
+  test_chunks_are_recycled();
+  test_clock();
+  return 0;
+}
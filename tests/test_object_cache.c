@@ -0,0 +1,117 @@
+#define MEM_USE_PAGE_HEAP
+#define PAGE_HEAP_IMPL
+#define PAGEMAP_IMPL
+#define POOL_IMPL
+#define OBJECT_CACHE_IMPL
+#include "object_cache.h"
+
+#include <pthread.h>
+
+#include "test.h"
+
+typedef struct {
+  pthread_mutex_t lock;
+  int value;
+} Object;
+
+static size_t constructed, destroyed;
+static size_t fail_after = SIZE_MAX;
+
+static int object_ctor(void *object, void *ctx) {
+  (void)ctx;
+  if (constructed == fail_after) {
+    return 0;
+  }
+  constructed++;
+  ((Object *)object)->value = 0;
+  return pthread_mutex_init(&((Object *)object)->lock, NULL) == 0;
+}
+
+static void object_dtor(void *object, void *ctx) {
+  (void)ctx;
+  destroyed++;
+  pthread_mutex_destroy(&((Object *)object)->lock);
+}
+
+static void test_objects_stay_constructed(void) {
+  constructed = destroyed = 0;
+  MemObjectCache *cache =
+      mem_object_cache_init(sizeof(Object), 16, object_ctor, object_dtor, NULL);
+  CHECK(cache != NULL);
+  Object *objects[40];
+  for (int i = 0; i < 40; ++i) {
+    objects[i] = mem_object_cache_alloc(cache);
+    CHECK(objects[i] != NULL && (uintptr_t)objects[i] % 16 == 0);
+    CHECK(pthread_mutex_lock(&objects[i]->lock) == 0);
+    objects[i]->value = i;
+    pthread_mutex_unlock(&objects[i]->lock);
+  }
+  CHECK(constructed == 48); // Three slabs of 16
+  for (int i = 0; i < 40; ++i) {
+    mem_object_cache_free(cache, objects[i]);
+  }
+  for (int i = 0; i < 40; ++i) {
+    objects[i] = mem_object_cache_alloc(cache);
+    CHECK(objects[i] != NULL);
+  }
+  CHECK(constructed == 48 && destroyed == 0);
+  mem_object_cache_deinit(cache);
+  CHECK(destroyed == 48);
+}
+
+static void test_reap_keeps_slabs_in_use(void) {
+  constructed = destroyed = 0;
+  MemObjectCache *cache =
+      mem_object_cache_init(sizeof(Object), 8, object_ctor, object_dtor, NULL);
+  Object *objects[24];
+  for (int i = 0; i < 24; ++i) {
+    objects[i] = mem_object_cache_alloc(cache);
+  }
+  // Empties the first slab, leaves one object in use in each of the others
+  for (int i = 0; i < 24; ++i) {
+    if (i >= 8 && i % 8 == 0) {
+      continue;
+    }
+    mem_object_cache_free(cache, objects[i]);
+  }
+  // Freeing twice, freeing a pointer inside an object or a foreign pointer
+  // must not empty a slab
+  mem_object_cache_free(cache, objects[1]);
+  mem_object_cache_free(cache, objects[1]);
+  mem_object_cache_free(cache, (uint8_t *)objects[8] + 1);
+  Object foreign;
+  mem_object_cache_free(cache, &foreign);
+  CHECK(mem_object_cache_reap(cache) == 1);
+  CHECK(destroyed == 8);
+  CHECK(pthread_mutex_lock(&objects[8]->lock) == 0);
+  pthread_mutex_unlock(&objects[8]->lock);
+  CHECK(pthread_mutex_lock(&objects[16]->lock) == 0);
+  pthread_mutex_unlock(&objects[16]->lock);
+  mem_object_cache_free(cache, objects[8]);
+  mem_object_cache_free(cache, objects[16]);
+  CHECK(mem_object_cache_reap(cache) == 2);
+  CHECK(destroyed == 24);
+  mem_object_cache_deinit(cache);
+}
+
+static void test_failed_constructor(void) {
+  constructed = destroyed = 0;
+  fail_after = 5;
+  MemObjectCache *cache =
+      mem_object_cache_init(sizeof(Object), 8, object_ctor, object_dtor, NULL);
+  CHECK(mem_object_cache_alloc(cache) == NULL);
+  // The objects built before the failure are destroyed with the slab
+  CHECK(constructed == 5 && destroyed == 5);
+  fail_after = SIZE_MAX;
+  CHECK(mem_object_cache_alloc(cache) != NULL);
+  mem_object_cache_deinit(cache);
+}
+
+int main(void) {
+  test_objects_stay_constructed();
+  test_reap_keeps_slabs_in_use();
+  test_failed_constructor();
+  CHECK(mem_object_cache_init(0, 8, NULL, NULL, NULL) == NULL);
+  CHECK(mem_object_cache_alloc(NULL) == NULL);
+  return 0;
+}
@@ -0,0 +1,73 @@
+#define MEM_USE_PAGE_HEAP
+#define PAGE_HEAP_IMPL
+#define PAGEMAP_IMPL
+#define POOL_IMPL
+#define ARENA_IMPL
+#include "arena_allocator.h"
+#include "page_heap.h"
+#include "pool_allocator.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+static void test_spans(void) {
+  uint8_t *a = mem_page_heap_alloc(1);
+  uint8_t *b = mem_page_heap_alloc(3);
+  uint8_t *c = mem_page_heap_alloc(200);
+  CHECK(a != NULL && b != NULL && c != NULL);
+  CHECK((uintptr_t)a % MEM_PAGE_SIZE == 0);
+  CHECK((uintptr_t)b % MEM_PAGE_SIZE == 0);
+  memset(c, 0xAB, 200 * MEM_PAGE_SIZE);
+
+  // Any pointer inside a span finds it
+  MemSpan *span = mem_page_heap_lookup(b + MEM_PAGE_SIZE + 17);
+  CHECK(span != NULL && span->start == b && span->n_pages == 3);
+  mem_page_heap_free(b);
+  CHECK(mem_page_heap_lookup(b) == NULL);
+
+  // a and b coalesce, a span of their combined size comes back at a
+  mem_page_heap_free(a);
+  uint8_t *d = mem_page_heap_alloc(4);
+  CHECK(d == a);
+  mem_page_heap_free(d);
+  mem_page_heap_free(c);
+}
+
+static void test_calloc_after_trim(void) {
+  uint8_t *a = mem_page_heap_alloc(8);
+  CHECK(a != NULL);
+  memset(a, 0xFF, 8 * MEM_PAGE_SIZE);
+  mem_page_heap_free(a);
+  mem_page_heap_trim();
+  uint8_t *b = mem_page_heap_calloc(8);
+  CHECK(b != NULL);
+  for (size_t i = 0; i < 8 * MEM_PAGE_SIZE; ++i) {
+    CHECK(b[i] == 0);
+  }
+  mem_page_heap_free(b);
+}
+
+static void test_backing(void) {
+  MemPool *pool = mem_pool_init(64, 1000);
+  CHECK(pool != NULL);
+  CHECK(mem_page_heap_lookup(pool->data) != NULL);
+  void *chunk = mem_pool_alloc(pool);
+  CHECK(chunk != NULL);
+  mem_pool_free(pool, chunk);
+  mem_pool_deinit(pool);
+
+  MemArena *arena = mem_arena_init(100000);
+  CHECK(arena != NULL);
+  uint8_t *bytes = mem_arena_alloc(arena, 10);
+  CHECK(bytes != NULL && mem_page_heap_lookup(bytes) != NULL);
+  mem_arena_deinit(arena);
+}
+
+int main(void) {
+  test_spans();
+  test_calloc_after_trim();
+  test_backing();
+  return 0;
+}
@@ -0,0 +1,83 @@
+#define MEM_USE_PAGE_HEAP
+#define PAGE_HEAP_IMPL
+#define PAGEMAP_IMPL
+#define POOL_IMPL
+#define ARENA_IMPL
+#include "arena_allocator.h"
+#include "pagemap.h"
+#include "pool_allocator.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "test.h"
+
+static MemPagemap map;
+
+static void test_get_set(void) {
+  static _Alignas(4096) uint8_t region[16 * 4096];
+  CHECK(mem_pagemap_get(&map, region) == NULL);
+  CHECK(mem_pagemap_set(&map, region + 4096, 3 * 4096, (void *)0x1234));
+  CHECK(mem_pagemap_get(&map, region + 4096) == (void *)0x1234);
+  CHECK(mem_pagemap_get(&map, region + 4 * 4096 - 1) == (void *)0x1234);
+  CHECK(mem_pagemap_get(&map, region + 4 * 4096) == NULL);
+  CHECK(mem_pagemap_set(&map, region + 4096, 3 * 4096, NULL));
+  CHECK(mem_pagemap_get(&map, region + 2 * 4096) == NULL);
+}
+
+static void test_owners(void) {
+  int kind;
+  MemPool *pool = mem_pool_init(64, 1000);
+  CHECK(pool != NULL);
+  uint8_t *chunk = mem_pool_alloc(pool);
+  CHECK(mem_owner_get(chunk + 3, &kind) == pool && kind == MEM_OWNER_POOL);
+  // Dispatches to the pool, the chunk is the next one handed out again
+  mem_free(chunk);
+  CHECK(mem_pool_alloc(pool) == chunk);
+  mem_pool_deinit(pool);
+  CHECK(mem_owner_get(chunk, &kind) == NULL);
+
+  MemArena *arena = mem_arena_init(100000);
+  uint8_t *bytes = mem_arena_alloc(arena, 10);
+  CHECK(mem_owner_get(bytes, &kind) == arena && kind == MEM_OWNER_ARENA);
+  mem_free(bytes); // Ignored, arena memory goes away with the arena
+  mem_arena_deinit(arena);
+
+  void *span = mem_page_heap_alloc(2);
+  CHECK(mem_owner_get(span, &kind) != NULL && kind == MEM_OWNER_SPAN);
+  mem_free(span);
+  CHECK(mem_page_heap_lookup(span) == NULL);
+}
+
+// Writers race to publish tree nodes for pages far apart
+static void *writer(void *arg) {
+  uintptr_t base = (uintptr_t)arg;
+  for (uintptr_t i = 0; i < 1000; ++i) {
+    uintptr_t addr = base + (i << 30);
+    CHECK(mem_pagemap_set(&map, (void *)addr, 1, (void *)(addr | 1)));
+  }
+  return NULL;
+}
+
+static void test_concurrent_writers(void) {
+  pthread_t threads[4];
+  for (uintptr_t i = 0; i < 4; ++i) {
+    pthread_create(&threads[i], NULL, writer, (void *)((i + 1) << 20));
+  }
+  for (int i = 0; i < 4; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  for (uintptr_t t = 0; t < 4; ++t) {
+    for (uintptr_t i = 0; i < 1000; ++i) {
+      uintptr_t addr = ((t + 1) << 20) + (i << 30);
+      CHECK(mem_pagemap_get(&map, (void *)addr) == (void *)(addr | 1));
+    }
+  }
+}
+
+int main(void) {
+  test_get_set();
+  test_owners();
+  test_concurrent_writers();
+  return 0;
+}
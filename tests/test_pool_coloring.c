@@ -0,0 +1,78 @@
+#define MEM_USE_PAGE_HEAP
+#define PAGE_HEAP_IMPL
+#define PAGEMAP_IMPL
+#define POOL_IMPL
+#include "pool_allocator.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "test.h"
+
+#define THREADS 4
+#define POOLS_PER_THREAD 64
+
+// Page heap spans are page aligned, so the color is the page offset
+static size_t color_of(const MemPool *pool) {
+  return (uintptr_t)pool->data % MEM_PAGE_SIZE;
+}
+
+static void test_colors_rotate(void) {
+  MemPool *pools[2 * MEM_POOL_COLORS];
+  size_t seen[MEM_POOL_COLORS] = {0};
+  for (size_t i = 0; i < 2 * MEM_POOL_COLORS; ++i) {
+    pools[i] = mem_pool_init(4096, 4);
+    CHECK(pools[i] != NULL);
+    CHECK(color_of(pools[i]) % MEM_POOL_CACHE_LINE == 0);
+    CHECK(color_of(pools[i]) < MEM_POOL_COLORS * MEM_POOL_CACHE_LINE);
+    seen[color_of(pools[i]) / MEM_POOL_CACHE_LINE]++;
+    // The chunks still fit in the memory of the pool
+    uint8_t *last = mem_pool_alloc(pools[i]);
+    for (int c = 0; c < 3; ++c) {
+      last = mem_pool_alloc(pools[i]);
+    }
+    last[4095] = 1;
+  }
+  // Consecutive pools walk through every color, twice
+  for (size_t c = 0; c < MEM_POOL_COLORS; ++c) {
+    CHECK(seen[c] == 2);
+  }
+  for (size_t i = 0; i < 2 * MEM_POOL_COLORS; ++i) {
+    mem_pool_deinit(pools[i]);
+  }
+}
+
+static void *create_pools(void *arg) {
+  size_t *seen = arg;
+  for (int i = 0; i < POOLS_PER_THREAD; ++i) {
+    MemPool *pool = mem_pool_init(64, 16);
+    seen[color_of(pool) / MEM_POOL_CACHE_LINE]++;
+    mem_pool_deinit(pool);
+  }
+  return NULL;
+}
+
+// Pools created concurrently still take every color in turn
+static void test_concurrent_init(void) {
+  pthread_t threads[THREADS];
+  size_t seen[THREADS][MEM_POOL_COLORS] = {{0}};
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_create(&threads[i], NULL, create_pools, seen[i]);
+  }
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  for (size_t c = 0; c < MEM_POOL_COLORS; ++c) {
+    size_t total = 0;
+    for (int i = 0; i < THREADS; ++i) {
+      total += seen[i][c];
+    }
+    CHECK(total == THREADS * POOLS_PER_THREAD / MEM_POOL_COLORS);
+  }
+}
+
+int main(void) {
+  test_colors_rotate();
+  test_concurrent_init();
+  return 0;
+}
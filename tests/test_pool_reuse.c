@@ -0,0 +1,138 @@
+#define POOL_IMPL
+#include "pool_allocator.h"
+
+#include <string.h>
+
+#include "test.h"
+
+#define CHUNKS 16
+
+// Fills the pool, frees the chunks of order in that order and returns the
+// indices the next allocations hand out
+static void reuse_order(int flags, const size_t *order, size_t n,
+                        size_t *reused) {
+  MemPool *pool = mem_pool_init_ex(32, CHUNKS, flags);
+  CHECK(pool != NULL);
+  uint8_t *chunks[CHUNKS];
+  for (size_t i = 0; i < CHUNKS; ++i) {
+    chunks[i] = mem_pool_alloc(pool);
+    CHECK(chunks[i] != NULL);
+  }
+  CHECK(mem_pool_alloc(pool) == NULL);
+  for (size_t i = 0; i < n; ++i) {
+    mem_pool_free(pool, chunks[order[i]]);
+  }
+  mem_pool_free(pool, chunks[order[0]]); // Double frees are ignored
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t *chunk = mem_pool_alloc(pool);
+    CHECK(chunk != NULL);
+    reused[i] = (size_t)(chunk - chunks[0]) / 32;
+  }
+  CHECK(mem_pool_alloc(pool) == NULL);
+  mem_pool_deinit(pool);
+}
+
+static void test_policies(void) {
+  const size_t order[] = {9, 2, 14, 5};
+  size_t reused[4];
+
+  reuse_order(MEM_POOL_REUSE_LOWEST, order, 4, reused);
+  CHECK(reused[0] == 2 && reused[1] == 5 && reused[2] == 9 && reused[3] == 14);
+
+  reuse_order(MEM_POOL_REUSE_LIFO, order, 4, reused);
+  CHECK(reused[0] == 5 && reused[1] == 14 && reused[2] == 2 && reused[3] == 9);
+
+  reuse_order(MEM_POOL_REUSE_FIFO, order, 4, reused);
+  CHECK(reused[0] == 9 && reused[1] == 2 && reused[2] == 14 && reused[3] == 5);
+}
+
+// FIFO keeps a freed chunk out of circulation until every other free chunk
+// has been handed out
+static void test_fifo_delay(void) {
+  MemPool *pool = mem_pool_init_ex(32, CHUNKS, MEM_POOL_REUSE_FIFO);
+  uint8_t *first = mem_pool_alloc(pool);
+  mem_pool_free(pool, first);
+  for (size_t i = 0; i < CHUNKS - 1; ++i) {
+    CHECK(mem_pool_alloc(pool) != first);
+  }
+  CHECK(mem_pool_alloc(pool) == first);
+  mem_pool_deinit(pool);
+}
+
+// The queue of free indices wraps around without losing chunks
+static void test_churn(int flags) {
+  MemPool *pool = mem_pool_init_ex(16, CHUNKS, flags);
+  uint8_t *live[CHUNKS] = {0};
+  uint64_t seed = 12345;
+  for (int i = 0; i < 100000; ++i) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    size_t slot = (seed >> 33) % CHUNKS;
+    if (live[slot] != NULL) {
+      CHECK(*(size_t *)live[slot] == slot);
+      mem_pool_free(pool, live[slot]);
+      CHECK(!mem_pool_is_allocated(pool, live[slot]));
+      live[slot] = NULL;
+    } else {
+      live[slot] = mem_pool_alloc(pool);
+      CHECK(live[slot] != NULL && mem_pool_owns(pool, live[slot]));
+      // Pointers inside a chunk aren't chunks
+      CHECK(mem_pool_is_allocated(pool, live[slot]) &&
+            !mem_pool_is_allocated(pool, live[slot] + 1));
+      *(size_t *)live[slot] = slot;
+    }
+  }
+  mem_pool_deinit(pool);
+}
+
+// The lowest address policy really hands out the lowest free chunk, across
+// the summaries of full regions it keeps
+static void test_lowest(size_t n_chunks) {
+  MemPool *pool = mem_pool_init(8, n_chunks);
+  uint8_t *used = calloc(n_chunks, 1);
+  uint8_t *first = mem_pool_alloc(pool);
+  mem_pool_free(pool, first);
+  uint64_t seed = 42;
+  size_t in_use = 0, lowest = 0;
+  for (int i = 0; i < 200000; ++i) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    size_t r = (size_t)(seed >> 20);
+    // Mostly allocations until the pool is half full, then churn
+    if (in_use < n_chunks && (r % 4 != 0 || in_use < n_chunks / 2)) {
+      uint8_t *chunk = mem_pool_alloc(pool);
+      CHECK(chunk == first + lowest * 8);
+      used[lowest] = 1;
+      in_use++;
+      uint8_t *next = memchr(used + lowest, 0, n_chunks - lowest);
+      lowest = next != NULL ? (size_t)(next - used) : n_chunks;
+    } else if (in_use > 0) {
+      size_t index = r % n_chunks;
+      while (!used[index]) {
+        index = (index + 1) % n_chunks;
+      }
+      mem_pool_free(pool, first + index * 8);
+      used[index] = 0;
+      in_use--;
+      lowest = index < lowest ? index : lowest;
+    }
+    if (in_use == n_chunks) {
+      CHECK(mem_pool_alloc(pool) == NULL);
+    }
+  }
+  free(used);
+  mem_pool_deinit(pool);
+}
+
+int main(void) {
+  test_lowest(1);
+  test_lowest(100);
+  test_lowest(512);
+  test_lowest(40000);
+  test_lowest(32768 * 2 + 13);
+  test_policies();
+  test_fifo_delay();
+  test_churn(MEM_POOL_REUSE_LOWEST);
+  test_churn(MEM_POOL_REUSE_LIFO);
+  test_churn(MEM_POOL_REUSE_FIFO);
+  CHECK(mem_pool_init_ex(32, 16, MEM_POOL_REUSE_MASK) == NULL);
+  return 0;
+}
@@ -0,0 +1,140 @@
+#define POOL_IMPL
+#include "pool_allocator.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "test.h"
+
+#define CHUNKS 64
+#define SWAPS 200000
+#define READERS 2
+
+// Two copies of the same value, a torn read sees them differ
+typedef struct {
+  _Atomic uint64_t a;
+  _Atomic uint64_t b;
+} Node;
+
+static MemPool *pool;
+static Node *_Atomic current;
+static _Atomic int stop;
+static _Atomic uint64_t validated;
+
+static void node_set(Node *node, uint64_t value) {
+  atomic_store_explicit(&node->a, value, memory_order_relaxed);
+  atomic_store_explicit(&node->b, value, memory_order_relaxed);
+}
+
+static void test_versions(void) {
+  MemPool *stable = mem_pool_init_ex(sizeof(Node), 4, MEM_POOL_TYPE_STABLE);
+  CHECK(stable != NULL);
+  // Unpublished after alloc, published by write_end
+  Node *node = mem_pool_alloc(stable);
+  uint64_t version = mem_pool_read_begin(stable, node);
+  CHECK(version & 1);
+  CHECK(!mem_pool_read_validate(stable, node, version));
+  node_set(node, 1);
+  mem_pool_write_end(stable, node);
+  version = mem_pool_read_begin(stable, node);
+  CHECK(mem_pool_read_validate(stable, node, version));
+
+  // In place updates and frees fail the reads that started before them
+  mem_pool_write_begin(stable, node);
+  CHECK(!mem_pool_read_validate(stable, node, version));
+  CHECK(!mem_pool_read_validate(stable, node,
+                                mem_pool_read_begin(stable, node)));
+  mem_pool_write_end(stable, node);
+  version = mem_pool_read_begin(stable, node);
+  mem_pool_free(stable, node);
+  CHECK(!mem_pool_read_validate(stable, node, version));
+  // Freeing twice doesn't publish the chunk again
+  mem_pool_free(stable, node);
+  CHECK(mem_pool_read_begin(stable, node) & 1);
+  mem_pool_deinit(stable);
+}
+
+static void test_memory_is_parked(void) {
+  MemPool *stable = mem_pool_init_ex(sizeof(Node), 32, MEM_POOL_TYPE_STABLE);
+  CHECK(stable != NULL);
+  Node *node = mem_pool_alloc(stable);
+  node_set(node, 7);
+  mem_pool_write_end(stable, node);
+  uint64_t version = mem_pool_read_begin(stable, node);
+  uint8_t *data = stable->data;
+  mem_pool_deinit(stable);
+  // Still mapped and still a node
+  CHECK(atomic_load(&node->a) == 7);
+
+  // The next pool with the same geometry gets the same memory back, the
+  // other ones don't
+  MemPool *same = mem_pool_init_ex(sizeof(Node), 32,
+                                   MEM_POOL_TYPE_STABLE | MEM_POOL_REUSE_FIFO);
+  MemPool *other = mem_pool_init_ex(sizeof(Node), 32, MEM_POOL_TYPE_STABLE);
+  MemPool *plain = mem_pool_init(sizeof(Node), 32);
+  CHECK(same != NULL && other != NULL && plain != NULL);
+  CHECK(same->data == data && other->data != data && plain->data != data);
+  // Along with the versions, so a read of the old pool can't validate
+  CHECK(mem_pool_read_begin(same, node) == version + 1);
+  mem_pool_deinit(plain);
+  mem_pool_deinit(other);
+  mem_pool_deinit(same);
+}
+
+// Reads the current node without locks, the copies must match whenever the
+// read validates
+static void *reader(void *arg) {
+  (void)arg;
+  while (!atomic_load(&stop)) {
+    Node *node = atomic_load(&current);
+    uint64_t version = mem_pool_read_begin(pool, node);
+    uint64_t a = atomic_load_explicit(&node->a, memory_order_relaxed);
+    uint64_t b = atomic_load_explicit(&node->b, memory_order_relaxed);
+    if (mem_pool_read_validate(pool, node, version)) {
+      CHECK(a == b);
+      atomic_fetch_add(&validated, 1);
+    }
+  }
+  return NULL;
+}
+
+static void test_racing_readers(void) {
+  pool = mem_pool_init_ex(sizeof(Node), CHUNKS,
+                          MEM_POOL_REUSE_FIFO | MEM_POOL_TYPE_STABLE);
+  CHECK(pool != NULL);
+  Node *node = mem_pool_alloc(pool);
+  node_set(node, 0);
+  mem_pool_write_end(pool, node);
+  atomic_store(&current, node);
+  pthread_t threads[READERS];
+  for (int i = 0; i < READERS; ++i) {
+    pthread_create(&threads[i], NULL, reader, NULL);
+  }
+  // Swaps the current node and frees the old one under the readers, and
+  // sometimes updates the new one in place
+  for (uint64_t i = 1; i < SWAPS; ++i) {
+    Node *fresh = mem_pool_alloc(pool);
+    CHECK(fresh != NULL);
+    node_set(fresh, i);
+    mem_pool_write_end(pool, fresh);
+    mem_pool_free(pool, atomic_exchange(&current, fresh));
+    if (i % 7 == 0) {
+      mem_pool_write_begin(pool, fresh);
+      node_set(fresh, i + SWAPS);
+      mem_pool_write_end(pool, fresh);
+    }
+  }
+  atomic_store(&stop, 1);
+  for (int i = 0; i < READERS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  CHECK(atomic_load(&validated) > 0);
+  mem_pool_deinit(pool);
+}
+
+int main(void) {
+  test_versions();
+  test_memory_is_parked();
+  test_racing_readers();
+  return 0;
+}
@@ -0,0 +1,140 @@
+#define POOL_IMPL
+#define RECLAIM_IMPL
+#include "pool_allocator.h"
+#include "reclaim.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test.h"
+
+typedef struct {
+  pthread_mutex_t lock;
+  atomic_int trims;
+} Instance;
+
+static size_t count_trim(void *instance) {
+  atomic_fetch_add(&((Instance *)instance)->trims, 1);
+  return 1;
+}
+
+static void write_file(const char *path, const char *text) {
+  FILE *file = fopen(path, "w");
+  CHECK(file != NULL);
+  fputs(text, file);
+  fclose(file);
+}
+
+// Waits up to a second for the background thread to trim the instance
+static int wait_trims(Instance *instance) {
+  for (int i = 0; i < 100 && atomic_load(&instance->trims) == 0; ++i) {
+    usleep(10000);
+  }
+  return atomic_load(&instance->trims) > 0;
+}
+
+static void test_pool_trim(void) {
+  MemPool *pool = mem_pool_init(4096, 64);
+  CHECK(pool != NULL);
+  void *chunks[64];
+  for (int i = 0; i < 64; ++i) {
+    chunks[i] = mem_pool_alloc(pool);
+    memset(chunks[i], 0xAB, 4096);
+  }
+  CHECK(mem_reclaim_register_pool(pool, NULL));
+  CHECK(mem_reclaim_trigger() == 0); // Everything is in use
+  for (int i = 0; i < 64; ++i) {
+    mem_pool_free(pool, chunks[i]);
+  }
+  CHECK(mem_reclaim_trigger() >= 60 * 4096);
+  // The pool keeps working on the pages given back
+  unsigned char *chunk = mem_pool_alloc(pool);
+  CHECK(chunk != NULL);
+  memset(chunk, 1, 4096);
+  mem_reclaim_unregister(pool);
+  CHECK(mem_reclaim_trigger() == 0);
+  mem_pool_deinit(pool);
+}
+
+static void test_pressure_sources(void) {
+  char psi_path[] = "/tmp/reclaim_psiXXXXXX";
+  char events_path[] = "/tmp/reclaim_eventsXXXXXX";
+  close(mkstemp(psi_path));
+  close(mkstemp(events_path));
+  write_file(psi_path, "some avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+  write_file(events_path, "low 0\nhigh 2\nmax 0\noom 0\n");
+
+  Instance instance = {.trims = 0};
+  pthread_mutex_init(&instance.lock, NULL);
+  CHECK(mem_reclaim_register(&instance, count_trim, &instance.lock));
+  MemReclaimConfig config = {.interval_ms = 5,
+                             .psi_threshold = 10,
+                             .psi_path = psi_path,
+                             .events_path = events_path};
+  CHECK(mem_reclaim_start(&config));
+  CHECK(!mem_reclaim_start(&config)); // Already running
+  usleep(50000);
+  CHECK(atomic_load(&instance.trims) == 0); // Old events don't count
+
+  write_file(events_path, "low 0\nhigh 3\nmax 0\noom 0\n");
+  CHECK(wait_trims(&instance));
+  mem_reclaim_stop();
+
+  atomic_store(&instance.trims, 0);
+  write_file(psi_path, "some avg10=25.00 avg60=5.00 avg300=1.00 total=9\n");
+  CHECK(mem_reclaim_start(&config));
+  CHECK(wait_trims(&instance));
+  mem_reclaim_stop();
+
+  atomic_store(&instance.trims, 0);
+  config.psi_threshold = 0;
+  config.rss_limit = 1; // Any process is over it
+  CHECK(mem_reclaim_start(&config));
+  CHECK(wait_trims(&instance));
+  mem_reclaim_stop();
+
+  mem_reclaim_unregister(&instance);
+  pthread_mutex_destroy(&instance.lock);
+  unlink(psi_path);
+  unlink(events_path);
+}
+
+static atomic_int stop_triggering;
+
+static void *trigger_loop(void *arg) {
+  (void)arg;
+  while (!atomic_load(&stop_triggering)) {
+    mem_reclaim_trigger();
+  }
+  return NULL;
+}
+
+// Instances come and go, unregistered with their mutex held, while passes run
+static void test_unregister_during_trim(void) {
+  pthread_t thread;
+  pthread_create(&thread, NULL, trigger_loop, NULL);
+  for (int i = 0; i < 5000; ++i) {
+    Instance *instance = malloc(sizeof(Instance));
+    CHECK(instance != NULL);
+    pthread_mutex_init(&instance->lock, NULL);
+    atomic_init(&instance->trims, 0);
+    CHECK(mem_reclaim_register(instance, count_trim, &instance->lock));
+    pthread_mutex_lock(&instance->lock);
+    mem_reclaim_unregister(instance);
+    pthread_mutex_unlock(&instance->lock);
+    pthread_mutex_destroy(&instance->lock);
+    free(instance);
+  }
+  atomic_store(&stop_triggering, 1);
+  pthread_join(thread, NULL);
+}
+
+int main(void) {
+  test_pool_trim();
+  test_pressure_sources();
+  test_unregister_during_trim();
+  CHECK(mem_reclaim_trigger() == 0);
+  return 0;
+}
@@ -0,0 +1,145 @@
+#define POOL_IMPL
+#define SIZE_CLASS_ALLOC_IMPL
+#define SIZE_HISTOGRAM_IMPL
+#include "pool_allocator.h"
+#include "size_class_allocator.h"
+#include "size_histogram.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "test.h"
+
+// Runs the generator and keeps the header it writes
+static size_t generate(MemSizeHist *hist, size_t n_classes, char *header,
+                       size_t header_size) {
+  FILE *out = fmemopen(header, header_size, "w");
+  CHECK(out != NULL);
+  size_t n = mem_size_hist_generate(hist, n_classes, 8, out);
+  fclose(out);
+  return n;
+}
+
+static void record_workload(MemSizeHist *hist) {
+  for (int i = 0; i < 100; ++i) {
+    mem_size_hist_record(hist, 20);
+    mem_size_hist_record(hist, 40);
+  }
+  for (int i = 0; i < 10; ++i) {
+    mem_size_hist_record(hist, 100);
+  }
+  for (int i = 0; i < 3; ++i) {
+    mem_size_hist_record(hist, 5000);
+  }
+}
+
+static void test_generate(void) {
+  MemSizeHist *hist = mem_size_hist_init();
+  CHECK(hist != NULL);
+  record_workload(hist);
+  char header[1024];
+  /*
+   * The sizes are 24 (20 aligned), 40, 104 and 5120 (the top of the bucket of
+   * 5000). Dropping 24 wastes 16 bytes on 100 allocations, less than
+   * dropping 40 (64 * 100) or 104 (5016 * 10).
+   */
+  CHECK(generate(hist, 3, header, sizeof(header)) == 3);
+  CHECK(strstr(header, "#define MEM_SIZE_CLASS_COUNT 3") != NULL);
+  CHECK(strstr(header, "40, 104, 5120") != NULL);
+  CHECK(strstr(header, "1600 bytes of internal fragmentation") != NULL);
+  // More classes than sizes, every size gets its own
+  CHECK(generate(hist, 10, header, sizeof(header)) == 4);
+  CHECK(strstr(header, "24, 40, 104, 5120") != NULL);
+  CHECK(generate(hist, 0, header, sizeof(header)) == 0);
+  CHECK(mem_size_hist_generate(hist, 3, 12, stdout) == 0);
+
+  // Empty histograms have nothing to generate from
+  MemSizeHist *empty = mem_size_hist_init();
+  CHECK(generate(empty, 3, header, sizeof(header)) == 0);
+  mem_size_hist_deinit(empty);
+  mem_size_hist_deinit(hist);
+}
+
+static void test_save_load(void) {
+  MemSizeHist *hist = mem_size_hist_init();
+  record_workload(hist);
+  FILE *file = tmpfile();
+  CHECK(file != NULL);
+  CHECK(mem_size_hist_save(hist, file));
+  CHECK(mem_size_hist_save(hist, file)); // Loading merges the two runs
+  rewind(file);
+  MemSizeHist *loaded = mem_size_hist_init();
+  CHECK(mem_size_hist_load(loaded, file));
+  fclose(file);
+  for (size_t i = 0; i < MEM_HIST_BUCKETS; ++i) {
+    CHECK(loaded->counts[i] == 2 * hist->counts[i]);
+  }
+  char a[1024], b[1024];
+  generate(hist, 3, a, sizeof(a));
+  generate(loaded, 3, b, sizeof(b));
+  CHECK(strstr(b, "40, 104, 5120") != NULL);
+  CHECK(strcmp(strchr(a, '\n'), strchr(b, '\n')) != 0); // Counts doubled
+
+  file = tmpfile();
+  fputs("12 not a count\n", file);
+  rewind(file);
+  CHECK(!mem_size_hist_load(loaded, file));
+  fclose(file);
+  mem_size_hist_deinit(loaded);
+  mem_size_hist_deinit(hist);
+}
+
+static void *record_many(void *hist) {
+  for (int i = 0; i < 100000; ++i) {
+    mem_size_hist_record(hist, (size_t)i % 300);
+  }
+  return NULL;
+}
+
+static void test_concurrent_record(void) {
+  MemSizeHist *hist = mem_size_hist_init();
+  pthread_t threads[4];
+  for (int i = 0; i < 4; ++i) {
+    pthread_create(&threads[i], NULL, record_many, hist);
+  }
+  for (int i = 0; i < 4; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  uint64_t total = 0;
+  for (size_t i = 0; i < MEM_HIST_BUCKETS; ++i) {
+    total += hist->counts[i];
+  }
+  CHECK(total == 400000);
+  mem_size_hist_deinit(hist);
+}
+
+static void test_size_classes(void) {
+  const size_t classes[] = {40, 104, 5120};
+  MemSizeClassAlloc *alloc = mem_size_class_init(classes, 3, 16);
+  CHECK(alloc != NULL);
+  uint8_t *small = mem_size_class_alloc(alloc, 1);
+  uint8_t *mid = mem_size_class_alloc(alloc, 41);
+  uint8_t *big = mem_size_class_alloc(alloc, 5120);
+  CHECK(small != NULL && mid != NULL && big != NULL);
+  memset(small, 1, 40);
+  memset(mid, 2, 104);
+  memset(big, 3, 5120);
+  CHECK(mem_pool_owns(alloc->pools[0], small));
+  CHECK(mem_pool_owns(alloc->pools[1], mid));
+  CHECK(mem_pool_owns(alloc->pools[2], big));
+  CHECK(mem_size_class_alloc(alloc, 5121) == NULL);
+  mem_size_class_free(alloc, mid, 41);
+  CHECK(mem_size_class_alloc(alloc, 100) == mid);
+  mem_size_class_deinit(alloc);
+
+  const size_t unsorted[] = {64, 32};
+  CHECK(mem_size_class_init(unsorted, 2, 16) == NULL);
+}
+
+int main(void) {
+  test_generate();
+  test_save_load();
+  test_concurrent_record();
+  test_size_classes();
+  return 0;
+}
@@ -0,0 +1,68 @@
+#define SMALL_ALLOC_IMPL
+#include "small_allocator.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+#define BLOCKS 100000
+
+static void *blocks[BLOCKS];
+
+static size_t block_size(size_t i) { return (i % 64) * 16 + 1; }
+
+// Frees the even blocks from another thread, through the thread_free lists
+static void *remote_free(void *arg) {
+  (void)arg;
+  for (size_t i = 0; i < BLOCKS; i += 2) {
+    mem_small_free(blocks[i]);
+  }
+  return NULL;
+}
+
+static void test_blocks_dont_overlap(MemSmallHeap *heap) {
+  for (size_t i = 0; i < BLOCKS; ++i) {
+    blocks[i] = mem_small_alloc(heap, block_size(i));
+    CHECK(blocks[i] != NULL);
+    CHECK((uintptr_t)blocks[i] % MEM_SMALL_GRANULE == 0);
+    memset(blocks[i], (int)(i & 0xFF), block_size(i));
+  }
+  for (size_t i = 0; i < BLOCKS; ++i) {
+    uint8_t *bytes = blocks[i];
+    CHECK(bytes[0] == (i & 0xFF) && bytes[block_size(i) - 1] == (i & 0xFF));
+  }
+}
+
+static void test_remote_frees_are_reused(MemSmallHeap *heap) {
+  for (int round = 0; round < 5; ++round) {
+    test_blocks_dont_overlap(heap);
+    pthread_t thread;
+    pthread_create(&thread, NULL, remote_free, NULL);
+    pthread_join(thread, NULL);
+    for (size_t i = 1; i < BLOCKS; i += 2) {
+      mem_small_free(blocks[i]);
+    }
+  }
+  // Freed blocks are reused, five rounds without reuse would need about five
+  // times the pages of one
+  size_t pages = 0;
+  for (size_t c = 0; c < MEM_SMALL_CLASSES; ++c) {
+    for (MemSmallPage *page = heap->pages[c]; page; page = page->next) {
+      pages++;
+    }
+  }
+  CHECK(pages * MEM_SMALL_PAGE_SIZE < 4 * BLOCKS * 1024 / 2);
+}
+
+int main(void) {
+  MemSmallHeap *heap = mem_small_heap_init();
+  CHECK(heap != NULL);
+  test_remote_frees_are_reused(heap);
+  CHECK(mem_small_alloc(heap, MEM_SMALL_MAX_SIZE) != NULL);
+  CHECK(mem_small_alloc(heap, MEM_SMALL_MAX_SIZE + 1) == NULL);
+  mem_small_free(NULL);
+  mem_small_heap_deinit(heap);
+  return 0;
+}
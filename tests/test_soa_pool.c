@@ -0,0 +1,115 @@
+#define LARGE_ALLOC_IMPL
+#define SOA_POOL_IMPL
+#include "soa_pool.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+
+#define CAPACITY 1000
+
+// Random allocs and frees checked against the values written at alloc time
+static void test_against_reference(void) {
+  size_t fields[3] = {sizeof(float), sizeof(uint32_t), 1};
+  MemSoaPool *pool = mem_soa_pool_init(fields, 3, CAPACITY);
+  CHECK(pool != NULL);
+  for (size_t c = 0; c < 3; ++c) {
+    CHECK((uintptr_t)mem_soa_pool_column(pool, c) % MEM_SOA_ALIGNMENT == 0);
+  }
+  static MemSoaHandle handles[CAPACITY];
+  static MemSoaHandle stale[CAPACITY];
+  size_t live = 0, n_stale = 0;
+  uint64_t seed = 42;
+  for (uint32_t step = 0; step < 100000; ++step) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    if (live < CAPACITY && (seed >> 40) % 3 != 0) {
+      MemSoaHandle handle = mem_soa_pool_alloc(pool);
+      CHECK(handle != MEM_SOA_INVALID_HANDLE);
+      // New objects are zeroed
+      CHECK(*(uint32_t *)mem_soa_pool_get(pool, handle, 1) == 0);
+      *(uint32_t *)mem_soa_pool_get(pool, handle, 1) = step;
+      *(float *)mem_soa_pool_get(pool, handle, 0) = (float)step;
+      handles[live++] = handle;
+    } else if (live > 0) {
+      size_t victim = (seed >> 20) % live;
+      CHECK(mem_soa_pool_free(pool, handles[victim]));
+      if (n_stale < CAPACITY) {
+        stale[n_stale++] = handles[victim];
+      }
+      handles[victim] = handles[--live];
+    }
+    CHECK(mem_soa_pool_size(pool) == live);
+  }
+  CHECK(mem_soa_pool_size(pool) == live);
+  // Every live handle still reaches its own values, wherever they moved
+  for (size_t i = 0; i < live; ++i) {
+    uint32_t tag = *(uint32_t *)mem_soa_pool_get(pool, handles[i], 1);
+    CHECK(*(float *)mem_soa_pool_get(pool, handles[i], 0) == (float)tag);
+  }
+  // The columns are dense: the handle of every index is a live one
+  for (size_t i = 0; i < live; ++i) {
+    MemSoaHandle handle = mem_soa_pool_handle(pool, i);
+    CHECK(mem_soa_pool_get(pool, handle, 1) ==
+          (uint32_t *)mem_soa_pool_column(pool, 1) + i);
+  }
+  for (size_t i = 0; i < n_stale; ++i) {
+    CHECK(mem_soa_pool_get(pool, stale[i], 0) == NULL);
+    CHECK(!mem_soa_pool_free(pool, stale[i]));
+  }
+  mem_soa_pool_deinit(pool);
+}
+
+static void test_full(void) {
+  size_t fields[1] = {8};
+  MemSoaPool *pool = mem_soa_pool_init(fields, 1, 4);
+  for (int i = 0; i < 4; ++i) {
+    CHECK(mem_soa_pool_alloc(pool) != MEM_SOA_INVALID_HANDLE);
+  }
+  CHECK(mem_soa_pool_alloc(pool) == MEM_SOA_INVALID_HANDLE);
+  CHECK(mem_soa_pool_get(pool, MEM_SOA_INVALID_HANDLE, 0) == NULL);
+  mem_soa_pool_deinit(pool);
+}
+
+// Grown by doubling whenever it's full, the handles keep working
+static void test_grow(void) {
+  size_t fields[2] = {sizeof(uint64_t), sizeof(uint32_t)};
+  MemSoaPool *pool = mem_soa_pool_init(fields, 2, 16);
+  static MemSoaHandle handles[100000];
+  size_t capacity = 16;
+  for (uint32_t i = 0; i < 100000; ++i) {
+    MemSoaHandle handle = mem_soa_pool_alloc(pool);
+    if (handle == MEM_SOA_INVALID_HANDLE) {
+      capacity *= 2;
+      CHECK(mem_soa_pool_grow(pool, capacity));
+      handle = mem_soa_pool_alloc(pool);
+    }
+    CHECK(handle != MEM_SOA_INVALID_HANDLE);
+    *(uint64_t *)mem_soa_pool_get(pool, handle, 0) = i;
+    *(uint32_t *)mem_soa_pool_get(pool, handle, 1) = ~i;
+    handles[i] = handle;
+    if (i % 10 == 9) {
+      CHECK(mem_soa_pool_free(pool, handles[i - 5]));
+      handles[i - 5] = MEM_SOA_INVALID_HANDLE;
+    }
+  }
+  for (uint32_t i = 0; i < 100000; ++i) {
+    if (handles[i] != MEM_SOA_INVALID_HANDLE) {
+      CHECK(*(uint64_t *)mem_soa_pool_get(pool, handles[i], 0) == i);
+      CHECK(*(uint32_t *)mem_soa_pool_get(pool, handles[i], 1) == ~i);
+    }
+  }
+  CHECK(mem_soa_pool_size(pool) == 90000);
+  // Lower capacities are ignored, absurd ones refused
+  CHECK(mem_soa_pool_grow(pool, 10));
+  CHECK(!mem_soa_pool_grow(pool, UINT32_MAX));
+  CHECK(mem_soa_pool_get(pool, handles[0], 0) != NULL);
+  mem_soa_pool_deinit(pool);
+}
+
+int main(void) {
+  test_against_reference();
+  test_full();
+  test_grow();
+  return 0;
+}
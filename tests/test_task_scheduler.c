@@ -0,0 +1,147 @@
+#define POOL_IMPL
+#define MEM_STACK_IMPL
+#define TASK_SCHED_IMPL
+#include "task_scheduler.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "test.h"
+
+typedef struct {
+  uint64_t n;
+  uint64_t *out;
+} FibArgs;
+
+static void fib(MemScheduler *sched, void *arg) {
+  FibArgs *a = arg;
+  if (a->n < 2) {
+    *a->out = a->n;
+    return;
+  }
+  uint64_t x, y;
+  MemTaskGroup group = {0};
+  mem_sched_spawn(sched, &group, fib, &(FibArgs){a->n - 1, &x},
+                  sizeof(FibArgs));
+  fib(sched, &(FibArgs){a->n - 2, &y});
+  mem_sched_wait(sched, &group);
+  *a->out = x + y;
+}
+
+static void test_fork_join(size_t tasks_per_worker) {
+  MemScheduler *sched = mem_sched_init(4, tasks_per_worker, 4096);
+  CHECK(sched != NULL);
+  for (int i = 0; i < 5; ++i) {
+    uint64_t out = 0;
+    mem_sched_run(sched, fib, &(FibArgs){20, &out});
+    CHECK(out == 6765);
+  }
+  mem_sched_deinit(sched);
+}
+
+#define ITEMS 100000
+
+static atomic_int visits[ITEMS];
+
+static void visit(size_t begin, size_t end, void *ctx) {
+  CHECK(ctx == visits);
+  CHECK(end - begin <= 100);
+  for (size_t i = begin; i < end; ++i) {
+    atomic_fetch_add(&visits[i], 1);
+  }
+}
+
+static void test_parallel_for(MemScheduler *sched) {
+  mem_sched_parallel_for(sched, 0, ITEMS, 100, visit, visits);
+  for (size_t i = 0; i < ITEMS; ++i) {
+    CHECK(atomic_load(&visits[i]) == 1);
+  }
+  mem_sched_parallel_for(sched, 5, 5, 100, visit, visits); // Empty range
+}
+
+static void scratch_task(MemScheduler *sched, void *arg) {
+  (void)arg;
+  uint8_t *a = mem_sched_scratch(sched, 3);
+  uint8_t *b = mem_sched_scratch(sched, 100);
+  CHECK(a != NULL && b != NULL && b >= a + 16);
+  CHECK((uintptr_t)a % 16 == 0 && (uintptr_t)b % 16 == 0);
+  memset(b, 0xFF, 100);
+  CHECK(mem_sched_scratch(sched, 1 << 20) == NULL); // More than there is
+}
+
+static void scratch_root(MemScheduler *sched, void *arg) {
+  (void)arg;
+  MemTaskGroup group = {0};
+  for (int i = 0; i < 1000; ++i) {
+    mem_sched_spawn(sched, &group, scratch_task, NULL, 0);
+  }
+  mem_sched_wait(sched, &group);
+}
+
+static void test_scratch(MemScheduler *sched) {
+  CHECK(mem_sched_scratch(sched, 16) == NULL); // Not on a worker
+  // Scratch is released after every task, or 1000 tasks would exhaust it,
+  // including the ones run inline once the descriptors run out
+  mem_sched_run(sched, scratch_root, NULL);
+}
+
+static void count_inline(MemScheduler *sched, void *arg) {
+  (void)sched;
+  (*(int *)arg)++;
+}
+
+static void test_spawn_outside(MemScheduler *sched) {
+  int count = 0;
+  MemTaskGroup group = {0};
+  CHECK(mem_sched_spawn(sched, &group, count_inline, &count, 0) == 0);
+  CHECK(count == 1);
+  CHECK(mem_sched_spawn(sched, NULL, count_inline, &count, 0) == -1);
+  CHECK(mem_sched_spawn(sched, &group, NULL, &count, 0) == -1);
+  CHECK(mem_sched_spawn(NULL, &group, count_inline, &count, 0) == -1);
+  CHECK(count == 1); // Rejected, not run
+  mem_sched_wait(sched, &group);
+}
+
+// An argument too big for a descriptor runs inline, on a worker too
+static void spawn_big(MemScheduler *sched, void *arg) {
+  (void)arg;
+  int big[MEM_TASK_ARG_BYTES / sizeof(int) + 1] = {0};
+  MemTaskGroup group = {0};
+  CHECK(mem_sched_spawn(sched, &group, count_inline, big, sizeof(big)) == 0);
+  CHECK(big[0] == 1);
+  mem_sched_wait(sched, &group);
+}
+
+static void *run_from_thread(void *sched) {
+  for (int i = 0; i < 20; ++i) {
+    uint64_t out = 0;
+    mem_sched_run(sched, fib, &(FibArgs){15, &out});
+    CHECK(out == 610);
+  }
+  return NULL;
+}
+
+static void test_concurrent_roots(MemScheduler *sched) {
+  pthread_t threads[4];
+  for (int i = 0; i < 4; ++i) {
+    pthread_create(&threads[i], NULL, run_from_thread, sched);
+  }
+  for (int i = 0; i < 4; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+int main(void) {
+  test_fork_join(1024);
+  test_fork_join(2); // Descriptors run out all the time, tasks go inline
+  MemScheduler *sched = mem_sched_init(3, 256, 4096);
+  CHECK(sched != NULL);
+  test_parallel_for(sched);
+  test_scratch(sched);
+  test_spawn_outside(sched);
+  mem_sched_run(sched, spawn_big, NULL);
+  test_concurrent_roots(sched);
+  mem_sched_deinit(sched);
+  CHECK(mem_sched_init(0, 16, 0) == NULL);
+  return 0;
+}
@@ -0,0 +1,138 @@
+// A small wheel, 3 levels of 16 slots span 4096 ticks, so timers further
+// away than the whole wheel can be driven tick by tick
+#define MEM_WHEEL_BITS 4
+#define MEM_WHEEL_LEVELS 3
+#define POOL_IMPL
+#define TIMER_WHEEL_IMPL
+#include "timer_wheel.h"
+
+#include <stdint.h>
+
+#include "test.h"
+
+#define TIMERS 20000
+
+enum { PENDING = 1, FIRED, CANCELLED };
+
+static uint64_t expires[TIMERS];
+static MemTimer *handles[TIMERS];
+static int states[TIMERS];
+static uint64_t current;
+static uint64_t seed = 88172645463325252ull;
+
+static uint64_t next_rand(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+// Timers fire at their tick exactly, or on the first tick processed after
+// scheduling when it was already past
+static void on_expiry(MemTimerWheel *wheel, void *arg) {
+  (void)wheel;
+  size_t i = (size_t)arg;
+  CHECK(states[i] == PENDING);
+  CHECK(expires[i] == current || (expires[i] < current && i % 13 == 0));
+  states[i] = FIRED;
+}
+
+static void test_exact_ticks(void) {
+  current = 5;
+  MemTimerWheel *wheel = mem_wheel_init(current, 1024);
+  CHECK(wheel != NULL);
+  size_t pending = 0;
+  for (size_t i = 0; i < TIMERS; ++i) {
+    uint64_t r = next_rand();
+    // Mostly short timeouts, some past the whole wheel, some already due
+    uint64_t delay = r % 4 == 0 ? r % 100000 : r % 300;
+    expires[i] = i % 13 == 0 ? current - (r % 5) : current + delay;
+    states[i] = PENDING;
+    handles[i] = mem_wheel_schedule(wheel, expires[i], on_expiry, (void *)i);
+    CHECK(handles[i] != NULL);
+    pending++;
+    if (i % 7 == 3) {
+      size_t j = next_rand() % (i + 1);
+      if (states[j] == PENDING) {
+        mem_wheel_cancel(wheel, handles[j]);
+        states[j] = CANCELLED;
+        pending--;
+      }
+    }
+    if (i % 11 == 5) {
+      size_t j = next_rand() % (i + 1);
+      if (states[j] == PENDING && j % 13 != 0) {
+        expires[j] = current + next_rand() % 70000;
+        mem_wheel_reschedule(wheel, handles[j], expires[j]);
+      }
+    }
+    if (i % 3 == 0) {
+      for (uint64_t step = next_rand() % 50; step > 0; --step) {
+        current++;
+        pending -= mem_wheel_advance(wheel, current);
+      }
+    }
+    CHECK(mem_wheel_count(wheel) == pending);
+  }
+  while (mem_wheel_count(wheel) > 0) {
+    current++;
+    pending -= mem_wheel_advance(wheel, current);
+  }
+  CHECK(pending == 0);
+  for (size_t i = 0; i < TIMERS; ++i) {
+    CHECK(states[i] == FIRED || states[i] == CANCELLED);
+  }
+  // The nodes are recycled, without it the timers would need 20 pools
+  CHECK(wheel->n_pools < 20);
+  mem_wheel_deinit(wheel);
+}
+
+static MemTimer *victim;
+static int victim_fired;
+static uint64_t scheduled_at;
+
+static void on_victim(MemTimerWheel *wheel, void *arg) {
+  (void)wheel;
+  (void)arg;
+  victim_fired = 1;
+}
+
+static void on_rescheduled(MemTimerWheel *wheel, void *arg) {
+  (void)wheel;
+  (void)arg;
+  CHECK(current > scheduled_at);
+}
+
+// Cancels the other timer of its slot, and schedules one for the same tick
+static void on_killer(MemTimerWheel *wheel, void *arg) {
+  (void)arg;
+  mem_wheel_cancel(wheel, victim);
+  scheduled_at = current;
+  CHECK(mem_wheel_schedule(wheel, current, on_rescheduled, NULL) != NULL);
+}
+
+static void test_callbacks(void) {
+  current = 0;
+  MemTimerWheel *wheel = mem_wheel_init(0, 4);
+  // The slot is fired last scheduled first, the victim comes second
+  victim = mem_wheel_schedule(wheel, 10, on_victim, NULL);
+  mem_wheel_schedule(wheel, 10, on_killer, NULL);
+  for (current = 1; current <= 10; ++current) {
+    CHECK(mem_wheel_advance(wheel, current) == (current == 10));
+  }
+  CHECK(!victim_fired && mem_wheel_count(wheel) == 1);
+  CHECK(mem_wheel_advance(wheel, current) == 1);
+  CHECK(mem_wheel_count(wheel) == 0);
+  // An empty wheel skips ahead
+  CHECK(mem_wheel_advance(wheel, 1000000) == 0);
+  mem_wheel_deinit(wheel);
+
+  CHECK(mem_wheel_init(0, 0) == NULL);
+  CHECK(mem_wheel_schedule(NULL, 1, on_victim, NULL) == NULL);
+}
+
+int main(void) {
+  test_exact_ticks();
+  test_callbacks();
+  return 0;
+}
@@ -0,0 +1,364 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+/**
+ * STB-style implementation of a hashed hierarchical timer wheel. Time is
+ * counted in ticks (whatever unit the user picks), the wheel has
+ * MEM_WHEEL_LEVELS levels of 2^MEM_WHEEL_BITS slots, level l slots are
+ * 2^(l * MEM_WHEEL_BITS) ticks wide. A timer is put in the lowest level whose
+ * span covers its delay and moves down (cascades) as its expiry gets close,
+ * timers further away than the whole wheel wait in the top level and are
+ * placed again every time it cascades.
+ *
+ * The timers are intrusive nodes of a doubly linked slot list, carved from
+ * MemPools (LIFO, a node freed by an expiry is the first one reused): neither
+ * scheduling nor expiring a timer goes through malloc once the pools are
+ * warm.
+ *
+ * 'mem_wheel_init' -> Creates a wheel whose current time is now, the timers
+ * are allocated timers_per_pool at a time.
+ *
+ * 'mem_wheel_schedule' -> Schedules a callback at an absolute tick, O(1).
+ * Returns a handle to cancel or move the timer.
+ *
+ * 'mem_wheel_cancel' / 'mem_wheel_reschedule' -> Cancels / moves a pending
+ * timer, O(1).
+ *
+ * 'mem_wheel_advance' -> Moves the time forward up to now (included), firing
+ * the due timers. Every slot is unlinked from the wheel as a whole and fired
+ * as a batch.
+ *
+ * 'mem_wheel_deinit' -> Frees the wheel, pending timers never fire.
+ *
+ * @note A handle is valid until its timer fires or is cancelled: the node is
+ * recycled right before the callback runs, so a callback can't cancel its own
+ * timer (it can schedule new ones, or cancel other ones). Not thread safe.
+ * The nodes live in MemPools, so POOL_IMPL has to be defined once as well.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool_allocator.h"
+
+#ifndef MEM_WHEEL_BITS
+#define MEM_WHEEL_BITS 8
+#endif
+
+#ifndef MEM_WHEEL_LEVELS
+#define MEM_WHEEL_LEVELS 4
+#endif
+
+#define MEM_WHEEL_SLOTS ((size_t)1 << MEM_WHEEL_BITS)
+
+typedef struct MemTimerWheel MemTimerWheel;
+
+typedef void (*MemTimerFn)(MemTimerWheel *wheel, void *arg);
+
+/**
+ * @param next next timer of the slot
+ * @param pprev link pointing to this timer, NULL when it isn't pending
+ * @param expires tick the timer fires at
+ * @param fn callback
+ * @param arg argument of the callback
+ * @param pool pool the node comes from
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+typedef struct MemTimer {
+  struct MemTimer *next;
+  struct MemTimer **pprev;
+  uint64_t expires;
+  MemTimerFn fn;
+  void *arg;
+  MemPool *pool;
+} MemTimer;
+
+/**
+ * @param slots timer lists, level by level
+ * @param now next tick to process
+ * @param count number of pending timers
+ * @param pools pools of the timer nodes
+ * @param n_pools number of pools
+ * @param hint pool that most likely has a free node
+ * @param timers_per_pool number of nodes of every new pool
+ * @note The user isn't supposed access any of the struct members manually,
+ * stick to using the provided functions.
+ */
+struct MemTimerWheel {
+  MemTimer *slots[MEM_WHEEL_LEVELS][MEM_WHEEL_SLOTS];
+  uint64_t now;
+  size_t count;
+  MemPool **pools;
+  size_t n_pools;
+  MemPool *hint;
+  size_t timers_per_pool;
+};
+
+/**
+ * Heap allocates a new timer wheel
+ * @param now current tick
+ * @param timers_per_pool timer nodes added when the wheel runs out of them
+ * @return pointer to the wheel, or NULL on failure
+ */
+MemTimerWheel *mem_wheel_init(uint64_t now, size_t timers_per_pool);
+
+/**
+ * Schedules a timer
+ * @param wheel wheel we are scheduling on
+ * @param expires tick the timer fires at, a tick already processed means the
+ * next one
+ * @param fn callback
+ * @param arg argument of the callback
+ * @return handle of the timer, or NULL on failure (out of memory)
+ */
+MemTimer *mem_wheel_schedule(MemTimerWheel *wheel, uint64_t expires,
+                             MemTimerFn fn, void *arg);
+
+/**
+ * Cancels a pending timer, the handle becomes invalid
+ * @param wheel wheel the timer was scheduled on
+ * @param timer handle from 'mem_wheel_schedule'
+ */
+void mem_wheel_cancel(MemTimerWheel *wheel, MemTimer *timer);
+
+/**
+ * Moves a pending timer to a new tick, the handle stays valid
+ * @param wheel wheel the timer was scheduled on
+ * @param timer handle from 'mem_wheel_schedule'
+ * @param expires new tick the timer fires at
+ */
+void mem_wheel_reschedule(MemTimerWheel *wheel, MemTimer *timer,
+                          uint64_t expires);
+
+/**
+ * Processes every tick up to now (included), firing the due timers
+ * @param wheel wheel we are advancing
+ * @param now current tick
+ * @return number of timers fired
+ */
+size_t mem_wheel_advance(MemTimerWheel *wheel, uint64_t now);
+
+/**
+ * Gives the number of pending timers
+ * @param wheel wheel we are interested in
+ * @return number of pending timers
+ */
+size_t mem_wheel_count(const MemTimerWheel *wheel);
+
+/**
+ * Frees the memory related to the wheel passed as parameter
+ * @param wheel wheel we are freeing
+ */
+void mem_wheel_deinit(MemTimerWheel *wheel);
+
+#endif // TIMER_WHEEL_H
+
+#ifdef TIMER_WHEEL_IMPL
+
+#define MEM_WHEEL_MASK (MEM_WHEEL_SLOTS - 1)
+
+static void mem_wheel_link(MemTimer **head, MemTimer *timer) {
+  timer->next = *head;
+  if (timer->next != NULL) {
+    timer->next->pprev = &timer->next;
+  }
+  timer->pprev = head;
+  *head = timer;
+}
+
+static void mem_wheel_unlink(MemTimer *timer) {
+  *timer->pprev = timer->next;
+  if (timer->next != NULL) {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->pprev = NULL;
+}
+
+// Puts the timer in the lowest level whose span covers its delay
+static void mem_wheel_place(MemTimerWheel *wheel, MemTimer *timer) {
+  uint64_t expires = timer->expires;
+  if (expires < wheel->now) {
+    expires = wheel->now;
+  }
+  uint64_t delta = expires - wheel->now;
+  size_t level = 0;
+  while (level < MEM_WHEEL_LEVELS - 1 &&
+         delta >= (uint64_t)1 << ((level + 1) * MEM_WHEEL_BITS)) {
+    level++;
+  }
+  if (MEM_WHEEL_LEVELS * MEM_WHEEL_BITS < 64 &&
+      delta >> (MEM_WHEEL_LEVELS * MEM_WHEEL_BITS) != 0) {
+    // Too far away, park it in the last slot reached in time and place it
+    // again when it cascades from there
+    expires = wheel->now +
+              ((uint64_t)1 << (MEM_WHEEL_LEVELS * MEM_WHEEL_BITS)) - 1;
+  }
+  size_t slot = (size_t)(expires >> (level * MEM_WHEEL_BITS)) & MEM_WHEEL_MASK;
+  mem_wheel_link(&wheel->slots[level][slot], timer);
+}
+
+MemTimerWheel *mem_wheel_init(uint64_t now, size_t timers_per_pool) {
+  if (timers_per_pool == 0) {
+    return NULL;
+  }
+  MemTimerWheel *wheel = calloc(1, sizeof(MemTimerWheel));
+  if (wheel == NULL) {
+    return NULL;
+  }
+  wheel->now = now;
+  wheel->timers_per_pool = timers_per_pool;
+  return wheel;
+}
+
+// Takes a node from the pools, adding a new pool if they are full
+static MemTimer *mem_wheel_node_alloc(MemTimerWheel *wheel) {
+  MemTimer *timer = wheel->hint != NULL ? mem_pool_alloc(wheel->hint) : NULL;
+  if (timer != NULL) {
+    timer->pool = wheel->hint;
+    return timer;
+  }
+  for (size_t i = wheel->n_pools; i > 0; --i) {
+    timer = mem_pool_alloc(wheel->pools[i - 1]);
+    if (timer != NULL) {
+      wheel->hint = wheel->pools[i - 1];
+      timer->pool = wheel->hint;
+      return timer;
+    }
+  }
+  MemPool **pools =
+      realloc(wheel->pools, (wheel->n_pools + 1) * sizeof(MemPool *));
+  if (pools == NULL) {
+    return NULL;
+  }
+  wheel->pools = pools;
+  MemPool *pool = mem_pool_init_ex(sizeof(MemTimer), wheel->timers_per_pool,
+                                   MEM_POOL_REUSE_LIFO);
+  if (pool == NULL) {
+    return NULL;
+  }
+  wheel->pools[wheel->n_pools++] = pool;
+  wheel->hint = pool;
+  timer = mem_pool_alloc(pool);
+  timer->pool = pool;
+  return timer;
+}
+
+static void mem_wheel_node_free(MemTimerWheel *wheel, MemTimer *timer) {
+  wheel->hint = timer->pool;
+  mem_pool_free(timer->pool, timer);
+}
+
+MemTimer *mem_wheel_schedule(MemTimerWheel *wheel, uint64_t expires,
+                             MemTimerFn fn, void *arg) {
+  if (wheel == NULL || fn == NULL) {
+    return NULL;
+  }
+  MemTimer *timer = mem_wheel_node_alloc(wheel);
+  if (timer == NULL) {
+    return NULL;
+  }
+  timer->expires = expires;
+  timer->fn = fn;
+  timer->arg = arg;
+  mem_wheel_place(wheel, timer);
+  wheel->count++;
+  return timer;
+}
+
+void mem_wheel_cancel(MemTimerWheel *wheel, MemTimer *timer) {
+  if (wheel == NULL || timer == NULL || timer->pprev == NULL) {
+    return;
+  }
+  mem_wheel_unlink(timer);
+  wheel->count--;
+  mem_wheel_node_free(wheel, timer);
+}
+
+void mem_wheel_reschedule(MemTimerWheel *wheel, MemTimer *timer,
+                          uint64_t expires) {
+  if (wheel == NULL || timer == NULL || timer->pprev == NULL) {
+    return;
+  }
+  mem_wheel_unlink(timer);
+  timer->expires = expires;
+  mem_wheel_place(wheel, timer);
+}
+
+// Places again every timer of a slot, they all land in lower levels (or in
+// the same slot for the ones further away than the whole wheel)
+static void mem_wheel_cascade(MemTimerWheel *wheel, size_t level,
+                              size_t slot) {
+  MemTimer *batch = wheel->slots[level][slot];
+  wheel->slots[level][slot] = NULL;
+  while (batch != NULL) {
+    MemTimer *timer = batch;
+    batch = timer->next;
+    mem_wheel_place(wheel, timer);
+  }
+}
+
+size_t mem_wheel_advance(MemTimerWheel *wheel, uint64_t now) {
+  if (wheel == NULL) {
+    return 0;
+  }
+  size_t fired = 0;
+  while (wheel->now <= now) {
+    if (wheel->count == 0) {
+      wheel->now = now + 1; // Nothing can fire, skip the empty ticks
+      break;
+    }
+    uint64_t tick = wheel->now;
+    size_t slot = (size_t)tick & MEM_WHEEL_MASK;
+    if (slot == 0) {
+      // A lap of level l - 1 is over, bring the next slot of level l down
+      for (size_t level = 1; level < MEM_WHEEL_LEVELS; ++level) {
+        size_t upper =
+            (size_t)(tick >> (level * MEM_WHEEL_BITS)) & MEM_WHEEL_MASK;
+        mem_wheel_cascade(wheel, level, upper);
+        if (upper != 0) {
+          break;
+        }
+      }
+    }
+    // The slot leaves the wheel as a whole, timers scheduled by the callbacks
+    // go after this tick
+    MemTimer *batch = wheel->slots[0][slot];
+    wheel->slots[0][slot] = NULL;
+    if (batch != NULL) {
+      batch->pprev = &batch;
+    }
+    wheel->now = tick + 1;
+    while (batch != NULL) {
+      // Unlinked one at a time, a callback can cancel the rest of the batch
+      MemTimer *timer = batch;
+      mem_wheel_unlink(timer);
+      MemTimerFn fn = timer->fn;
+      void *arg = timer->arg;
+      wheel->count--;
+      mem_wheel_node_free(wheel, timer);
+      fn(wheel, arg);
+      fired++;
+    }
+  }
+  return fired;
+}
+
+size_t mem_wheel_count(const MemTimerWheel *wheel) {
+  return wheel != NULL ? wheel->count : 0;
+}
+
+void mem_wheel_deinit(MemTimerWheel *wheel) {
+  if (wheel != NULL) {
+    for (size_t i = 0; i < wheel->n_pools; ++i) {
+      mem_pool_deinit(wheel->pools[i]);
+    }
+    free(wheel->pools);
+    free(wheel);
+  }
+}
+
+#undef MEM_WHEEL_MASK
+
+#endif // TIMER_WHEEL_IMPL